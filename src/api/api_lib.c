@@ -639,6 +639,41 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
   return err;
 }
 
+/**
+ * Send multiple netbufs over a UDP or RAW netconn with one call into
+ * tcpip_thread. Sending stops at the first netbuf that fails.
+ *
+ * @param conn the UDP or RAW netconn over which to send data
+ * @param bufs array of netbufs containing the data to send
+ * @param count number of netbufs in the array
+ * @param sent pointer to a location that receives the number of netbufs sent
+ * @return ERR_OK if all netbufs were sent, else the error of the first
+ *         netbuf that could not be sent
+ */
+err_t
+netconn_send_batch(struct netconn *conn, struct netbuf *bufs, u16_t count, u16_t *sent)
+{
+  API_MSG_VAR_DECLARE(msg);
+  err_t err;
+
+  LWIP_ERROR("netconn_send_batch: invalid conn",  (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_send_batch: invalid bufs",  (bufs != NULL) || (count == 0), return ERR_ARG;);
+
+  LWIP_DEBUGF(API_LIB_DEBUG, ("netconn_send_batch: sending %"U16_F" netbufs\n", count));
+  API_MSG_VAR_ALLOC(msg);
+  API_MSG_VAR_REF(msg).msg.conn = conn;
+  API_MSG_VAR_REF(msg).msg.msg.bb.bufs = bufs;
+  API_MSG_VAR_REF(msg).msg.msg.bb.count = count;
+  API_MSG_VAR_REF(msg).msg.msg.bb.sent = 0;
+  TCPIP_APIMSG(&API_MSG_VAR_REF(msg), lwip_netconn_do_send_batch, err);
+  if (sent != NULL) {
+    *sent = API_MSG_VAR_REF(msg).msg.msg.bb.sent;
+  }
+  API_MSG_VAR_FREE(msg);
+
+  return err;
+}
+
 /**
  * Send data over a TCP netconn.
  *
@@ -655,13 +690,48 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
 err_t
 netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
                      u8_t apiflags, size_t *bytes_written)
+{
+  struct netvector vector;
+  vector.ptr = dataptr;
+  vector.len = size;
+  return netconn_write_vectors_partly(conn, &vector, 1, apiflags, bytes_written);
+}
+
+/**
+ * Send data from multiple buffers over a TCP netconn in one operation:
+ * one tcp_write per buffer, one tcp_output at the end.
+ *
+ * @param conn the TCP netconn over which to send data
+ * @param vectors array of vectors containing data to send
+ * @param vectorcnt number of vectors in the array
+ * @param apiflags combination of following flags :
+ * - NETCONN_COPY: data will be copied into memory belonging to the stack
+ * - NETCONN_MORE: for TCP connection, PSH flag will be set on last segment sent
+ * - NETCONN_DONTBLOCK: only write the data if all data can be written at once
+ * @param bytes_written pointer to a location that receives the number of written bytes
+ * @return ERR_OK if data was sent, any other err_t on error
+ */
+err_t
+netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                             u8_t apiflags, size_t *bytes_written)
 {
   API_MSG_VAR_DECLARE(msg);
   err_t err;
   u8_t dontblock;
+  size_t size;
+  u16_t i;
 
   LWIP_ERROR("netconn_write: invalid conn",  (conn != NULL), return ERR_ARG;);
   LWIP_ERROR("netconn_write: invalid conn->type",  (NETCONNTYPE_GROUP(conn->type)== NETCONN_TCP), return ERR_VAL;);
+  LWIP_ERROR("netconn_write: invalid vectors",  (vectors != NULL) || (vectorcnt == 0), return ERR_ARG;);
+  size = 0;
+  for (i = 0; i < vectorcnt; i++) {
+    if (size + vectors[i].len < size) {
+      /* overflow */
+      return ERR_VAL;
+    }
+    size += vectors[i].len;
+  }
   if (size == 0) {
     return ERR_OK;
   }
@@ -675,7 +745,9 @@ netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
   API_MSG_VAR_ALLOC(msg);
   /* non-blocking write sends as much  */
   API_MSG_VAR_REF(msg).msg.conn = conn;
-  API_MSG_VAR_REF(msg).msg.msg.w.dataptr = dataptr;
+  API_MSG_VAR_REF(msg).msg.msg.w.vector = vectors;
+  API_MSG_VAR_REF(msg).msg.msg.w.vector_cnt = vectorcnt;
+  API_MSG_VAR_REF(msg).msg.msg.w.vector_off = 0;
   API_MSG_VAR_REF(msg).msg.msg.w.apiflags = apiflags;
   API_MSG_VAR_REF(msg).msg.msg.w.len = size;
 #if LWIP_SO_SNDTIMEO
@@ -866,7 +938,14 @@ netconn_gethostbyname(const char *name, ip_addr_t *addr)
   }
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
 
+#if LWIP_TCPIP_CORE_LOCKING
+  /* the semaphore is signalled from the DNS callback if the name is not cached */
+  LOCK_TCPIP_CORE();
+  lwip_netconn_do_gethostbyname(&API_VAR_REF(msg));
+  UNLOCK_TCPIP_CORE();
+#else /* LWIP_TCPIP_CORE_LOCKING */
   tcpip_callback(lwip_netconn_do_gethostbyname, &API_VAR_REF(msg));
+#endif /* LWIP_TCPIP_CORE_LOCKING */
   sys_sem_wait(API_EXPR_REF(API_VAR_REF(msg).sem));
 #if !LWIP_NETCONN_SEM_PER_THREAD
   sys_sem_free(API_EXPR_REF(API_VAR_REF(msg).sem));
@@ -55,7 +55,8 @@
 
 #include <string.h>
 
-/* netconns are polled once per second (e.g. continue write on memory error) */
+/* netconns with a pending write are polled once per second (e.g. continue
+   write on memory error), idle ones are not polled at all */
 #define NETCONN_TCP_POLL_INTERVAL 2
 
 #define SET_NONBLOCKING_CONNECT(conn, val)  do { if(val) { \
@@ -188,6 +189,9 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
     buf->ptr = p;
     ip_addr_set(&buf->addr, addr);
     buf->port = port;
+#if LWIP_CHECKSUM_ON_COPY_RX && !LWIP_NETBUF_RECVINFO
+    buf->flags = 0;
+#endif /* LWIP_CHECKSUM_ON_COPY_RX && !LWIP_NETBUF_RECVINFO */
 #if LWIP_NETBUF_RECVINFO
     {
       /* get the UDP header - always in the first pbuf, ensured by udp_input */
@@ -199,6 +203,20 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
       buf->toport_chksum = udphdr->dest;
     }
 #endif /* LWIP_NETBUF_RECVINFO */
+#if LWIP_CHECKSUM_ON_COPY_RX && LWIP_SOCKET
+    if (p->flags & PBUF_FLAG_CHKSUM_RX) {
+      /* udp_input left the partial checksum in the UDP header */
+      const struct udp_hdr* udphdr = (const struct udp_hdr*)ip_next_header_ptr();
+      p->flags = (u8_t)(p->flags & ~PBUF_FLAG_CHKSUM_RX);
+      buf->flags |= NETBUF_FLAG_CHKSUM_RX;
+      buf->rx_chksum = udphdr->chksum;
+      /* netconns not used by a socket get checked datagrams */
+      if ((conn->socket < 0) && (netbuf_copy_chksum(buf, NULL, 0) != ERR_OK)) {
+        netbuf_delete(buf);
+        return;
+      }
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY_RX && LWIP_SOCKET */
   }
 
   len = p->tot_len;
@@ -317,9 +335,87 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
     }
   }
 
+  if ((conn->pcb.tcp != NULL) && (conn->state != NETCONN_WRITE) &&
+      (conn->state != NETCONN_CLOSE) && !(conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    /* nothing left to wait for: an idle connection needs no poll timer */
+    tcp_poll(conn->pcb.tcp, NULL, 0);
+  }
+
   return ERR_OK;
 }
 
+#if LWIP_SO_ZEROCOPY
+/**
+ * Remember that the data just passed to tcp_write() for the current
+ * NETCONN_ZEROCOPY write (number conn->zc_next) is referenced until
+ * everything up to pcb->snd_lbb is ACKed.
+ *
+ * @param conn the TCP netconn that is writing
+ */
+static void
+zerocopy_queue(struct netconn *conn)
+{
+  u8_t idx;
+
+  if (conn->zc_count > 0) {
+    idx = (u8_t)((conn->zc_first + conn->zc_count - 1) % LWIP_SO_ZEROCOPY_PENDING);
+    if ((conn->zc_pending[idx].id == conn->zc_next) ||
+        (conn->zc_count == LWIP_SO_ZEROCOPY_PENDING)) {
+      /* extend the newest entry (if the ring is full, this merges the write
+         into the previous one, which then completes together with it) */
+      conn->zc_pending[idx].id = conn->zc_next;
+      conn->zc_pending[idx].seqno = conn->pcb.tcp->snd_lbb;
+      return;
+    }
+  }
+  idx = (u8_t)((conn->zc_first + conn->zc_count) % LWIP_SO_ZEROCOPY_PENDING);
+  conn->zc_pending[idx].id = conn->zc_next;
+  conn->zc_pending[idx].seqno = conn->pcb.tcp->snd_lbb;
+  conn->zc_count++;
+}
+
+/**
+ * Report completed zero-copy writes to the netconn's zc_callback.
+ *
+ * @param conn the TCP netconn
+ * @param lastack the highest sequence number ACKed by the remote host
+ * @param all 1 if the pcb is gone and every pending write has completed
+ * @param err passed to zc_callback
+ */
+static void
+zerocopy_complete(struct netconn *conn, u32_t lastack, u8_t all, err_t err)
+{
+  u32_t hi = conn->zc_done;
+  u8_t completed = 0;
+
+  while (conn->zc_count > 0) {
+    u8_t idx = conn->zc_first;
+    if (!all) {
+      /* don't complete a write that is still being enqueued or unACKed data */
+      if ((conn->zc_pending[idx].id == conn->zc_next) ||
+          ((s32_t)(lastack - conn->zc_pending[idx].seqno) < 0)) {
+        break;
+      }
+    }
+    hi = conn->zc_pending[idx].id;
+    completed = 1;
+    conn->zc_first = (u8_t)((idx + 1) % LWIP_SO_ZEROCOPY_PENDING);
+    conn->zc_count--;
+  }
+  if (completed) {
+    u32_t lo = conn->zc_done;
+    conn->zc_done = hi + 1;
+    if (conn->zc_next == hi) {
+      /* the write in progress has been aborted */
+      conn->zc_next++;
+    }
+    if (conn->zc_callback != NULL) {
+      conn->zc_callback(conn, lo, hi, err, conn->zc_arg);
+    }
+  }
+}
+#endif /* LWIP_SO_ZEROCOPY */
+
 /**
  * Sent callback function for TCP netconns.
  * Signals the conn->sem and calls API_EVENT.
@@ -335,6 +431,13 @@ sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
   LWIP_UNUSED_ARG(pcb);
   LWIP_ASSERT("conn != NULL", (conn != NULL));
 
+#if LWIP_SO_ZEROCOPY
+  if (conn->zc_count > 0) {
+    /* report before closing might unregister this netconn from the pcb */
+    zerocopy_complete(conn, pcb->lastack, 0, ERR_OK);
+  }
+#endif /* LWIP_SO_ZEROCOPY */
+
   if (conn->state == NETCONN_WRITE) {
     lwip_netconn_do_writemore(conn  WRITE_DELAYED);
   } else if (conn->state == NETCONN_CLOSE) {
@@ -382,6 +485,11 @@ err_tcp(void *arg, err_t err)
   old_state = conn->state;
   conn->state = NETCONN_NONE;
 
+#if LWIP_SO_ZEROCOPY
+  /* the pcb has freed its segments: no zero-copy data is referenced any more */
+  zerocopy_complete(conn, 0, 1, err);
+#endif /* LWIP_SO_ZEROCOPY */
+
   /* @todo: the type of NETCONN_EVT created should depend on 'old_state' */
 
   /* Notify the user layer about a connection error. Used to signal select. */
@@ -428,7 +536,8 @@ err_tcp(void *arg, err_t err)
 
 /**
  * Setup a tcp_pcb with the correct callback function pointers
- * and their arguments.
+ * and their arguments. poll_tcp is only registered while a write or close
+ * is pending (see lwip_netconn_do_writemore, lwip_netconn_do_close_internal).
  *
  * @param conn the TCP netconn to setup
  */
@@ -441,7 +550,6 @@ setup_tcp(struct netconn *conn)
   tcp_arg(pcb, conn);
   tcp_recv(pcb, recv_tcp);
   tcp_sent(pcb, sent_tcp);
-  tcp_poll(pcb, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
   tcp_err(pcb, err_tcp);
 }
 
@@ -536,6 +644,11 @@ pcb_new(struct api_msg_msg *msg)
       if (NETCONNTYPE_ISUDPNOCHKSUM(msg->conn->type)) {
         udp_setflags(msg->conn->pcb.udp, UDP_FLAGS_NOCHKSUM);
       }
+#if LWIP_CHECKSUM_ON_COPY_RX && LWIP_SOCKET
+      /* sockets check the checksum while copying (recv_udp checks it
+         right away for netconns that are not used by a socket) */
+      udp_setflags(msg->conn->pcb.udp, udp_flags(msg->conn->pcb.udp) | UDP_FLAGS_CHKSUM_RX);
+#endif /* LWIP_CHECKSUM_ON_COPY_RX && LWIP_SOCKET */
       udp_recv(msg->conn->pcb.udp, recv_udp, msg->conn);
     }
     break;
@@ -654,6 +767,14 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
 #if LWIP_TCP
   conn->current_msg  = NULL;
   conn->write_offset = 0;
+#if LWIP_SO_ZEROCOPY
+  conn->zc_next      = 0;
+  conn->zc_done      = 0;
+  conn->zc_first     = 0;
+  conn->zc_count     = 0;
+  conn->zc_callback  = NULL;
+  conn->zc_arg       = NULL;
+#endif /* LWIP_SO_ZEROCOPY */
 #endif /* LWIP_TCP */
 #if LWIP_SO_SNDTIMEO
   conn->send_timeout = 0;
@@ -1321,54 +1442,92 @@ lwip_netconn_do_listen(struct api_msg_msg *msg)
 #endif /* LWIP_TCP */
 
 /**
- * Send some data on a RAW or UDP pcb contained in a netconn
- * Called from netconn_send
+ * Send a netbuf on a RAW or UDP pcb contained in a netconn
  *
- * @param msg the api_msg_msg pointing to the connection
+ * @param conn the RAW or UDP netconn
+ * @param buf the netbuf to send
+ * @return the result of raw_send/udp_send, ERR_CONN if there is no pcb
  */
-void
-lwip_netconn_do_send(struct api_msg_msg *msg)
+static err_t
+lwip_netconn_send_netbuf(struct netconn *conn, struct netbuf *buf)
 {
-  if (ERR_IS_FATAL(msg->conn->last_err)) {
-    msg->err = msg->conn->last_err;
-  } else {
-    msg->err = ERR_CONN;
-    if (msg->conn->pcb.tcp != NULL) {
-      switch (NETCONNTYPE_GROUP(msg->conn->type)) {
+  err_t err;
+
+  if (ERR_IS_FATAL(conn->last_err)) {
+    return conn->last_err;
+  }
+  err = ERR_CONN;
+  if (conn->pcb.tcp != NULL) {
+    switch (NETCONNTYPE_GROUP(conn->type)) {
 #if LWIP_RAW
-      case NETCONN_RAW:
-        if (ip_addr_isany(&msg->msg.b->addr)) {
-          msg->err = raw_send(msg->conn->pcb.raw, msg->msg.b->p);
-        } else {
-          msg->err = raw_sendto(msg->conn->pcb.raw, msg->msg.b->p, &msg->msg.b->addr);
-        }
-        break;
+    case NETCONN_RAW:
+      if (ip_addr_isany(&buf->addr)) {
+        err = raw_send(conn->pcb.raw, buf->p);
+      } else {
+        err = raw_sendto(conn->pcb.raw, buf->p, &buf->addr);
+      }
+      break;
 #endif
 #if LWIP_UDP
-      case NETCONN_UDP:
+    case NETCONN_UDP:
 #if LWIP_CHECKSUM_ON_COPY
-        if (ip_addr_isany(&msg->msg.b->addr)) {
-          msg->err = udp_send_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        } else {
-          msg->err = udp_sendto_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-            &msg->msg.b->addr, msg->msg.b->port,
-            msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
-        }
+      if (ip_addr_isany(&buf->addr)) {
+        err = udp_send_chksum(conn->pcb.udp, buf->p,
+          buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
+      } else {
+        err = udp_sendto_chksum(conn->pcb.udp, buf->p,
+          &buf->addr, buf->port,
+          buf->flags & NETBUF_FLAG_CHKSUM, buf->toport_chksum);
+      }
 #else /* LWIP_CHECKSUM_ON_COPY */
-        if (ip_addr_isany_val(msg->msg.b->addr)) {
-          msg->err = udp_send(msg->conn->pcb.udp, msg->msg.b->p);
-        } else {
-          msg->err = udp_sendto(msg->conn->pcb.udp, msg->msg.b->p, &msg->msg.b->addr, msg->msg.b->port);
-        }
+      if (ip_addr_isany_val(buf->addr)) {
+        err = udp_send(conn->pcb.udp, buf->p);
+      } else {
+        err = udp_sendto(conn->pcb.udp, buf->p, &buf->addr, buf->port);
+      }
 #endif /* LWIP_CHECKSUM_ON_COPY */
-        break;
+      break;
 #endif /* LWIP_UDP */
-      default:
-        break;
-      }
+    default:
+      break;
+    }
+  }
+  return err;
+}
+
+/**
+ * Send some data on a RAW or UDP pcb contained in a netconn
+ * Called from netconn_send
+ *
+ * @param msg the api_msg_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send(struct api_msg_msg *msg)
+{
+  msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.b);
+  TCPIP_APIMSG_ACK(msg);
+}
+
+/**
+ * Send multiple netbufs on a RAW or UDP pcb contained in a netconn,
+ * stopping at the first one that cannot be sent.
+ * Called from netconn_send_batch
+ *
+ * @param msg the api_msg_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send_batch(struct api_msg_msg *msg)
+{
+  u16_t i;
+
+  msg->err = ERR_OK;
+  for (i = 0; i < msg->msg.bb.count; i++) {
+    msg->err = lwip_netconn_send_netbuf(msg->conn, &msg->msg.bb.bufs[i]);
+    if (msg->err != ERR_OK) {
+      break;
     }
   }
+  msg->msg.bb.sent = i;
   TCPIP_APIMSG_ACK(msg);
 }
 
@@ -1425,6 +1584,7 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
   size_t diff;
   u8_t dontblock;
   u8_t apiflags;
+  u8_t write_flags;
 
   LWIP_ASSERT("conn != NULL", conn != NULL);
   LWIP_ASSERT("conn->state == NETCONN_WRITE", (conn->state == NETCONN_WRITE));
@@ -1454,33 +1614,64 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
   } else
 #endif /* LWIP_SO_SNDTIMEO */
   {
-    dataptr = (const u8_t*)conn->current_msg->msg.w.dataptr + conn->write_offset;
-    diff = conn->current_msg->msg.w.len - conn->write_offset;
-    if (diff > 0xffffUL) { /* max_u16_t */
-      len = 0xffff;
-      apiflags |= TCP_WRITE_FLAG_MORE;
-    } else {
-      len = (u16_t)diff;
-    }
-    available = tcp_sndbuf(conn->pcb.tcp);
-    if (available < len) {
-      /* don't try to write more than sendbuf */
-      len = available;
-      if (dontblock) { 
-        if (!len) {
-          err = ERR_WOULDBLOCK;
-          goto err_mem;
-        }
+    struct api_msg_msg *msg = conn->current_msg;
+    u16_t want;
+    do {
+      /* skip vectors that have been written completely (or are empty) */
+      while (msg->msg.w.vector_off == msg->msg.w.vector->len) {
+        msg->msg.w.vector++;
+        msg->msg.w.vector_cnt--;
+        msg->msg.w.vector_off = 0;
+        LWIP_ASSERT("lwip_netconn_do_writemore: vectors exhausted", msg->msg.w.vector_cnt > 0);
+      }
+      dataptr = (const u8_t*)msg->msg.w.vector->ptr + msg->msg.w.vector_off;
+      diff = msg->msg.w.vector->len - msg->msg.w.vector_off;
+      write_flags = apiflags;
+      if (diff > 0xffffUL) { /* max_u16_t */
+        len = 0xffff;
+        write_flags |= TCP_WRITE_FLAG_MORE;
       } else {
-        apiflags |= TCP_WRITE_FLAG_MORE;
+        len = (u16_t)diff;
+        if (msg->msg.w.vector_cnt > 1) {
+          /* more vectors follow: only push after the last one */
+          write_flags |= TCP_WRITE_FLAG_MORE;
+        }
+      }
+      want = len;
+      available = tcp_sndbuf(conn->pcb.tcp);
+      if (available < len) {
+        /* don't try to write more than sendbuf */
+        len = available;
+        if (dontblock) {
+          if (!len) {
+            err = ERR_WOULDBLOCK;
+            break;
+          }
+        } else {
+          write_flags |= TCP_WRITE_FLAG_MORE;
+        }
       }
+      LWIP_ASSERT("lwip_netconn_do_writemore: invalid length!", ((conn->write_offset + len) <= msg->msg.w.len));
+      err = tcp_write(conn->pcb.tcp, dataptr, len, write_flags);
+      if (err == ERR_OK) {
+#if LWIP_SO_ZEROCOPY
+        if (apiflags & NETCONN_ZEROCOPY) {
+          zerocopy_queue(conn);
+        }
+#endif /* LWIP_SO_ZEROCOPY */
+        conn->write_offset += len;
+        msg->msg.w.vector_off += len;
+      }
+      /* continue with the next vector until the send buffer is full */
+    } while ((err == ERR_OK) && (len == want) && (conn->write_offset < msg->msg.w.len));
+
+    if (dontblock && (conn->write_offset > 0) && ((err == ERR_MEM) || (err == ERR_WOULDBLOCK))) {
+      /* non-blocking write: return the part that has been written */
+      err = ERR_OK;
     }
-    LWIP_ASSERT("lwip_netconn_do_writemore: invalid length!", ((conn->write_offset + len) <= conn->current_msg->msg.w.len));
-    err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
     /* if OK or memory error, check available space */
-    if ((err == ERR_OK) || (err == ERR_MEM)) {
-err_mem:
-      if (dontblock && (len < conn->current_msg->msg.w.len)) {
+    if ((err == ERR_OK) || (err == ERR_MEM) || (err == ERR_WOULDBLOCK)) {
+      if (dontblock && (conn->write_offset < msg->msg.w.len)) {
         /* non-blocking write did not write everything: mark the pcb non-writable
            and let poll_tcp check writable space to mark the pcb writable again */
         API_EVENT(conn, NETCONN_EVT_SENDMINUS, len);
@@ -1495,7 +1686,6 @@ err_mem:
 
     if (err == ERR_OK) {
       err_t out_err;
-      conn->write_offset += len;
       if ((conn->write_offset == conn->current_msg->msg.w.len) || dontblock) {
         /* return sent length */
         conn->current_msg->msg.w.len = conn->write_offset;
@@ -1535,10 +1725,22 @@ err_mem:
       conn->current_msg->msg.w.len = 0;
     }
   }
+  if ((conn->pcb.tcp != NULL) &&
+      (!write_finished || (conn->flags & NETCONN_FLAG_CHECK_WRITESPACE))) {
+    /* poll to retry the write or to check for send buffer space */
+    tcp_poll(conn->pcb.tcp, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+  }
   if (write_finished) {
     /* everything was written: set back connection state
        and back to application task */
     sys_sem_t* op_completed_sem = LWIP_API_MSG_SEM(conn->current_msg);
+#if LWIP_SO_ZEROCOPY
+    if ((conn->zc_count > 0) && (conn->zc_pending[(conn->zc_first + conn->zc_count - 1) %
+         LWIP_SO_ZEROCOPY_PENDING].id == conn->zc_next)) {
+      /* data of this write has been enqueued: the next write gets a new number */
+      conn->zc_next++;
+    }
+#endif /* LWIP_SO_ZEROCOPY */
     conn->current_msg->err = err;
     conn->current_msg = NULL;
     conn->state = NETCONN_NONE;
@@ -1584,6 +1786,12 @@ lwip_netconn_do_write(struct api_msg_msg *msg)
         LWIP_ASSERT("msg->msg.w.len != 0", msg->msg.w.len != 0);
         msg->conn->current_msg = msg;
         msg->conn->write_offset = 0;
+#if LWIP_SO_ZEROCOPY
+        if ((msg->msg.w.apiflags & NETCONN_ZEROCOPY) && (msg->conn->zc_callback == NULL)) {
+          /* nobody would be told when the data may be reused: copy it */
+          msg->msg.w.apiflags = (u8_t)((msg->msg.w.apiflags & ~NETCONN_ZEROCOPY) | NETCONN_COPY);
+        }
+#endif /* LWIP_SO_ZEROCOPY */
 #if LWIP_TCPIP_CORE_LOCKING
         if (lwip_netconn_do_writemore(msg->conn, 0) != ERR_OK) {
           LWIP_ASSERT("state!", msg->conn->state == NETCONN_WRITE);
@@ -42,6 +42,10 @@
 
 #include "lwip/netbuf.h"
 #include "lwip/memp.h"
+#if LWIP_CHECKSUM_ON_COPY_RX
+#include "lwip/inet_chksum.h"
+#include "lwip/stats.h"
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
 
 #include <string.h>
 
@@ -242,4 +246,70 @@ netbuf_first(struct netbuf *buf)
   buf->ptr = buf->p;
 }
 
+#if LWIP_CHECKSUM_ON_COPY_RX
+/** Add a (host order) lwip checksum of data starting at 'offset' to 'acc' */
+static u32_t
+netbuf_chksum_add(u32_t acc, u16_t chksum, u16_t offset)
+{
+  if (offset & 1) {
+    chksum = SWAP_BYTES_IN_WORD(chksum);
+  }
+  acc += chksum;
+  return FOLD_U32T(acc);
+}
+
+/**
+ * Copy the start of a received netbuf into a buffer (like netbuf_copy).
+ * If the checksum of the netbuf has not been checked yet (see
+ * LWIP_CHECKSUM_ON_COPY_RX), it is checked while copying: the copied data
+ * is summed by LWIP_CHKSUM_COPY, the rest of the data in place.
+ *
+ * @param buf the netbuf to copy from
+ * @param dataptr the application supplied buffer
+ * @param len number of bytes to copy (at most netbuf_len(buf)), 0 to only
+ *        check the checksum (see netbuf_check_chksum)
+ * @return ERR_OK if the data was copied,
+ *         ERR_VAL if the checksum is wrong (the netbuf should be dropped then)
+ */
+err_t
+netbuf_copy_chksum(struct netbuf *buf, void *dataptr, u16_t len)
+{
+  struct pbuf *q;
+  u32_t acc;
+  u16_t offset = 0, n;
+
+  LWIP_ERROR("netbuf_copy_chksum: invalid buf", (buf != NULL), return ERR_ARG;);
+  LWIP_ERROR("netbuf_copy_chksum: invalid len", (len <= buf->p->tot_len), return ERR_ARG;);
+  if ((buf->flags & NETBUF_FLAG_CHKSUM_RX) == 0) {
+    if (len > 0) {
+      pbuf_copy_partial(buf->p, dataptr, len, 0);
+    }
+    return ERR_OK;
+  }
+
+  acc = (u16_t)~buf->rx_chksum;
+  for (q = buf->p; q != NULL; q = q->next) {
+    n = 0;
+    if (offset < len) {
+      n = LWIP_MIN(q->len, (u16_t)(len - offset));
+      acc = netbuf_chksum_add(acc, LWIP_CHKSUM_COPY((u8_t*)dataptr + offset, q->payload, n), offset);
+    }
+    if (n < q->len) {
+      acc = netbuf_chksum_add(acc, (u16_t)~inet_chksum((u8_t*)q->payload + n, (u16_t)(q->len - n)),
+        (u16_t)(offset + n));
+    }
+    offset = (u16_t)(offset + q->len);
+  }
+  acc = FOLD_U32T(acc);
+  if (acc != 0xffff) {
+    LWIP_DEBUGF(API_LIB_DEBUG, ("netbuf_copy_chksum: bad checksum\n"));
+    UDP_STATS_INC(udp.chkerr);
+    UDP_STATS_INC(udp.drop);
+    return ERR_VAL;
+  }
+  buf->flags = (u8_t)(buf->flags & ~NETBUF_FLAG_CHKSUM_RX);
+  return ERR_OK;
+}
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
+
 #endif /* LWIP_NETCONN */
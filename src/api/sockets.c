@@ -210,6 +210,24 @@ struct lwip_sock {
   u8_t err;
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
+  /** if only one thread is waiting for this socket: its select_cb (NULL if
+      more than one thread is waiting or that one cannot be identified) */
+  struct lwip_select_cb *select_cb;
+#if LWIP_SOCKET_EPOLL
+  /** number of epoll instances this socket is registered with */
+  u8_t epoll_registered;
+#endif /* LWIP_SOCKET_EPOLL */
+#if LWIP_SO_ZEROCOPY
+  /** completion callback for MSG_ZEROCOPY sends, set by SO_ZEROCOPY */
+  lwip_zerocopy_fn zc_callback;
+  void *zc_arg;
+#endif /* LWIP_SO_ZEROCOPY */
+#if LWIP_SOCKET_RECV_ZEROCOPY
+  /** number of the next loan handed out by lwip_recv_lend() */
+  u32_t lend_next;
+  /** number of the next loan expected by lwip_recv_release() */
+  u32_t lend_release;
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
 };
 
 #if LWIP_NETCONN_SEM_PER_THREAD
@@ -232,12 +250,59 @@ struct lwip_select_cb {
   fd_set *writeset;
   /** unimplemented: exceptset passed to select */
   fd_set *exceptset;
+#if LWIP_SOCKET_POLL
+  /** fds passed to poll; NULL if the task is waiting in select */
+  struct pollfd *poll_fds;
+  /** nfds passed to poll */
+  nfds_t poll_nfds;
+#endif /* LWIP_SOCKET_POLL */
   /** don't signal the same semaphore twice: set to 1 when signalled */
   int sem_signalled;
   /** semaphore to wake up a task waiting for select */
   SELECT_SEM_T sem;
 };
 
+#if LWIP_SOCKET_EPOLL
+/** Registration of one socket with one epoll instance */
+struct lwip_epoll_item {
+  /** next item on the ready list of the epoll instance */
+  struct lwip_epoll_item *ready_next;
+  /** events passed to lwip_epoll_ctl() */
+  u32_t events;
+  /** data passed to lwip_epoll_ctl() */
+  lwip_epoll_data_t data;
+  /** LWIP_EPOLL_ITEM_* flags */
+  u8_t flags;
+};
+
+/** the socket is registered with the epoll instance */
+#define LWIP_EPOLL_ITEM_REGISTERED  0x01U
+/** the item is on the ready list */
+#define LWIP_EPOLL_ITEM_READY       0x02U
+/** EPOLLONESHOT: events have been reported, wait for EPOLL_CTL_MOD */
+#define LWIP_EPOLL_ITEM_DISABLED    0x04U
+
+/** Description of an epoll instance */
+struct lwip_epoll {
+  /** 1 if this instance is in use */
+  u8_t used;
+  /** number of tasks waiting in lwip_epoll_wait() */
+  SELWAIT_T waiting;
+  /** number of times the semaphore has been signalled and not yet taken:
+      each waiting task is woken once, not every task per event */
+  SELWAIT_T signalled;
+  /** Sockets that might be ready (FIFO). Items are added by event_callback()
+      and removed by lwip_epoll_wait() if they turn out not to be ready. */
+  struct lwip_epoll_item *ready_head;
+  struct lwip_epoll_item *ready_tail;
+  /** semaphore to wake up tasks waiting in lwip_epoll_wait() */
+  sys_sem_t sem;
+};
+
+/** epoll file descriptors follow the socket file descriptors */
+#define LWIP_EPOLL_OFFSET  (LWIP_SOCKET_OFFSET + NUM_SOCKETS)
+#endif /* LWIP_SOCKET_EPOLL */
+
 /** A struct sockaddr replacement that has the same alignment as sockaddr_in/
  *  sockaddr_in6 if instantiated.
  */
@@ -280,6 +345,12 @@ static struct lwip_select_cb *select_cb_list;
 /** This counter is increased from lwip_select when the list is changed
     and checked in event_callback to see if it has changed. */
 static volatile int select_cb_ctr;
+#if LWIP_SOCKET_EPOLL
+/** The global array of epoll instances */
+static struct lwip_epoll epolls[LWIP_SOCKET_EPOLL_INSTANCES];
+/** Registrations of every socket with every epoll instance */
+static struct lwip_epoll_item epoll_items[NUM_SOCKETS][LWIP_SOCKET_EPOLL_INSTANCES];
+#endif /* LWIP_SOCKET_EPOLL */
 
 /** Table to quickly map an lwIP error (err_t) to a socket error
   * by using -err as an index */
@@ -326,6 +397,10 @@ static const int err_to_errno_table[] = {
 
 /* Forward declaration of some functions */
 static void event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len);
+#if LWIP_SOCKET_EPOLL
+static int lwip_epoll_close(int epfd);
+static void lwip_epoll_sock_event(int s, struct lwip_sock *sock);
+#endif /* LWIP_SOCKET_EPOLL */
 #if !LWIP_TCPIP_CORE_LOCKING
 static void lwip_getsockopt_callback(void *arg);
 static void lwip_setsockopt_callback(void *arg);
@@ -442,6 +517,18 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].errevent   = 0;
       sockets[i].err        = 0;
       sockets[i].select_waiting = 0;
+      sockets[i].select_cb  = NULL;
+#if LWIP_SOCKET_EPOLL
+      sockets[i].epoll_registered = 0;
+#endif /* LWIP_SOCKET_EPOLL */
+#if LWIP_SO_ZEROCOPY
+      sockets[i].zc_callback = NULL;
+      sockets[i].zc_arg     = NULL;
+#endif /* LWIP_SO_ZEROCOPY */
+#if LWIP_SOCKET_RECV_ZEROCOPY
+      sockets[i].lend_next  = 0;
+      sockets[i].lend_release = 0;
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
       return i + LWIP_SOCKET_OFFSET;
     }
     SYS_ARCH_UNPROTECT(lev);
@@ -468,6 +555,17 @@ free_socket(struct lwip_sock *sock, int is_tcp)
 
   /* Protect socket array */
   SYS_ARCH_PROTECT(lev);
+#if LWIP_SOCKET_EPOLL
+  if (sock->epoll_registered) {
+    /* unregister from all epoll instances, ready list entries are
+       dropped by lwip_epoll_wait() */
+    int i;
+    for (i = 0; i < LWIP_SOCKET_EPOLL_INSTANCES; i++) {
+      epoll_items[sock - sockets][i].flags &= LWIP_EPOLL_ITEM_READY;
+    }
+    sock->epoll_registered = 0;
+  }
+#endif /* LWIP_SOCKET_EPOLL */
   sock->conn       = NULL;
   SYS_ARCH_UNPROTECT(lev);
   /* don't use 'sock' after this line, as another task might have allocated it */
@@ -629,6 +727,12 @@ lwip_close(int s)
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_close(%d)\n", s));
 
+#if LWIP_SOCKET_EPOLL
+  if ((s >= LWIP_EPOLL_OFFSET) && (s < LWIP_EPOLL_OFFSET + LWIP_SOCKET_EPOLL_INSTANCES)) {
+    return lwip_epoll_close(s);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   sock = get_socket(s);
   if (!sock) {
     return -1;
@@ -839,7 +943,22 @@ lwip_recvfrom(int s, void *mem, size_t len, int flags,
 
     /* copy the contents of the received buffer into
     the supplied memory pointer mem */
-    pbuf_copy_partial(p, (u8_t*)mem + off, copylen, sock->lastoffset);
+#if LWIP_CHECKSUM_ON_COPY_RX
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+      /* checks the checksum if udp_input deferred that */
+      if (netbuf_copy_chksum((struct netbuf *)buf, (u8_t*)mem + off, copylen) != ERR_OK) {
+        /* drop the datagram and wait for the next one */
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvfrom(%d): dropping netbuf=%p (checksum)\n", s, buf));
+        sock->lastdata = NULL;
+        netbuf_delete((struct netbuf *)buf);
+        buf = NULL;
+        continue;
+      }
+    } else
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
+    {
+      pbuf_copy_partial(p, (u8_t*)mem + off, copylen, sock->lastoffset);
+    }
 
     off += copylen;
 
@@ -927,12 +1046,416 @@ lwip_read(int s, void *mem, size_t len)
   return lwip_recvfrom(s, mem, len, 0, NULL, NULL);
 }
 
+int
+lwip_readv(int s, const struct iovec *iov, int iovcnt)
+{
+  struct msghdr msg;
+
+  msg.msg_name = NULL;
+  msg.msg_namelen = 0;
+  /* Hack: we have to cast via number to cast from 'const' pointer to non-const.
+     Blame the opengroup standard for this inconsistency. */
+  msg.msg_iov = (struct iovec *)(size_t)iov;
+  msg.msg_iovlen = iovcnt;
+  msg.msg_control = NULL;
+  msg.msg_controllen = 0;
+  msg.msg_flags = 0;
+  return lwip_recvmsg(s, &msg, 0);
+}
+
 int
 lwip_recv(int s, void *mem, size_t len, int flags)
 {
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+/** Common code for lwip_recvmsg() and lwip_recvmmsg() */
+static int
+lwip_recvmsg_sock(struct lwip_sock *sock, int s, struct msghdr *message, int flags)
+{
+  int i;
+
+  LWIP_ERROR("lwip_recvmsg: invalid message", (message != NULL) && (message->msg_iovlen >= 0) &&
+             ((message->msg_iov != NULL) || (message->msg_iovlen == 0)),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+  for (i = 0; i < message->msg_iovlen; i++) {
+    if ((message->msg_iov[i].iov_base == NULL) && (message->msg_iov[i].iov_len != 0)) {
+      sock_set_errno(sock, err_to_errno(ERR_VAL));
+      return -1;
+    }
+  }
+  message->msg_flags = 0;
+  message->msg_controllen = 0;
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+#if LWIP_TCP
+    int recv_flags = flags;
+    int buflen = 0;
+    for (i = 0; i < message->msg_iovlen; i++) {
+      int recvd;
+      if (message->msg_iov[i].iov_len == 0) {
+        continue;
+      }
+      recvd = lwip_recvfrom(s, message->msg_iov[i].iov_base, message->msg_iov[i].iov_len, recv_flags,
+        (buflen == 0) ? (struct sockaddr *)message->msg_name : NULL,
+        (buflen == 0) ? &message->msg_namelen : NULL);
+      if (recvd <= 0) {
+        if (buflen == 0) {
+          /* nothing received: return the result (error, EOF) of this call */
+          return recvd;
+        }
+        break;
+      }
+      buflen += recvd;
+      if (((size_t)recvd < message->msg_iov[i].iov_len) || (flags & MSG_PEEK)) {
+        break;
+      }
+      /* only the first buffer may wait for data */
+      recv_flags |= MSG_DONTWAIT;
+    }
+    sock_set_errno(sock, 0);
+    return buflen;
+#else /* LWIP_TCP */
+    sock_set_errno(sock, err_to_errno(ERR_ARG));
+    return -1;
+#endif /* LWIP_TCP */
+  }
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf *buf;
+    u16_t off, copylen, tot_len;
+    u8_t bad;
+    err_t err;
+
+    do {
+      if (sock->lastdata) {
+        buf = (struct netbuf *)sock->lastdata;
+      } else {
+        if (((flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+            (sock->rcvevent <= 0)) {
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d): returning EWOULDBLOCK\n", s));
+          sock_set_errno(sock, EWOULDBLOCK);
+          return -1;
+        }
+        err = netconn_recv(sock->conn, &buf);
+        if (err != ERR_OK) {
+          sock_set_errno(sock, err_to_errno(err));
+          return (err == ERR_CLSD) ? 0 : -1;
+        }
+        LWIP_ASSERT("buf != NULL", buf != NULL);
+        sock->lastdata = buf;
+      }
+      tot_len = buf->p->tot_len;
+
+      /* scatter the datagram */
+      off = 0;
+      bad = 0;
+      for (i = 0; (i < message->msg_iovlen) && (off < tot_len); i++) {
+        copylen = (u16_t)LWIP_MIN(message->msg_iov[i].iov_len, (size_t)(tot_len - off));
+        if (copylen == 0) {
+          continue;
+        }
+#if LWIP_CHECKSUM_ON_COPY_RX
+        if (off == 0) {
+          /* checks the checksum if udp_input deferred that */
+          if (netbuf_copy_chksum(buf, message->msg_iov[i].iov_base, copylen) != ERR_OK) {
+            bad = 1;
+            break;
+          }
+        } else
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
+        {
+          pbuf_copy_partial(buf->p, message->msg_iov[i].iov_base, copylen, off);
+        }
+        off = (u16_t)(off + copylen);
+      }
+#if LWIP_CHECKSUM_ON_COPY_RX
+      if (!bad && (off == 0) && (netbuf_check_chksum(buf) != ERR_OK)) {
+        bad = 1;
+      }
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
+      if (bad) {
+        /* drop the datagram and wait for the next one */
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d): dropping netbuf=%p (checksum)\n", s, (void*)buf));
+        sock->lastdata = NULL;
+        netbuf_delete(buf);
+        buf = NULL;
+      }
+    } while (buf == NULL);
+
+    if (off < tot_len) {
+      message->msg_flags |= MSG_TRUNC;
+    }
+    if ((message->msg_name != NULL) && (message->msg_namelen > 0)) {
+      union sockaddr_aligned saddr;
+      IPADDR_PORT_TO_SOCKADDR(&saddr, netbuf_fromaddr(buf), netbuf_fromport(buf));
+      if (message->msg_namelen > saddr.sa.sa_len) {
+        message->msg_namelen = saddr.sa.sa_len;
+      }
+      MEMCPY(message->msg_name, &saddr, message->msg_namelen);
+    }
+    if ((flags & MSG_PEEK) == 0) {
+      sock->lastdata = NULL;
+      sock->lastoffset = 0;
+      netbuf_delete(buf);
+    }
+    sock_set_errno(sock, 0);
+    return off;
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
+/**
+ * Receive into multiple buffers. For TCP, the buffers are filled one after
+ * another (only the first one may block). For UDP/RAW, one datagram is
+ * scattered across the buffers; MSG_TRUNC is set in message->msg_flags if
+ * it did not fit. Ancillary data is not supported (msg_controllen is set
+ * to 0).
+ */
+int
+lwip_recvmsg(int s, struct msghdr *message, int flags)
+{
+  struct lwip_sock *sock;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d, message=%p, flags=0x%x)\n", s, (void*)message, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  return lwip_recvmsg_sock(sock, s, message, flags);
+}
+
+/**
+ * Receive up to 'vlen' messages with one call. Only the first message may
+ * block (like MSG_WAITFORONE on Linux, there is no timeout argument); after
+ * that, the datagrams already queued on the socket are drained without
+ * waiting. msgvec[i].msg_len is set to the number of bytes received.
+ *
+ * @return the number of messages received, or -1 (0 for TCP EOF) if not
+ *         even the first one could be received
+ */
+int
+lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+  unsigned int i;
+  int recvd;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg(%d, msgvec=%p, vlen=%u, flags=0x%x)\n", s, (void*)msgvec, vlen, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  LWIP_ERROR("lwip_recvmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+  if (vlen > IOV_MAX) {
+    vlen = IOV_MAX;
+  }
+
+  for (i = 0; i < vlen; i++) {
+    recvd = lwip_recvmsg_sock(sock, s, &msgvec[i].msg_hdr, (i == 0) ? flags : (flags | MSG_DONTWAIT));
+    if ((recvd < 0) ||
+        ((recvd == 0) && (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP))) {
+      if (i == 0) {
+        /* error or EOF on the first message: return that, errno is set */
+        return recvd;
+      }
+      /* nothing more queued (or EOF): return what we have */
+      break;
+    }
+    msgvec[i].msg_len = (unsigned int)recvd;
+    if (flags & MSG_PEEK) {
+      /* peeking again would return the same data */
+      i++;
+      break;
+    }
+  }
+  sock_set_errno(sock, 0);
+  return (int)i;
+}
+
+#if LWIP_SOCKET_RECV_ZEROCOPY
+/**
+ * Receive data without copying it: the received pbuf chain is lent to the
+ * application, which gets pointers to the pbuf payloads in 'iov'. For TCP,
+ * this returns the data of one received chain (pbufs not fitting into 'iov'
+ * are left for the next call); for UDP/RAW, one datagram (truncated if it
+ * does not fit into 'iov'). The data must be passed back to
+ * lwip_recv_release(), which also opens the TCP receive window.
+ *
+ * @param s the socket to receive from
+ * @param iov array to be filled with pointers to the received data
+ * @param iovcnt in: number of entries in 'iov', out: number of entries used
+ * @param flags MSG_DONTWAIT is supported, MSG_PEEK is not
+ * @param loan filled in to be passed to lwip_recv_release()
+ * @return number of bytes lent, 0 if the connection is closed, -1 on error
+ */
+int
+lwip_recv_lend(int s, struct iovec *iov, int *iovcnt, int flags, struct lwip_recv_loan *loan)
+{
+  struct lwip_sock *sock;
+  void             *buf = NULL;
+  struct pbuf      *p, *q;
+  u16_t            offset;
+  u32_t            len = 0;
+  int              i = 0;
+  err_t            err;
+  u8_t             is_tcp;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_lend(%d, %p, .., 0x%x, ..)\n", s, (void*)iov, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if ((iov == NULL) || (iovcnt == NULL) || (*iovcnt <= 0) || (loan == NULL) ||
+      ((flags & MSG_PEEK) != 0)) {
+    sock_set_errno(sock, EINVAL);
+    return -1;
+  }
+  is_tcp = (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP);
+
+  do {
+    if (sock->lastdata) {
+      buf = sock->lastdata;
+    } else {
+      if (((flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+          (sock->rcvevent <= 0)) {
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_lend(%d): returning EWOULDBLOCK\n", s));
+        sock_set_errno(sock, EWOULDBLOCK);
+        return -1;
+      }
+      if (is_tcp) {
+        err = netconn_recv_tcp_pbuf(sock->conn, (struct pbuf **)&buf);
+      } else {
+        err = netconn_recv(sock->conn, (struct netbuf **)&buf);
+      }
+      if (err != ERR_OK) {
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_lend(%d): error is \"%s\"!\n",
+          s, lwip_strerr(err)));
+        sock_set_errno(sock, err_to_errno(err));
+        return (err == ERR_CLSD) ? 0 : -1;
+      }
+      LWIP_ASSERT("buf != NULL", buf != NULL);
+      sock->lastdata = buf;
+    }
+#if LWIP_CHECKSUM_ON_COPY_RX
+    if (!is_tcp && (netbuf_check_chksum((struct netbuf *)buf) != ERR_OK)) {
+      /* udp_input deferred the checksum and it is wrong: drop the datagram */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_lend(%d): dropping netbuf=%p (checksum)\n", s, buf));
+      sock->lastdata = NULL;
+      netbuf_delete((struct netbuf *)buf);
+      buf = NULL;
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
+  } while (buf == NULL);
+
+  /* the buffer now belongs to the application */
+  sock->lastdata = NULL;
+  offset = sock->lastoffset;
+  sock->lastoffset = 0;
+  if (is_tcp) {
+    p = (struct pbuf *)buf;
+  } else {
+    /* keep the pbufs, but not the netbuf */
+    p = ((struct netbuf *)buf)->p;
+    ((struct netbuf *)buf)->p = ((struct netbuf *)buf)->ptr = NULL;
+    netbuf_delete((struct netbuf *)buf);
+  }
+
+  /* skip data already returned by lwip_recv() */
+  for (q = p; offset >= q->len; q = q->next) {
+    offset = (u16_t)(offset - q->len);
+    LWIP_ASSERT("lastoffset beyond the end of lastdata", q->next != NULL);
+  }
+  for (; (q != NULL) && (i < *iovcnt); q = q->next, i++) {
+    iov[i].iov_base = (u8_t *)q->payload + offset;
+    iov[i].iov_len = (size_t)(q->len - offset);
+    len += (u32_t)(q->len - offset);
+    offset = 0;
+  }
+  if ((q != NULL) && is_tcp) {
+    /* the remaining pbufs stay in the socket for the next call */
+    pbuf_ref(q);
+    sock->lastdata = q;
+  }
+
+  loan->p = p;
+  loan->len = is_tcp ? len : 0;
+  loan->seq = sock->lend_next++;
+  *iovcnt = i;
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_lend(%d): lent %"U32_F" bytes in %d pbufs\n", s, len, i));
+  sock_set_errno(sock, 0);
+  return (int)len;
+}
+
+/**
+ * Return data lent by lwip_recv_lend() to the stack: frees the pbufs and,
+ * for TCP, updates the receive window (netconn_recved). Loans must be
+ * returned in the order they were lent; a loan that has already been
+ * returned or that is not the oldest one outstanding is rejected (EINVAL).
+ *
+ * @param s the socket the data was received from
+ * @param loan as filled in by lwip_recv_lend()
+ * @return 0 on success, -1 on error
+ */
+int
+lwip_recv_release(int s, struct lwip_recv_loan *loan)
+{
+  struct lwip_sock *sock;
+
+  LWIP_ERROR("lwip_recv_release: invalid loan", (loan != NULL),
+             set_errno(EINVAL); return -1;);
+
+  if (loan->p == NULL) {
+    /* already returned */
+    set_errno(EINVAL);
+    return -1;
+  }
+  sock = get_socket(s);
+  if (!sock) {
+    /* the socket has already been closed, there is no window to update */
+    pbuf_free((struct pbuf *)loan->p);
+    loan->p = NULL;
+    return -1;
+  }
+  if (loan->seq != sock->lend_release) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_release(%d): loan %"U32_F" returned, expected %"U32_F"\n",
+                                s, loan->seq, sock->lend_release));
+    sock_set_errno(sock, EINVAL);
+    return -1;
+  }
+  sock->lend_release++;
+  pbuf_free((struct pbuf *)loan->p);
+  loan->p = NULL;
+
+  if (loan->len > 0) {
+    netconn_recved(sock->conn, loan->len);
+  }
+  sock_set_errno(sock, 0);
+  return 0;
+}
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
+
+/** Convert MSG_* flags of a send call to NETCONN_* write flags */
+static u8_t
+lwip_send_write_flags(int flags)
+{
+  u8_t write_flags = NETCONN_COPY |
+    ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
+    ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0);
+#if LWIP_SO_ZEROCOPY
+  if (flags & MSG_ZEROCOPY) {
+    /* reference the data (lwip_netconn_do_write still copies it if
+       SO_ZEROCOPY has not been enabled) */
+    write_flags = (u8_t)((write_flags & ~NETCONN_COPY) | NETCONN_ZEROCOPY);
+  }
+#endif /* LWIP_SO_ZEROCOPY */
+  return write_flags;
+}
+
 int
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -958,9 +1481,7 @@ lwip_send(int s, const void *data, size_t size, int flags)
 #endif /* (LWIP_UDP || LWIP_RAW) */
   }
 
-  write_flags = NETCONN_COPY |
-    ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
-    ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0);
+  write_flags = lwip_send_write_flags(flags);
   written = 0;
   err = netconn_write_partly(sock->conn, data, size, write_flags, &written);
 
@@ -969,6 +1490,268 @@ lwip_send(int s, const void *data, size_t size, int flags)
   return (err == ERR_OK ? (int)written : -1);
 }
 
+/** Check the arguments common to lwip_sendmsg() and lwip_sendmmsg().
+ * @return 0 if 'msg' is valid, else an errno value */
+static int
+lwip_sendmsg_check(const struct msghdr *msg)
+{
+  LWIP_ERROR("lwip_sendmsg: invalid msghdr", (msg != NULL) && (msg->msg_iovlen >= 0) &&
+             ((msg->msg_iov != NULL) || (msg->msg_iovlen == 0)),
+             return err_to_errno(ERR_ARG););
+  if (msg->msg_iovlen > IOV_MAX) {
+    return EMSGSIZE;
+  }
+  return 0;
+}
+
+#if LWIP_UDP || LWIP_RAW
+/**
+ * Build the netbuf to send a UDP/RAW datagram from a msghdr: a chain of
+ * PBUF_REF pbufs pointing to the iovecs (or a copy with
+ * LWIP_NETIF_TX_SINGLE_PBUF). The netbuf must be freed by netbuf_free()
+ * after sending it.
+ *
+ * @param sock the socket to send on
+ * @param msg the message to send
+ * @param buf the netbuf to initialize
+ * @param size returns the size of the datagram
+ * @return 0 on success (buf is initialized), else an errno value
+ */
+static int
+lwip_sendmsg_netbuf(struct lwip_sock *sock, const struct msghdr *msg, struct netbuf *buf, size_t *size)
+{
+  const struct sockaddr *to = (const struct sockaddr *)msg->msg_name;
+  u16_t remote_port;
+  err_t err;
+  int i;
+
+  if ((to != NULL) && !SOCK_ADDR_TYPE_MATCH(to, sock)) {
+    /* sockaddr does not match socket type (IPv4/IPv6) */
+    return err_to_errno(ERR_VAL);
+  }
+  LWIP_ERROR("lwip_sendmsg: invalid address", (((to == NULL) && (msg->msg_namelen == 0)) ||
+             (IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen) &&
+             IS_SOCK_ADDR_TYPE_VALID(to) && IS_SOCK_ADDR_ALIGNED(to))),
+             return err_to_errno(ERR_ARG););
+  *size = 0;
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    *size += msg->msg_iov[i].iov_len;
+    if (*size > 0xFFFF) {
+      return EMSGSIZE;
+    }
+  }
+
+  /* initialize a buffer */
+  buf->p = buf->ptr = NULL;
+#if LWIP_CHECKSUM_ON_COPY
+  buf->flags = 0;
+#endif /* LWIP_CHECKSUM_ON_COPY */
+  if (to) {
+    SOCKADDR_TO_IPADDR_PORT(to, &buf->addr, remote_port);
+  } else {
+    remote_port = 0;
+    ip_addr_set_any(NETCONNTYPE_ISIPV6(netconn_type(sock->conn)), &buf->addr);
+  }
+  netbuf_fromport(buf) = remote_port;
+
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  /* Allocate a new netbuf and copy the data into it. */
+  if (netbuf_alloc(buf, (u16_t)*size) == NULL) {
+    err = ERR_MEM;
+  } else {
+    u16_t off = 0;
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY((u8_t*)buf->p->payload + off, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      off = (u16_t)(off + msg->msg_iov[i].iov_len);
+    }
+    err = ERR_OK;
+  }
+#else /* LWIP_NETIF_TX_SINGLE_PBUF */
+  /* make a chain of pbufs pointing to the data that should be sent */
+  err = netbuf_ref(buf, (msg->msg_iovlen > 0) ? msg->msg_iov[0].iov_base : NULL,
+    (u16_t)((msg->msg_iovlen > 0) ? msg->msg_iov[0].iov_len : 0));
+  for (i = 1; (err == ERR_OK) && (i < msg->msg_iovlen); i++) {
+    struct pbuf *p;
+    if (msg->msg_iov[i].iov_len == 0) {
+      continue;
+    }
+    p = pbuf_alloc(PBUF_RAW, 0, PBUF_REF);
+    if (p == NULL) {
+      err = ERR_MEM;
+    } else {
+      p->payload = msg->msg_iov[i].iov_base;
+      p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
+      pbuf_cat(buf->p, p);
+    }
+  }
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+  if (err != ERR_OK) {
+    netbuf_free(buf);
+    return err_to_errno(err);
+  }
+  return 0;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
+/**
+ * Send data from multiple buffers. For TCP, this is one netconn write
+ * operation (one tcp_write per buffer, one tcp_output at the end). For
+ * UDP/RAW, the buffers are sent as one datagram built from a chain of
+ * PBUF_REF pbufs. Ancillary data (msg_control) is ignored.
+ */
+int
+lwip_sendmsg(int s, const struct msghdr *msg, int flags)
+{
+  struct lwip_sock *sock;
+  err_t err;
+  int errval;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmsg(%d, msg=%p, flags=0x%x)\n", s, (const void*)msg, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  errval = lwip_sendmsg_check(msg);
+  if (errval != 0) {
+    sock_set_errno(sock, errval);
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+#if LWIP_TCP
+    size_t written = 0;
+    LWIP_ASSERT("struct netvector must match struct iovec",
+      (sizeof(struct netvector) == sizeof(struct iovec)) &&
+      (offsetof(struct netvector, len) == offsetof(struct iovec, iov_len)));
+    err = netconn_write_vectors_partly(sock->conn, (struct netvector *)msg->msg_iov,
+      (u16_t)msg->msg_iovlen, lwip_send_write_flags(flags), &written);
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmsg(%d) err=%d written=%"SZT_F"\n", s, err, written));
+    sock_set_errno(sock, err_to_errno(err));
+    return (err == ERR_OK ? (int)written : -1);
+#else /* LWIP_TCP */
+    sock_set_errno(sock, err_to_errno(ERR_ARG));
+    return -1;
+#endif /* LWIP_TCP */
+  }
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf buf;
+    size_t size;
+
+    errval = lwip_sendmsg_netbuf(sock, msg, &buf, &size);
+    if (errval != 0) {
+      sock_set_errno(sock, errval);
+      return -1;
+    }
+    /* send the data */
+    err = netconn_send(sock->conn, &buf);
+
+    /* deallocated the buffer */
+    netbuf_free(&buf);
+
+    sock_set_errno(sock, err_to_errno(err));
+    return (err == ERR_OK ? (int)size : -1);
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
+/**
+ * Send up to 'vlen' messages with one call. For UDP/RAW, the datagrams are
+ * passed to tcpip_thread in batches of LWIP_SOCKET_MMSG_BATCH, so sending N
+ * datagrams takes N/LWIP_SOCKET_MMSG_BATCH round trips instead of N. For
+ * TCP, this is the same as calling lwip_sendmsg() for each message.
+ * msgvec[i].msg_len is set to the number of bytes sent.
+ *
+ * @return the number of messages sent, or -1 if not even the first one
+ *         could be sent
+ */
+int
+lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+  unsigned int done = 0;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmmsg(%d, msgvec=%p, vlen=%u, flags=0x%x)\n", s, (void*)msgvec, vlen, flags));
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  LWIP_ERROR("lwip_sendmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+  if (vlen > IOV_MAX) {
+    vlen = IOV_MAX;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    for (; done < vlen; done++) {
+      int sent = lwip_sendmsg(s, &msgvec[done].msg_hdr, flags);
+      if (sent < 0) {
+        break;
+      }
+      msgvec[done].msg_len = (unsigned int)sent;
+    }
+    if (done == 0) {
+      /* errno is set by lwip_sendmsg */
+      return (vlen == 0) ? 0 : -1;
+    }
+    sock_set_errno(sock, 0);
+    return (int)done;
+  }
+#if LWIP_UDP || LWIP_RAW
+  {
+    struct netbuf bufs[LWIP_SOCKET_MMSG_BATCH];
+    int errval = 0;
+    err_t err;
+
+    LWIP_UNUSED_ARG(flags);
+    while ((done < vlen) && (errval == 0)) {
+      u16_t count = 0;
+      u16_t sent = 0;
+      u16_t j;
+
+      /* build the netbufs of one batch */
+      while ((count < LWIP_SOCKET_MMSG_BATCH) && (done + count < vlen)) {
+        struct msghdr *msg = &msgvec[done + count].msg_hdr;
+        size_t size;
+        errval = lwip_sendmsg_check(msg);
+        if (errval == 0) {
+          errval = lwip_sendmsg_netbuf(sock, msg, &bufs[count], &size);
+        }
+        if (errval != 0) {
+          break;
+        }
+        msgvec[done + count].msg_len = (unsigned int)size;
+        count++;
+      }
+      if (count > 0) {
+        /* send them with one call into tcpip_thread */
+        err = netconn_send_batch(sock->conn, bufs, count, &sent);
+        for (j = 0; j < count; j++) {
+          netbuf_free(&bufs[j]);
+        }
+        if ((err != ERR_OK) && (errval == 0)) {
+          errval = err_to_errno(err);
+        }
+        done += sent;
+      }
+    }
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendmmsg(%d) done=%u errval=%d\n", s, done, errval));
+    if ((done == 0) && (errval != 0)) {
+      sock_set_errno(sock, errval);
+      return -1;
+    }
+    sock_set_errno(sock, 0);
+    return (int)done;
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  sock_set_errno(sock, err_to_errno(ERR_ARG));
+  return -1;
+#endif /* LWIP_UDP || LWIP_RAW */
+}
+
 int
 lwip_sendto(int s, const void *data, size_t size, int flags,
        const struct sockaddr *to, socklen_t tolen)
@@ -1126,6 +1909,158 @@ lwip_write(int s, const void *data, size_t size)
   return lwip_send(s, data, size, 0);
 }
 
+int
+lwip_writev(int s, const struct iovec *iov, int iovcnt)
+{
+  struct msghdr msg;
+
+  msg.msg_name = NULL;
+  msg.msg_namelen = 0;
+  /* Hack: we have to cast via number to cast from 'const' pointer to non-const.
+     Blame the opengroup standard for this inconsistency. */
+  msg.msg_iov = (struct iovec *)(size_t)iov;
+  msg.msg_iovlen = iovcnt;
+  msg.msg_control = NULL;
+  msg.msg_controllen = 0;
+  msg.msg_flags = 0;
+  return lwip_sendmsg(s, &msg, 0);
+}
+
+/**
+ * Register a task waiting in select or poll with a socket.
+ * Must be called with SYS_ARCH protected.
+ */
+static void
+lwip_sock_select_wait(struct lwip_sock *sock, struct lwip_select_cb *scb)
+{
+  /* if this is the only waiter, event_callback() can signal it directly */
+  sock->select_cb = (sock->select_waiting == 0) ? scb : NULL;
+  sock->select_waiting++;
+  LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+}
+
+/**
+ * Unregister a task waiting in select or poll from a socket.
+ * Must be called with SYS_ARCH protected.
+ */
+static void
+lwip_sock_select_unwait(struct lwip_sock *sock, struct lwip_select_cb *scb)
+{
+  /* @todo: what if this is a new socket (reallocated?) in this case,
+     select_waiting-- would be wrong (a global 'sockalloc' counter,
+     stored per socket could help) */
+  LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+  if (sock->select_waiting > 0) {
+    sock->select_waiting--;
+  }
+  if (sock->select_cb == scb) {
+    sock->select_cb = NULL;
+  }
+}
+
+#if LWIP_SOCKET_POLL
+/**
+ * Calculate the revents of a pollfd from the events of a socket.
+ * Must be called with SYS_ARCH protected.
+ */
+static short
+lwip_poll_revents(struct lwip_sock *sock, short events)
+{
+  short revents = 0;
+
+  if ((events & POLLIN) && ((sock->lastdata != NULL) || (sock->rcvevent > 0))) {
+    revents |= POLLIN;
+  }
+  if ((events & POLLOUT) && (sock->sendevent != 0)) {
+    revents |= POLLOUT;
+  }
+  /* errors are always reported */
+  if (sock->errevent != 0) {
+    revents |= POLLERR;
+  }
+  return revents;
+}
+#endif /* LWIP_SOCKET_POLL */
+
+/**
+ * Check if a task waiting in select or poll waits for events pending on a
+ * socket. Must be called with SYS_ARCH protected.
+ *
+ * @param scb the waiting task
+ * @param s the socket
+ * @param sock the socket's lwip_sock
+ * @return 1 if the task must be woken up, 0 otherwise
+ */
+static int
+lwip_select_cb_check(struct lwip_select_cb *scb, int s, struct lwip_sock *sock)
+{
+#if LWIP_SOCKET_POLL
+  if (scb->poll_fds != NULL) {
+    nfds_t i;
+    for (i = 0; i < scb->poll_nfds; i++) {
+      if ((scb->poll_fds[i].fd == s) && lwip_poll_revents(sock, scb->poll_fds[i].events)) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif /* LWIP_SOCKET_POLL */
+  if ((sock->rcvevent > 0) && scb->readset && FD_ISSET(s, scb->readset)) {
+    return 1;
+  }
+  if ((sock->sendevent != 0) && scb->writeset && FD_ISSET(s, scb->writeset)) {
+    return 1;
+  }
+  if ((sock->errevent != 0) && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
+    return 1;
+  }
+  return 0;
+}
+
+/** Put a select_cb on top of select_cb_list */
+static void
+lwip_link_select_cb(struct lwip_select_cb *select_cb)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  /* Protect the select_cb_list */
+  SYS_ARCH_PROTECT(lev);
+
+  /* Put this select_cb on top of list */
+  select_cb->next = select_cb_list;
+  if (select_cb_list != NULL) {
+    select_cb_list->prev = select_cb;
+  }
+  select_cb_list = select_cb;
+  /* Increasing this counter tells even_callback that the list has changed. */
+  select_cb_ctr++;
+
+  /* Now we can safely unprotect */
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/** Remove a select_cb from select_cb_list */
+static void
+lwip_unlink_select_cb(struct lwip_select_cb *select_cb)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  if (select_cb->next != NULL) {
+    select_cb->next->prev = select_cb->prev;
+  }
+  if (select_cb_list == select_cb) {
+    LWIP_ASSERT("select_cb->prev == NULL", select_cb->prev == NULL);
+    select_cb_list = select_cb->next;
+  } else {
+    LWIP_ASSERT("select_cb->prev != NULL", select_cb->prev != NULL);
+    select_cb->prev->next = select_cb->next;
+  }
+  /* Increasing this counter tells even_callback that the list has changed. */
+  select_cb_ctr++;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
 /**
  * Go through the readset and writeset lists and see which socket of the sockets
  * set in the sets has events. On return, readset, writeset and exceptset have
@@ -1242,6 +2177,10 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
     select_cb.readset = readset;
     select_cb.writeset = writeset;
     select_cb.exceptset = exceptset;
+#if LWIP_SOCKET_POLL
+    select_cb.poll_fds = NULL;
+    select_cb.poll_nfds = 0;
+#endif /* LWIP_SOCKET_POLL */
     select_cb.sem_signalled = 0;
 #if LWIP_NETCONN_SEM_PER_THREAD
     select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
@@ -1253,20 +2192,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
     }
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
 
-    /* Protect the select_cb_list */
-    SYS_ARCH_PROTECT(lev);
-
-    /* Put this select_cb on top of list */
-    select_cb.next = select_cb_list;
-    if (select_cb_list != NULL) {
-      select_cb_list->prev = &select_cb;
-    }
-    select_cb_list = &select_cb;
-    /* Increasing this counter tells even_callback that the list has changed. */
-    select_cb_ctr++;
-
-    /* Now we can safely unprotect */
-    SYS_ARCH_UNPROTECT(lev);
+    lwip_link_select_cb(&select_cb);
 
     /* Increase select_waiting for each socket we are interested in */
     maxfdp2 = maxfdp1;
@@ -1278,8 +2204,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
         SYS_ARCH_PROTECT(lev);
         sock = tryget_socket(i);
         if (sock != NULL) {
-          sock->select_waiting++;
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
+          lwip_sock_select_wait(sock, &select_cb);
         } else {
           /* Not a valid socket */
           nready = -1;
@@ -1312,81 +2237,205 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       }
     }
 
-    /* Decrease select_waiting for each socket we are interested in */
-    for (i = LWIP_SOCKET_OFFSET; i < maxfdp2; i++) {
-      if ((readset && FD_ISSET(i, readset)) ||
-          (writeset && FD_ISSET(i, writeset)) ||
-          (exceptset && FD_ISSET(i, exceptset))) {
-        struct lwip_sock *sock;
-        SYS_ARCH_PROTECT(lev);
-        sock = tryget_socket(i);
-        if (sock != NULL) {
-          /* @todo: what if this is a new socket (reallocated?) in this case,
-             select_waiting-- would be wrong (a global 'sockalloc' counter,
-             stored per socket could help) */
-          LWIP_ASSERT("sock->select_waiting > 0", sock->select_waiting > 0);
-          if (sock->select_waiting > 0) {
-            sock->select_waiting--;
-          }
-        } else {
-          /* Not a valid socket */
-          nready = -1;
-        }
-        SYS_ARCH_UNPROTECT(lev);
-      }
+    /* Decrease select_waiting for each socket we are interested in */
+    for (i = LWIP_SOCKET_OFFSET; i < maxfdp2; i++) {
+      if ((readset && FD_ISSET(i, readset)) ||
+          (writeset && FD_ISSET(i, writeset)) ||
+          (exceptset && FD_ISSET(i, exceptset))) {
+        struct lwip_sock *sock;
+        SYS_ARCH_PROTECT(lev);
+        sock = tryget_socket(i);
+        if (sock != NULL) {
+          lwip_sock_select_unwait(sock, &select_cb);
+        } else {
+          /* Not a valid socket */
+          nready = -1;
+        }
+        SYS_ARCH_UNPROTECT(lev);
+      }
+    }
+    /* Take us off the list */
+    lwip_unlink_select_cb(&select_cb);
+
+#if !LWIP_NETCONN_SEM_PER_THREAD
+    sys_sem_free(&select_cb.sem);
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    if (nready < 0) {
+      /* This happens when a socket got closed while waiting */
+      set_errno(EBADF);
+      return -1;
+    }
+
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      /* Timeout */
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: timeout expired\n"));
+      /* This is OK as the local fdsets are empty and nready is zero,
+         or we would have returned earlier. */
+      goto return_copy_fdsets;
+    }
+
+    /* See what's set */
+    nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: nready=%d\n", nready));
+return_copy_fdsets:
+  set_errno(0);
+  if (readset) {
+    *readset = lreadset;
+  }
+  if (writeset) {
+    *writeset = lwriteset;
+  }
+  if (exceptset) {
+    *exceptset = lexceptset;
+  }
+  return nready;
+}
+
+#if LWIP_SOCKET_POLL
+/** Options for lwip_pollscan() */
+enum lwip_pollscan_opts
+{
+  /** Only calculate revents */
+  LWIP_POLLSCAN_CALC = 0,
+  /** Also register with the sockets (increment select_waiting) */
+  LWIP_POLLSCAN_INC_WAIT = 1,
+  /** Also unregister from the sockets (decrement select_waiting) */
+  LWIP_POLLSCAN_DEC_WAIT = 2
+};
+
+/**
+ * Update revents in each struct pollfd.
+ *
+ * @param fds array of structures to update
+ * @param nfds number of structures in fds
+ * @param opts what to do with select_waiting of each socket
+ * @param select_cb the select_cb to (un)register with the sockets
+ * @return number of structures that have revents != 0
+ */
+static int
+lwip_pollscan(struct pollfd *fds, nfds_t nfds, enum lwip_pollscan_opts opts,
+              struct lwip_select_cb *select_cb)
+{
+  int nready = 0;
+  nfds_t fdi;
+  struct lwip_sock *sock;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  for (fdi = 0; fdi < nfds; fdi++) {
+    fds[fdi].revents = 0;
+    /* negative fds are ignored */
+    if (fds[fdi].fd < 0) {
+      continue;
+    }
+    SYS_ARCH_PROTECT(lev);
+    sock = tryget_socket(fds[fdi].fd);
+    if (sock == NULL) {
+      SYS_ARCH_UNPROTECT(lev);
+      /* not a valid socket (or closed while waiting) */
+      fds[fdi].revents = POLLNVAL;
+      nready++;
+      continue;
+    }
+    if (opts == LWIP_POLLSCAN_INC_WAIT) {
+      lwip_sock_select_wait(sock, select_cb);
+    } else if (opts == LWIP_POLLSCAN_DEC_WAIT) {
+      lwip_sock_select_unwait(sock, select_cb);
+    }
+    fds[fdi].revents = lwip_poll_revents(sock, fds[fdi].events);
+    SYS_ARCH_UNPROTECT(lev);
+    if (fds[fdi].revents != 0) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_pollscan: fd=%d revents=0x%x\n",
+                  fds[fdi].fd, (unsigned int)fds[fdi].revents));
+      nready++;
+    }
+  }
+
+  LWIP_ASSERT("nready >= 0", nready >= 0);
+  return nready;
+}
+
+/**
+ * poll() on sockets: works like lwip_select() but takes an array of
+ * struct pollfd, so the number of sockets is not limited by FD_SETSIZE
+ * and only the sockets passed are checked.
+ *
+ * @param fds the sockets to wait for and their events
+ * @param nfds number of structures in fds
+ * @param timeout in milliseconds, -1 waits forever, 0 returns immediately
+ * @return number of structures with revents != 0, 0 on timeout, -1 on error
+ */
+int
+lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+  u32_t waitres = 0;
+  int nready;
+  struct lwip_select_cb select_cb;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll(%p, %d, %d)\n",
+                  (void*)fds, (int)nfds, timeout));
+
+  if ((fds == NULL) && (nfds != 0)) {
+    set_errno(EFAULT);
+    return -1;
+  }
+
+  nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_CALC, NULL);
+
+  /* If we don't have any current events, then suspend if we are supposed to */
+  if (!nready && (timeout != 0)) {
+    /* None ready: add our semaphore to list (see lwip_select) */
+    select_cb.next = NULL;
+    select_cb.prev = NULL;
+    select_cb.readset = NULL;
+    select_cb.writeset = NULL;
+    select_cb.exceptset = NULL;
+    select_cb.poll_fds = fds;
+    select_cb.poll_nfds = nfds;
+    select_cb.sem_signalled = 0;
+#if LWIP_NETCONN_SEM_PER_THREAD
+    select_cb.sem = LWIP_NETCONN_THREAD_SEM_GET();
+#else /* LWIP_NETCONN_SEM_PER_THREAD */
+    if (sys_sem_new(&select_cb.sem, 0) != ERR_OK) {
+      /* failed to create semaphore */
+      set_errno(ENOMEM);
+      return -1;
+    }
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+    lwip_link_select_cb(&select_cb);
+
+    /* Register with each socket and scan again: there could have been
+       events between the last scan (without us on the list) and putting
+       us on the list! */
+    nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_INC_WAIT, &select_cb);
+    if (!nready) {
+      /* Still none ready, just wait to be woken */
+      waitres = sys_arch_sem_wait(SELECT_SEM_PTR(select_cb.sem), (timeout < 0) ? 0 : (u32_t)timeout);
     }
+
+    /* Unregister from each socket and see what's set */
+    nready = lwip_pollscan(fds, nfds, LWIP_POLLSCAN_DEC_WAIT, &select_cb);
+
     /* Take us off the list */
-    SYS_ARCH_PROTECT(lev);
-    if (select_cb.next != NULL) {
-      select_cb.next->prev = select_cb.prev;
-    }
-    if (select_cb_list == &select_cb) {
-      LWIP_ASSERT("select_cb.prev == NULL", select_cb.prev == NULL);
-      select_cb_list = select_cb.next;
-    } else {
-      LWIP_ASSERT("select_cb.prev != NULL", select_cb.prev != NULL);
-      select_cb.prev->next = select_cb.next;
-    }
-    /* Increasing this counter tells even_callback that the list has changed. */
-    select_cb_ctr++;
-    SYS_ARCH_UNPROTECT(lev);
+    lwip_unlink_select_cb(&select_cb);
 
 #if !LWIP_NETCONN_SEM_PER_THREAD
     sys_sem_free(&select_cb.sem);
 #endif /* LWIP_NETCONN_SEM_PER_THREAD */
 
-    if (nready < 0) {
-      /* This happens when a socket got closed while waiting */
-      set_errno(EBADF);
-      return -1;
-    }
-
     if (waitres == SYS_ARCH_TIMEOUT) {
-      /* Timeout */
-      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: timeout expired\n"));
-      /* This is OK as the local fdsets are empty and nready is zero,
-         or we would have returned earlier. */
-      goto return_copy_fdsets;
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: timeout expired\n"));
     }
-
-    /* See what's set */
-    nready = lwip_selscan(maxfdp1, readset, writeset, exceptset, &lreadset, &lwriteset, &lexceptset);
   }
 
-  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_select: nready=%d\n", nready));
-return_copy_fdsets:
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_poll: nready=%d\n", nready));
   set_errno(0);
-  if (readset) {
-    *readset = lreadset;
-  }
-  if (writeset) {
-    *writeset = lwriteset;
-  }
-  if (exceptset) {
-    *exceptset = lexceptset;
-  }
   return nready;
 }
+#endif /* LWIP_SOCKET_POLL */
 
 /**
  * Callback registered in the netconn layer for each socket-netconn.
@@ -1455,12 +2504,29 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_SOCKET_EPOLL
+  if (sock->epoll_registered && (evt != NETCONN_EVT_RCVMINUS) && (evt != NETCONN_EVT_SENDMINUS)) {
+    lwip_epoll_sock_event(s, sock);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   if (sock->select_waiting == 0) {
     /* noone is waiting for this socket, no need to check select_cb_list */
     SYS_ARCH_UNPROTECT(lev);
     return;
   }
 
+  if (sock->select_cb != NULL) {
+    /* exactly one task is waiting for this socket: no need to check select_cb_list */
+    scb = sock->select_cb;
+    if ((scb->sem_signalled == 0) && lwip_select_cb_check(scb, s, sock)) {
+      scb->sem_signalled = 1;
+      sys_sem_signal(SELECT_SEM_PTR(scb->sem));
+    }
+    SYS_ARCH_UNPROTECT(lev);
+    return;
+  }
+
   /* Now decide if anyone is waiting for this socket */
   /* NOTE: This code goes through the select_cb_list list multiple times
      ONLY IF a select was actually waiting. We go through the list the number
@@ -1472,25 +2538,8 @@ again:
     /* remember the state of select_cb_list to detect changes */
     last_select_cb_ctr = select_cb_ctr;
     if (scb->sem_signalled == 0) {
-      /* semaphore not signalled yet */
-      int do_signal = 0;
-      /* Test this select call for our socket */
-      if (sock->rcvevent > 0) {
-        if (scb->readset && FD_ISSET(s, scb->readset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->sendevent != 0) {
-        if (!do_signal && scb->writeset && FD_ISSET(s, scb->writeset)) {
-          do_signal = 1;
-        }
-      }
-      if (sock->errevent != 0) {
-        if (!do_signal && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
-          do_signal = 1;
-        }
-      }
-      if (do_signal) {
+      /* semaphore not signalled yet: test this select call for our socket */
+      if (lwip_select_cb_check(scb, s, sock)) {
         scb->sem_signalled = 1;
         /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
            lead to the select thread taking itself off the list, invalidating the semaphore. */
@@ -1509,6 +2558,348 @@ again:
   SYS_ARCH_UNPROTECT(lev);
 }
 
+#if LWIP_SOCKET_EPOLL
+/**
+ * Map an epoll file descriptor to its instance.
+ *
+ * @param epfd the epoll file descriptor
+ * @return the epoll instance or NULL (errno is set to EBADF)
+ */
+static struct lwip_epoll *
+get_epoll(int epfd)
+{
+  int i = epfd - LWIP_EPOLL_OFFSET;
+
+  if ((i < 0) || (i >= LWIP_SOCKET_EPOLL_INSTANCES) || !epolls[i].used) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("get_epoll(%d): invalid\n", epfd));
+    set_errno(EBADF);
+    return NULL;
+  }
+  return &epolls[i];
+}
+
+/**
+ * Check which of the registered events are currently pending on a socket.
+ * Must be called with SYS_ARCH protected.
+ */
+static u32_t
+lwip_epoll_revents(struct lwip_sock *sock, struct lwip_epoll_item *item)
+{
+  u32_t revents = 0;
+
+  if (item->flags & LWIP_EPOLL_ITEM_DISABLED) {
+    return 0;
+  }
+  if ((item->events & EPOLLIN) && ((sock->lastdata != NULL) || (sock->rcvevent > 0))) {
+    revents |= EPOLLIN;
+  }
+  if ((item->events & EPOLLOUT) && (sock->sendevent != 0)) {
+    revents |= EPOLLOUT;
+  }
+  /* errors and hangups are always reported */
+  if (sock->errevent != 0) {
+    revents |= EPOLLERR;
+  }
+  if ((sock->conn != NULL) && (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) &&
+      ERR_IS_FATAL(sock->conn->last_err)) {
+    /* the connection has been reset, aborted or closed in both directions */
+    revents |= EPOLLHUP;
+  }
+  return revents;
+}
+
+/**
+ * Append an item to the ready list of an epoll instance and wake up all
+ * tasks waiting on it. Must be called with SYS_ARCH protected.
+ */
+static void
+lwip_epoll_set_ready(struct lwip_epoll *ep, struct lwip_epoll_item *item)
+{
+  if (!(item->flags & LWIP_EPOLL_ITEM_READY)) {
+    item->flags |= LWIP_EPOLL_ITEM_READY;
+    item->ready_next = NULL;
+    if (ep->ready_tail != NULL) {
+      ep->ready_tail->ready_next = item;
+    } else {
+      ep->ready_head = item;
+    }
+    ep->ready_tail = item;
+  }
+  while (ep->signalled < ep->waiting) {
+    ep->signalled++;
+    sys_sem_signal(&ep->sem);
+  }
+}
+
+/**
+ * Called from event_callback() (SYS_ARCH protected) for a socket that is
+ * registered with at least one epoll instance: puts the socket on the ready
+ * list of each instance for which one of the registered events is pending.
+ */
+static void
+lwip_epoll_sock_event(int s, struct lwip_sock *sock)
+{
+  int i;
+
+  for (i = 0; i < LWIP_SOCKET_EPOLL_INSTANCES; i++) {
+    struct lwip_epoll_item *item = &epoll_items[s - LWIP_SOCKET_OFFSET][i];
+    if ((item->flags & LWIP_EPOLL_ITEM_REGISTERED) && lwip_epoll_revents(sock, item)) {
+      lwip_epoll_set_ready(&epolls[i], item);
+    }
+  }
+}
+
+/**
+ * Move ready events from the ready list to 'events'. Items that are not
+ * ready any more are dropped from the list, level-triggered items that are
+ * still ready are moved to the end of the list (so that all ready sockets
+ * are reported in turn if maxevents is small).
+ * Must be called with SYS_ARCH protected.
+ *
+ * @return number of events stored in 'events'
+ */
+static int
+lwip_epoll_harvest(struct lwip_epoll *ep, struct lwip_epoll_event *events, int maxevents)
+{
+  struct lwip_epoll_item *item, *last = ep->ready_tail;
+  int n = 0;
+
+  while ((n < maxevents) && ((item = ep->ready_head) != NULL)) {
+    ep->ready_head = item->ready_next;
+    if (ep->ready_head == NULL) {
+      ep->ready_tail = NULL;
+    }
+    item->flags &= ~LWIP_EPOLL_ITEM_READY;
+
+    if (item->flags & LWIP_EPOLL_ITEM_REGISTERED) {
+      int s = (int)((item - &epoll_items[0][0]) / LWIP_SOCKET_EPOLL_INSTANCES);
+      u32_t revents = lwip_epoll_revents(&sockets[s], item);
+      if (revents) {
+        events[n].events = revents;
+        events[n].data = item->data;
+        n++;
+        if (item->events & EPOLLONESHOT) {
+          item->flags |= LWIP_EPOLL_ITEM_DISABLED;
+        } else if (!(item->events & EPOLLET)) {
+          lwip_epoll_set_ready(ep, item);
+        }
+      }
+    }
+    if (item == last) {
+      /* don't report level-triggered items twice in one call */
+      break;
+    }
+  }
+  return n;
+}
+
+int
+lwip_epoll_create(int size)
+{
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  for (i = 0; i < LWIP_SOCKET_EPOLL_INSTANCES; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (!epolls[i].used) {
+      epolls[i].used = 1;
+      SYS_ARCH_UNPROTECT(lev);
+      epolls[i].waiting = 0;
+      epolls[i].signalled = 0;
+      epolls[i].ready_head = NULL;
+      epolls[i].ready_tail = NULL;
+      if (sys_sem_new(&epolls[i].sem, 0) != ERR_OK) {
+        epolls[i].used = 0;
+        set_errno(ENOMEM);
+        return -1;
+      }
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create(%d) = %d\n", size, i + LWIP_EPOLL_OFFSET));
+      set_errno(0);
+      return i + LWIP_EPOLL_OFFSET;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+  }
+  set_errno(ENFILE);
+  return -1;
+}
+
+/** Called from lwip_close() for epoll file descriptors. Fails with EBUSY
+ * while a task is waiting in lwip_epoll_wait() on the instance. */
+static int
+lwip_epoll_close(int epfd)
+{
+  struct lwip_epoll *ep;
+  int i, idx;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  idx = (int)(ep - epolls);
+
+  SYS_ARCH_PROTECT(lev);
+  if (ep->waiting != 0) {
+    /* the semaphore is still in use */
+    SYS_ARCH_UNPROTECT(lev);
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_close(%d): tasks are waiting\n", epfd));
+    set_errno(EBUSY);
+    return -1;
+  }
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    if (epoll_items[i][idx].flags & LWIP_EPOLL_ITEM_REGISTERED) {
+      sockets[i].epoll_registered--;
+    }
+    epoll_items[i][idx].flags = 0;
+  }
+  ep->ready_head = NULL;
+  ep->ready_tail = NULL;
+  SYS_ARCH_UNPROTECT(lev);
+
+  sys_sem_free(&ep->sem);
+  ep->used = 0;
+  set_errno(0);
+  return 0;
+}
+
+int
+lwip_epoll_ctl(int epfd, int op, int s, struct lwip_epoll_event *event)
+{
+  struct lwip_epoll *ep;
+  struct lwip_sock *sock;
+  struct lwip_epoll_item *item;
+  int err = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d)\n", epfd, op, s));
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  sock = get_socket(s);
+  if (sock == NULL) {
+    return -1;
+  }
+  if ((event == NULL) && (op != EPOLL_CTL_DEL)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  item = &epoll_items[s - LWIP_SOCKET_OFFSET][ep - epolls];
+
+  SYS_ARCH_PROTECT(lev);
+  switch (op) {
+    case EPOLL_CTL_ADD:
+      if (item->flags & LWIP_EPOLL_ITEM_REGISTERED) {
+        err = EEXIST;
+        break;
+      }
+      /* keep READY: the item might still be linked into the ready list */
+      item->flags = (u8_t)((item->flags & LWIP_EPOLL_ITEM_READY) | LWIP_EPOLL_ITEM_REGISTERED);
+      item->events = event->events;
+      item->data = event->data;
+      sock->epoll_registered++;
+      break;
+    case EPOLL_CTL_MOD:
+      if (!(item->flags & LWIP_EPOLL_ITEM_REGISTERED)) {
+        err = ENOENT;
+        break;
+      }
+      item->flags &= ~LWIP_EPOLL_ITEM_DISABLED;
+      item->events = event->events;
+      item->data = event->data;
+      break;
+    case EPOLL_CTL_DEL:
+      if (!(item->flags & LWIP_EPOLL_ITEM_REGISTERED)) {
+        err = ENOENT;
+        break;
+      }
+      /* the ready list entry (if any) is dropped by lwip_epoll_wait() */
+      item->flags &= LWIP_EPOLL_ITEM_READY;
+      sock->epoll_registered--;
+      break;
+    default:
+      err = EINVAL;
+      break;
+  }
+  if ((err == 0) && (op != EPOLL_CTL_DEL) && lwip_epoll_revents(sock, item)) {
+    /* events might be pending already */
+    lwip_epoll_set_ready(ep, item);
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  sock_set_errno(sock, err);
+  return err ? -1 : 0;
+}
+
+/**
+ * Wait for events on the sockets registered with an epoll instance.
+ * Only the sockets on the ready list of the instance are checked, so the
+ * cost does not depend on the number of registered sockets.
+ *
+ * @param epfd the epoll file descriptor
+ * @param events receives the pending events
+ * @param maxevents maximum number of events to return
+ * @param timeout in milliseconds, -1 waits forever, 0 returns immediately
+ * @return the number of events returned or -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct lwip_epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  u32_t waitres;
+  int nready;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  if ((events == NULL) || (maxevents <= 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  for (;;) {
+    SYS_ARCH_PROTECT(lev);
+    nready = lwip_epoll_harvest(ep, events, maxevents);
+    if ((nready > 0) || (timeout == 0)) {
+      SYS_ARCH_UNPROTECT(lev);
+      break;
+    }
+    /* nothing ready: wait to be signalled by event_callback */
+    ep->waiting++;
+    SYS_ARCH_UNPROTECT(lev);
+
+    waitres = sys_arch_sem_wait(&ep->sem, (timeout < 0) ? 0 : (u32_t)timeout);
+
+    SYS_ARCH_PROTECT(lev);
+    ep->waiting--;
+    if (waitres != SYS_ARCH_TIMEOUT) {
+      /* A signal left over from a task that timed out may wake us up without
+         an event: that is harmless, the ready list is simply checked again */
+      ep->signalled--;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      /* check once more, then return */
+      timeout = 0;
+    } else if (timeout > 0) {
+      timeout = (waitres < (u32_t)timeout) ? (int)(timeout - waitres) : 0;
+    }
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d): nready=%d\n", epfd, nready));
+  set_errno(0);
+  return nready;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 /**
  * Unimplemented: Close one end of a full-duplex connection.
  * Currently, the full connection is closed.
@@ -1809,6 +3200,12 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
 #endif /* LWIP_UDPLITE */
       *(int*)optval = (udp_flags(sock->conn->pcb.udp) & UDP_FLAGS_NOCHKSUM) ? 1 : 0;
       break;
+#if LWIP_UDP_REUSEPORT
+    case SO_REUSEPORT:
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_UDP);
+      *(int*)optval = (udp_flags(sock->conn->pcb.udp) & UDP_FLAGS_REUSEPORT) ? 1 : 0;
+      break;
+#endif /* LWIP_UDP_REUSEPORT */
 #endif /* LWIP_UDP*/
     default:
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n",
@@ -1874,8 +3271,12 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
 #if LWIP_TCP
 /* Level: IPPROTO_TCP */
   case IPPROTO_TCP:
-    /* Special case: all IPPROTO_TCP option take an int */
-    LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_TCP);
+    /* Special case: all IPPROTO_TCP option take an int (but TCP_CONGESTION) */
+    if (optname == TCP_CONGESTION) {
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, char, NETCONN_TCP);
+    } else {
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_TCP);
+    }
     switch (optname) {
     case TCP_NODELAY:
       *(int*)optval = tcp_nagle_disabled(sock->conn->pcb.tcp);
@@ -1905,6 +3306,19 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
                   s, *(int *)optval));
       break;
 #endif /* LWIP_TCP_KEEPALIVE */
+    case TCP_CONGESTION:
+      {
+        const char *name = tcp_get_congestion(sock->conn->pcb.tcp);
+        socklen_t len = (socklen_t)(strlen(name) + 1);
+        if (*optlen < len) {
+          len = *optlen;
+        }
+        MEMCPY(optval, name, len);
+        *optlen = len;
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_CONGESTION) = %s\n",
+                    s, name));
+      }
+      break;
     default:
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, UNIMPL: optname=0x%x, ..)\n",
                   s, optname));
@@ -2077,6 +3491,21 @@ lwip_setsockopt_callback(void *arg)
 }
 #endif  /* LWIP_TCPIP_CORE_LOCKING */
 
+#if LWIP_SO_ZEROCOPY
+/** Zero-copy completion callback registered with the netconn of a socket
+ * that has SO_ZEROCOPY enabled: passes completions on to the application.
+ */
+static void
+lwip_zerocopy_done(struct netconn *conn, u32_t lo, u32_t hi, err_t err, void *arg)
+{
+  struct lwip_sock *sock = (struct lwip_sock *)arg;
+
+  if (sock->zc_callback != NULL) {
+    sock->zc_callback(conn->socket, lo, hi, (err == ERR_OK) ? 0 : err_to_errno(err), sock->zc_arg);
+  }
+}
+#endif /* LWIP_SO_ZEROCOPY */
+
 /** lwip_setsockopt_impl: the actual implementation of setsockopt:
  * same argument as lwip_setsockopt, either called directly or through callback
  */
@@ -2111,6 +3540,13 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       }
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                   s, optname, (*(const int*)optval?"on":"off")));
+#if LWIP_TCP && LWIP_TCP_PCB_TIMERS
+      if ((optname == SO_KEEPALIVE) &&
+          (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP)) {
+        /* (re-)arm the keepalive timer */
+        tcp_timers_touch(sock->conn->pcb.tcp);
+      }
+#endif /* LWIP_TCP && LWIP_TCP_PCB_TIMERS */
       break;
 
     /* SO_TYPE is get-only */
@@ -2154,6 +3590,18 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
       }
       break;
 #endif /* LWIP_SO_LINGER */
+#if LWIP_SO_ZEROCOPY
+    case SO_ZEROCOPY:
+      {
+        const struct lwip_zerocopy* zc = (const struct lwip_zerocopy*)optval;
+        LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, struct lwip_zerocopy, NETCONN_TCP);
+        sock->zc_callback = zc->callback;
+        sock->zc_arg = zc->arg;
+        netconn_set_zerocopy_callback(sock->conn,
+          (zc->callback != NULL) ? lwip_zerocopy_done : NULL, sock);
+      }
+      break;
+#endif /* LWIP_SO_ZEROCOPY */
 #if LWIP_UDP
     case SO_NO_CHECK:
       LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_UDP);
@@ -2169,6 +3617,17 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
         udp_setflags(sock->conn->pcb.udp, udp_flags(sock->conn->pcb.udp) & ~UDP_FLAGS_NOCHKSUM);
       }
       break;
+#if LWIP_UDP_REUSEPORT
+    case SO_REUSEPORT:
+      /* must be set before bind() on all sockets sharing the port */
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_UDP);
+      if (*(const int*)optval) {
+        udp_setflags(sock->conn->pcb.udp, udp_flags(sock->conn->pcb.udp) | UDP_FLAGS_REUSEPORT);
+      } else {
+        udp_setflags(sock->conn->pcb.udp, udp_flags(sock->conn->pcb.udp) & ~UDP_FLAGS_REUSEPORT);
+      }
+      break;
+#endif /* LWIP_UDP_REUSEPORT */
 #endif /* LWIP_UDP */
     default:
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n",
@@ -2257,8 +3716,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
 #if LWIP_TCP
 /* Level: IPPROTO_TCP */
   case IPPROTO_TCP:
-    /* Special case: all IPPROTO_TCP option take an int */
-    LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_TCP);
+    /* Special case: all IPPROTO_TCP option take an int (but TCP_CONGESTION) */
+    if (optname == TCP_CONGESTION) {
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, char, NETCONN_TCP);
+    } else {
+      LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_TCP);
+    }
     switch (optname) {
     case TCP_NODELAY:
       if (*(const int*)optval) {
@@ -2292,12 +3755,28 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
                   s, sock->conn->pcb.tcp->keep_cnt));
       break;
 #endif /* LWIP_TCP_KEEPALIVE */
+    case TCP_CONGESTION:
+      {
+        /* the name need not be NUL-terminated */
+        char name[TCP_CC_NAME_MAX];
+        size_t len = LWIP_MIN(optlen, sizeof(name) - 1);
+        MEMCPY(name, optval, len);
+        name[len] = 0;
+        if (tcp_set_congestion(sock->conn->pcb.tcp, name) != ERR_OK) {
+          err = ENOENT;
+        }
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_CONGESTION) -> %s\n",
+                    s, name));
+      }
+      break;
     default:
       LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, UNIMPL: optname=0x%x, ..)\n",
                   s, optname));
       err = ENOPROTOOPT;
       break;
     }  /* switch (optname) */
+    /* keepalive settings may have changed */
+    tcp_timers_touch(sock->conn->pcb.tcp);
     break;
 #endif /* LWIP_TCP*/
 
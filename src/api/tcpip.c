@@ -44,9 +44,11 @@
 #include "lwip/memp.h"
 #include "lwip/mem.h"
 #include "lwip/pbuf.h"
+#include "lwip/stats.h"
 #include "lwip/tcpip.h"
 #include "lwip/init.h"
 #include "lwip/ip.h"
+#include "lwip/ip4_gro.h"
 #include "netif/etharp.h"
 #include "netif/ppp/pppoe.h"
 #include "netif/ppp/pppos.h"
@@ -62,10 +64,200 @@ static void *tcpip_init_done_arg;
 static sys_mbox_t mbox;
 
 #if LWIP_TCPIP_CORE_LOCKING
-/** The global semaphore to lock the stack. */
-sys_mutex_t lock_tcpip_core;
+/** A thread waiting for the core lock */
+struct tcpip_core_waiter {
+  struct tcpip_core_waiter *next;
+  sys_sem_t sem;
+  /** slots only: a thread waits with this slot */
+  u8_t used;
+  /** slots only: sem has been created */
+  u8_t sem_valid;
+};
+
+/** The global lock of the stack: set while a thread owns it */
+static u8_t core_locked;
+/** Threads waiting for the lock, in the order they asked for it */
+static struct tcpip_core_waiter *core_waiters_head;
+static struct tcpip_core_waiter *core_waiters_tail;
+/** Waiter slots: their semaphores are created once and kept, so a contended
+    lock does not create and free a semaphore */
+static struct tcpip_core_waiter core_waiter_slots[LWIP_TCPIP_CORE_LOCK_SLOTS];
+
+/** Append a waiter to the queue. Must be called with SYS_ARCH protected. */
+static void
+tcpip_core_enqueue(struct tcpip_core_waiter *waiter)
+{
+  waiter->next = NULL;
+  if (core_waiters_tail != NULL) {
+    core_waiters_tail->next = waiter;
+  } else {
+    core_waiters_head = waiter;
+  }
+  core_waiters_tail = waiter;
+  SYS_STATS_INC(core_lock.contended);
+  SYS_STATS_INC(core_lock.waiting);
+#if SYS_STATS
+  if (lwip_stats.sys.core_lock.waiting > lwip_stats.sys.core_lock.max_waiting) {
+    lwip_stats.sys.core_lock.max_waiting = lwip_stats.sys.core_lock.waiting;
+  }
+#endif /* SYS_STATS */
+}
+
+/** Give back a waiter: a slot keeps its semaphore for the next waiter */
+static void
+tcpip_core_waiter_done(struct tcpip_core_waiter *waiter)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if ((waiter >= &core_waiter_slots[0]) &&
+      (waiter < &core_waiter_slots[LWIP_TCPIP_CORE_LOCK_SLOTS])) {
+    SYS_ARCH_PROTECT(lev);
+    waiter->used = 0;
+    SYS_ARCH_UNPROTECT(lev);
+  } else {
+    sys_sem_free(&waiter->sem);
+  }
+}
+
+/**
+ * Take the global lock of the stack (LOCK_TCPIP_CORE()).
+ *
+ * An uncontended lock only takes SYS_ARCH_PROTECT. A thread finding the lock
+ * taken queues itself and sleeps on a semaphore; tcpip_core_unlock() then
+ * passes ownership to the first waiter directly, so the lock is granted in
+ * FIFO order and a thread that releases and re-takes it in a loop (like
+ * tcpip_thread) cannot starve the others.
+ * Waiters use the semaphores of LWIP_TCPIP_CORE_LOCK_SLOTS slots, which are
+ * created on first use and kept; only a thread finding all slots in use
+ * creates (and frees) a semaphore of its own.
+ */
+void
+tcpip_core_lock(void)
+{
+  struct tcpip_core_waiter own;
+  struct tcpip_core_waiter *waiter = NULL;
+  u8_t i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  SYS_STATS_INC(core_lock.acquired);
+  if (!core_locked) {
+    core_locked = 1;
+    SYS_ARCH_UNPROTECT(lev);
+    return;
+  }
+  for (i = 0; i < LWIP_TCPIP_CORE_LOCK_SLOTS; i++) {
+    if (!core_waiter_slots[i].used) {
+      waiter = &core_waiter_slots[i];
+      waiter->used = 1;
+      break;
+    }
+  }
+  if ((waiter != NULL) && waiter->sem_valid) {
+    /* the usual case: queue with the semaphore of the slot */
+    tcpip_core_enqueue(waiter);
+    SYS_ARCH_UNPROTECT(lev);
+  } else {
+    SYS_ARCH_UNPROTECT(lev);
+
+    if (waiter == NULL) {
+      waiter = &own;
+    }
+    if (sys_sem_new(&waiter->sem, 0) != ERR_OK) {
+      LWIP_ASSERT("tcpip_core_lock: failed to create semaphore", 0);
+      if (waiter != &own) {
+        SYS_ARCH_PROTECT(lev);
+        waiter->used = 0;
+        SYS_ARCH_UNPROTECT(lev);
+      }
+      /* cannot queue: poll for the lock instead */
+      for (;;) {
+        SYS_ARCH_PROTECT(lev);
+        if (!core_locked) {
+          core_locked = 1;
+          SYS_ARCH_UNPROTECT(lev);
+          return;
+        }
+        SYS_ARCH_UNPROTECT(lev);
+        sys_msleep(1);
+      }
+    }
+    if (waiter != &own) {
+      waiter->sem_valid = 1;
+    }
+
+    SYS_ARCH_PROTECT(lev);
+    if (!core_locked) {
+      /* released while the semaphore was created */
+      core_locked = 1;
+      SYS_ARCH_UNPROTECT(lev);
+      tcpip_core_waiter_done(waiter);
+      return;
+    }
+    tcpip_core_enqueue(waiter);
+    SYS_ARCH_UNPROTECT(lev);
+  }
+
+  /* tcpip_core_unlock() hands the lock over without releasing it */
+  sys_arch_sem_wait(&waiter->sem, 0);
+  tcpip_core_waiter_done(waiter);
+}
+
+/**
+ * Release the global lock of the stack (UNLOCK_TCPIP_CORE()), handing it
+ * to the first waiting thread if there is one.
+ */
+void
+tcpip_core_unlock(void)
+{
+  struct tcpip_core_waiter *waiter;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  LWIP_ASSERT("tcpip_core_unlock: not locked", core_locked);
+  waiter = core_waiters_head;
+  if (waiter != NULL) {
+    core_waiters_head = waiter->next;
+    if (core_waiters_head == NULL) {
+      core_waiters_tail = NULL;
+    }
+    SYS_STATS_DEC(core_lock.waiting);
+  } else {
+    core_locked = 0;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (waiter != NULL) {
+    sys_sem_signal(&waiter->sem);
+  }
+}
 #endif /* LWIP_TCPIP_CORE_LOCKING */
 
+#if IP_GRO && !LWIP_TCPIP_CORE_LOCKING_INPUT
+/**
+ * Fetch the next message for tcpip_thread. While GRO holds received
+ * packets, only messages already in the mbox are taken (at most
+ * IP_GRO_MAX_BATCH in a row): the held packets are passed on before waiting.
+ */
+static void
+tcpip_gro_fetch(struct tcpip_msg **msg)
+{
+  static u16_t batch;
+
+  if (ip4_gro_pending()) {
+    if ((++batch < IP_GRO_MAX_BATCH) &&
+        (sys_mbox_tryfetch(&mbox, (void **)msg) != SYS_MBOX_EMPTY)) {
+      return;
+    }
+    LOCK_TCPIP_CORE();
+    ip4_gro_flush();
+    UNLOCK_TCPIP_CORE();
+  }
+  batch = 0;
+  sys_timeouts_mbox_fetch(&mbox, (void **)msg);
+}
+#endif /* IP_GRO && !LWIP_TCPIP_CORE_LOCKING_INPUT */
+
 
 /**
  * The main lwIP thread. This thread has exclusive access to lwIP core functions
@@ -92,7 +284,11 @@ tcpip_thread(void *arg)
     UNLOCK_TCPIP_CORE();
     LWIP_TCPIP_THREAD_ALIVE();
     /* wait for a message, timeouts are processed while waiting */
+#if IP_GRO && !LWIP_TCPIP_CORE_LOCKING_INPUT
+    tcpip_gro_fetch(&msg);
+#else /* IP_GRO && !LWIP_TCPIP_CORE_LOCKING_INPUT */
     sys_timeouts_mbox_fetch(&mbox, (void **)&msg);
+#endif /* IP_GRO && !LWIP_TCPIP_CORE_LOCKING_INPUT */
     LOCK_TCPIP_CORE();
     if (msg == NULL) {
       LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: invalid message: NULL\n"));
@@ -110,6 +306,10 @@ tcpip_thread(void *arg)
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
     case TCPIP_MSG_INPKT:
       LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: PACKET %p\n", (void *)msg));
+#if IP_GRO
+      /* merge with the following packets, see tcpip_gro_fetch() */
+      ip4_gro_start();
+#endif /* IP_GRO */
 #if LWIP_ETHERNET
       if (msg->msg.inp.netif->flags & (NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET)) {
         ethernet_input(msg->msg.inp.p, msg->msg.inp.netif);
@@ -562,12 +762,6 @@ tcpip_init(tcpip_init_done_fn initfunc, void *arg)
   if(sys_mbox_new(&mbox, TCPIP_MBOX_SIZE) != ERR_OK) {
     LWIP_ASSERT("failed to create tcpip_thread mbox", 0);
   }
-#if LWIP_TCPIP_CORE_LOCKING
-  if(sys_mutex_new(&lock_tcpip_core) != ERR_OK) {
-    LWIP_ASSERT("failed to create lock_tcpip_core", 0);
-  }
-#endif /* LWIP_TCPIP_CORE_LOCKING */
-
   sys_thread_new(TCPIP_THREAD_NAME, tcpip_thread, NULL, TCPIP_THREAD_STACKSIZE, TCPIP_THREAD_PRIO);
 }
 
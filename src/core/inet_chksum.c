@@ -52,7 +52,7 @@
  * #define LWIP_CHKSUM <your_checksum_routine> 
  *
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4 (x86-64 SSE2/AVX2 only).
  */
 
 #ifndef LWIP_CHKSUM
@@ -259,6 +259,348 @@ lwip_standard_chksum(const void *dataptr, int len)
 }
 #endif
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* SIMD version #4 */
+/*
+ * x86-64 version: the bulk of the data is summed as 32-bit words into 64-bit
+ * accumulators (no carries to handle) by an SSE2 or AVX2 kernel. The kernel
+ * is selected at runtime (CPUID) on the first call, or by calling
+ * lwip_chksum_set_impl(). Needs GCC or clang.
+ */
+#if !defined(__x86_64__) || !defined(__GNUC__)
+#error "LWIP_CHKSUM_ALGORITHM 4 needs x86-64 and GCC or clang"
+#endif
+#include <immintrin.h>
+
+typedef unsigned long long chksum_acc_t;
+/** Bulk kernel: sums 'len' bytes (a multiple of 32) as 32-bit words */
+typedef chksum_acc_t (*lwip_chksum_bulk_fn)(const u8_t *pb, int len);
+
+/** Add 32-bit words (len must be a multiple of 4) to 'sum' */
+static chksum_acc_t
+lwip_chksum_add_words(const u8_t *pb, int len, chksum_acc_t sum)
+{
+  u32_t w0, w1;
+
+  while (len >= 8) {
+    memcpy(&w0, pb, sizeof(w0));
+    memcpy(&w1, pb + 4, sizeof(w1));
+    sum += w0;
+    sum += w1;
+    pb += 8;
+    len -= 8;
+  }
+  if (len >= 4) {
+    memcpy(&w0, pb, sizeof(w0));
+    sum += w0;
+  }
+  return sum;
+}
+
+static chksum_acc_t
+lwip_chksum_bulk_scalar(const u8_t *pb, int len)
+{
+  return lwip_chksum_add_words(pb, len, 0);
+}
+
+static chksum_acc_t
+lwip_chksum_bulk_sse2(const u8_t *pb, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero;
+  chksum_acc_t res[2];
+
+  for (; len > 0; len -= 32, pb += 32) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(const void *)pb);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(const void *)(pb + 16));
+    /* zero-extend the 32-bit words to 64 bits and add them up */
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+  }
+  acc0 = _mm_add_epi64(acc0, acc1);
+  _mm_storeu_si128((__m128i *)(void *)res, acc0);
+  return res[0] + res[1];
+}
+
+__attribute__((target("avx2")))
+static chksum_acc_t
+lwip_chksum_bulk_avx2(const u8_t *pb, int len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero;
+  __m128i acc;
+  chksum_acc_t res[2];
+
+  if (len & 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)pb);
+    acc0 = _mm256_unpacklo_epi32(v, zero);
+    acc1 = _mm256_unpackhi_epi32(v, zero);
+    pb += 32;
+    len -= 32;
+  }
+  for (; len > 0; len -= 64, pb += 64) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(const void *)pb);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(const void *)(pb + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+  }
+  acc0 = _mm256_add_epi64(acc0, acc1);
+  acc = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+  _mm_storeu_si128((__m128i *)(void *)res, acc);
+  return res[0] + res[1];
+}
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+/** Copy kernel: copies and sums 'len' bytes (a multiple of 32) in one pass */
+typedef chksum_acc_t (*lwip_chksum_copy_bulk_fn)(u8_t *dst, const u8_t *src, int len);
+
+/** Copy and add 32-bit words (len must be a multiple of 4) to 'sum' */
+static chksum_acc_t
+lwip_chksum_copy_words(u8_t *dst, const u8_t *src, int len, chksum_acc_t sum)
+{
+  u32_t w;
+
+  for (; len >= 4; len -= 4, src += 4, dst += 4) {
+    memcpy(&w, src, sizeof(w));
+    memcpy(dst, &w, sizeof(w));
+    sum += w;
+  }
+  return sum;
+}
+
+static chksum_acc_t
+lwip_chksum_copy_bulk_scalar(u8_t *dst, const u8_t *src, int len)
+{
+  return lwip_chksum_copy_words(dst, src, len, 0);
+}
+
+static chksum_acc_t
+lwip_chksum_copy_bulk_sse2(u8_t *dst, const u8_t *src, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero;
+  chksum_acc_t res[2];
+
+  for (; len > 0; len -= 32, src += 32, dst += 32) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(const void *)src);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(const void *)(src + 16));
+    _mm_storeu_si128((__m128i *)(void *)dst, v0);
+    _mm_storeu_si128((__m128i *)(void *)(dst + 16), v1);
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+  }
+  acc0 = _mm_add_epi64(acc0, acc1);
+  _mm_storeu_si128((__m128i *)(void *)res, acc0);
+  return res[0] + res[1];
+}
+
+__attribute__((target("avx2")))
+static chksum_acc_t
+lwip_chksum_copy_bulk_avx2(u8_t *dst, const u8_t *src, int len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero;
+  __m128i acc;
+  chksum_acc_t res[2];
+
+  if (len & 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)src);
+    _mm256_storeu_si256((__m256i *)(void *)dst, v);
+    acc0 = _mm256_unpacklo_epi32(v, zero);
+    acc1 = _mm256_unpackhi_epi32(v, zero);
+    src += 32;
+    dst += 32;
+    len -= 32;
+  }
+  for (; len > 0; len -= 64, src += 64, dst += 64) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(const void *)src);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(const void *)(src + 32));
+    _mm256_storeu_si256((__m256i *)(void *)dst, v0);
+    _mm256_storeu_si256((__m256i *)(void *)(dst + 32), v1);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+  }
+  acc0 = _mm256_add_epi64(acc0, acc1);
+  acc = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+  _mm_storeu_si128((__m128i *)(void *)res, acc);
+  return res[0] + res[1];
+}
+
+/** The copy kernel in use, NULL until selected */
+static lwip_chksum_copy_bulk_fn lwip_chksum_copy_bulk;
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
+
+/** The kernel in use, NULL until selected */
+static lwip_chksum_bulk_fn lwip_chksum_bulk;
+
+/**
+ * Select the kernel used by lwip_standard_chksum() (and by lwip_chksum_copy()
+ * for LWIP_CHKSUM_COPY_ALGORITHM 2).
+ *
+ * @param impl one of LWIP_CHKSUM_IMPL_*. LWIP_CHKSUM_IMPL_AUTO selects the
+ *        fastest kernel supported by the CPU.
+ * @return the kernel selected (a kernel not supported by the CPU is replaced
+ *         by the next slower one)
+ */
+u8_t
+lwip_chksum_set_impl(u8_t impl)
+{
+  __builtin_cpu_init();
+  if ((impl == LWIP_CHKSUM_IMPL_AUTO) || (impl == LWIP_CHKSUM_IMPL_AVX2)) {
+    impl = __builtin_cpu_supports("avx2") ? LWIP_CHKSUM_IMPL_AVX2 : LWIP_CHKSUM_IMPL_SSE2;
+  }
+  switch (impl) {
+    case LWIP_CHKSUM_IMPL_AVX2:
+      lwip_chksum_bulk = lwip_chksum_bulk_avx2;
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+      lwip_chksum_copy_bulk = lwip_chksum_copy_bulk_avx2;
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
+      break;
+    case LWIP_CHKSUM_IMPL_SSE2:
+      lwip_chksum_bulk = lwip_chksum_bulk_sse2;
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+      lwip_chksum_copy_bulk = lwip_chksum_copy_bulk_sse2;
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
+      break;
+    default:
+      impl = LWIP_CHKSUM_IMPL_SCALAR;
+      lwip_chksum_bulk = lwip_chksum_bulk_scalar;
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+      lwip_chksum_copy_bulk = lwip_chksum_copy_bulk_scalar;
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
+      break;
+  }
+  return impl;
+}
+
+/**
+ * lwip checksum
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+u16_t
+lwip_standard_chksum(const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  u16_t t = 0;
+  chksum_acc_t sum = 0;
+  u32_t sum32;
+  int bulk;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t)pb & 1);
+
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pb++;
+    len--;
+  }
+
+  if (lwip_chksum_bulk == NULL) {
+    lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AUTO);
+  }
+  bulk = len & ~31;
+  if (bulk > 0) {
+    sum = lwip_chksum_bulk(pb, bulk);
+    pb += bulk;
+    len -= bulk;
+  }
+  sum = lwip_chksum_add_words(pb, len & ~3, sum);
+  pb += len & ~3;
+  len &= 3;
+
+  /* 16-bit word remaining? */
+  if (len > 1) {
+    u16_t w;
+    memcpy(&w, pb, sizeof(w));
+    sum += w;
+    pb += 2;
+    len -= 2;
+  }
+
+  /* dangling tail byte remaining? */
+  if (len > 0) {                /* include odd byte */
+    ((u8_t *)&t)[0] = *pb;
+  }
+
+  sum += t;                     /* add end bytes */
+
+  /* Fold 64-bit sum to 16 bits */
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum32 = (u32_t)sum;
+  sum32 = FOLD_U32T(sum32);
+  sum32 = FOLD_U32T(sum32);
+
+  if (odd) {
+    sum32 = SWAP_BYTES_IN_WORD(sum32);
+  }
+
+  return (u16_t)sum32;
+}
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+/**
+ * Copy data like MEMCPY and return its lwip checksum, reading the data
+ * only once (see LWIP_CHKSUM_COPY_ALGORITHM 2 below).
+ */
+u16_t
+lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *pd = (u8_t *)dst;
+  const u8_t *ps = (const u8_t *)src;
+  u16_t t = 0;
+  chksum_acc_t sum = 0;
+  u32_t sum32;
+  int bulk, n = len;
+
+  if (lwip_chksum_copy_bulk == NULL) {
+    lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AUTO);
+  }
+  bulk = n & ~31;
+  if (bulk > 0) {
+    sum = lwip_chksum_copy_bulk(pd, ps, bulk);
+    pd += bulk;
+    ps += bulk;
+    n -= bulk;
+  }
+  sum = lwip_chksum_copy_words(pd, ps, n & ~3, sum);
+  pd += n & ~3;
+  ps += n & ~3;
+  n &= 3;
+
+  if (n > 1) {
+    u16_t w;
+    memcpy(&w, ps, sizeof(w));
+    memcpy(pd, &w, sizeof(w));
+    sum += w;
+    pd += 2;
+    ps += 2;
+    n -= 2;
+  }
+  if (n > 0) {
+    *pd = *ps;
+    ((u8_t *)&t)[0] = *ps;
+  }
+  sum += t;
+
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum = (sum >> 32) + (sum & 0xffffffffUL);
+  sum32 = (u32_t)sum;
+  sum32 = FOLD_U32T(sum32);
+  sum32 = FOLD_U32T(sum32);
+  return (u16_t)sum32;
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
+#endif
+
 /** Parts of the pseudo checksum which are common to IPv4 and IPv6 */
 static u16_t
 inet_cksum_pseudo_base(struct pbuf *p, u8_t proto, u16_t proto_len, u32_t acc)
@@ -611,3 +953,55 @@ lwip_chksum_copy(void *dst, const void *src, u16_t len)
   return LWIP_CHKSUM(dst, len);
 }
 #endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 1) */
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2) && (LWIP_CHKSUM_ALGORITHM != 4) /* Version #2 */
+/** Single pass: the data is summed as 32-bit words while it is copied, so
+ * it is read only once. The result is the same as for version #1: the sum
+ * is taken relative to the start of the data, so neither 'src' nor 'dst'
+ * need to be aligned. (LWIP_CHKSUM_ALGORITHM 4 has its own SIMD version
+ * of this, see above.)
+ */
+u16_t
+lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *pd = (u8_t *)dst;
+  const u8_t *ps = (const u8_t *)src;
+  u32_t sum = 0, w, tmp;
+  u16_t t = 0;
+
+  while (len > 3) {
+    SMEMCPY(&w, ps, sizeof(w));
+    SMEMCPY(pd, &w, sizeof(w));
+    tmp = sum + w;
+    if (tmp < w) {
+      tmp++;                    /* add back carry */
+    }
+    sum = tmp;
+    ps += 4;
+    pd += 4;
+    len -= 4;
+  }
+
+  /* make room in upper bits */
+  sum = FOLD_U32T(sum);
+
+  if (len > 1) {
+    u16_t h;
+    SMEMCPY(&h, ps, sizeof(h));
+    SMEMCPY(pd, &h, sizeof(h));
+    sum += h;
+    ps += 2;
+    pd += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    *pd = *ps;
+    ((u8_t *)&t)[0] = *ps;
+  }
+  sum += t;
+
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+  return (u16_t)sum;
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) && (LWIP_CHKSUM_ALGORITHM != 4) */
@@ -74,6 +74,24 @@
 #if (!LWIP_UDP && LWIP_UDPLITE)
   #error "If you want to use UDP Lite, you have to define LWIP_UDP=1 in your lwipopts.h"
 #endif
+#if (!LWIP_CHECKSUM_ON_COPY && LWIP_CHECKSUM_ON_COPY_RX)
+  #error "If you want to use LWIP_CHECKSUM_ON_COPY_RX, you have to define LWIP_CHECKSUM_ON_COPY=1 in your lwipopts.h"
+#endif
+#if (!LWIP_TCP && IP_GRO)
+  #error "If you want to use IP_GRO, you have to define LWIP_TCP=1 in your lwipopts.h"
+#endif
+#if MEMP_MAGAZINES && (MEMP_MEM_MALLOC || !defined(MEMP_MAGAZINES_GET))
+  #error "If you want to use MEMP_MAGAZINES, you have to define MEMP_MEM_MALLOC=0 and MEMP_MAGAZINES_GET() in your lwipopts.h"
+#endif
+#if MEM_USE_TLSF && (MEM_LIBC_MALLOC || MEM_USE_POOLS)
+  #error "MEM_USE_TLSF replaces the lwIP heap: you have to define MEM_LIBC_MALLOC=0 and MEM_USE_POOLS=0 in your lwipopts.h"
+#endif
+#if MEMP_LOCKFREE && (MEMP_MEM_MALLOC || MEMP_SANITY_CHECK || (MEMP_OVERFLOW_CHECK >= 2))
+  #error "If you want to use MEMP_LOCKFREE, you have to define MEMP_MEM_MALLOC=0, MEMP_SANITY_CHECK=0 and MEMP_OVERFLOW_CHECK<2 in your lwipopts.h"
+#endif
+#if MEMP_LOCKFREE && !defined(SYS_ARCH_CAS_U32)
+  #error "If you want to use MEMP_LOCKFREE, you have to define SYS_ARCH_CAS_U32 in your sys_arch.h"
+#endif
 #if (!LWIP_UDP && LWIP_DHCP)
   #error "If you want to use DHCP, you have to define LWIP_UDP=1 in your lwipopts.h"
 #endif
@@ -115,7 +133,7 @@
   #error "If you want to use Sequential API, you have to define MEMP_NUM_TCPIP_MSG_API>=1 in your lwipopts.h"
 #endif
 /* There must be sufficient timeouts, taking into account requirements of the subsystems. */
-#if LWIP_TIMERS && (MEMP_NUM_SYS_TIMEOUT < (LWIP_TCP + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + PPP_SUPPORT + (LWIP_IPV6 ? (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD) : 0)))
+#if LWIP_TIMERS && (MEMP_NUM_SYS_TIMEOUT < (LWIP_TCP + (LWIP_TCP && LWIP_TCP_RTT_MS) + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + PPP_SUPPORT + (LWIP_IPV6 ? (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD) : 0)))
   #error "MEMP_NUM_SYS_TIMEOUT is too low to accomodate all required timeouts"
 #endif
 #if (IP_REASSEMBLY && (MEMP_NUM_REASSDATA > IP_REASS_MAX_PBUFS))
@@ -149,12 +167,21 @@
 #if (LWIP_TCP && ((TCP_MAXRTX > 12) || (TCP_SYNMAXRTX > 12)))
   #error "If you want to use TCP, TCP_MAXRTX and TCP_SYNMAXRTX must less or equal to 12 (due to tcp_backoff table), so, you have to reduce them in your lwipopts.h"
 #endif
+#if (LWIP_TCP && ((LWIP_TCP_CC_BBR && (TCP_CC_PRIV_WORDS < 12)) || (LWIP_TCP_CC_CUBIC && (TCP_CC_PRIV_WORDS < 5))))
+  #error "TCP_CC_PRIV_WORDS is too small for the congestion control modules enabled in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RACK && (!LWIP_TCP_SACK || !LWIP_TCP_RTT_MS))
+  #error "LWIP_TCP_RACK needs LWIP_TCP_SACK and LWIP_TCP_RTT_MS, so you have to enable them in your lwipopts.h"
+#endif
 #if (LWIP_TCP && TCP_LISTEN_BACKLOG && ((TCP_DEFAULT_LISTEN_BACKLOG < 0) || (TCP_DEFAULT_LISTEN_BACKLOG > 0xff)))
   #error "If you want to use TCP backlog, TCP_DEFAULT_LISTEN_BACKLOG must fit into an u8_t"
 #endif
 #if (LWIP_NETIF_API && (NO_SYS==1))
   #error "If you want to use NETIF API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
+#if (LWIP_SO_ZEROCOPY && !LWIP_TCP)
+  #error "If you want to use LWIP_SO_ZEROCOPY, you have to define LWIP_TCP=1 in your lwipopts.h"
+#endif
 #if ((LWIP_SOCKET || LWIP_NETCONN) && (NO_SYS==1))
   #error "If you want to use Sequential API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
@@ -215,6 +242,9 @@
 #if LWIP_TCPIP_CORE_LOCKING_INPUT && !LWIP_TCPIP_CORE_LOCKING
   #error "When using LWIP_TCPIP_CORE_LOCKING_INPUT, LWIP_TCPIP_CORE_LOCKING must be enabled, too"
 #endif
+#if LWIP_TCPIP_CORE_LOCKING && NO_SYS
+  #error "LWIP_TCPIP_CORE_LOCKING needs NO_SYS=0 (it locks against tcpip_thread)"
+#endif
 #if LWIP_TCP && LWIP_NETIF_TX_SINGLE_PBUF && !TCP_OVERSIZE
   #error "LWIP_NETIF_TX_SINGLE_PBUF needs TCP_OVERSIZE enabled to create single-pbuf TCP packets"
 #endif
@@ -228,6 +258,12 @@
 #if NETCONN_MORE != TCP_WRITE_FLAG_MORE
   #error "NETCONN_MORE != TCP_WRITE_FLAG_MORE"
 #endif
+#if LWIP_SO_ZEROCOPY && ((NETCONN_ZEROCOPY & (TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE)) != 0)
+  #error "NETCONN_ZEROCOPY must not overlap with TCP_WRITE_FLAG_*"
+#endif
+#if LWIP_SO_ZEROCOPY && ((LWIP_SO_ZEROCOPY_PENDING < 1) || (LWIP_SO_ZEROCOPY_PENDING > 255))
+  #error "LWIP_SO_ZEROCOPY_PENDING must be in the range 1..255"
+#endif
 #endif /* LWIP_NETCONN && LWIP_TCP */ 
 #if LWIP_SOCKET
 /* Check that the SO_* socket options and SOF_* lwIP-internal flags match */
@@ -46,6 +46,7 @@
 #include "lwip/def.h"
 #include "lwip/mem.h"
 #include "lwip/ip_frag.h"
+#include "lwip/ip4_gro.h"
 #include "lwip/inet_chksum.h"
 #include "lwip/netif.h"
 #include "lwip/icmp.h"
@@ -392,6 +393,13 @@ ip4_input(struct pbuf *p, struct netif *inp)
   int check_ip_src = 1;
 #endif /* IP_ACCEPT_LINK_LAYER_ADDRESSING || LWIP_IGMP */
 
+#if IP_GRO
+  if (ip4_gro_receive(p, inp)) {
+    /* held for merging with the following segments */
+    return ERR_OK;
+  }
+#endif /* IP_GRO */
+
   IP_STATS_INC(ip.recv);
   snmp_inc_ipinreceives();
 
@@ -718,6 +726,86 @@ ip4_input(struct pbuf *p, struct netif *inp)
   return ERR_OK;
 }
 
+#if LWIP_NETIF_OFFLOAD
+/**
+ * Software GSO: cut a TCP GSO packet (see struct pbuf) into segments of
+ * p->gso_size data bytes and send them one by one. The segments reference
+ * the data of p (pbuf_alloc_offload_ref(), so a netif may queue them) and
+ * leave their checksum to ip4_output_if_src() or the netif.
+ */
+static err_t
+ip4_gso_output(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *dest,
+               u8_t ttl, u8_t tos, u8_t proto, struct netif *netif,
+               void *ip_options, u16_t optlen)
+{
+  struct tcp_hdr *tcphdr = (struct tcp_hdr *)p->payload;
+  struct tcp_hdr *seghdr;
+  struct pbuf *seg, *q, *r;
+  u16_t hdrlen, left, len, n, chunk, offset;
+  u32_t seqno, acc;
+  err_t err = ERR_OK;
+
+  LWIP_ASSERT("GSO is only supported for TCP", proto == IP_PROTO_TCP);
+  hdrlen = (u16_t)(TCPH_HDRLEN(tcphdr) * 4);
+  LWIP_ASSERT("TCP header must be in the first pbuf", p->len >= hdrlen);
+  seqno = ntohl(tcphdr->seqno);
+  left = (u16_t)(p->tot_len - hdrlen);
+  q = p;
+  offset = hdrlen;
+
+  while ((left > 0) && (err == ERR_OK)) {
+    len = LWIP_MIN(left, p->gso_size);
+    seg = pbuf_alloc(PBUF_IP, hdrlen, PBUF_RAM);
+    if (seg == NULL) {
+      err = ERR_MEM;
+      break;
+    }
+    seghdr = (struct tcp_hdr *)seg->payload;
+    MEMCPY(seghdr, tcphdr, hdrlen);
+    seghdr->seqno = htonl(seqno);
+    if (left > len) {
+      TCPH_FLAGS_SET(seghdr, TCPH_FLAGS(tcphdr) & ~(TCP_PSH | TCP_FIN));
+    }
+    /* reference the data of this segment */
+    for (n = len; n > 0; n = (u16_t)(n - chunk)) {
+      while (offset >= q->len) {
+        offset = (u16_t)(offset - q->len);
+        q = q->next;
+      }
+      chunk = LWIP_MIN(n, (u16_t)(q->len - offset));
+      r = pbuf_alloc_offload_ref(q, offset, chunk);
+      if (r == NULL) {
+        err = ERR_MEM;
+        break;
+      }
+      pbuf_cat(seg, r);
+      offset = (u16_t)(offset + chunk);
+    }
+    if (err == ERR_OK) {
+      /* add the length to the pseudo header sum */
+      acc = (u32_t)tcphdr->chksum + htons((u16_t)(hdrlen + len));
+      acc = FOLD_U32T(acc);
+      seghdr->chksum = (u16_t)FOLD_U32T(acc);
+      seg->flags |= PBUF_FLAG_CSUM_PARTIAL;
+      seg->csum_start = 0;
+      seg->csum_offset = p->csum_offset;
+#if IP_OPTIONS_SEND
+      err = ip4_output_if_opt_src(seg, src, dest, ttl, tos, proto, netif,
+        ip_options, optlen);
+#else /* IP_OPTIONS_SEND */
+      LWIP_UNUSED_ARG(ip_options);
+      LWIP_UNUSED_ARG(optlen);
+      err = ip4_output_if_src(seg, src, dest, ttl, tos, proto, netif);
+#endif /* IP_OPTIONS_SEND */
+    }
+    pbuf_free(seg);
+    seqno += len;
+    left = (u16_t)(left - len);
+  }
+  return err;
+}
+#endif /* LWIP_NETIF_OFFLOAD */
+
 /**
  * Sends an IP packet on a network interface. This function constructs
  * the IP header and calculates the IP header checksum. If the source
@@ -808,6 +896,19 @@ err_t ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_add
 
   LWIP_IP_CHECK_PBUF_REF_COUNT_FOR_TX(p);
 
+#if LWIP_NETIF_OFFLOAD
+  /* segment in software unless the netif does it (not for packets to self) */
+  if ((p->gso_size != 0) && (dest != IP_HDRINCL) &&
+      (!(netif->offload_flags & NETIF_OFFLOAD_TSO) ||
+       ip4_addr_cmp(dest, netif_ip4_addr(netif)) || ip4_addr_isloopback(dest))) {
+#if IP_OPTIONS_SEND
+    return ip4_gso_output(p, src, dest, ttl, tos, proto, netif, ip_options, optlen);
+#else /* IP_OPTIONS_SEND */
+    return ip4_gso_output(p, src, dest, ttl, tos, proto, netif, NULL, 0);
+#endif /* IP_OPTIONS_SEND */
+  }
+#endif /* LWIP_NETIF_OFFLOAD */
+
   snmp_inc_ipoutrequests();
 
   /* Should the IP header be generated or is it already included in p? */
@@ -932,6 +1033,9 @@ err_t ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_add
       ) {
     /* Packet to self, enqueue it for loopback */
     LWIP_DEBUGF(IP_DEBUG, ("netif_loop_output()"));
+#if LWIP_NETIF_OFFLOAD
+    pbuf_offload_chksum(p);
+#endif /* LWIP_NETIF_OFFLOAD */
     return netif_loop_output(netif, p);
   }
 #if LWIP_MULTICAST_TX_OPTIONS
@@ -940,9 +1044,21 @@ err_t ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_add
   }
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
 #endif /* ENABLE_LOOPBACK */
+#if LWIP_NETIF_OFFLOAD
+  /* compute the checksum if the netif can't or the packet is fragmented */
+  if ((p->gso_size == 0) && (p->flags & PBUF_FLAG_CSUM_PARTIAL) &&
+      (!(netif->offload_flags & NETIF_OFFLOAD_CSUM_TCP) ||
+       (netif->mtu && (p->tot_len > netif->mtu)))) {
+    pbuf_offload_chksum(p);
+  }
+#endif /* LWIP_NETIF_OFFLOAD */
 #if IP_FRAG
   /* don't fragment if interface has mtu set to 0 [loopif] */
-  if (netif->mtu && (p->tot_len > netif->mtu)) {
+  if (netif->mtu && (p->tot_len > netif->mtu)
+#if LWIP_NETIF_OFFLOAD
+      && (p->gso_size == 0)
+#endif /* LWIP_NETIF_OFFLOAD */
+      ) {
     return ip4_frag(p, netif, dest);
   }
 #endif /* IP_FRAG */
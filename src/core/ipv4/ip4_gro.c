@@ -0,0 +1,300 @@
+/**
+ * @file
+ * Generic receive offload (GRO) for IPv4 TCP: in-order segments of a flow
+ * received in one batch are merged into one packet before ip4_input().
+ *
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission. 
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT 
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#if IP_GRO /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/ip4_gro.h"
+#include "lwip/ip.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/tcp_impl.h"
+
+#include <string.h>
+
+/**
+ * The GRO code currently has the following limitations:
+ * - only TCP segments with just the ACK (and PSH) flag and without IP
+ *   options are merged, and only if they are addressed to the netif they
+ *   are received on (forwarded packets are never touched)
+ * - segments must carry the same ACK, window and TCP options
+ * - all segments but the last must have an even length
+ *
+ * The TCP checksum of a merged packet is derived from the headers of its
+ * segments. A valid merged checksum only shows that the sum of all segments
+ * is right (errors in two segments can cancel out), so each segment's
+ * checksum is verified before it is held or merged (unless the netif has
+ * disabled NETIF_CHECKSUM_CHECK_TCP): corrupted segments are passed on
+ * unmerged and dropped by tcp_input().
+ */
+
+/** A flow with a held packet */
+struct ip4_gro_flow {
+  /** the held packet (the merged segments), NULL if this slot is free */
+  struct pbuf *p;
+  /** the netif the packet was received on */
+  struct netif *inp;
+  /** sequence number of the next in-order segment */
+  u32_t next_seqno;
+  /** sum of the pseudo and TCP headers of the merged segments */
+  u16_t hdr_sum;
+  /** number of merged segments */
+  u16_t segs;
+};
+
+static struct ip4_gro_flow ip4_gro_flows[IP_GRO_MAX_FLOWS];
+/** != 0 while received packets may be held */
+static u8_t ip4_gro_active;
+/** number of flows with a held packet */
+static u8_t ip4_gro_held;
+/** flow to deliver when a new one is needed and all are used */
+static u8_t ip4_gro_next_evict;
+
+/** Sum of the TCP pseudo header and the TCP header of a segment */
+static u16_t
+ip4_gro_hdr_sum(struct ip_hdr *iphdr, struct tcp_hdr *tcphdr, u16_t tcplen)
+{
+  u32_t acc;
+
+  acc = (u16_t)~inet_chksum(tcphdr, (u16_t)(TCPH_HDRLEN(tcphdr) * 4));
+  /* src and dest are adjacent in the IP header */
+  acc += (u16_t)~inet_chksum(&iphdr->src, 2 * sizeof(ip4_addr_p_t));
+  acc += PP_HTONS(IP_PROTO_TCP);
+  acc += htons(tcplen);
+  acc = FOLD_U32T(acc);
+  return (u16_t)FOLD_U32T(acc);
+}
+
+/** Check the TCP checksum of a segment before it is held or merged */
+static u8_t
+ip4_gro_chksum_ok(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
+{
+#if CHECKSUM_CHECK_TCP
+  IF__NETIF_CHECKSUM_ENABLED(inp, NETIF_CHECKSUM_CHECK_TCP) {
+    ip4_addr_t src, dest;
+    u16_t chksum;
+
+    ip4_addr_copy(src, iphdr->src);
+    ip4_addr_copy(dest, iphdr->dest);
+    pbuf_header(p, -IP_HLEN);
+    chksum = inet_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &src, &dest);
+    pbuf_header(p, IP_HLEN);
+    return chksum == 0;
+  }
+#else /* CHECKSUM_CHECK_TCP */
+  LWIP_UNUSED_ARG(p);
+  LWIP_UNUSED_ARG(iphdr);
+#endif /* CHECKSUM_CHECK_TCP */
+  LWIP_UNUSED_ARG(inp);
+  return 1;
+}
+
+/** Fix the IP and TCP header of a packet merged from several segments and
+ * pass it to ip4_input() */
+static void
+ip4_gro_deliver(struct ip4_gro_flow *flow)
+{
+  struct pbuf *p = flow->p;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  u32_t acc;
+  u8_t active;
+
+  if (p == NULL) {
+    return;
+  }
+  if (flow->segs > 1) {
+    iphdr = (struct ip_hdr *)p->payload;
+    tcphdr = (struct tcp_hdr *)((u8_t *)p->payload + IP_HLEN);
+    IPH_LEN_SET(iphdr, htons(p->tot_len));
+    IPH_CHKSUM_SET(iphdr, 0);
+    IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+    /* the data sum of each segment is minus the sum of its headers, so the
+       merged header only has to make up for the difference */
+    tcphdr->chksum = 0;
+    acc = ip4_gro_hdr_sum(iphdr, tcphdr, (u16_t)(p->tot_len - IP_HLEN));
+    acc += (u16_t)~flow->hdr_sum;
+    acc = FOLD_U32T(acc);
+    tcphdr->chksum = (u16_t)~FOLD_U32T(acc);
+  }
+  LWIP_DEBUGF(IP_DEBUG, ("ip4_gro_deliver: %"U16_F" segments, %"U16_F" bytes\n",
+    flow->segs, p->tot_len));
+
+  flow->p = NULL;
+  ip4_gro_held--;
+  /* don't hold the packet again */
+  active = ip4_gro_active;
+  ip4_gro_active = 0;
+  ip4_input(p, flow->inp);
+  ip4_gro_active = active;
+}
+
+/**
+ * Start holding received TCP segments for merging. They are passed on by
+ * ip4_gro_flush(), which must be called at the end of the batch.
+ */
+void
+ip4_gro_start(void)
+{
+  ip4_gro_active = 1;
+}
+
+/**
+ * Pass all held packets to ip4_input() and stop holding packets.
+ */
+void
+ip4_gro_flush(void)
+{
+  u8_t i;
+
+  ip4_gro_active = 0;
+  for (i = 0; (i < IP_GRO_MAX_FLOWS) && (ip4_gro_held != 0); i++) {
+    ip4_gro_deliver(&ip4_gro_flows[i]);
+  }
+}
+
+/**
+ * @return 1 if packets are held (ip4_gro_flush() has to be called), 0 if not
+ */
+u8_t
+ip4_gro_pending(void)
+{
+  return ip4_gro_held != 0;
+}
+
+/**
+ * Called by ip4_input() for every received packet: hold TCP segments or
+ * merge them with a held segment of the same flow.
+ *
+ * @param p the received IP packet (p->payload points to IP header)
+ * @param inp the netif on which this packet was received
+ * @return 1 if the packet has been taken, 0 if ip4_input() has to process it
+ */
+u8_t
+ip4_gro_receive(struct pbuf *p, struct netif *inp)
+{
+  struct ip_hdr *iphdr, *fiphdr;
+  struct tcp_hdr *tcphdr, *ftcphdr;
+  struct ip4_gro_flow *flow = NULL, *free_flow = NULL;
+  u16_t hdrlen, datalen;
+  u8_t flags, mergeable, i;
+
+  if (!ip4_gro_active || (p->len < IP_HLEN + TCP_HLEN)) {
+    return 0;
+  }
+  iphdr = (struct ip_hdr *)p->payload;
+  if ((IPH_V(iphdr) != 4) || (IPH_HL(iphdr) != IP_HLEN / 4) ||
+      (IPH_PROTO(iphdr) != IP_PROTO_TCP)) {
+    return 0;
+  }
+  tcphdr = (struct tcp_hdr *)((u8_t *)p->payload + IP_HLEN);
+  hdrlen = (u16_t)(TCPH_HDRLEN(tcphdr) * 4);
+  flags = (u8_t)TCPH_FLAGS(tcphdr);
+  /* only complete data segments to us with valid headers are held */
+  mergeable = (hdrlen >= TCP_HLEN) && (p->len >= IP_HLEN + hdrlen) &&
+    (p->tot_len > IP_HLEN + hdrlen) && (ntohs(IPH_LEN(iphdr)) == p->tot_len) &&
+    ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) == 0) &&
+    ((flags & ~TCP_PSH) == TCP_ACK) &&
+    (ip4_addr_get_u32(&iphdr->dest) == ip4_addr_get_u32(netif_ip4_addr(inp))) &&
+    (inet_chksum(iphdr, IP_HLEN) == 0);
+  datalen = (u16_t)(p->tot_len - IP_HLEN - hdrlen);
+
+  for (i = 0; i < IP_GRO_MAX_FLOWS; i++) {
+    if (ip4_gro_flows[i].p == NULL) {
+      if (free_flow == NULL) {
+        free_flow = &ip4_gro_flows[i];
+      }
+      continue;
+    }
+    fiphdr = (struct ip_hdr *)ip4_gro_flows[i].p->payload;
+    ftcphdr = (struct tcp_hdr *)((u8_t *)fiphdr + IP_HLEN);
+    if ((ip4_gro_flows[i].inp == inp) &&
+        (ip4_addr_get_u32(&iphdr->src) == ip4_addr_get_u32(&fiphdr->src)) &&
+        (ip4_addr_get_u32(&iphdr->dest) == ip4_addr_get_u32(&fiphdr->dest)) &&
+        (tcphdr->src == ftcphdr->src) && (tcphdr->dest == ftcphdr->dest)) {
+      flow = &ip4_gro_flows[i];
+      break;
+    }
+  }
+
+  if (flow != NULL) {
+    if (mergeable && (ntohl(tcphdr->seqno) == flow->next_seqno) &&
+        (tcphdr->ackno == ftcphdr->ackno) && (tcphdr->wnd == ftcphdr->wnd) &&
+        (TCPH_HDRLEN(tcphdr) == TCPH_HDRLEN(ftcphdr)) &&
+        (memcmp(tcphdr + 1, ftcphdr + 1, hdrlen - TCP_HLEN) == 0) &&
+        (((flow->p->tot_len - IP_HLEN - hdrlen) & 1) == 0) &&
+        ((u32_t)flow->p->tot_len + datalen <= 0xffff) &&
+        ip4_gro_chksum_ok(p, iphdr, inp)) {
+      /* append the data to the held packet */
+      u32_t acc = flow->hdr_sum;
+      acc += ip4_gro_hdr_sum(iphdr, tcphdr, (u16_t)(hdrlen + datalen));
+      acc = FOLD_U32T(acc);
+      flow->hdr_sum = (u16_t)FOLD_U32T(acc);
+      pbuf_header(p, (s16_t)-(IP_HLEN + hdrlen));
+      pbuf_cat(flow->p, p);
+      flow->next_seqno += datalen;
+      flow->segs++;
+      if (flags & TCP_PSH) {
+        /* the sender wants the data to be delivered */
+        TCPH_SET_FLAG(ftcphdr, TCP_PSH);
+        ip4_gro_deliver(flow);
+      }
+      return 1;
+    }
+    /* keep the segments of the flow in order */
+    ip4_gro_deliver(flow);
+    free_flow = flow;
+  }
+
+  if (!mergeable || (flags & TCP_PSH) || !ip4_gro_chksum_ok(p, iphdr, inp)) {
+    return 0;
+  }
+  if (free_flow == NULL) {
+    free_flow = &ip4_gro_flows[ip4_gro_next_evict];
+    ip4_gro_next_evict = (u8_t)((ip4_gro_next_evict + 1) % IP_GRO_MAX_FLOWS);
+    ip4_gro_deliver(free_flow);
+  }
+  free_flow->p = p;
+  free_flow->inp = inp;
+  free_flow->next_seqno = ntohl(tcphdr->seqno) + datalen;
+  free_flow->hdr_sum = ip4_gro_hdr_sum(iphdr, tcphdr, (u16_t)(hdrlen + datalen));
+  free_flow->segs = 1;
+  ip4_gro_held++;
+  return 1;
+}
+
+#endif /* IP_GRO */
@@ -7,6 +7,9 @@
  * If you want to use the standard C library malloc() instead, define
  * MEM_LIBC_MALLOC to 1 in your lwipopts.h
  *
+ * To get constant-time mem_malloc()/mem_free() from a two-level segregated
+ * fit (TLSF) heap instead of the first-fit heap, define MEM_USE_TLSF to 1.
+ *
  * To let mem_malloc() use pools (prevents fragmentation and is much faster than
  * a heap but might waste some memory), define MEM_USE_POOLS to 1, define
  * MEM_USE_CUSTOM_POOLS to 1 and create a file "lwippools.h" that includes a list
@@ -205,8 +208,10 @@ u8_t ram_heap[MEM_SIZE_ALIGNED + (2U*SIZEOF_STRUCT_MEM) + MEM_ALIGNMENT];
 static u8_t *ram;
 /** the last entry, always unused! */
 static struct mem *ram_end;
+#if !MEM_USE_TLSF
 /** pointer to the lowest free block, this is used for faster search */
 static struct mem *lfree;
+#endif /* !MEM_USE_TLSF */
 
 /** concurrent access protection */
 #if !NO_SYS
@@ -215,7 +220,9 @@ static sys_mutex_t mem_mutex;
 
 #if LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT
 
+#if !MEM_USE_TLSF
 static volatile u8_t mem_free_count;
+#endif /* !MEM_USE_TLSF */
 
 /* Allow mem_free from other (e.g. interrupt) context */
 #define LWIP_MEM_FREE_DECL_PROTECT()  SYS_ARCH_DECL_PROTECT(lev_free)
@@ -239,6 +246,449 @@ static volatile u8_t mem_free_count;
 #endif /* LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT */
 
 
+#if MEM_USE_TLSF
+/* Two-level segregated fit (TLSF): the heap keeps the physical block list of
+ * the first-fit heap below (struct mem, ram_end), but free blocks are also
+ * kept in size-segregated free lists: the first level is the power of two
+ * of the block size, the second level splits that range linearly into
+ * MEM_TLSF_SL_COUNT lists. Two bitmaps record the non-empty lists, so that
+ * mem_malloc() and mem_free() run in constant time (no heap scan). */
+
+/** log2 of the number of second-level lists per first-level range */
+#define MEM_TLSF_SL_LOG2   4
+#define MEM_TLSF_SL_COUNT  (1 << MEM_TLSF_SL_LOG2)
+/** first-level ranges: sizes below MEM_TLSF_SL_COUNT, then one per bit */
+#define MEM_TLSF_FL_COUNT  ((sizeof(mem_size_t) * 8) - MEM_TLSF_SL_LOG2 + 1)
+/** end of a free list (the offset of ram_end is never a free block) */
+#define MEM_TLSF_NONE      MEM_SIZE_ALIGNED
+
+/** Free list links, stored in the data part of a free block */
+struct mem_tlsf_free {
+  mem_size_t next_free;
+  mem_size_t prev_free;
+};
+#define MEM_TLSF_LINKS(ptr) ((struct mem_tlsf_free *)(void *)&ram[(ptr) + SIZEOF_STRUCT_MEM])
+#define MEM_TLSF_MEM(ptr)   ((struct mem *)(void *)&ram[ptr])
+/** data size of the block at offset 'ptr' */
+#define MEM_TLSF_SIZE(ptr)  ((mem_size_t)(MEM_TLSF_MEM(ptr)->next - (ptr) - SIZEOF_STRUCT_MEM))
+
+/** first free block of every list */
+static mem_size_t mem_tlsf_head[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
+/** bit 'fl' is set if any list of first level 'fl' is non-empty */
+static u32_t mem_tlsf_fl_bitmap;
+/** bit 'sl' is set if list [fl][sl] is non-empty */
+static u32_t mem_tlsf_sl_bitmap[MEM_TLSF_FL_COUNT];
+
+/** Index of the least significant bit set in x (x != 0) */
+static u32_t
+mem_tlsf_ffs(u32_t x)
+{
+#if defined(__GNUC__)
+  return (u32_t)__builtin_ctz(x);
+#else
+  u32_t i = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+/** Index of the most significant bit set in x (x != 0) */
+static u32_t
+mem_tlsf_fls(u32_t x)
+{
+#if defined(__GNUC__)
+  return (u32_t)(31 - __builtin_clz(x));
+#else
+  u32_t i = 0;
+  while (x >>= 1) {
+    i++;
+  }
+  return i;
+#endif
+}
+
+/** Calculate the list indices for a block of data size 'size' */
+static void
+mem_tlsf_mapping(u32_t size, u32_t *fl, u32_t *sl)
+{
+  if (size < MEM_TLSF_SL_COUNT) {
+    *fl = 0;
+    *sl = size;
+  } else {
+    u32_t t = mem_tlsf_fls(size);
+    *sl = (size >> (t - MEM_TLSF_SL_LOG2)) - MEM_TLSF_SL_COUNT;
+    *fl = t - MEM_TLSF_SL_LOG2 + 1;
+  }
+}
+
+/** Put the free block at offset 'ptr' into its free list */
+static void
+mem_tlsf_insert(mem_size_t ptr)
+{
+  u32_t fl, sl;
+  struct mem_tlsf_free *links = MEM_TLSF_LINKS(ptr);
+
+  mem_tlsf_mapping(MEM_TLSF_SIZE(ptr), &fl, &sl);
+  links->next_free = mem_tlsf_head[fl][sl];
+  links->prev_free = MEM_TLSF_NONE;
+  if (links->next_free != MEM_TLSF_NONE) {
+    MEM_TLSF_LINKS(links->next_free)->prev_free = ptr;
+  }
+  mem_tlsf_head[fl][sl] = ptr;
+  mem_tlsf_fl_bitmap |= (1UL << fl);
+  mem_tlsf_sl_bitmap[fl] |= (1UL << sl);
+}
+
+/** Take the free block at offset 'ptr' out of its free list */
+static void
+mem_tlsf_remove(mem_size_t ptr)
+{
+  u32_t fl, sl;
+  struct mem_tlsf_free *links = MEM_TLSF_LINKS(ptr);
+
+  mem_tlsf_mapping(MEM_TLSF_SIZE(ptr), &fl, &sl);
+  if (links->next_free != MEM_TLSF_NONE) {
+    MEM_TLSF_LINKS(links->next_free)->prev_free = links->prev_free;
+  }
+  if (links->prev_free != MEM_TLSF_NONE) {
+    MEM_TLSF_LINKS(links->prev_free)->next_free = links->next_free;
+  } else {
+    LWIP_ASSERT("mem_tlsf_remove: block is list head", mem_tlsf_head[fl][sl] == ptr);
+    mem_tlsf_head[fl][sl] = links->next_free;
+    if (links->next_free == MEM_TLSF_NONE) {
+      mem_tlsf_sl_bitmap[fl] &= ~(1UL << sl);
+      if (mem_tlsf_sl_bitmap[fl] == 0) {
+        mem_tlsf_fl_bitmap &= ~(1UL << fl);
+      }
+    }
+  }
+}
+
+/**
+ * Find a free block with at least 'size' bytes of data and take it out of
+ * its free list.
+ *
+ * The size is rounded up to the next list so that every block of the first
+ * non-empty list found via the bitmaps fits. Only if that fails (the heap
+ * is nearly exhausted), the list 'size' itself maps to is searched.
+ *
+ * @return offset of the block or MEM_TLSF_NONE if no block is big enough
+ */
+static mem_size_t
+mem_tlsf_find(mem_size_t size)
+{
+  u32_t fl, sl, map;
+  u32_t rounded = size;
+  mem_size_t ptr;
+
+  if (rounded >= MEM_TLSF_SL_COUNT) {
+    rounded += (1UL << (mem_tlsf_fls(rounded) - MEM_TLSF_SL_LOG2)) - 1;
+  }
+  mem_tlsf_mapping(rounded, &fl, &sl);
+  if (fl < MEM_TLSF_FL_COUNT) {
+    map = mem_tlsf_sl_bitmap[fl] & (~0UL << sl);
+    if (map == 0) {
+      map = (fl + 1 < MEM_TLSF_FL_COUNT) ? (mem_tlsf_fl_bitmap & (~0UL << (fl + 1))) : 0;
+      if (map != 0) {
+        fl = mem_tlsf_ffs(map);
+        map = mem_tlsf_sl_bitmap[fl];
+      }
+    }
+    if (map != 0) {
+      ptr = mem_tlsf_head[fl][mem_tlsf_ffs(map)];
+      mem_tlsf_remove(ptr);
+      return ptr;
+    }
+  }
+  /* last resort: first fit in the list of the exact size */
+  mem_tlsf_mapping(size, &fl, &sl);
+  for (ptr = mem_tlsf_head[fl][sl]; ptr != MEM_TLSF_NONE; ptr = MEM_TLSF_LINKS(ptr)->next_free) {
+    if (MEM_TLSF_SIZE(ptr) >= size) {
+      mem_tlsf_remove(ptr);
+      return ptr;
+    }
+  }
+  return MEM_TLSF_NONE;
+}
+
+/**
+ * Zero the heap and put it into the free lists as one big block
+ */
+void
+mem_init(void)
+{
+  struct mem *mem;
+  u32_t fl, sl;
+
+  LWIP_ASSERT("Sanity check alignment",
+    (SIZEOF_STRUCT_MEM & (MEM_ALIGNMENT-1)) == 0);
+  LWIP_ASSERT("MIN_SIZE too small for the free list links",
+    MIN_SIZE_ALIGNED >= sizeof(struct mem_tlsf_free));
+
+  /* align the heap */
+  ram = (u8_t *)LWIP_MEM_ALIGN(LWIP_RAM_HEAP_POINTER);
+  /* initialize the start of the heap */
+  mem = (struct mem *)(void *)ram;
+  mem->next = MEM_SIZE_ALIGNED;
+  mem->prev = 0;
+  mem->used = 0;
+  /* initialize the end of the heap */
+  ram_end = (struct mem *)(void *)&ram[MEM_SIZE_ALIGNED];
+  ram_end->used = 1;
+  ram_end->next = MEM_SIZE_ALIGNED;
+  ram_end->prev = MEM_SIZE_ALIGNED;
+
+  for (fl = 0; fl < MEM_TLSF_FL_COUNT; fl++) {
+    for (sl = 0; sl < MEM_TLSF_SL_COUNT; sl++) {
+      mem_tlsf_head[fl][sl] = MEM_TLSF_NONE;
+    }
+    mem_tlsf_sl_bitmap[fl] = 0;
+  }
+  mem_tlsf_fl_bitmap = 0;
+  mem_tlsf_insert(0);
+
+  MEM_STATS_AVAIL(avail, MEM_SIZE_ALIGNED);
+
+  if(sys_mutex_new(&mem_mutex) != ERR_OK) {
+    LWIP_ASSERT("failed to create mem_mutex", 0);
+  }
+}
+
+/**
+ * Put a struct mem back on the heap, merging it with free neighbours
+ *
+ * @param rmem is the data portion of a struct mem as returned by a previous
+ *             call to mem_malloc()
+ */
+void
+mem_free(void *rmem)
+{
+  struct mem *mem, *nmem, *pmem;
+  mem_size_t ptr;
+  LWIP_MEM_FREE_DECL_PROTECT();
+
+  if (rmem == NULL) {
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("mem_free(p == NULL) was called.\n"));
+    return;
+  }
+  LWIP_ASSERT("mem_free: sanity check alignment", (((mem_ptr_t)rmem) & (MEM_ALIGNMENT-1)) == 0);
+
+  LWIP_ASSERT("mem_free: legal memory", (u8_t *)rmem >= (u8_t *)ram &&
+    (u8_t *)rmem < (u8_t *)ram_end);
+
+  if ((u8_t *)rmem < (u8_t *)ram || (u8_t *)rmem >= (u8_t *)ram_end) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_free: illegal memory\n"));
+    /* protect mem stats from concurrent access */
+    SYS_ARCH_PROTECT(lev);
+    MEM_STATS_INC(illegal);
+    SYS_ARCH_UNPROTECT(lev);
+    return;
+  }
+  /* protect the heap from concurrent access */
+  LWIP_MEM_FREE_PROTECT();
+  /* Get the corresponding struct mem ... */
+  mem = (struct mem *)(void *)((u8_t *)rmem - SIZEOF_STRUCT_MEM);
+  ptr = (mem_size_t)((u8_t *)mem - ram);
+  /* ... which has to be in a used state ... */
+  LWIP_ASSERT("mem_free: mem->used", mem->used);
+  /* ... and is now unused. */
+  mem->used = 0;
+
+  MEM_STATS_DEC_USED(used, mem->next - ptr);
+
+  /* merge with the next block if that is free */
+  nmem = MEM_TLSF_MEM(mem->next);
+  if (nmem != ram_end && nmem->used == 0) {
+    mem_tlsf_remove(mem->next);
+    mem->next = nmem->next;
+    MEM_TLSF_MEM(nmem->next)->prev = ptr;
+  }
+  /* merge with the previous block if that is free */
+  pmem = MEM_TLSF_MEM(mem->prev);
+  if (pmem != mem && pmem->used == 0) {
+    mem_tlsf_remove(mem->prev);
+    pmem->next = mem->next;
+    MEM_TLSF_MEM(mem->next)->prev = mem->prev;
+    ptr = mem->prev;
+  }
+  mem_tlsf_insert(ptr);
+  LWIP_MEM_FREE_UNPROTECT();
+}
+
+/**
+ * Shrink memory returned by mem_malloc().
+ *
+ * @param rmem pointer to memory allocated by mem_malloc the is to be shrinked
+ * @param newsize required size after shrinking (needs to be smaller than or
+ *                equal to the previous size)
+ * @return for compatibility reasons: is always == rmem, at the moment
+ *         or NULL if newsize is > old size, in which case rmem is NOT touched
+ *         or freed!
+ */
+void *
+mem_trim(void *rmem, mem_size_t newsize)
+{
+  mem_size_t size;
+  mem_size_t ptr, ptr2, next;
+  struct mem *mem, *mem2;
+  /* use the FREE_PROTECT here: it protects with sem OR SYS_ARCH_PROTECT */
+  LWIP_MEM_FREE_DECL_PROTECT();
+
+  /* Expand the size of the allocated memory region so that we can
+     adjust for alignment. */
+  newsize = LWIP_MEM_ALIGN_SIZE(newsize);
+
+  if(newsize < MIN_SIZE_ALIGNED) {
+    /* every data block must be at least MIN_SIZE_ALIGNED long */
+    newsize = MIN_SIZE_ALIGNED;
+  }
+
+  if (newsize > MEM_SIZE_ALIGNED) {
+    return NULL;
+  }
+
+  LWIP_ASSERT("mem_trim: legal memory", (u8_t *)rmem >= (u8_t *)ram &&
+   (u8_t *)rmem < (u8_t *)ram_end);
+
+  if ((u8_t *)rmem < (u8_t *)ram || (u8_t *)rmem >= (u8_t *)ram_end) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("mem_trim: illegal memory\n"));
+    /* protect mem stats from concurrent access */
+    SYS_ARCH_PROTECT(lev);
+    MEM_STATS_INC(illegal);
+    SYS_ARCH_UNPROTECT(lev);
+    return rmem;
+  }
+  /* Get the corresponding struct mem ... */
+  mem = (struct mem *)(void *)((u8_t *)rmem - SIZEOF_STRUCT_MEM);
+  /* ... and its offset pointer */
+  ptr = (mem_size_t)((u8_t *)mem - ram);
+
+  size = mem->next - ptr - SIZEOF_STRUCT_MEM;
+  LWIP_ASSERT("mem_trim can only shrink memory", newsize <= size);
+  if (newsize > size) {
+    /* not supported */
+    return NULL;
+  }
+  if (newsize == size) {
+    /* No change in size, simply return */
+    return rmem;
+  }
+
+  /* protect the heap from concurrent access */
+  LWIP_MEM_FREE_PROTECT();
+
+  mem2 = MEM_TLSF_MEM(mem->next);
+  ptr2 = ptr + SIZEOF_STRUCT_MEM + newsize;
+  if (mem2->used == 0) {
+    /* The next block is free: move its start down to the end of mem */
+    mem_tlsf_remove(mem->next);
+    next = mem2->next;
+  } else if (newsize + SIZEOF_STRUCT_MEM + MIN_SIZE_ALIGNED <= size) {
+    /* Next block is used but there's room for a new free block in between */
+    next = mem->next;
+  } else {
+    /* too small for another block: the remaining space stays unused */
+    LWIP_MEM_FREE_UNPROTECT();
+    return rmem;
+  }
+  mem2 = MEM_TLSF_MEM(ptr2);
+  mem2->used = 0;
+  mem2->next = next;
+  mem2->prev = ptr;
+  mem->next = ptr2;
+  if (next != MEM_SIZE_ALIGNED) {
+    MEM_TLSF_MEM(next)->prev = ptr2;
+  }
+  mem_tlsf_insert(ptr2);
+  MEM_STATS_DEC_USED(used, (size - newsize));
+  LWIP_MEM_FREE_UNPROTECT();
+  return rmem;
+}
+
+/**
+ * Allocate a block of memory with a minimum of 'size' bytes from the
+ * segregated free lists (constant time, no heap scan).
+ *
+ * @param size is the minimum size of the requested block in bytes.
+ * @return pointer to allocated memory or NULL if no free memory was found.
+ *
+ * Note that the returned value will always be aligned (as defined by MEM_ALIGNMENT).
+ */
+void *
+mem_malloc(mem_size_t size)
+{
+  mem_size_t ptr, ptr2;
+  struct mem *mem, *mem2;
+  LWIP_MEM_ALLOC_DECL_PROTECT();
+
+  if (size == 0) {
+    return NULL;
+  }
+
+  /* Expand the size of the allocated memory region so that we can
+     adjust for alignment. */
+  size = LWIP_MEM_ALIGN_SIZE(size);
+
+  if(size < MIN_SIZE_ALIGNED) {
+    /* every data block must be at least MIN_SIZE_ALIGNED long */
+    size = MIN_SIZE_ALIGNED;
+  }
+
+  if (size > MEM_SIZE_ALIGNED) {
+    return NULL;
+  }
+
+  /* protect the heap from concurrent access (no need to let mem_free run in
+     between as with the first-fit heap: this does not take long) */
+  sys_mutex_lock(&mem_mutex);
+  LWIP_MEM_ALLOC_PROTECT();
+
+  ptr = mem_tlsf_find(size);
+  if (ptr == MEM_TLSF_NONE) {
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("mem_malloc: could not allocate %"S16_F" bytes\n", (s16_t)size));
+    MEM_STATS_INC(err);
+    LWIP_MEM_ALLOC_UNPROTECT();
+    sys_mutex_unlock(&mem_mutex);
+    return NULL;
+  }
+  mem = MEM_TLSF_MEM(ptr);
+
+  if (mem->next - (ptr + SIZEOF_STRUCT_MEM) >= (size + SIZEOF_STRUCT_MEM + MIN_SIZE_ALIGNED)) {
+    /* split large block, put the remainder back into the free lists */
+    ptr2 = ptr + SIZEOF_STRUCT_MEM + size;
+    mem2 = MEM_TLSF_MEM(ptr2);
+    mem2->used = 0;
+    mem2->next = mem->next;
+    mem2->prev = ptr;
+    mem->next = ptr2;
+    if (mem2->next != MEM_SIZE_ALIGNED) {
+      MEM_TLSF_MEM(mem2->next)->prev = ptr2;
+    }
+    mem_tlsf_insert(ptr2);
+    MEM_STATS_INC_USED(used, (size + SIZEOF_STRUCT_MEM));
+  } else {
+    /* near fit or exact fit: do not split */
+    MEM_STATS_INC_USED(used, mem->next - ptr);
+  }
+  mem->used = 1;
+
+  LWIP_MEM_ALLOC_UNPROTECT();
+  sys_mutex_unlock(&mem_mutex);
+  LWIP_ASSERT("mem_malloc: allocated memory not above ram_end.",
+   (mem_ptr_t)mem + SIZEOF_STRUCT_MEM + size <= (mem_ptr_t)ram_end);
+  LWIP_ASSERT("mem_malloc: allocated memory properly aligned.",
+   ((mem_ptr_t)mem + SIZEOF_STRUCT_MEM) % MEM_ALIGNMENT == 0);
+
+  return (u8_t *)mem + SIZEOF_STRUCT_MEM;
+}
+
+#else /* MEM_USE_TLSF */
+
 /**
  * "Plug holes" by combining adjacent empty struct mems.
  * After this function is through, there should not exist
@@ -650,6 +1100,7 @@ mem_malloc_adjust_lfree:
   return NULL;
 }
 
+#endif /* MEM_USE_TLSF */
 #endif /* MEM_USE_POOLS */
 /**
  * Contiguously allocates enough space for count objects that are size bytes
@@ -120,10 +120,41 @@ struct memp {
 
 #endif /* MEMP_OVERFLOW_CHECK */
 
+/* MEMP_ELEMENT_SIZE: distance between two elements of a pool */
+#if MEMP_OVERFLOW_CHECK
+#define MEMP_ELEMENT_SIZE(type) (MEMP_SIZE + memp_sizes[type] + MEMP_SANITY_REGION_AFTER_ALIGNED)
+#else /* MEMP_OVERFLOW_CHECK */
+#define MEMP_ELEMENT_SIZE(type) (MEMP_SIZE + memp_sizes[type])
+#endif /* MEMP_OVERFLOW_CHECK */
+
+#if MEMP_LOCKFREE
+/** This array holds the freelist head of each pool: an ABA tag (incremented
+ *  on every change) in the upper 16 bits and the index of the first free
+ *  element + 1 (0: pool empty) in the lower 16 bits.
+ *  Elements form a linked list. */
+static volatile u32_t memp_head[MEMP_MAX];
+/** This array holds the first element of each pool (index 0). */
+static u8_t *memp_first[MEMP_MAX];
+
+#define MEMP_HEAD_INDEX_MASK  0x0000ffffUL
+#define MEMP_HEAD_TAG_MASK    0xffff0000UL
+/** The next head value: a new tag (ABA protection) and first index 'idx' */
+#define MEMP_HEAD_NEXT(head, idx) ((u32_t)((((head) + 0x10000UL) & MEMP_HEAD_TAG_MASK) | (idx)))
+
+/* protection is only needed for the statistics */
+#define MEMP_POOL_DECL_PROTECT(lev)
+#define MEMP_POOL_PROTECT(lev)
+#define MEMP_POOL_UNPROTECT(lev)
+#else /* MEMP_LOCKFREE */
 /** This array holds the first free element of each pool.
  *  Elements form a linked list. */
 static struct memp *memp_tab[MEMP_MAX];
 
+#define MEMP_POOL_DECL_PROTECT(lev) SYS_ARCH_DECL_PROTECT(lev)
+#define MEMP_POOL_PROTECT(lev)      SYS_ARCH_PROTECT(lev)
+#define MEMP_POOL_UNPROTECT(lev)    SYS_ARCH_UNPROTECT(lev)
+#endif /* MEMP_LOCKFREE */
+
 #else /* MEMP_MEM_MALLOC */
 
 #define MEMP_ALIGN_SIZE(x) (LWIP_MEM_ALIGN_SIZE(x))
@@ -349,6 +380,277 @@ memp_overflow_init(void)
 }
 #endif /* MEMP_OVERFLOW_CHECK */
 
+#if MEMP_LOCKFREE
+/**
+ * Convert a pointer to an element into its freelist index.
+ * 'memp' may be garbage (read from an element just taken by another thread):
+ * the result is only used if the compare-and-swap succeeds.
+ */
+static u32_t
+memp_pool_index(memp_t type, struct memp *memp)
+{
+  if (memp == NULL) {
+    return 0;
+  }
+  return ((u32_t)(((mem_ptr_t)memp - (mem_ptr_t)memp_first[type]) /
+    MEMP_ELEMENT_SIZE(type)) + 1) & MEMP_HEAD_INDEX_MASK;
+}
+
+/** Convert a (non-zero) freelist index into a pointer to its element */
+#define MEMP_POOL_ELEMENT(type, idx) \
+  ((struct memp *)(void *)(memp_first[type] + ((idx) - 1) * MEMP_ELEMENT_SIZE(type)))
+#endif /* MEMP_LOCKFREE */
+
+/**
+ * Take the first element off the freelist of a pool.
+ * Must be called with MEMP_POOL_PROTECT held.
+ *
+ * @param type the pool to take an element from
+ * @return the element or NULL if the pool is empty
+ */
+static struct memp *
+memp_pool_get(memp_t type)
+{
+#if MEMP_LOCKFREE
+  u32_t head, next;
+  struct memp *memp;
+
+  do {
+    head = memp_head[type];
+    if ((head & MEMP_HEAD_INDEX_MASK) == 0) {
+      return NULL;
+    }
+    memp = MEMP_POOL_ELEMENT(type, head & MEMP_HEAD_INDEX_MASK);
+    next = memp_pool_index(type, memp->next);
+  } while (!SYS_ARCH_CAS_U32(&memp_head[type], head, MEMP_HEAD_NEXT(head, next)));
+  return memp;
+#else /* MEMP_LOCKFREE */
+  struct memp *memp = memp_tab[type];
+
+  if (memp != NULL) {
+    memp_tab[type] = memp->next;
+  }
+  return memp;
+#endif /* MEMP_LOCKFREE */
+}
+
+/**
+ * Put an element onto the freelist of a pool.
+ * Must be called with MEMP_POOL_PROTECT held.
+ *
+ * @param type the pool to put the element into
+ * @param memp the element
+ * @return 1 if the pool was empty before, 0 otherwise
+ */
+static u8_t
+memp_pool_put(memp_t type, struct memp *memp)
+{
+#if MEMP_LOCKFREE
+  u32_t head;
+  u32_t idx = memp_pool_index(type, memp);
+
+  do {
+    head = memp_head[type];
+    memp->next = ((head & MEMP_HEAD_INDEX_MASK) == 0) ? NULL :
+      MEMP_POOL_ELEMENT(type, head & MEMP_HEAD_INDEX_MASK);
+  } while (!SYS_ARCH_CAS_U32(&memp_head[type], head, MEMP_HEAD_NEXT(head, idx)));
+  return (u8_t)((head & MEMP_HEAD_INDEX_MASK) == 0);
+#else /* MEMP_LOCKFREE */
+  memp->next = memp_tab[type];
+  memp_tab[type] = memp;
+  return (u8_t)(memp->next == NULL);
+#endif /* MEMP_LOCKFREE */
+}
+
+#if MEMP_MAGAZINES
+/** Only pools with at least this many elements are cached per thread */
+#define MEMP_MAGAZINE_MIN_NUM  (4 * MEMP_MAGAZINE_SIZE)
+/** Number of elements moved between a magazine and its pool at once */
+#define MEMP_MAGAZINE_BATCH    ((MEMP_MAGAZINE_SIZE + 1) / 2)
+
+/**
+ * Get the magazines of the calling thread if a pool is cached.
+ *
+ * @param type the pool to check
+ * @return the magazines to use or NULL to use the pool directly
+ */
+static struct memp_magazines *
+memp_magazines_get(memp_t type)
+{
+  if (memp_num[type] < MEMP_MAGAZINE_MIN_NUM) {
+    return NULL;
+  }
+  return MEMP_MAGAZINES_GET();
+}
+
+/**
+ * Account for the elements taken from or put into a magazine without
+ * locking since the last call. Must be called with MEMP_POOL_PROTECT held.
+ */
+static void
+memp_magazine_sync(struct memp_magazines *mags, memp_t type)
+{
+#if MEMP_STATS
+  s32_t delta = (s32_t)mags->pool[type].synced - (s32_t)mags->pool[type].count;
+
+  lwip_stats.memp[type].used = (mem_size_t)(lwip_stats.memp[type].used + delta);
+  lwip_stats.memp[type].cached = (mem_size_t)(lwip_stats.memp[type].cached - delta);
+  if (lwip_stats.memp[type].max < lwip_stats.memp[type].used) {
+    lwip_stats.memp[type].max = lwip_stats.memp[type].used;
+  }
+#endif /* MEMP_STATS */
+  mags->pool[type].synced = mags->pool[type].count;
+}
+
+/**
+ * Move up to MEMP_MAGAZINE_BATCH elements from a pool into an empty magazine.
+ *
+ * @return the number of elements moved (0 if the pool is empty)
+ */
+static u16_t
+memp_magazine_refill(struct memp_magazines *mags, memp_t type)
+{
+  struct memp *memp;
+  u16_t n;
+  MEMP_POOL_DECL_PROTECT(old_level);
+
+  MEMP_POOL_PROTECT(old_level);
+#if MEMP_OVERFLOW_CHECK >= 2
+  memp_overflow_check_all();
+#endif /* MEMP_OVERFLOW_CHECK >= 2 */
+  memp_magazine_sync(mags, type);
+
+  for (n = 0; n < MEMP_MAGAZINE_BATCH; n++) {
+    memp = memp_pool_get(type);
+    if (memp == NULL) {
+      break;
+    }
+    memp->next = (struct memp *)mags->pool[type].first;
+    mags->pool[type].first = memp;
+  }
+  mags->pool[type].count = (u16_t)(mags->pool[type].count + n);
+  mags->pool[type].synced = mags->pool[type].count;
+#if MEMP_STATS
+  lwip_stats.memp[type].cached = (mem_size_t)(lwip_stats.memp[type].cached + n);
+#endif /* MEMP_STATS */
+  if (n == 0) {
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", memp_desc[type]));
+    MEMP_STATS_INC(err, type);
+  }
+  MEMP_POOL_UNPROTECT(old_level);
+
+  return n;
+}
+
+/**
+ * Move elements from a magazine back into its pool.
+ *
+ * @param keep number of elements to leave in the magazine
+ */
+static void
+memp_magazine_flush_pool(struct memp_magazines *mags, memp_t type, u16_t keep)
+{
+  struct memp *memp;
+  u16_t n = 0;
+  u8_t was_empty = 0;
+  MEMP_POOL_DECL_PROTECT(old_level);
+
+  MEMP_POOL_PROTECT(old_level);
+  memp_magazine_sync(mags, type);
+
+  while (mags->pool[type].count > keep) {
+    memp = (struct memp *)mags->pool[type].first;
+    mags->pool[type].first = memp->next;
+    was_empty |= memp_pool_put(type, memp);
+    mags->pool[type].count--;
+    n++;
+  }
+  mags->pool[type].synced = mags->pool[type].count;
+#if MEMP_STATS
+  lwip_stats.memp[type].cached = (mem_size_t)(lwip_stats.memp[type].cached - n);
+#endif /* MEMP_STATS */
+
+#if MEMP_SANITY_CHECK
+  LWIP_ASSERT("memp sanity", memp_sanity());
+#endif /* MEMP_SANITY_CHECK */
+
+  MEMP_POOL_UNPROTECT(old_level);
+#ifdef LWIP_HOOK_MEMP_AVAILABLE
+  if (was_empty) {
+    LWIP_HOOK_MEMP_AVAILABLE(type);
+  }
+#endif
+  LWIP_UNUSED_ARG(n);
+  LWIP_UNUSED_ARG(was_empty);
+}
+
+/**
+ * Return all elements cached in a thread's magazines to their pools.
+ * Call this before a thread that used memp_malloc/memp_free exits.
+ *
+ * @param mags the magazines of the thread
+ */
+void
+memp_magazines_flush(struct memp_magazines *mags)
+{
+  u16_t i;
+
+  LWIP_ERROR("memp_magazines_flush: invalid mags", (mags != NULL), return;);
+
+  for (i = 0; i < MEMP_MAX; ++i) {
+    if ((mags->pool[i].count != 0) || (mags->pool[i].synced != 0)) {
+      memp_magazine_flush_pool(mags, (memp_t)i, 0);
+    }
+  }
+}
+
+#if MEMP_STATS
+struct memp_magazines *memp_magazines_list;
+
+/**
+ * Register a thread's magazines so that stats_display() shows how many
+ * elements of each pool they cache.
+ *
+ * @param mags the magazines of the thread
+ * @param name name to show (e.g. the thread name), not copied
+ */
+void
+memp_magazines_register(struct memp_magazines *mags, const char *name)
+{
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("memp_magazines_register: invalid mags", (mags != NULL), return;);
+  mags->name = name;
+  SYS_ARCH_PROTECT(old_level);
+  mags->next = memp_magazines_list;
+  memp_magazines_list = mags;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+/**
+ * Remove magazines registered by memp_magazines_register() (e.g. after
+ * memp_magazines_flush() when the thread exits).
+ *
+ * @param mags the magazines of the thread
+ */
+void
+memp_magazines_unregister(struct memp_magazines *mags)
+{
+  struct memp_magazines **m;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  for (m = &memp_magazines_list; *m != NULL; m = &(*m)->next) {
+    if (*m == mags) {
+      *m = mags->next;
+      break;
+    }
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+}
+#endif /* MEMP_STATS */
+#endif /* MEMP_MAGAZINES */
+
 /**
  * Initialize this module.
  * 
@@ -365,6 +667,9 @@ memp_init(void)
     MEMP_STATS_AVAIL(max, i, 0);
     MEMP_STATS_AVAIL(err, i, 0);
     MEMP_STATS_AVAIL(avail, i, memp_num[i]);
+#if MEMP_MAGAZINES
+    MEMP_STATS_AVAIL(cached, i, 0);
+#endif /* MEMP_MAGAZINES */
   }
 
 #if !MEMP_SEPARATE_POOLS
@@ -372,19 +677,19 @@ memp_init(void)
 #endif /* !MEMP_SEPARATE_POOLS */
   /* for every pool: */
   for (i = 0; i < MEMP_MAX; ++i) {
-    memp_tab[i] = NULL;
 #if MEMP_SEPARATE_POOLS
     memp = (struct memp*)LWIP_MEM_ALIGN(memp_bases[i]);
 #endif /* MEMP_SEPARATE_POOLS */
+#if MEMP_LOCKFREE
+    memp_head[i] = 0;
+    memp_first[i] = (u8_t *)memp;
+#else /* MEMP_LOCKFREE */
+    memp_tab[i] = NULL;
+#endif /* MEMP_LOCKFREE */
     /* create a linked list of memp elements */
     for (j = 0; j < memp_num[i]; ++j) {
-      memp->next = memp_tab[i];
-      memp_tab[i] = memp;
-      memp = (struct memp *)(void *)((u8_t *)memp + MEMP_SIZE + memp_sizes[i]
-#if MEMP_OVERFLOW_CHECK
-        + MEMP_SANITY_REGION_AFTER_ALIGNED
-#endif
-      );
+      memp_pool_put((memp_t)i, memp);
+      memp = (struct memp *)(void *)((u8_t *)memp + MEMP_ELEMENT_SIZE(i));
     }
   }
 #if MEMP_OVERFLOW_CHECK
@@ -413,35 +718,54 @@ memp_malloc_fn(memp_t type, const char* file, const int line)
 #endif
 {
   struct memp *memp;
-  SYS_ARCH_DECL_PROTECT(old_level);
+#if MEMP_MAGAZINES
+  struct memp_magazines *mags;
+#endif /* MEMP_MAGAZINES */
+  MEMP_POOL_DECL_PROTECT(old_level);
  
   LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
 
-  SYS_ARCH_PROTECT(old_level);
+#if MEMP_MAGAZINES
+  mags = memp_magazines_get(type);
+  if (mags != NULL) {
+    /* fast path: take an element from this thread's magazine */
+    if ((mags->pool[type].count == 0) && (memp_magazine_refill(mags, type) == 0)) {
+      return NULL;
+    }
+    memp = (struct memp *)mags->pool[type].first;
+    mags->pool[type].first = memp->next;
+    mags->pool[type].count--;
+  } else
+#endif /* MEMP_MAGAZINES */
+  {
+    MEMP_POOL_PROTECT(old_level);
 #if MEMP_OVERFLOW_CHECK >= 2
-  memp_overflow_check_all();
+    memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
-  memp = memp_tab[type];
-  
+    memp = memp_pool_get(type);
+
+    if (memp != NULL) {
+      MEMP_STATS_INC_USED(used, type);
+    } else {
+      LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", memp_desc[type]));
+      MEMP_STATS_INC(err, type);
+    }
+
+    MEMP_POOL_UNPROTECT(old_level);
+  }
+
   if (memp != NULL) {
-    memp_tab[type] = memp->next;
 #if MEMP_OVERFLOW_CHECK
     memp->next = NULL;
     memp->file = file;
     memp->line = line;
 #endif /* MEMP_OVERFLOW_CHECK */
-    MEMP_STATS_INC_USED(used, type);
     LWIP_ASSERT("memp_malloc: memp properly aligned",
                 ((mem_ptr_t)memp % MEM_ALIGNMENT) == 0);
     memp = (struct memp*)(void *)((u8_t*)memp + MEMP_SIZE);
-  } else {
-    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", memp_desc[type]));
-    MEMP_STATS_INC(err, type);
   }
 
-  SYS_ARCH_UNPROTECT(old_level);
-
   return memp;
 }
 
@@ -455,10 +779,11 @@ void
 memp_free(memp_t type, void *mem)
 {
   struct memp *memp;
-#ifdef LWIP_HOOK_MEMP_AVAILABLE
-  struct memp *old_first;
-#endif
-  SYS_ARCH_DECL_PROTECT(old_level);
+  u8_t was_empty;
+#if MEMP_MAGAZINES
+  struct memp_magazines *mags;
+#endif /* MEMP_MAGAZINES */
+  MEMP_POOL_DECL_PROTECT(old_level);
 
   if (mem == NULL) {
     return;
@@ -468,7 +793,26 @@ memp_free(memp_t type, void *mem)
 
   memp = (struct memp *)(void *)((u8_t*)mem - MEMP_SIZE);
 
-  SYS_ARCH_PROTECT(old_level);
+#if MEMP_MAGAZINES
+  mags = memp_magazines_get(type);
+  if (mags != NULL) {
+#if MEMP_OVERFLOW_CHECK
+    memp_overflow_check_element_overflow(memp, type);
+    memp_overflow_check_element_underflow(memp, type);
+#endif /* MEMP_OVERFLOW_CHECK */
+    /* fast path: put the element into this thread's magazine, making room
+       by returning half of it to the pool if it is full */
+    if (mags->pool[type].count >= MEMP_MAGAZINE_SIZE) {
+      memp_magazine_flush_pool(mags, type, MEMP_MAGAZINE_SIZE - MEMP_MAGAZINE_BATCH);
+    }
+    memp->next = (struct memp *)mags->pool[type].first;
+    mags->pool[type].first = memp;
+    mags->pool[type].count++;
+    return;
+  }
+#endif /* MEMP_MAGAZINES */
+
+  MEMP_POOL_PROTECT(old_level);
 #if MEMP_OVERFLOW_CHECK
 #if MEMP_OVERFLOW_CHECK >= 2
   memp_overflow_check_all();
@@ -480,22 +824,19 @@ memp_free(memp_t type, void *mem)
 
   MEMP_STATS_DEC(used, type);
 
-  memp->next = memp_tab[type];
-#ifdef LWIP_HOOK_MEMP_AVAILABLE
-  old_first = memp_tab[type];
-#endif
-  memp_tab[type] = memp;
+  was_empty = memp_pool_put(type, memp);
 
 #if MEMP_SANITY_CHECK
   LWIP_ASSERT("memp sanity", memp_sanity());
 #endif /* MEMP_SANITY_CHECK */
 
-  SYS_ARCH_UNPROTECT(old_level);
+  MEMP_POOL_UNPROTECT(old_level);
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
-  if (old_first == NULL) {
+  if (was_empty) {
     LWIP_HOOK_MEMP_AVAILABLE(type);
   }
 #endif
+  LWIP_UNUSED_ARG(was_empty);
 }
 
 #endif /* MEMP_MEM_MALLOC */
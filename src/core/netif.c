@@ -46,6 +46,7 @@
 #include "lwip/udp.h"
 #include "lwip/snmp.h"
 #include "lwip/igmp.h"
+#include "lwip/ip4_gro.h"
 #include "netif/etharp.h"
 #include "lwip/stats.h"
 #if ENABLE_LOOPBACK
@@ -207,6 +208,10 @@ netif_add(struct netif *netif,
 #endif /* LWIP_IPV6 */
   NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
   netif->flags = 0;
+#if LWIP_NETIF_OFFLOAD
+  netif->offload_flags = 0;
+  netif->gso_max_size = 0;
+#endif /* LWIP_NETIF_OFFLOAD */
 #if LWIP_DHCP
   /* netif not under DHCP control by default */
   netif->dhcp = NULL;
@@ -320,6 +325,11 @@ netif_remove(struct netif *netif)
     return;
   }
 
+#if IP_GRO
+  /* don't keep packets received on this netif */
+  ip4_gro_flush();
+#endif /* IP_GRO */
+
 #if LWIP_IPV4
   if (!ip4_addr_isany_val(*netif_ip4_addr(netif))) {
 #if LWIP_TCP
@@ -72,7 +72,7 @@
 #if LWIP_TCP && TCP_QUEUE_OOSEQ
 #include "lwip/tcp_impl.h"
 #endif
-#if LWIP_CHECKSUM_ON_COPY
+#if LWIP_CHECKSUM_ON_COPY || LWIP_NETIF_OFFLOAD
 #include "lwip/inet_chksum.h"
 #endif
 
@@ -127,8 +127,7 @@ pbuf_free_ooseq(void)
     if (NULL != pcb->ooseq) {
       /** Free the ooseq pbufs of one PCB only */
       LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_free_ooseq: freeing out-of-sequence pbufs\n"));
-      tcp_segs_free(pcb->ooseq);
-      pcb->ooseq = NULL;
+      tcp_ooseq_free(pcb);
       return;
     }
   }
@@ -171,6 +170,63 @@ pbuf_pool_is_empty(void)
 }
 #endif /* !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ */
 
+#if PBUF_RAM_ARENAS
+/** Element size of PBUF_RAM size class 'i' (struct pbuf included) */
+#define PBUF_RAM_ARENA_SIZE(i) (((i) < 5) ? (128U << (i)) : (PBUF_RAM_ARENA_JUMBO_SIZE))
+/** Pool of PBUF_RAM size class 'i' (the pools are declared in order in memp_std.h) */
+#define PBUF_RAM_ARENA_POOL(i) ((memp_t)(MEMP_PBUF_RAM_128 + (i)))
+
+/**
+ * Allocate a PBUF_RAM pbuf from the smallest size class it fits into.
+ *
+ * @param size size of struct pbuf, headers and payload
+ * @return the pbuf (only 'arena' set) or NULL if no class fits or the class
+ *         is empty (use the heap then)
+ */
+static struct pbuf *
+pbuf_ram_arena_alloc(u32_t size)
+{
+  struct pbuf *p;
+  u8_t i;
+
+  for (i = 0; i < PBUF_RAM_ARENA_CLASSES; i++) {
+    if (size <= PBUF_RAM_ARENA_SIZE(i)) {
+      p = (struct pbuf *)memp_malloc(PBUF_RAM_ARENA_POOL(i));
+      if (p == NULL) {
+        PBUF_ARENA_STATS_INC(miss, i);
+        return NULL;
+      }
+      PBUF_ARENA_STATS_INC(hit, i);
+      p->arena = (u8_t)(i + 1);
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Get the number of bytes a PBUF_RAM pbuf can hold from p->payload on: this
+ * may be more than p->len if it was allocated from a size class.
+ *
+ * @param p a PBUF_RAM pbuf
+ * @return the usable payload size of p
+ */
+u16_t
+pbuf_ram_capacity(const struct pbuf *p)
+{
+  LWIP_ASSERT("pbuf_ram_capacity: PBUF_RAM only", p->type == PBUF_RAM);
+  if ((p->arena != 0)
+#if LWIP_SUPPORT_CUSTOM_PBUF
+      && ((p->flags & PBUF_FLAG_IS_CUSTOM) == 0)
+#endif /* LWIP_SUPPORT_CUSTOM_PBUF */
+     ) {
+    return (u16_t)LWIP_MIN(0xffff, PBUF_RAM_ARENA_SIZE(p->arena - 1) -
+      (u32_t)((const u8_t *)p->payload - (const u8_t *)p));
+  }
+  return p->len;
+}
+#endif /* PBUF_RAM_ARENAS */
+
 /**
  * Allocates a pbuf of the given type (possibly a chain for PBUF_POOL type).
  *
@@ -308,10 +364,20 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
 
     break;
   case PBUF_RAM:
-    /* If pbuf is to be allocated in RAM, allocate memory for it. */
-    p = (struct pbuf*)mem_malloc(LWIP_MEM_ALIGN_SIZE(SIZEOF_STRUCT_PBUF + offset) + LWIP_MEM_ALIGN_SIZE(length));
-    if (p == NULL) {
-      return NULL;
+#if PBUF_RAM_ARENAS
+    /* Try the size class first, */
+    p = pbuf_ram_arena_alloc(LWIP_MEM_ALIGN_SIZE(SIZEOF_STRUCT_PBUF + offset) + LWIP_MEM_ALIGN_SIZE(length));
+    if (p == NULL)
+#endif /* PBUF_RAM_ARENAS */
+    {
+      /* If pbuf is to be allocated in RAM, allocate memory for it. */
+      p = (struct pbuf*)mem_malloc(LWIP_MEM_ALIGN_SIZE(SIZEOF_STRUCT_PBUF + offset) + LWIP_MEM_ALIGN_SIZE(length));
+      if (p == NULL) {
+        return NULL;
+      }
+#if PBUF_RAM_ARENAS
+      p->arena = 0;
+#endif /* PBUF_RAM_ARENAS */
     }
     /* Set up internal structure of the pbuf. */
     p->payload = LWIP_MEM_ALIGN((void *)((u8_t *)p + SIZEOF_STRUCT_PBUF + offset));
@@ -348,6 +414,9 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
   p->ref = 1;
   /* set flags */
   p->flags = 0;
+#if LWIP_NETIF_OFFLOAD
+  p->gso_size = 0;
+#endif /* LWIP_NETIF_OFFLOAD */
   LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_alloc(length=%"U16_F") == %p\n", length, (void *)p));
   return p;
 }
@@ -412,6 +481,12 @@ pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_cust
     p->pbuf.payload = NULL;
   }
   p->pbuf.flags = PBUF_FLAG_IS_CUSTOM;
+#if PBUF_RAM_ARENAS
+  p->pbuf.arena = 0;
+#endif /* PBUF_RAM_ARENAS */
+#if LWIP_NETIF_OFFLOAD
+  p->pbuf.gso_size = 0;
+#endif /* LWIP_NETIF_OFFLOAD */
   p->pbuf.len = p->pbuf.tot_len = length;
   p->pbuf.type = type;
   p->pbuf.ref = 1;
@@ -480,6 +555,10 @@ pbuf_realloc(struct pbuf *p, u16_t new_len)
 #if LWIP_SUPPORT_CUSTOM_PBUF
       && ((q->flags & PBUF_FLAG_IS_CUSTOM) == 0)
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
+#if PBUF_RAM_ARENAS
+      /* pool elements of a size class cannot be trimmed */
+      && (q->arena == 0)
+#endif /* PBUF_RAM_ARENAS */
      ) {
     /* reallocate and adjust the length of the pbuf that will be split */
     q = (struct pbuf *)mem_trim(q, (u16_t)((u8_t *)q->payload - (u8_t *)q) + rem_len);
@@ -579,6 +658,12 @@ pbuf_header_impl(struct pbuf *p, s16_t header_size_increment, u8_t force)
   /* modify pbuf length fields */
   p->len += header_size_increment;
   p->tot_len += header_size_increment;
+#if LWIP_NETIF_OFFLOAD
+  if (p->flags & PBUF_FLAG_CSUM_PARTIAL) {
+    /* csum_start is relative to the payload */
+    p->csum_start += header_size_increment;
+  }
+#endif /* LWIP_NETIF_OFFLOAD */
 
   LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_header: old %p new %p (%"S16_F")\n",
     (void *)payload, (void *)p->payload, header_size_increment));
@@ -715,7 +800,14 @@ pbuf_free(struct pbuf *p)
           memp_free(MEMP_PBUF, p);
         /* type == PBUF_RAM */
         } else {
-          mem_free(p);
+#if PBUF_RAM_ARENAS
+          if (p->arena != 0) {
+            memp_free(PBUF_RAM_ARENA_POOL(p->arena - 1), p);
+          } else
+#endif /* PBUF_RAM_ARENAS */
+          {
+            mem_free(p);
+          }
         }
       }
       count++;
@@ -1214,6 +1306,98 @@ pbuf_fill_chksum(struct pbuf *p, u16_t start_offset, const void *dataptr,
 }
 #endif /* LWIP_CHECKSUM_ON_COPY */
 
+#if LWIP_NETIF_OFFLOAD
+/** Free-callback of pbuf_alloc_offload_ref() pbufs: releases the reference
+ * on the pbuf they point into. */
+static void
+pbuf_free_offload_ref(struct pbuf *p)
+{
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref*)p;
+  if (pcr->original != NULL) {
+    pbuf_free(pcr->original);
+  }
+  memp_free(MEMP_FRAG_PBUF, pcr);
+}
+
+/**
+ * Allocates a PBUF_REF pbuf for 'length' bytes of the payload of p (a single
+ * pbuf, not the chain) starting at 'offset'. It holds a reference on p until
+ * it is freed, so packets built from such pbufs (GSO packets and software GSO
+ * segments) stay valid when a netif queues them beyond its output call and
+ * the stack frees p in the meantime (e.g. acked TCP data).
+ *
+ * @param p the pbuf holding the data
+ * @param offset offset of the data in p->payload
+ * @param length length of the data
+ * @return the new pbuf or NULL if out of memory (MEMP_FRAG_PBUF)
+ */
+struct pbuf *
+pbuf_alloc_offload_ref(struct pbuf *p, u16_t offset, u16_t length)
+{
+  struct pbuf_custom_ref *pcr;
+  struct pbuf *r;
+
+  LWIP_ASSERT("pbuf_alloc_offload_ref: data not in p", (u32_t)offset + length <= p->len);
+  pcr = (struct pbuf_custom_ref*)memp_malloc(MEMP_FRAG_PBUF);
+  if (pcr == NULL) {
+    return NULL;
+  }
+  pcr->original = NULL;
+  pcr->pc.custom_free_function = pbuf_free_offload_ref;
+  r = pbuf_alloced_custom(PBUF_RAW, length, PBUF_REF, &pcr->pc,
+    (u8_t *)p->payload + offset, length);
+  if (r == NULL) {
+    memp_free(MEMP_FRAG_PBUF, pcr);
+    return NULL;
+  }
+  pbuf_ref(p);
+  pcr->original = p;
+  return r;
+}
+
+/**
+ * Computes a checksum left to the netif (PBUF_FLAG_CSUM_PARTIAL) in
+ * software, e.g. because the netif does not support it or the packet is
+ * looped back or fragmented.
+ *
+ * @param p the packet to complete
+ */
+void
+pbuf_offload_chksum(struct pbuf *p)
+{
+  struct pbuf *q;
+  u16_t offset, field, chksum, n;
+  u32_t acc = 0;
+  u8_t swapped = 0;
+
+  if ((p->flags & PBUF_FLAG_CSUM_PARTIAL) == 0) {
+    return;
+  }
+  field = (u16_t)(p->csum_start + p->csum_offset);
+  LWIP_ASSERT("checksum field must be in the first pbuf", field + 2 <= p->len);
+
+  /* the checksum field holds the pseudo header sum */
+  for (q = pbuf_skip(p, p->csum_start, &offset); q != NULL; q = q->next) {
+    n = (u16_t)(q->len - offset);
+    acc += (u16_t)~inet_chksum((u8_t *)q->payload + offset, n);
+    acc = FOLD_U32T(acc);
+    acc = FOLD_U32T(acc);
+    if (n % 2 != 0) {
+      swapped = 1 - swapped;
+      acc = SWAP_BYTES_IN_WORD(acc);
+    }
+    offset = 0;
+  }
+  if (swapped) {
+    acc = SWAP_BYTES_IN_WORD(acc);
+  }
+  acc = FOLD_U32T(acc);
+  chksum = (u16_t)~acc;
+  SMEMCPY((u8_t *)p->payload + field, &chksum, sizeof(chksum));
+  p->flags = (u8_t)(p->flags & ~PBUF_FLAG_CSUM_PARTIAL);
+}
+#endif /* LWIP_NETIF_OFFLOAD */
+
  /** Get one byte from the specified position in a pbuf
  * WARNING: returns zero for offset >= p->tot_len
  *
@@ -43,6 +43,7 @@
 #include "lwip/def.h"
 #include "lwip/stats.h"
 #include "lwip/mem.h"
+#include "lwip/sys.h"
 #include "lwip/debug.h"
 
 #include <string.h>
@@ -130,8 +131,45 @@ stats_display_memp(struct stats_mem *mem, int index)
   };
   if(index < MEMP_MAX) {
     stats_display_mem(mem, memp_names[index]);
+#if MEMP_MAGAZINES
+    LWIP_PLATFORM_DIAG(("\tcached: %"U32_F"\n", (u32_t)mem->cached));
+#endif /* MEMP_MAGAZINES */
   }
 }
+
+#if MEMP_MAGAZINES
+void
+stats_display_memp_magazines(struct memp_magazines *mags)
+{
+  char * memp_names[] = {
+#define LWIP_MEMPOOL(name,num,size,desc) desc,
+#include "lwip/memp_std.h"
+  };
+  int i;
+
+  LWIP_PLATFORM_DIAG(("\nMEMP magazines %s\n", mags->name != NULL ? mags->name : ""));
+  for (i = 0; i < MEMP_MAX; i++) {
+    if (mags->pool[i].count != 0) {
+      LWIP_PLATFORM_DIAG(("\t%s cached: %"U32_F"\n", memp_names[i], (u32_t)mags->pool[i].count));
+    }
+  }
+}
+#endif /* MEMP_MAGAZINES */
+
+#if PBUF_RAM_ARENAS
+void
+stats_display_pbuf_arena(struct stats_pbuf_arena *arena, int index)
+{
+  const char *arena_names[] = {
+    "128", "256", "512", "1024", "2048", "JUMBO"
+  };
+  if(index < PBUF_RAM_ARENA_CLASSES) {
+    LWIP_PLATFORM_DIAG(("\nPBUF_RAM_%s\n\t", arena_names[index]));
+    LWIP_PLATFORM_DIAG(("hit: %"STAT_COUNTER_F"\n\t", arena->hit));
+    LWIP_PLATFORM_DIAG(("miss: %"STAT_COUNTER_F"\n", arena->miss));
+  }
+}
+#endif /* PBUF_RAM_ARENAS */
 #endif /* MEMP_STATS */
 #endif /* MEM_STATS || MEMP_STATS */
 
@@ -149,6 +187,11 @@ stats_display_sys(struct stats_sys *sys)
   LWIP_PLATFORM_DIAG(("mbox.used:  %"U32_F"\n\t", (u32_t)sys->mbox.used)); 
   LWIP_PLATFORM_DIAG(("mbox.max:   %"U32_F"\n\t", (u32_t)sys->mbox.max)); 
   LWIP_PLATFORM_DIAG(("mbox.err:   %"U32_F"\n\t", (u32_t)sys->mbox.err)); 
+#if LWIP_TCPIP_CORE_LOCKING
+  LWIP_PLATFORM_DIAG(("core_lock.acquired:    %"U32_F"\n\t", (u32_t)sys->core_lock.acquired));
+  LWIP_PLATFORM_DIAG(("core_lock.contended:   %"U32_F"\n\t", (u32_t)sys->core_lock.contended));
+  LWIP_PLATFORM_DIAG(("core_lock.max_waiting: %"U32_F"\n\t", (u32_t)sys->core_lock.max_waiting));
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 }
 #endif /* SYS_STATS */
 
@@ -174,6 +217,22 @@ stats_display(void)
   for (i = 0; i < MEMP_MAX; i++) {
     MEMP_STATS_DISPLAY(i);
   }
+#if MEMP_MAGAZINES && MEMP_STATS
+  {
+    struct memp_magazines *mags;
+    SYS_ARCH_DECL_PROTECT(old_level);
+    SYS_ARCH_PROTECT(old_level);
+    for (mags = memp_magazines_list; mags != NULL; mags = mags->next) {
+      stats_display_memp_magazines(mags);
+    }
+    SYS_ARCH_UNPROTECT(old_level);
+  }
+#endif /* MEMP_MAGAZINES && MEMP_STATS */
+#if PBUF_RAM_ARENAS
+  for (i = 0; i < PBUF_RAM_ARENA_CLASSES; i++) {
+    PBUF_ARENA_STATS_DISPLAY(i);
+  }
+#endif /* PBUF_RAM_ARENAS */
   SYS_STATS_DISPLAY();
 }
 #endif /* LWIP_STATS_DISPLAY */
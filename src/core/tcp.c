@@ -55,6 +55,8 @@
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/nd6.h"
+#include "lwip/sys.h"
+#include "lwip/timers.h"
 
 #include <string.h>
 
@@ -116,6 +118,26 @@ struct tcp_pcb *tcp_tw_pcbs;
 struct tcp_pcb ** const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs,
   &tcp_active_pcbs, &tcp_tw_pcbs};
 
+#if LWIP_TCP_PCB_HASH
+/** Hash table of tcp_active_pcbs, keyed on the 4-tuple */
+struct tcp_pcb *tcp_active_hash[TCP_PCB_HASH_SIZE];
+/** Hash table of tcp_tw_pcbs, keyed on the 4-tuple */
+struct tcp_pcb *tcp_tw_hash[TCP_PCB_HASH_SIZE];
+/** Hash table of tcp_listen_pcbs, keyed on the local port */
+union tcp_listen_pcbs_t tcp_listen_hash[TCP_PCB_LISTEN_HASH_SIZE];
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_PCB_TIMERS
+/* Deadlines (in tcp_ticks) of active and TIME-WAIT pcbs are kept in a
+   timing wheel of 3 levels, the pcbs tcp_slowtmr() is working on on
+   tcp_timers_wheel.expired. */
+WHEEL_DECLARE(tcp_timers_wheel, 3);
+/** pcbs touched since the last tcp_fasttmr() */
+static struct tcp_pcb *tcp_timers_dirty;
+/** pcbs tcp_fasttmr() is working on */
+static struct tcp_pcb *tcp_timers_touched;
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 /** Only used for temporary storage. */
 struct tcp_pcb *tcp_tmp_pcb;
 
@@ -151,6 +173,10 @@ tcp_tmr(void)
        tcp_tmr() is called. */
     tcp_slowtmr();
   }
+#if LWIP_TCP_RTT_MS && !LWIP_TIMERS
+  /* no sys_timeout(): check the retransmission timers every 250 ms */
+  tcp_rto_tmr();
+#endif /* LWIP_TCP_RTT_MS && !LWIP_TIMERS */
 }
 
 /**
@@ -401,7 +427,7 @@ tcp_abandon(struct tcp_pcb *pcb, int reset)
     }
 #if TCP_QUEUE_OOSEQ
     if (pcb->ooseq != NULL) {
-      tcp_segs_free(pcb->ooseq);
+      tcp_ooseq_free(pcb);
     }
 #endif /* TCP_QUEUE_OOSEQ */
     if (send_rst) {
@@ -574,6 +600,7 @@ tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
   lpcb->so_options = pcb->so_options;
   lpcb->ttl = pcb->ttl;
   lpcb->tos = pcb->tos;
+  lpcb->cc_ops = pcb->cc_ops;
 #if LWIP_IPV4 && LWIP_IPV6
   PCB_ISIPV6(lpcb) = PCB_ISIPV6(pcb);
   lpcb->accept_any_ip_version = 0;
@@ -857,8 +884,367 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+#if LWIP_TCP_RTT_MS
+/* Retransmission deadlines (pcb->rto_node.due, in TCP_NOW() milliseconds) of
+   the active pcbs are kept in a timing wheel of 3 levels (level 0 slots are
+   1 ms wide), so that tcp_rto_tmr() only visits the pcbs that are due. */
+WHEEL_DECLARE(tcp_rto_wheel, 3);
+
+/**
+ * Called from TCP_RMV: take an active pcb out of the wheel.
+ */
+void
+tcp_rto_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if ((pcblist == &tcp_active_pcbs) && wheel_node_linked(&pcb->rto_node)) {
+    wheel_remove(&tcp_rto_wheel, &pcb->rto_node);
+  }
+}
+
+/** Set pcb->rto (in TCP_SLOW_INTERVAL ticks, used for the coarse timeouts)
+ * from pcb->rto_ms */
+static void
+tcp_rto_ticks(struct tcp_pcb *pcb)
+{
+  pcb->rto = (s16_t)((pcb->rto_ms + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL);
+}
+
+/**
+ * Calculate the retransmission time-out of a pcb from its RTT estimate
+ * (RFC 6298: RTO = SRTT + max(G, 4 * RTTVAR), G being 1 ms), without
+ * exponential backoff.
+ *
+ * @param pcb the tcp_pcb to update
+ */
+void
+tcp_rto_calc(struct tcp_pcb *pcb)
+{
+  u32_t rto;
+
+  if (pcb->srtt == 0) {
+    rto = TCP_RTO_INITIAL_MS;
+  } else {
+    /* rttvar is scaled by 4 already */
+    rto = (pcb->srtt >> 3) + LWIP_MAX(pcb->rttvar, 1);
+  }
+  pcb->rto_ms = LWIP_MIN(LWIP_MAX(rto, TCP_RTO_MIN_MS), TCP_RTO_MAX_MS);
+  tcp_rto_ticks(pcb);
+}
+
+/**
+ * Update the RTT estimate of a pcb with a new measurement (RFC 6298).
+ *
+ * @param pcb the tcp_pcb the measurement was taken on
+ * @param rtt measured round-trip time in milliseconds
+ */
+void
+tcp_rtt_update(struct tcp_pcb *pcb, u32_t rtt)
+{
+  s32_t delta;
+
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rtt_update: experienced rtt %"U32_F" msec\n", rtt));
+
+  if (pcb->srtt == 0) {
+    /* first measurement: SRTT = R, RTTVAR = R/2 */
+    pcb->srtt = LWIP_MAX(rtt << 3, 1);
+    pcb->rttvar = rtt << 1;
+  } else {
+    /* SRTT = 7/8 SRTT + 1/8 R, RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| */
+    delta = (s32_t)rtt - (s32_t)(pcb->srtt >> 3);
+    pcb->srtt = LWIP_MAX((u32_t)((s32_t)pcb->srtt + delta), 1);
+    if (delta < 0) {
+      delta = -delta;
+    }
+    pcb->rttvar = pcb->rttvar - (pcb->rttvar >> 2) + (u32_t)delta;
+  }
+  tcp_rto_calc(pcb);
+
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rtt_update: srtt %"U32_F" rttvar %"U32_F" RTO %"U32_F" msec\n",
+                              pcb->srtt >> 3, pcb->rttvar >> 2, pcb->rto_ms));
+}
+
+/**
+ * (Re-)start the retransmission timer of a pcb to expire 'ms' from now,
+ * without changing what it runs for (pcb->rack_timer).
+ *
+ * @param pcb the tcp_pcb to start the timer for
+ * @param ms time-out in milliseconds
+ */
+void
+tcp_rto_arm(struct tcp_pcb *pcb, u32_t ms)
+{
+  pcb->rtime = 0;
+  if (wheel_node_linked(&pcb->rto_node)) {
+    wheel_remove(&tcp_rto_wheel, &pcb->rto_node);
+  }
+  /* the wheel is empty: catch up with the current time */
+  wheel_sync(&tcp_rto_wheel, TCP_NOW());
+  pcb->rto_node.due = TCP_NOW() + ms;
+  wheel_insert(&tcp_rto_wheel, &pcb->rto_node);
+  tcp_rto_timer_needed(pcb->rto_node.due);
+}
+
+/**
+ * (Re-)start the retransmission timer of a pcb: it expires pcb->rto_ms
+ * from now.
+ *
+ * @param pcb the tcp_pcb to start the timer for
+ */
+void
+tcp_rto_start(struct tcp_pcb *pcb)
+{
+#if LWIP_TCP_RACK
+  pcb->rack_timer = TCP_RACK_TMR_RTO;
+#endif /* LWIP_TCP_RACK */
+  tcp_rto_arm(pcb, pcb->rto_ms);
+}
+
+/**
+ * Called when the retransmission timer of a pcb expired: back off the
+ * time-out and retransmit.
+ *
+ * @param pcb the tcp_pcb to retransmit on
+ */
+static void
+tcp_rto_expired(struct tcp_pcb *pcb)
+{
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rto_tmr: rto %"U32_F" msec nrtx %"U16_F"\n",
+                              pcb->rto_ms, (u16_t)pcb->nrtx));
+
+  /* Double retransmission time-out unless we are trying to
+   * connect to somebody (i.e., we are in SYN_SENT). */
+  if (pcb->state != SYN_SENT) {
+    tcp_rto_calc(pcb);
+    pcb->rto_ms = LWIP_MIN(pcb->rto_ms << tcp_backoff[pcb->nrtx], TCP_RTO_MAX_MS);
+    tcp_rto_ticks(pcb);
+  }
+
+#if LWIP_TCP_RACK
+  /* a time-out ends the tail loss probe episode */
+  pcb->rack_flags &= ~(TCP_RACK_F_TLP | TCP_RACK_F_TLP_REXMIT);
+#endif /* LWIP_TCP_RACK */
+
+  /* Restart the retransmission timer. */
+  tcp_rto_start(pcb);
+
+  /* Reduce congestion window and ssthresh. */
+  pcb->cc_ops->rto(pcb);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_rto_tmr: cwnd %"TCPWNDSIZE_F
+                               " ssthresh %"TCPWNDSIZE_F"\n",
+                               pcb->cwnd, pcb->ssthresh));
+
+  tcp_rexmit_rto(pcb);
+}
+
+/**
+ * The retransmission timer of a pcb is due: retransmit (or probe) unless it
+ * was stopped in the meantime. Pcbs that are not handled here have left
+ * the wheel and are linked again by the next tcp_rto_start().
+ *
+ * @param pcb the tcp_pcb whose deadline passed
+ */
+static void
+tcp_rto_due(struct tcp_pcb *pcb)
+{
+  if ((pcb->rtime < 0) || (pcb->persist_backoff > 0) ||
+      (pcb->nrtx == TCP_MAXRTX) ||
+      ((pcb->state == SYN_SENT) && (pcb->nrtx == TCP_SYNMAXRTX))) {
+    return;
+  }
+  if (pcb->unacked == NULL) {
+    /* nothing to retransmit: tcp_output_segment() restarts the timer */
+    pcb->rtime = -1;
+    return;
+  }
+#if LWIP_TCP_RACK
+  if (pcb->rack_timer != TCP_RACK_TMR_RTO) {
+    /* probe or reordering time-out */
+    tcp_rack_timeout(pcb);
+  } else
+#endif /* LWIP_TCP_RACK */
+  {
+    tcp_rto_expired(pcb);
+  }
+}
+
+/**
+ * Advances the wheel of retransmission deadlines up to TCP_NOW(), runs the
+ * timers of the pcbs that are due (in order of their deadline) and
+ * schedules itself for the next deadline (see tcp_rto_timer_needed()).
+ * Pcbs without a running timer are not visited. With LWIP_TCP_RACK, the
+ * timer of a pcb may be running for a tail loss probe or for the
+ * reordering window instead (see tcp_rack_timeout()). Pcbs that reached
+ * the maximum number of retransmissions are removed by tcp_slowtmr(), the
+ * persist timer is run by tcp_slowtmr(), too.
+ */
+void
+tcp_rto_tmr(void)
+{
+  /* the pcbs of a millisecond are moved to the expired list so that the
+     stack can safely restart or remove timers while we work on them */
+  while (wheel_advance(&tcp_rto_wheel, TCP_NOW())) {
+    while (tcp_rto_wheel.expired != NULL) {
+      struct tcp_pcb *pcb = WHEEL_ENTRY(tcp_rto_wheel.expired, struct tcp_pcb, rto_node);
+      wheel_remove(&tcp_rto_wheel, &pcb->rto_node);
+      tcp_rto_due(pcb);
+    }
+  }
+  if (tcp_rto_wheel.pending > 0) {
+    tcp_rto_timer_needed(wheel_next(&tcp_rto_wheel));
+  }
+}
+#endif /* LWIP_TCP_RTT_MS */
+
+/**
+ * Runs the retransmission and persist timers of an active pcb, sends
+ * keepalives and checks the state timeouts (FIN-WAIT-2, SYN-RCVD, LAST-ACK,
+ * keepalive, out-of-sequence data).
+ *
+ * @param pcb the active pcb to handle (in tcp_slowtmr())
+ * @param reset set to 1 if a RST should be sent when removing the pcb
+ * @return != 0 if the pcb has timed out and should be removed
+ */
+static u8_t
+tcp_slowtmr_pcb(struct tcp_pcb *pcb, u8_t *reset)
+{
+  u8_t pcb_remove = 0;
+  u8_t pcb_reset = 0;
+  err_t err;
+
+  if (pcb->state == SYN_SENT && pcb->nrtx == TCP_SYNMAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
+  }
+  else if (pcb->nrtx == TCP_MAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
+  } else {
+    if (pcb->persist_backoff > 0) {
+      /* If snd_wnd is zero, use persist timer to send 1 byte probes
+       * instead of using the standard retransmission mechanism. */
+      u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
+      if (pcb->persist_cnt < backoff_cnt) {
+        pcb->persist_cnt++;
+      }
+      if (pcb->persist_cnt >= backoff_cnt) {
+        if (tcp_zero_window_probe(pcb) == ERR_OK) {
+          pcb->persist_cnt = 0;
+          if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
+            pcb->persist_backoff++;
+          }
+        }
+      }
+    }
+#if !LWIP_TCP_RTT_MS
+    else {
+      /* Increase the retransmission timer if it is running */
+      if(pcb->rtime >= 0) {
+        ++pcb->rtime;
+      }
+
+      if (pcb->unacked != NULL && pcb->rtime >= pcb->rto) {
+        /* Time for a retransmission. */
+        LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
+                                    " pcb->rto %"S16_F"\n",
+                                    pcb->rtime, pcb->rto));
+
+        /* Double retransmission time-out unless we are trying to
+         * connect to somebody (i.e., we are in SYN_SENT). */
+        if (pcb->state != SYN_SENT) {
+          pcb->rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[pcb->nrtx];
+        }
+
+        /* Reset the retransmission timer. */
+        pcb->rtime = 0;
+
+        /* Reduce congestion window and ssthresh. */
+        pcb->cc_ops->rto(pcb);
+        LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                     " ssthresh %"TCPWNDSIZE_F"\n",
+                                     pcb->cwnd, pcb->ssthresh));
+
+        /* The following needs to be called AFTER cwnd is set to one
+           mss - STJ */
+        tcp_rexmit_rto(pcb);
+      }
+    }
+#endif /* !LWIP_TCP_RTT_MS */
+  }
+  /* Check if this PCB has stayed too long in FIN-WAIT-2 */
+  if (pcb->state == FIN_WAIT_2) {
+    /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
+    if (pcb->flags & TF_RXCLOSED) {
+      /* PCB was fully closed (either through close() or SHUT_RDWR):
+         normal FIN-WAIT timeout handling. */
+      if ((u32_t)(tcp_ticks - pcb->tmr) >
+          TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
+        ++pcb_remove;
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
+      }
+    }
+  }
+
+  /* Check if KEEPALIVE should be sent */
+  if(ip_get_option(pcb, SOF_KEEPALIVE) &&
+     ((pcb->state == ESTABLISHED) ||
+      (pcb->state == CLOSE_WAIT))) {
+    if((u32_t)(tcp_ticks - pcb->tmr) >
+       (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL)
+    {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
+      ip_addr_debug_print(TCP_DEBUG, &pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+      
+      ++pcb_remove;
+      ++pcb_reset;
+    }
+    else if((u32_t)(tcp_ticks - pcb->tmr) > 
+            (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+            / TCP_SLOW_INTERVAL)
+    {
+      err = tcp_keepalive(pcb);
+      if (err == ERR_OK) {
+        pcb->keep_cnt_sent++;
+      }
+    }
+  }
+
+  /* If this PCB has queued out of sequence data, but has been
+     inactive for too long, will drop the data (it will eventually
+     be retransmitted). */
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL &&
+      (u32_t)tcp_ticks - pcb->tmr >= pcb->rto * TCP_OOSEQ_TIMEOUT) {
+    tcp_ooseq_free(pcb);
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  /* Check if this PCB has stayed too long in SYN-RCVD */
+  if (pcb->state == SYN_RCVD) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
+    }
+  }
+
+  /* Check if this PCB has stayed too long in LAST-ACK */
+  if (pcb->state == LAST_ACK) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
+    }
+  }
+
+  *reset = pcb_reset;
+  return pcb_remove;
+}
+
+#if !LWIP_TCP_PCB_TIMERS
 /**
- * Called every 500 ms and implements the retransmission timer and the timer that
+ * Called every 500 ms and implements the retransmission timer (unless
+ * LWIP_TCP_RTT_MS, see tcp_rto_tmr()) and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
  * various timers such as the inactivity timer in each PCB.
  *
@@ -868,7 +1254,6 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -897,137 +1282,7 @@ tcp_slowtmr_start:
     }
     pcb->last_timer = tcp_timer_ctr;
 
-    pcb_remove = 0;
-    pcb_reset = 0;
-
-    if (pcb->state == SYN_SENT && pcb->nrtx == TCP_SYNMAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
-    }
-    else if (pcb->nrtx == TCP_MAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
-    } else {
-      if (pcb->persist_backoff > 0) {
-        /* If snd_wnd is zero, use persist timer to send 1 byte probes
-         * instead of using the standard retransmission mechanism. */
-        u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff-1];
-        if (pcb->persist_cnt < backoff_cnt) {
-          pcb->persist_cnt++;
-        }
-        if (pcb->persist_cnt >= backoff_cnt) {
-          if (tcp_zero_window_probe(pcb) == ERR_OK) {
-            pcb->persist_cnt = 0;
-            if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
-              pcb->persist_backoff++;
-            }
-          }
-        }
-      } else {
-        /* Increase the retransmission timer if it is running */
-        if(pcb->rtime >= 0) {
-          ++pcb->rtime;
-        }
-
-        if (pcb->unacked != NULL && pcb->rtime >= pcb->rto) {
-          /* Time for a retransmission. */
-          LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
-                                      " pcb->rto %"S16_F"\n",
-                                      pcb->rtime, pcb->rto));
-
-          /* Double retransmission time-out unless we are trying to
-           * connect to somebody (i.e., we are in SYN_SENT). */
-          if (pcb->state != SYN_SENT) {
-            pcb->rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[pcb->nrtx];
-          }
-
-          /* Reset the retransmission timer. */
-          pcb->rtime = 0;
-
-          /* Reduce congestion window and ssthresh. */
-          eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-          pcb->ssthresh = eff_wnd >> 1;
-          if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-            pcb->ssthresh = (pcb->mss << 1);
-          }
-          pcb->cwnd = pcb->mss;
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                       " ssthresh %"TCPWNDSIZE_F"\n",
-                                       pcb->cwnd, pcb->ssthresh));
-
-          /* The following needs to be called AFTER cwnd is set to one
-             mss - STJ */
-          tcp_rexmit_rto(pcb);
-        }
-      }
-    }
-    /* Check if this PCB has stayed too long in FIN-WAIT-2 */
-    if (pcb->state == FIN_WAIT_2) {
-      /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
-      if (pcb->flags & TF_RXCLOSED) {
-        /* PCB was fully closed (either through close() or SHUT_RDWR):
-           normal FIN-WAIT timeout handling. */
-        if ((u32_t)(tcp_ticks - pcb->tmr) >
-            TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
-          ++pcb_remove;
-          LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
-        }
-      }
-    }
-
-    /* Check if KEEPALIVE should be sent */
-    if(ip_get_option(pcb, SOF_KEEPALIVE) &&
-       ((pcb->state == ESTABLISHED) ||
-        (pcb->state == CLOSE_WAIT))) {
-      if((u32_t)(tcp_ticks - pcb->tmr) >
-         (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL)
-      {
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
-        ip_addr_debug_print(TCP_DEBUG, &pcb->remote_ip);
-        LWIP_DEBUGF(TCP_DEBUG, ("\n"));
-        
-        ++pcb_remove;
-        ++pcb_reset;
-      }
-      else if((u32_t)(tcp_ticks - pcb->tmr) > 
-              (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
-              / TCP_SLOW_INTERVAL)
-      {
-        err = tcp_keepalive(pcb);
-        if (err == ERR_OK) {
-          pcb->keep_cnt_sent++;
-        }
-      }
-    }
-
-    /* If this PCB has queued out of sequence data, but has been
-       inactive for too long, will drop the data (it will eventually
-       be retransmitted). */
-#if TCP_QUEUE_OOSEQ
-    if (pcb->ooseq != NULL &&
-        (u32_t)tcp_ticks - pcb->tmr >= pcb->rto * TCP_OOSEQ_TIMEOUT) {
-      tcp_segs_free(pcb->ooseq);
-      pcb->ooseq = NULL;
-      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
-    }
-#endif /* TCP_QUEUE_OOSEQ */
-
-    /* Check if this PCB has stayed too long in SYN-RCVD */
-    if (pcb->state == SYN_RCVD) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
-      }
-    }
-
-    /* Check if this PCB has stayed too long in LAST-ACK */
-    if (pcb->state == LAST_ACK) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
-      }
-    }
+    pcb_remove = tcp_slowtmr_pcb(pcb, &pcb_reset);
 
     /* If the PCB should be removed, do it. */
     if (pcb_remove) {
@@ -1044,6 +1299,8 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_active_pcbs, pcb);
+      TCP_RTO_RMV(&tcp_active_pcbs, pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1112,6 +1369,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(&tcp_tw_pcbs, pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       memp_free(MEMP_TCP_PCB, pcb2);
@@ -1168,6 +1426,298 @@ tcp_fasttmr_start:
   }
 }
 
+#else /* !LWIP_TCP_PCB_TIMERS */
+
+/** Unlink a pcb from the dirty list (or the list tcp_fasttmr() works on) */
+static void
+tcp_timers_dirty_unlink(struct tcp_pcb *pcb)
+{
+  *pcb->tmr_dirty_pprev = pcb->tmr_dirty_next;
+  if (pcb->tmr_dirty_next != NULL) {
+    pcb->tmr_dirty_next->tmr_dirty_pprev = pcb->tmr_dirty_pprev;
+  }
+  pcb->tmr_flags &= ~TCP_TIMERS_F_DIRTY;
+}
+
+/** Update *next if tick 'due' is earlier (ticks before tcp_ticks + 1 count as
+ * tcp_ticks + 1) */
+static void
+tcp_timers_min(u32_t *next, u8_t *found, u32_t due)
+{
+  if ((s32_t)(due - (tcp_ticks + 1)) < 0) {
+    due = tcp_ticks + 1;
+  }
+  if (!*found || ((s32_t)(due - *next) < 0)) {
+    *next = due;
+    *found = 1;
+  }
+}
+
+/**
+ * Calculate the next tcp_ticks value at which tcp_slowtmr() has to handle
+ * a pcb. This mirrors the checks done by tcp_slowtmr_pcb() and the poll
+ * timer: counters that are incremented every tick (retransmission and
+ * persist timer) make the pcb due every tick while they are running.
+ *
+ * @param pcb the pcb to check
+ * @param next receives the tick the pcb is due at
+ * @return 1 if the pcb has a deadline, 0 if it is idle
+ */
+static u8_t
+tcp_timers_next(struct tcp_pcb *pcb, u32_t *next)
+{
+  u8_t found = 0;
+
+  if (pcb->state == TIME_WAIT) {
+    tcp_timers_min(next, &found, pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+    return found;
+  }
+  if (
+#if !LWIP_TCP_RTT_MS
+      /* with LWIP_TCP_RTT_MS, tcp_rto_tmr() runs the retransmission timer */
+      (pcb->rtime >= 0) ||
+#endif /* !LWIP_TCP_RTT_MS */
+      (pcb->persist_backoff > 0) ||
+      (pcb->nrtx == TCP_MAXRTX) ||
+      ((pcb->state == SYN_SENT) && (pcb->nrtx == TCP_SYNMAXRTX))) {
+    tcp_timers_min(next, &found, tcp_ticks + 1);
+    return found;
+  }
+  if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+    tcp_timers_min(next, &found, pcb->tmr + TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+  }
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+    tcp_timers_min(next, &found, pcb->tmr +
+      (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb)) / TCP_SLOW_INTERVAL + 1);
+  }
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL) {
+    tcp_timers_min(next, &found, pcb->tmr + pcb->rto * TCP_OOSEQ_TIMEOUT);
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+  if (pcb->state == SYN_RCVD) {
+    tcp_timers_min(next, &found, pcb->tmr + TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+  }
+  if (pcb->state == LAST_ACK) {
+    tcp_timers_min(next, &found, pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+  }
+  /* The poll timer only matters if there is a poll callback or something
+     for the tcp_output() following it to do. */
+  if (
+#if LWIP_CALLBACK_API
+      (pcb->poll != NULL) ||
+#else /* LWIP_CALLBACK_API */
+      1 ||
+#endif /* LWIP_CALLBACK_API */
+      (pcb->unsent != NULL) || (pcb->flags & TF_NAGLEMEMERR)) {
+    tcp_timers_min(next, &found, pcb->tmr_last +
+      ((pcb->polltmr < pcb->pollinterval) ? (u32_t)(pcb->pollinterval - pcb->polltmr) : 1));
+  }
+  return found;
+}
+
+/** Re-calculate the deadline of a registered pcb and (re-)insert it into
+ * the wheel. Pcbs that still need tcp_fasttmr() go back on the dirty list. */
+static void
+tcp_timers_arm(struct tcp_pcb *pcb)
+{
+  if (!(pcb->tmr_flags & TCP_TIMERS_F_REG)) {
+    return;
+  }
+  if (wheel_node_linked(&pcb->tmr_node)) {
+    wheel_remove(&tcp_timers_wheel, &pcb->tmr_node);
+  }
+  if (tcp_timers_next(pcb, &pcb->tmr_node.due)) {
+    /* an empty wheel follows tcp_ticks (which the unit tests set) */
+    wheel_sync(&tcp_timers_wheel, tcp_ticks);
+    wheel_insert(&tcp_timers_wheel, &pcb->tmr_node);
+  }
+  if ((pcb->state != TIME_WAIT) &&
+      ((pcb->refused_data != NULL) || (pcb->flags & TF_ACK_DELAY))) {
+    tcp_timers_touch(pcb);
+  }
+}
+
+/**
+ * Called from TCP_REG: active and TIME-WAIT pcbs get their deadlines
+ * evaluated by the next tcp_fasttmr().
+ */
+void
+tcp_timers_reg(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if ((pcblist == &tcp_active_pcbs) || (pcblist == &tcp_tw_pcbs)) {
+    pcb->tmr_last = tcp_ticks;
+    pcb->tmr_flags = TCP_TIMERS_F_REG;
+    tcp_timers_touch(pcb);
+  }
+}
+
+/**
+ * Called from TCP_RMV: unlink a pcb from the wheel and the timer lists.
+ */
+void
+tcp_timers_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if ((pcblist == &tcp_active_pcbs) || (pcblist == &tcp_tw_pcbs)) {
+    if (wheel_node_linked(&pcb->tmr_node)) {
+      wheel_remove(&tcp_timers_wheel, &pcb->tmr_node);
+    }
+    if (pcb->tmr_flags & TCP_TIMERS_F_DIRTY) {
+      tcp_timers_dirty_unlink(pcb);
+    }
+    pcb->tmr_flags = 0;
+  }
+}
+
+/**
+ * Have the deadlines of a pcb re-evaluated by the next tcp_fasttmr().
+ * Called by the stack whenever a pcb's timer state might have changed
+ * (tcp_output(), tcp_write(), tcp_poll(), keepalive options).
+ *
+ * @param pcb the tcp_pcb to check (may be in any state)
+ */
+void
+tcp_timers_touch(struct tcp_pcb *pcb)
+{
+  if (pcb->state == LISTEN) {
+    /* struct tcp_pcb_listen has no timer fields */
+    return;
+  }
+  if ((pcb->tmr_flags & (TCP_TIMERS_F_REG | TCP_TIMERS_F_DIRTY)) == TCP_TIMERS_F_REG) {
+    pcb->tmr_dirty_pprev = &tcp_timers_dirty;
+    pcb->tmr_dirty_next = tcp_timers_dirty;
+    if (tcp_timers_dirty != NULL) {
+      tcp_timers_dirty->tmr_dirty_pprev = &pcb->tmr_dirty_next;
+    }
+    tcp_timers_dirty = pcb;
+    pcb->tmr_flags |= TCP_TIMERS_F_DIRTY;
+  }
+}
+
+/**
+ * Called every 500 ms: handles only the pcbs that have a deadline in this
+ * tick (see tcp_timers_next()). Retransmission, persist and keepalive
+ * handling and the state timeouts are the same as without
+ * LWIP_TCP_PCB_TIMERS, the poll timer is caught up for the ticks a pcb
+ * was not handled.
+ *
+ * Automatically called from tcp_tmr().
+ */
+void
+tcp_slowtmr(void)
+{
+  struct tcp_pcb *pcb;
+  err_t err;
+
+  ++tcp_ticks;
+  ++tcp_timer_ctr;
+
+  /* move this tick's pcbs to the expired list so that callbacks can safely
+     remove pcbs while we work on them */
+  while (wheel_advance(&tcp_timers_wheel, tcp_ticks)) {
+    while (tcp_timers_wheel.expired != NULL) {
+      u32_t missed;
+      pcb = WHEEL_ENTRY(tcp_timers_wheel.expired, struct tcp_pcb, tmr_node);
+      missed = tcp_ticks - pcb->tmr_last - 1;
+      wheel_remove(&tcp_timers_wheel, &pcb->tmr_node);
+      pcb->tmr_last = tcp_ticks;
+
+      if (pcb->state == TIME_WAIT) {
+        /* Check if this PCB has stayed long enough in TIME-WAIT */
+        if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+          tcp_pcb_purge(pcb);
+          TCP_RMV(&tcp_tw_pcbs, pcb);
+          memp_free(MEMP_TCP_PCB, pcb);
+          continue;
+        }
+      } else {
+        u8_t pcb_reset = 0;
+        LWIP_ASSERT("tcp_slowtmr: active pcb->state != CLOSED\n", pcb->state != CLOSED);
+        LWIP_ASSERT("tcp_slowtmr: active pcb->state != LISTEN\n", pcb->state != LISTEN);
+
+        if (tcp_slowtmr_pcb(pcb, &pcb_reset)) {
+          tcp_err_fn err_fn = pcb->errf;
+          void *err_arg = pcb->callback_arg;
+          tcp_pcb_purge(pcb);
+          TCP_RMV_ACTIVE(pcb);
+          if (pcb_reset) {
+            tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
+                     pcb->local_port, pcb->remote_port);
+          }
+          memp_free(MEMP_TCP_PCB, pcb);
+          TCP_EVENT_ERR(err_fn, err_arg, ERR_ABRT);
+          continue;
+        }
+
+        /* We check if we should poll the connection (the poll timer did not
+           run while this pcb had no deadline). */
+        pcb->polltmr = (u8_t)LWIP_MIN(pcb->polltmr + missed, 0xfe);
+        ++pcb->polltmr;
+        if (pcb->polltmr >= pcb->pollinterval) {
+          pcb->polltmr = 0;
+          LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
+          TCP_EVENT_POLL(pcb, err);
+          /* if err == ERR_ABRT, 'pcb' is already deallocated */
+          if (err == ERR_ABRT) {
+            continue;
+          }
+          if (err == ERR_OK) {
+            tcp_output(pcb);
+          }
+        }
+      }
+      tcp_timers_arm(pcb);
+    }
+  }
+}
+
+/**
+ * Is called every TCP_FAST_INTERVAL (250 ms): sends delayed ACKs, processes
+ * data previously "refused" by upper layer (application) and re-evaluates
+ * the deadlines of all pcbs touched since the last call.
+ *
+ * Automatically called from tcp_tmr().
+ */
+void
+tcp_fasttmr(void)
+{
+  struct tcp_pcb *pcb;
+
+  ++tcp_timer_ctr;
+
+  /* only pcbs touched since the last call are handled */
+  LWIP_ASSERT("tcp_timers_touched == NULL", tcp_timers_touched == NULL);
+  tcp_timers_touched = tcp_timers_dirty;
+  tcp_timers_dirty = NULL;
+  if (tcp_timers_touched != NULL) {
+    tcp_timers_touched->tmr_dirty_pprev = &tcp_timers_touched;
+  }
+
+  while ((pcb = tcp_timers_touched) != NULL) {
+    tcp_timers_dirty_unlink(pcb);
+    if (pcb->state != TIME_WAIT) {
+      /* send delayed ACKs */
+      if (pcb->flags & TF_ACK_DELAY) {
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: delayed ACK\n"));
+        tcp_ack_now(pcb);
+        tcp_output(pcb);
+        pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
+      }
+
+      /* If there is data which was previously "refused" by upper layer */
+      if (pcb->refused_data != NULL) {
+        if (tcp_process_refused_data(pcb) == ERR_ABRT) {
+          /* pcb has been freed */
+          continue;
+        }
+      }
+    }
+    tcp_timers_arm(pcb);
+  }
+}
+#endif /* !LWIP_TCP_PCB_TIMERS */
+
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
 void
 tcp_txnow(void)
@@ -1288,6 +1838,23 @@ tcp_setprio(struct tcp_pcb *pcb, u8_t prio)
 }
 
 #if TCP_QUEUE_OOSEQ
+/**
+ * Deallocates the out-of-sequence queue of a pcb (pcb->ooseq).
+ *
+ * @param pcb the tcp_pcb whose queued out-of-sequence segments to free
+ */
+void
+tcp_ooseq_free(struct tcp_pcb *pcb)
+{
+  tcp_segs_free(pcb->ooseq);
+  pcb->ooseq = NULL;
+  pcb->ooseq_root = NULL;
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  pcb->ooseq_blen = 0;
+  pcb->ooseq_qlen = 0;
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+}
+
 /**
  * Returns a copy of the given TCP segment.
  * The pbuf and data are not copied, only the pointers
@@ -1499,8 +2066,13 @@ tcp_alloc(u8_t prio)
     pcb->rto = 3000 / TCP_SLOW_INTERVAL;
     pcb->sa = 0;
     pcb->sv = 3000 / TCP_SLOW_INTERVAL;
+#if LWIP_TCP_RTT_MS
+    tcp_rto_calc(pcb);
+#endif /* LWIP_TCP_RTT_MS */
     pcb->rtime = -1;
     pcb->cwnd = 1;
+    pcb->cc_ops = TCP_CC_DEFAULT;
+    pcb->cc_ops->init(pcb);
     iss = tcp_next_iss();
     pcb->snd_wl2 = iss;
     pcb->snd_nxt = iss;
@@ -1659,6 +2231,7 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */  
   pcb->pollinterval = interval;
+  tcp_timers_touch(pcb);
 }
 
 /**
@@ -1713,8 +2286,7 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
     if (pcb->ooseq != NULL) {
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_purge: data left on ->ooseq\n"));
     }
-    tcp_segs_free(pcb->ooseq);
-    pcb->ooseq = NULL;
+    tcp_ooseq_free(pcb);
 #endif /* TCP_QUEUE_OOSEQ */
 
     /* Stop the retransmission timer as it will expect data on unacked
@@ -1730,6 +2302,95 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_PCB_HASH
+/** Fold an IP address into 32 bits for tcp_pcb_hash() */
+static u32_t
+tcp_pcb_hash_addr(const ip_addr_t *addr)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(addr)) {
+    const u32_t *a = ip_2_ip6(addr)->addr;
+    return a[0] ^ a[1] ^ a[2] ^ a[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(addr));
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/**
+ * Calculate the bucket index of a connection in tcp_active_hash/tcp_tw_hash.
+ *
+ * @param local_ip local IP address of the connection
+ * @param local_port local port in host byte order
+ * @param remote_ip remote IP address of the connection
+ * @param remote_port remote port in host byte order
+ * @return bucket index in the range [0..TCP_PCB_HASH_SIZE-1]
+ */
+u16_t
+tcp_pcb_hash(const ip_addr_t *local_ip, u16_t local_port,
+             const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_pcb_hash_addr(local_ip) ^ tcp_pcb_hash_addr(remote_ip) ^
+    (((u32_t)local_port << 16) | remote_port);
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return (u16_t)(h & (TCP_PCB_HASH_SIZE - 1));
+}
+
+/** Get the hash bucket a pcb on 'pcblist' belongs to (NULL for unhashed lists) */
+static struct tcp_pcb **
+tcp_pcb_hash_bucket(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  if (pcblist == &tcp_active_pcbs) {
+    return &tcp_active_hash[tcp_pcb_hash(&pcb->local_ip, pcb->local_port,
+      &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcblist == &tcp_tw_pcbs) {
+    return &tcp_tw_hash[tcp_pcb_hash(&pcb->local_ip, pcb->local_port,
+      &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcblist == &tcp_listen_pcbs.pcbs) {
+    return &tcp_listen_hash[TCP_PCB_LISTEN_HASH(pcb->local_port)].pcbs;
+  }
+  /* tcp_bound_pcbs are never looked up by tcp_input() */
+  return NULL;
+}
+
+/**
+ * Insert a pcb into the hash table belonging to a pcb list.
+ * Called from TCP_REG after the pcb has been put on 'pcblist'.
+ */
+void
+tcp_pcb_hash_reg(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(pcblist, pcb);
+  if (bucket != NULL) {
+    pcb->hash_next = *bucket;
+    *bucket = pcb;
+  }
+}
+
+/**
+ * Remove a pcb from the hash table belonging to a pcb list.
+ * Called from TCP_RMV; does nothing if the pcb is not hashed.
+ */
+void
+tcp_pcb_hash_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(pcblist, pcb);
+  if (bucket != NULL) {
+    for (; *bucket != NULL; bucket = &(*bucket)->hash_next) {
+      if (*bucket == pcb) {
+        *bucket = pcb->hash_next;
+        break;
+      }
+    }
+    pcb->hash_next = NULL;
+  }
+}
+#endif /* LWIP_TCP_PCB_HASH */
+
 /**
  * Purges the PCB and removes it from a PCB list. Any delayed ACKs are sent first.
  *
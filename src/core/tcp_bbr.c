@@ -0,0 +1,293 @@
+/**
+ * @file
+ * Model-based TCP congestion control after BBR (without pacing)
+ *
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission. 
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT 
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_CC_BBR /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp_impl.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+/**
+ * This module keeps a model of the path: the maximum delivery rate seen in
+ * the last BBR_BW_ROUNDS round trips and the minimum round-trip time seen in
+ * the last BBR_MIN_RTT_WIN milliseconds. cwnd is set to a gain times their
+ * product (the bandwidth-delay product) instead of being reduced on loss.
+ *
+ * lwIP does not pace segments, so unlike real BBR the gains are applied to
+ * cwnd: a round at 5/4 of the BDP probes for more bandwidth, the next one at
+ * 3/4 drains the queue this built. A round trip is measured from the time
+ * snd_nxt is recorded until data sent after it is ACKed, which also gives
+ * the RTT samples.
+ */
+#define BBR_BW_ROUNDS      10
+#define BBR_MIN_RTT_WIN    10000
+#define BBR_PROBE_RTT_TIME 200
+#define BBR_MIN_CWND(pcb)  (4U * (pcb)->mss)
+
+enum bbr_mode {
+  BBR_STARTUP,   /* exponential growth until bandwidth stops increasing */
+  BBR_DRAIN,     /* drain the queue built in startup */
+  BBR_PROBE_BW,  /* cycle the cwnd gain around the BDP */
+  BBR_PROBE_RTT  /* shrink cwnd to refresh the minimum RTT */
+};
+
+/** cwnd gain per PROBE_BW round, in 1/4 */
+static const u8_t bbr_cycle_gain[8] = { 5, 3, 4, 4, 4, 4, 4, 4 };
+
+struct tcp_bbr {
+  u8_t mode;
+  u8_t cycle_idx;
+  u8_t full_bw_cnt;    /* rounds without significant bandwidth growth */
+  u8_t started;        /* round tracking started */
+  u32_t round_seq;     /* the round ends when this is ACKed */
+  u32_t round_start;   /* TCP_NOW() at the start of the round */
+  u32_t round_acked;   /* bytes ACKed in this round */
+  u32_t round_count;
+  u32_t bw;            /* max. delivery rate (bytes/ms << 8) */
+  u32_t bw_round;      /* round_count when bw was sampled */
+  u32_t full_bw;       /* bw at the last 25% growth in startup */
+  u32_t min_rtt;       /* ms, 0 if no sample yet */
+  u32_t min_rtt_stamp; /* TCP_NOW() when min_rtt was sampled */
+  u32_t probe_rtt_done;
+  u32_t prior_cwnd;    /* cwnd before PROBE_RTT */
+};
+
+/** The bandwidth-delay product in bytes (0 if there is no model yet) */
+static u32_t
+tcp_bbr_bdp(struct tcp_bbr *b)
+{
+  return (b->bw >> 8) * b->min_rtt + (((b->bw & 0xFF) * b->min_rtt) >> 8);
+}
+
+/** The cwnd the model asks for, with a gain in 1/4 */
+static tcpwnd_size_t
+tcp_bbr_target(struct tcp_pcb *pcb, struct tcp_bbr *b, u32_t gain)
+{
+  u32_t target = tcp_bbr_bdp(b) / 4 * gain + 2U * pcb->mss;
+  target = LWIP_MAX(target, BBR_MIN_CWND(pcb));
+  return (tcpwnd_size_t)LWIP_MIN(target, (u32_t)TCPWND_MAX);
+}
+
+static void
+tcp_bbr_new_round(struct tcp_pcb *pcb, struct tcp_bbr *b, u32_t now)
+{
+  /* data up to snd_nxt may have been sent long ago: the round (and the RTT
+     sample) ends with the ACK for data sent from now on */
+  b->round_seq = pcb->snd_nxt + 1;
+  b->round_start = now;
+  b->round_acked = 0;
+}
+
+/** A round trip ended: take bandwidth and RTT samples, advance the mode */
+static void
+tcp_bbr_round_end(struct tcp_pcb *pcb, struct tcp_bbr *b, u32_t now)
+{
+  u32_t elapsed = now - b->round_start;
+  u32_t sample;
+
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+  if ((b->min_rtt == 0) || (elapsed <= b->min_rtt)) {
+    b->min_rtt = elapsed;
+    b->min_rtt_stamp = now;
+  }
+  sample = (b->round_acked << 8) / elapsed;
+  if ((sample >= b->bw) || ((u32_t)(b->round_count - b->bw_round) >= BBR_BW_ROUNDS)) {
+    b->bw = sample;
+    b->bw_round = b->round_count;
+  }
+  b->round_count++;
+
+  switch (b->mode) {
+  case BBR_STARTUP:
+    if (b->bw >= b->full_bw + b->full_bw / 4) {
+      b->full_bw = b->bw;
+      b->full_bw_cnt = 0;
+    } else if (++b->full_bw_cnt >= 3) {
+      b->mode = BBR_DRAIN;
+    }
+    break;
+  case BBR_DRAIN:
+    if ((u32_t)(pcb->snd_nxt - pcb->lastack) <= tcp_bbr_bdp(b)) {
+      b->mode = BBR_PROBE_BW;
+      b->cycle_idx = 0;
+    }
+    break;
+  case BBR_PROBE_BW:
+    b->cycle_idx = (u8_t)((b->cycle_idx + 1) & 7);
+    break;
+  case BBR_PROBE_RTT:
+    if ((s32_t)(now - b->probe_rtt_done) >= 0) {
+      b->mode = (b->full_bw_cnt >= 3) ? BBR_PROBE_BW : BBR_STARTUP;
+      b->cycle_idx = 0;
+      b->min_rtt_stamp = now;
+      pcb->cwnd = (tcpwnd_size_t)LWIP_MAX(pcb->cwnd, b->prior_cwnd);
+    }
+    break;
+  default:
+    break;
+  }
+
+  if ((b->mode != BBR_PROBE_RTT) && ((u32_t)(now - b->min_rtt_stamp) > BBR_MIN_RTT_WIN)) {
+    /* min_rtt is stale: measure it again with (almost) empty queues */
+    b->mode = BBR_PROBE_RTT;
+    b->prior_cwnd = pcb->cwnd;
+    b->probe_rtt_done = now + LWIP_MAX(BBR_PROBE_RTT_TIME, b->min_rtt);
+    b->min_rtt = 0;
+  }
+  tcp_bbr_new_round(pcb, b, now);
+}
+
+static void
+tcp_bbr_init(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("TCP_CC_PRIV_WORDS too small for bbr",
+    TCP_CC_PRIV_WORDS * sizeof(u32_t) >= sizeof(struct tcp_bbr));
+  memset(TCP_CC_PRIV(pcb, struct tcp_bbr), 0, sizeof(struct tcp_bbr));
+}
+
+static void
+tcp_bbr_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct tcp_bbr *b = TCP_CC_PRIV(pcb, struct tcp_bbr);
+  u32_t now = TCP_NOW();
+  tcpwnd_size_t target;
+
+  if (!b->started) {
+    b->started = 1;
+    b->min_rtt_stamp = now;
+    tcp_bbr_new_round(pcb, b, now);
+  } else {
+    b->round_acked = LWIP_MIN(b->round_acked + acked, 0xFFFFFFU);
+    if (TCP_SEQ_GEQ(pcb->lastack, b->round_seq)) {
+      tcp_bbr_round_end(pcb, b, now);
+    }
+  }
+
+  if (pcb->flags & TF_INFR) {
+    /* fast recovery adjusts cwnd */
+    return;
+  }
+  switch (b->mode) {
+  case BBR_STARTUP:
+    if ((tcpwnd_size_t)(pcb->cwnd + acked) > pcb->cwnd) {
+      pcb->cwnd += acked;
+    }
+    break;
+  case BBR_PROBE_RTT:
+    pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(pcb->cwnd, BBR_MIN_CWND(pcb));
+    break;
+  default:
+    target = tcp_bbr_target(pcb, b, (b->mode == BBR_PROBE_BW) ? bbr_cycle_gain[b->cycle_idx] : 4);
+    if (pcb->cwnd < target) {
+      /* grow back at most as fast as in slow start */
+      pcb->cwnd = (tcpwnd_size_t)LWIP_MIN((u32_t)pcb->cwnd + acked, target);
+    } else {
+      pcb->cwnd = target;
+    }
+    break;
+  }
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_bbr_ack: mode %"U16_F" bw %"U32_F" min_rtt %"U32_F" cwnd %"TCPWNDSIZE_F"\n",
+                               (u16_t)b->mode, b->bw, b->min_rtt, pcb->cwnd));
+}
+
+static void
+tcp_bbr_loss(struct tcp_pcb *pcb)
+{
+  struct tcp_bbr *b = TCP_CC_PRIV(pcb, struct tcp_bbr);
+
+  if (b->bw == 0) {
+    /* no model yet */
+    tcp_cc_newreno.loss(pcb);
+    return;
+  }
+  if (b->mode == BBR_STARTUP) {
+    /* loss in startup: the pipe is full */
+    b->mode = BBR_DRAIN;
+    b->full_bw_cnt = 3;
+  }
+  /* loss is no congestion signal to the model: keep sending at the BDP */
+  pcb->ssthresh = tcp_bbr_target(pcb, b, 4);
+  pcb->cwnd = pcb->ssthresh;
+}
+
+static void
+tcp_bbr_recovered(struct tcp_pcb *pcb)
+{
+  struct tcp_bbr *b = TCP_CC_PRIV(pcb, struct tcp_bbr);
+  if (b->bw == 0) {
+    pcb->cwnd = pcb->ssthresh;
+  } else {
+    pcb->cwnd = tcp_bbr_target(pcb, b, 4);
+  }
+}
+
+static void
+tcp_bbr_rto(struct tcp_pcb *pcb)
+{
+  struct tcp_bbr *b = TCP_CC_PRIV(pcb, struct tcp_bbr);
+
+  if (b->bw == 0) {
+    tcp_cc_newreno.rto(pcb);
+    return;
+  }
+  /* restart from one segment, ACKs grow cwnd back to the model quickly */
+  pcb->ssthresh = tcp_bbr_target(pcb, b, 4);
+  pcb->cwnd = pcb->mss;
+}
+
+static void
+tcp_bbr_idle(struct tcp_pcb *pcb)
+{
+  /* keep the model, but don't count the idle time as a round trip */
+  TCP_CC_PRIV(pcb, struct tcp_bbr)->started = 0;
+}
+
+const struct tcp_cc_ops tcp_cc_bbr = {
+  "bbr",
+  tcp_bbr_init,
+  tcp_bbr_ack,
+  tcp_bbr_loss,
+  tcp_bbr_recovered,
+  tcp_bbr_rto,
+  tcp_bbr_idle
+};
+
+#endif /* LWIP_TCP && LWIP_TCP_CC_BBR */
@@ -0,0 +1,198 @@
+/**
+ * @file
+ * TCP congestion control: module selection and the NewReno module
+ * (RFC 5681, RFC 6582).
+ *
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission. 
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT 
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp_impl.h"
+#include "lwip/def.h"
+
+#include <string.h>
+
+/** All congestion control modules that can be selected by name */
+static const struct tcp_cc_ops * const tcp_cc_modules[] = {
+  &tcp_cc_newreno,
+#if LWIP_TCP_CC_CUBIC
+  &tcp_cc_cubic,
+#endif /* LWIP_TCP_CC_CUBIC */
+#if LWIP_TCP_CC_BBR
+  &tcp_cc_bbr,
+#endif /* LWIP_TCP_CC_BBR */
+};
+
+/**
+ * Set the congestion control module of a pcb. On a listening pcb, this
+ * sets the module used by connections accepted from it.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param ops the module to use
+ */
+void
+tcp_set_cc_ops(struct tcp_pcb *pcb, const struct tcp_cc_ops *ops)
+{
+  LWIP_ASSERT("tcp_set_cc_ops: invalid ops", ops != NULL);
+  if (pcb->state == LISTEN) {
+    ((struct tcp_pcb_listen *)pcb)->cc_ops = ops;
+    return;
+  }
+  pcb->cc_ops = ops;
+  ops->init(pcb);
+}
+
+/**
+ * Set the congestion control module of a pcb by name.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param name name of the module ("newreno", "cubic", "bbr")
+ * @return ERR_OK if the module was set, ERR_ARG if it is not compiled in
+ */
+err_t
+tcp_set_congestion(struct tcp_pcb *pcb, const char *name)
+{
+  size_t i;
+  for (i = 0; i < sizeof(tcp_cc_modules) / sizeof(tcp_cc_modules[0]); i++) {
+    if (strcmp(tcp_cc_modules[i]->name, name) == 0) {
+      tcp_set_cc_ops(pcb, tcp_cc_modules[i]);
+      return ERR_OK;
+    }
+  }
+  return ERR_ARG;
+}
+
+/**
+ * Get the name of the congestion control module of a pcb.
+ */
+const char *
+tcp_get_congestion(struct tcp_pcb *pcb)
+{
+  if (pcb->state == LISTEN) {
+    return ((struct tcp_pcb_listen *)pcb)->cc_ops->name;
+  }
+  return pcb->cc_ops->name;
+}
+
+static void
+tcp_newreno_init(struct tcp_pcb *pcb)
+{
+  LWIP_UNUSED_ARG(pcb);
+}
+
+static void
+tcp_newreno_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  LWIP_UNUSED_ARG(acked);
+  if (pcb->flags & TF_INFR) {
+    return;
+  }
+  if (pcb->cwnd < pcb->ssthresh) {
+    if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+      pcb->cwnd += pcb->mss;
+    }
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+  } else {
+    tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+    if (new_cwnd > pcb->cwnd) {
+      pcb->cwnd = new_cwnd;
+    }
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+  }
+}
+
+static void
+tcp_newreno_loss(struct tcp_pcb *pcb)
+{
+  /* Set ssthresh to half of the minimum of the current
+   * cwnd and the advertised window */
+  if (pcb->cwnd > pcb->snd_wnd) {
+    pcb->ssthresh = pcb->snd_wnd / 2;
+  } else {
+    pcb->ssthresh = pcb->cwnd / 2;
+  }
+
+  /* The minimum value for ssthresh should be 2 MSS */
+  if (pcb->ssthresh < (2U * pcb->mss)) {
+    LWIP_DEBUGF(TCP_FR_DEBUG,
+                ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
+                 " should be min 2 mss %"U16_F"...\n",
+                 pcb->ssthresh, 2*pcb->mss));
+    pcb->ssthresh = 2*pcb->mss;
+  }
+
+  pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+}
+
+static void
+tcp_newreno_recovered(struct tcp_pcb *pcb)
+{
+  pcb->cwnd = pcb->ssthresh;
+}
+
+static void
+tcp_newreno_rto(struct tcp_pcb *pcb)
+{
+  tcpwnd_size_t eff_wnd;
+
+  /* Reduce congestion window and ssthresh. */
+  eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+  pcb->ssthresh = eff_wnd >> 1;
+  if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+    pcb->ssthresh = (pcb->mss << 1);
+  }
+  pcb->cwnd = pcb->mss;
+}
+
+static void
+tcp_newreno_idle(struct tcp_pcb *pcb)
+{
+  /* restart window (RFC 5681, 4.1) */
+  tcpwnd_size_t rw = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+  if (pcb->cwnd > rw) {
+    pcb->cwnd = rw;
+  }
+}
+
+const struct tcp_cc_ops tcp_cc_newreno = {
+  "newreno",
+  tcp_newreno_init,
+  tcp_newreno_ack,
+  tcp_newreno_loss,
+  tcp_newreno_recovered,
+  tcp_newreno_rto,
+  tcp_newreno_idle
+};
+
+#endif /* LWIP_TCP */
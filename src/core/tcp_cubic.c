@@ -0,0 +1,226 @@
+/**
+ * @file
+ * CUBIC TCP congestion control (RFC 8312)
+ *
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission. 
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT 
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_CC_CUBIC /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp_impl.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+/**
+ * All arithmetic is done in u32_t: time is kept in 1/1024 seconds and the
+ * cubic function is evaluated for at most 64 seconds away from K.
+ * beta is 0.7 and C is 0.4 (RFC 8312, 5.).
+ */
+#define CUBIC_MAX_OFFS   0xFFFFU
+
+struct tcp_cubic {
+  u32_t epoch_start; /* TCP_NOW() when the current epoch began (0: none) */
+  u32_t w_max;       /* cwnd before the last reduction (bytes) */
+  u32_t origin;      /* cwnd at the plateau of the cubic function */
+  u32_t k;           /* time from epoch start to the plateau (1/1024 s) */
+  u32_t w_est;       /* TCP-friendly (Reno) window estimate (bytes) */
+};
+
+/** Bytes the cubic function grows (or shrinks) 'offs' (1/1024 s) away
+ * from K: C * offs^3 segments */
+static u32_t
+tcp_cubic_delta(u32_t offs, u16_t mss)
+{
+  u32_t t2, t3, segs;
+  if (offs > CUBIC_MAX_OFFS) {
+    offs = CUBIC_MAX_OFFS;
+  }
+  t2 = (offs * offs) >> 10;          /* s^2 * 2^10 */
+  t3 = ((t2 >> 6) * offs) >> 4;      /* s^3 * 2^10 */
+  segs = t3 / 10 * 4;                /* C * s^3 * 2^10 */
+  return (segs >> 10) * mss + (((segs & 0x3FF) * mss) >> 10);
+}
+
+/** Time (1/1024 s) the cubic function needs to grow by 'bytes' */
+static u32_t
+tcp_cubic_root(u32_t bytes, u16_t mss)
+{
+  u32_t lo = 0, hi = CUBIC_MAX_OFFS;
+  while (lo < hi) {
+    u32_t mid = (lo + hi) / 2;
+    if (tcp_cubic_delta(mid, mss) < bytes) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** Increase cwnd towards 'target' by (target - cwnd) / cwnd segments,
+ * but by no more than half a segment per ACK */
+static void
+tcp_cubic_grow(struct tcp_pcb *pcb, u32_t target)
+{
+  u32_t inc, segs;
+  if (target <= pcb->cwnd) {
+    return;
+  }
+  segs = pcb->cwnd / pcb->mss;
+  inc = (target - pcb->cwnd) / (segs ? segs : 1);
+  inc = LWIP_MIN(inc, pcb->mss / 2U);
+  if ((tcpwnd_size_t)(pcb->cwnd + inc) > pcb->cwnd) {
+    pcb->cwnd += (tcpwnd_size_t)inc;
+  }
+}
+
+static void
+tcp_cubic_init(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("TCP_CC_PRIV_WORDS too small for cubic",
+    TCP_CC_PRIV_WORDS * sizeof(u32_t) >= sizeof(struct tcp_cubic));
+  memset(TCP_CC_PRIV(pcb, struct tcp_cubic), 0, sizeof(struct tcp_cubic));
+}
+
+static void
+tcp_cubic_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct tcp_cubic *c = TCP_CC_PRIV(pcb, struct tcp_cubic);
+  u32_t now, t, offs, target;
+
+  if (pcb->flags & TF_INFR) {
+    return;
+  }
+  if (pcb->cwnd < pcb->ssthresh) {
+    /* slow start */
+    tcp_cc_newreno.ack(pcb, acked);
+    return;
+  }
+
+  now = TCP_NOW();
+  if (c->epoch_start == 0) {
+    /* first ACK in congestion avoidance after a reduction */
+    c->epoch_start = now ? now : 1;
+    if (pcb->cwnd < c->w_max) {
+      c->k = tcp_cubic_root(c->w_max - pcb->cwnd, pcb->mss);
+      c->origin = c->w_max;
+    } else {
+      c->k = 0;
+      c->origin = pcb->cwnd;
+    }
+    c->w_est = pcb->cwnd;
+  }
+
+  t = LWIP_MIN((u32_t)(now - c->epoch_start), 0x3FFFFFU);
+  t = (t << 10) / 1000;
+  if (t >= c->k) {
+    offs = t - c->k;
+    target = c->origin + tcp_cubic_delta(offs, pcb->mss);
+  } else {
+    u32_t delta;
+    offs = c->k - t;
+    delta = tcp_cubic_delta(offs, pcb->mss);
+    target = (c->origin > delta) ? c->origin - delta : 0;
+  }
+
+  /* TCP-friendly region: grow like Reno with alpha = 3(1-beta)/(1+beta) */
+  c->w_est += (u32_t)acked * pcb->mss / pcb->cwnd * 9 / 17;
+  if (c->w_est > target) {
+    target = c->w_est;
+  }
+
+  tcp_cubic_grow(pcb, target);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_cubic_ack: cwnd %"TCPWNDSIZE_F" target %"U32_F"\n",
+                               pcb->cwnd, target));
+}
+
+/** Multiplicative decrease: remember w_max and set ssthresh to beta * cwnd */
+static void
+tcp_cubic_reduce(struct tcp_pcb *pcb)
+{
+  struct tcp_cubic *c = TCP_CC_PRIV(pcb, struct tcp_cubic);
+
+  c->epoch_start = 0;
+  if (pcb->cwnd < c->w_max) {
+    /* fast convergence: release bandwidth to new flows */
+    c->w_max = pcb->cwnd / 20 * 17;
+  } else {
+    c->w_max = pcb->cwnd;
+  }
+  pcb->ssthresh = pcb->cwnd / 10 * 7;
+  if (pcb->ssthresh < (2U * pcb->mss)) {
+    pcb->ssthresh = 2 * pcb->mss;
+  }
+}
+
+static void
+tcp_cubic_loss(struct tcp_pcb *pcb)
+{
+  tcp_cubic_reduce(pcb);
+  pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+}
+
+static void
+tcp_cubic_recovered(struct tcp_pcb *pcb)
+{
+  pcb->cwnd = pcb->ssthresh;
+}
+
+static void
+tcp_cubic_rto(struct tcp_pcb *pcb)
+{
+  tcp_cubic_reduce(pcb);
+  pcb->cwnd = pcb->mss;
+}
+
+static void
+tcp_cubic_idle(struct tcp_pcb *pcb)
+{
+  /* the cubic function does not grow while idle */
+  TCP_CC_PRIV(pcb, struct tcp_cubic)->epoch_start = 0;
+  tcp_cc_newreno.idle(pcb);
+}
+
+const struct tcp_cc_ops tcp_cc_cubic = {
+  "cubic",
+  tcp_cubic_init,
+  tcp_cubic_ack,
+  tcp_cubic_loss,
+  tcp_cubic_recovered,
+  tcp_cubic_rto,
+  tcp_cubic_idle
+};
+
+#endif /* LWIP_TCP && LWIP_TCP_CC_CUBIC */
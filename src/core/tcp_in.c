@@ -60,9 +60,10 @@
 #if LWIP_ND6_TCP_REACHABILITY_HINTS
 #include "lwip/nd6.h"
 #endif /* LWIP_ND6_TCP_REACHABILITY_HINTS */
+#if LWIP_TCP_RTT_MS
+#include "lwip/sys.h"
+#endif /* LWIP_TCP_RTT_MS */
 
-/** Initial CWND calculation as defined RFC 2581 */
-#define LWIP_TCP_CALC_INITIAL_CWND(mss) LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U));
 /** Initial slow start threshold value: we use the full window */
 #define LWIP_TCP_INITIAL_SSTHRESH(pcb)  ((pcb)->snd_wnd)
 
@@ -81,6 +82,16 @@ static u16_t tcplen;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK
+/* SACK blocks of the segment being processed (left and right edges) */
+static u32_t sack_blocks[2 * LWIP_TCP_MAX_SACK_BLOCKS];
+static u8_t sack_num;
+#endif /* LWIP_TCP_SACK */
+#if LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS
+/* TSecr of the segment being processed (0 if it has no timestamp option) */
+static u32_t ts_ecr;
+#endif /* LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
@@ -90,6 +101,9 @@ static void tcp_parseopt(struct tcp_pcb *pcb);
 
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+static void tcp_sack_mark(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -111,6 +125,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
 #endif /* SO_REUSE */
   u8_t hdrlen;
   err_t err;
+#if LWIP_TCP_PCB_HASH
+  u16_t hash;
+#endif /* LWIP_TCP_PCB_HASH */
 
   LWIP_UNUSED_ARG(inp);
 
@@ -210,8 +227,15 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
-  
+#if LWIP_TCP_PCB_HASH
+  hash = tcp_pcb_hash(ip_current_dest_addr(), tcphdr->dest,
+    ip_current_src_addr(), tcphdr->src);
+  /* 'prev' is only used to move pcbs to the front of the lists */
+  LWIP_UNUSED_ARG(prev);
+  for(pcb = tcp_active_hash[hash]; pcb != NULL; pcb = pcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
   for(pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
     LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
@@ -219,6 +243,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         pcb->local_port == tcphdr->dest &&
         ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()) &&
         ip_addr_cmp(&pcb->local_ip, ip_current_dest_addr())) {
+#if !LWIP_TCP_PCB_HASH
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -229,6 +254,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         tcp_active_pcbs = pcb;
       }
       LWIP_ASSERT("tcp_input: pcb->next != pcb (after cache)", pcb->next != pcb);
+#endif /* !LWIP_TCP_PCB_HASH */
       break;
     }
     prev = pcb;
@@ -237,7 +263,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if LWIP_TCP_PCB_HASH
+    for(pcb = tcp_tw_hash[hash]; pcb != NULL; pcb = pcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
     for(pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
       if (pcb->remote_port == tcphdr->src &&
           pcb->local_port == tcphdr->dest &&
@@ -256,7 +286,12 @@ tcp_input(struct pbuf *p, struct netif *inp)
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
     prev = NULL;
+#if LWIP_TCP_PCB_HASH
+    lpcb = tcp_listen_hash[TCP_PCB_LISTEN_HASH(tcphdr->dest)].listen_pcbs;
+    for(; lpcb != NULL; lpcb = lpcb->hash_next) {
+#else /* LWIP_TCP_PCB_HASH */
     for(lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#endif /* LWIP_TCP_PCB_HASH */
       if (lpcb->local_port == tcphdr->dest) {
 #if LWIP_IPV4 && LWIP_IPV6
         if (lpcb->accept_any_ip_version) {
@@ -295,6 +330,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
 #endif /* SO_REUSE */
     if (lpcb != NULL) {
+#if !LWIP_TCP_PCB_HASH
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -305,6 +341,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
               /* put this listening pcb at the head of the listening list */
         tcp_listen_pcbs.listen_pcbs = lpcb;
       }
+#endif /* !LWIP_TCP_PCB_HASH */
     
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
       tcp_listen_input(lpcb);
@@ -584,6 +621,7 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 #if LWIP_CALLBACK_API
     npcb->accept = pcb->accept;
 #endif /* LWIP_CALLBACK_API */
+    tcp_set_cc_ops(npcb, pcb->cc_ops);
     /* inherit socket options */
     npcb->so_options = pcb->so_options & SOF_INHERITED;
     /* Register the new PCB so that we can begin receiving segments
@@ -762,7 +800,7 @@ tcp_process(struct tcp_pcb *pcb)
       if(pcb->unacked == NULL)
         pcb->rtime = -1;
       else {
-        pcb->rtime = 0;
+        TCP_RTO_RESTART(pcb);
         pcb->nrtx = 0;
       }
 
@@ -898,20 +936,266 @@ tcp_process(struct tcp_pcb *pcb)
 }
 
 #if TCP_QUEUE_OOSEQ
+/* The segments on pcb->ooseq are kept on a sorted list (linked via 'next')
+ * and, to find the place of an incoming segment in O(log n), on an AVL tree
+ * keyed by sequence number (pcb->ooseq_root). Since the segments on ooseq
+ * never overlap, sorting by seqno also sorts them by their right edge. */
+
+/** Upper bound of the height of the ooseq tree (an AVL tree of 65535 nodes
+ * is at most 23 levels high) */
+#define TCP_OOSEQ_TREE_DEPTH  24
+
+#define TCP_OOSEQ_HEIGHT(seg) (((seg) != NULL) ? (seg)->ooseq_height : 0)
+
+/** Recalculate the height of an ooseq tree node from its children */
+static void
+tcp_ooseq_update(struct tcp_seg *seg)
+{
+  u8_t hl = TCP_OOSEQ_HEIGHT(seg->ooseq_left);
+  u8_t hr = TCP_OOSEQ_HEIGHT(seg->ooseq_right);
+  seg->ooseq_height = (u8_t)(LWIP_MAX(hl, hr) + 1);
+}
+
+static struct tcp_seg *
+tcp_ooseq_rotate_left(struct tcp_seg *seg)
+{
+  struct tcp_seg *r = seg->ooseq_right;
+  seg->ooseq_right = r->ooseq_left;
+  r->ooseq_left = seg;
+  tcp_ooseq_update(seg);
+  tcp_ooseq_update(r);
+  return r;
+}
+
+static struct tcp_seg *
+tcp_ooseq_rotate_right(struct tcp_seg *seg)
+{
+  struct tcp_seg *l = seg->ooseq_left;
+  seg->ooseq_left = l->ooseq_right;
+  l->ooseq_right = seg;
+  tcp_ooseq_update(seg);
+  tcp_ooseq_update(l);
+  return l;
+}
+
+/**
+ * Restore the AVL property of an ooseq subtree whose children differ in
+ * height by at most 2.
+ *
+ * @param seg root of the subtree
+ * @return the new root of the subtree
+ */
+static struct tcp_seg *
+tcp_ooseq_balance(struct tcp_seg *seg)
+{
+  int diff = TCP_OOSEQ_HEIGHT(seg->ooseq_left) - TCP_OOSEQ_HEIGHT(seg->ooseq_right);
+
+  if (diff > 1) {
+    if (TCP_OOSEQ_HEIGHT(seg->ooseq_left->ooseq_left) <
+        TCP_OOSEQ_HEIGHT(seg->ooseq_left->ooseq_right)) {
+      seg->ooseq_left = tcp_ooseq_rotate_left(seg->ooseq_left);
+    }
+    return tcp_ooseq_rotate_right(seg);
+  }
+  if (diff < -1) {
+    if (TCP_OOSEQ_HEIGHT(seg->ooseq_right->ooseq_right) <
+        TCP_OOSEQ_HEIGHT(seg->ooseq_right->ooseq_left)) {
+      seg->ooseq_right = tcp_ooseq_rotate_right(seg->ooseq_right);
+    }
+    return tcp_ooseq_rotate_left(seg);
+  }
+  tcp_ooseq_update(seg);
+  return seg;
+}
+
+/** Rebalance the ooseq tree bottom-up along a path of links from the root */
+static void
+tcp_ooseq_rebalance(struct tcp_seg **path[], int depth)
+{
+  while (depth > 0) {
+    depth--;
+    *path[depth] = tcp_ooseq_balance(*path[depth]);
+  }
+}
+
+/**
+ * Look up the neighbours of a sequence number on the ooseq tree.
+ *
+ * @param pcb the tcp_pcb to search
+ * @param seq the sequence number
+ * @param prev returns the last segment starting before seq (or NULL)
+ * @return the first segment starting at or after seq (or NULL)
+ */
+static struct tcp_seg *
+tcp_ooseq_lookup(struct tcp_pcb *pcb, u32_t seq, struct tcp_seg **prev)
+{
+  struct tcp_seg *seg = pcb->ooseq_root;
+  struct tcp_seg *next = NULL;
+
+  *prev = NULL;
+  while (seg != NULL) {
+    if (TCP_SEQ_LT(seg->tcphdr->seqno, seq)) {
+      *prev = seg;
+      seg = seg->ooseq_right;
+    } else {
+      next = seg;
+      seg = seg->ooseq_left;
+    }
+  }
+  return next;
+}
+
+/**
+ * Put a segment on pcb->ooseq.
+ *
+ * @param pcb the tcp_pcb to queue the segment on
+ * @param prev the segment that precedes seg on ooseq (NULL to put it first)
+ * @param seg the segment to queue (must not overlap prev or prev->next)
+ */
+static void
+tcp_ooseq_link(struct tcp_pcb *pcb, struct tcp_seg *prev, struct tcp_seg *seg)
+{
+  struct tcp_seg **path[TCP_OOSEQ_TREE_DEPTH];
+  struct tcp_seg **link = &pcb->ooseq_root;
+  int depth = 0;
+
+  if (prev != NULL) {
+    seg->next = prev->next;
+    prev->next = seg;
+  } else {
+    seg->next = pcb->ooseq;
+    pcb->ooseq = seg;
+  }
+
+  while (*link != NULL) {
+    LWIP_ASSERT("tcp_ooseq_link: tree too deep", depth < TCP_OOSEQ_TREE_DEPTH);
+    path[depth++] = link;
+    if (TCP_SEQ_LT(seg->tcphdr->seqno, (*link)->tcphdr->seqno)) {
+      link = &(*link)->ooseq_left;
+    } else {
+      link = &(*link)->ooseq_right;
+    }
+  }
+  seg->ooseq_left = NULL;
+  seg->ooseq_right = NULL;
+  seg->ooseq_height = 1;
+  *link = seg;
+  tcp_ooseq_rebalance(path, depth);
+
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  pcb->ooseq_blen += seg->p->tot_len;
+  pcb->ooseq_qlen += pbuf_clen(seg->p);
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+}
+
+/**
+ * Take a segment off pcb->ooseq (the segment is not freed).
+ *
+ * @param pcb the tcp_pcb the segment is queued on
+ * @param prev the segment that precedes seg on ooseq (NULL if seg is first)
+ * @param seg the segment to remove
+ */
+static void
+tcp_ooseq_unlink(struct tcp_pcb *pcb, struct tcp_seg *prev, struct tcp_seg *seg)
+{
+  struct tcp_seg **path[TCP_OOSEQ_TREE_DEPTH];
+  struct tcp_seg **link = &pcb->ooseq_root;
+  struct tcp_seg *succ;
+  int depth = 0;
+  int pos;
+
+  if (prev != NULL) {
+    prev->next = seg->next;
+  } else {
+    pcb->ooseq = seg->next;
+  }
+
+  while (*link != seg) {
+    LWIP_ASSERT("tcp_ooseq_unlink: segment not on tree", *link != NULL);
+    LWIP_ASSERT("tcp_ooseq_unlink: tree too deep", depth < TCP_OOSEQ_TREE_DEPTH);
+    path[depth++] = link;
+    if (TCP_SEQ_LT(seg->tcphdr->seqno, (*link)->tcphdr->seqno)) {
+      link = &(*link)->ooseq_left;
+    } else {
+      link = &(*link)->ooseq_right;
+    }
+  }
+  if (seg->ooseq_left == NULL) {
+    *link = seg->ooseq_right;
+  } else if (seg->ooseq_right == NULL) {
+    *link = seg->ooseq_left;
+  } else {
+    /* replace seg by its successor, the leftmost node of its right subtree */
+    pos = depth;
+    path[depth++] = link;
+    link = &seg->ooseq_right;
+    while ((*link)->ooseq_left != NULL) {
+      LWIP_ASSERT("tcp_ooseq_unlink: tree too deep", depth < TCP_OOSEQ_TREE_DEPTH);
+      path[depth++] = link;
+      link = &(*link)->ooseq_left;
+    }
+    succ = *link;
+    *link = succ->ooseq_right;
+    succ->ooseq_left = seg->ooseq_left;
+    succ->ooseq_right = seg->ooseq_right;
+    *path[pos] = succ;
+    if (depth > pos + 1) {
+      /* the path went through seg->ooseq_right, now it's succ's */
+      path[pos + 1] = &succ->ooseq_right;
+    }
+  }
+  tcp_ooseq_rebalance(path, depth);
+
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  pcb->ooseq_blen -= seg->p->tot_len;
+  pcb->ooseq_qlen -= pbuf_clen(seg->p);
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+}
+
+/**
+ * Trim the right edge of a segment on pcb->ooseq.
+ *
+ * @param pcb the tcp_pcb the segment is queued on
+ * @param seg the segment to trim
+ * @param len the new length of the segment
+ */
+static void
+tcp_ooseq_trim(struct tcp_pcb *pcb, struct tcp_seg *seg, u16_t len)
+{
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  pcb->ooseq_blen -= seg->p->tot_len;
+  pcb->ooseq_qlen -= pbuf_clen(seg->p);
+#else /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+  LWIP_UNUSED_ARG(pcb);
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+  seg->len = len;
+  pbuf_realloc(seg->p, len);
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  pcb->ooseq_blen += seg->p->tot_len;
+  pcb->ooseq_qlen += pbuf_clen(seg->p);
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+}
+
 /**
- * Insert segment into the list (segments covered with new one will be deleted)
+ * Insert segment into the ooseq queue after prev (segments covered with
+ * the new one will be deleted)
  *
  * Called from tcp_receive()
  */
 static void
-tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
+tcp_oos_insert_segment(struct tcp_pcb *pcb, struct tcp_seg *prev,
+                       struct tcp_seg *cseg, struct tcp_seg *next)
 {
   struct tcp_seg *old_seg;
 
   if (TCPH_FLAGS(cseg->tcphdr) & TCP_FIN) {
     /* received segment overlaps all following segments */
-    tcp_segs_free(next);
-    next = NULL;
+    while (next != NULL) {
+      old_seg = next;
+      next = next->next;
+      tcp_ooseq_unlink(pcb, prev, old_seg);
+      tcp_seg_free(old_seg);
+    }
   }
   else {
     /* delete some following segments
@@ -925,6 +1209,7 @@ tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
       }
       old_seg = next;
       next = next->next;
+      tcp_ooseq_unlink(pcb, prev, old_seg);
       tcp_seg_free(old_seg);
     }
     if (next &&
@@ -934,7 +1219,7 @@ tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
       pbuf_realloc(cseg->p, cseg->len);
     }
   }
-  cseg->next = next;
+  tcp_ooseq_link(pcb, prev, cseg);
 }
 #endif /* TCP_QUEUE_OOSEQ */
 
@@ -959,14 +1244,12 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_QUEUE_OOSEQ */
   struct pbuf *p;
   s32_t off;
+#if !LWIP_TCP_RTT_MS
   s16_t m;
+#endif /* !LWIP_TCP_RTT_MS */
   u32_t right_wnd_edge;
   u16_t new_tot_len;
   int found_dupack = 0;
-#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
-  u32_t ooseq_blen;
-  u16_t ooseq_qlen;
-#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
 
   LWIP_ASSERT("tcp_receive: wrong state", pcb->state >= ESTABLISHED);
 
@@ -994,6 +1277,12 @@ tcp_receive(struct tcp_pcb *pcb)
       } else if (pcb->persist_backoff > 0) {
         /* stop persist timer */
           pcb->persist_backoff = 0;
+#if LWIP_TCP_RTT_MS
+        /* tcp_rto_tmr() skipped the retransmission timer while persisting */
+        if (pcb->rtime >= 0) {
+          tcp_rto_start(pcb);
+        }
+#endif /* LWIP_TCP_RTT_MS */
       }
       LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
@@ -1027,6 +1316,12 @@ tcp_receive(struct tcp_pcb *pcb)
      *
      */
 
+#if LWIP_TCP_SACK
+    if (sack_num > 0) {
+      tcp_sack_mark(pcb);
+    }
+#endif /* LWIP_TCP_SACK */
+
     /* Clause 1 */
     if (TCP_SEQ_LEQ(ackno, pcb->lastack)) {
       pcb->acked = 0;
@@ -1039,6 +1334,13 @@ tcp_receive(struct tcp_pcb *pcb)
             /* Clause 5 */
             if (pcb->lastack == ackno) {
               found_dupack = 1;
+#if LWIP_TCP_SACK && !LWIP_TCP_RACK
+              if ((pcb->flags & (TF_SACK | TF_INFR)) == (TF_SACK | TF_INFR)) {
+                /* in fast recovery with SACK, every duplicate ACK may
+                   report another lost segment */
+                tcp_rexmit_sack(pcb);
+              }
+#endif /* LWIP_TCP_SACK && !LWIP_TCP_RACK */
               if ((u8_t)(pcb->dupacks + 1) > pcb->dupacks) {
                 ++pcb->dupacks;
               }
@@ -1048,8 +1350,8 @@ tcp_receive(struct tcp_pcb *pcb)
                 if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
                   pcb->cwnd += pcb->mss;
                 }
-              } else if (pcb->dupacks == 3) {
-                /* Do fast retransmit */
+              } else if ((pcb->dupacks == 3) && !TCP_RACK_ACTIVE(pcb)) {
+                /* Do fast retransmit (RACK detects losses by time instead) */
                 tcp_rexmit_fast(pcb);
               }
             }
@@ -1068,15 +1370,39 @@ tcp_receive(struct tcp_pcb *pcb)
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        pcb->flags &= ~TF_INFR;
-        pcb->cwnd = pcb->ssthresh;
+#if LWIP_TCP_SACK
+        if ((pcb->flags & TF_SACK) && TCP_SEQ_LT(ackno, pcb->sack_recover)) {
+          /* A partial ACK: stay in fast recovery (the next hole is
+             retransmitted below) and deflate the window by the amount
+             of data acknowledged (RFC 6582). */
+          if (pcb->cwnd > pcb->ssthresh + (ackno - pcb->lastack)) {
+            pcb->cwnd -= (tcpwnd_size_t)(ackno - pcb->lastack);
+          } else {
+            pcb->cwnd = pcb->ssthresh;
+          }
+        } else
+#endif /* LWIP_TCP_SACK */
+        {
+          pcb->flags &= ~TF_INFR;
+          pcb->cc_ops->recovered(pcb);
+        }
       }
 
       /* Reset the number of retransmissions. */
       pcb->nrtx = 0;
 
+#if LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS
+      /* Every ACK for new data echoing one of our timestamps is an RTT
+         sample, even for retransmitted segments (RFC 7323, section 4). */
+      if ((pcb->flags & TF_TIMESTAMP) && (ts_ecr != 0) &&
+          ((u32_t)(TCP_NOW() - ts_ecr) <= TCP_RTO_MAX_MS)) {
+        tcp_rtt_update(pcb, TCP_NOW() - ts_ecr);
+        pcb->rttest = 0;
+      }
+#endif /* LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS */
+
       /* Reset the retransmission time-out. */
-      pcb->rto = (pcb->sa >> 3) + pcb->sv;
+      TCP_RTO_RESET(pcb);
 
       /* Update the send buffer space. Diff between the two can never exceed 64K
          unless window scaling is used. */
@@ -1091,18 +1417,7 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Update the congestion control variables (cwnd and
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
-        if (pcb->cwnd < pcb->ssthresh) {
-          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
-            pcb->cwnd += pcb->mss;
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        } else {
-          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
-          if (new_cwnd > pcb->cwnd) {
-            pcb->cwnd = new_cwnd;
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        }
+        pcb->cc_ops->ack(pcb, pcb->acked);
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
                                     ackno,
@@ -1132,6 +1447,11 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 
         pcb->snd_queuelen -= pbuf_clen(next->p);
+#if LWIP_TCP_RACK
+        if (!(next->flags & TF_SEG_SACKED)) {
+          tcp_rack_delivered(pcb, next);
+        }
+#endif /* LWIP_TCP_RACK */
         tcp_seg_free(next);
 
         LWIP_DEBUGF(TCP_QLEN_DEBUG, ("%"TCPWNDSIZE_F" (after freeing unacked)\n", (tcpwnd_size_t)pcb->snd_queuelen));
@@ -1146,9 +1466,16 @@ tcp_receive(struct tcp_pcb *pcb)
       if (pcb->unacked == NULL) {
         pcb->rtime = -1;
       } else {
-        pcb->rtime = 0;
+        TCP_RTO_RESTART(pcb);
       }
 
+#if LWIP_TCP_SACK
+      if ((pcb->flags & TF_INFR) && !TCP_RACK_ACTIVE(pcb)) {
+        /* partial ACK in fast recovery */
+        tcp_rexmit_sack(pcb);
+      }
+#endif /* LWIP_TCP_SACK */
+
       pcb->polltmr = 0;
 
 #if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
@@ -1190,6 +1517,12 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->acked--;
       }
       pcb->snd_queuelen -= pbuf_clen(next->p);
+#if LWIP_TCP_RACK
+      if (!(next->flags & TF_SEG_SACKED)) {
+        /* requeued for retransmission, but the original was delivered */
+        tcp_rack_delivered(pcb, next);
+      }
+#endif /* LWIP_TCP_RACK */
       tcp_seg_free(next);
       LWIP_DEBUGF(TCP_QLEN_DEBUG, ("%"TCPWNDSIZE_F" (after freeing unsent)\n", (tcpwnd_size_t)pcb->snd_queuelen));
       if (pcb->snd_queuelen != 0) {
@@ -1206,6 +1539,9 @@ tcp_receive(struct tcp_pcb *pcb)
        incoming segment acknowledges the segment we use to take a
        round-trip time measurement. */
     if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
+#if LWIP_TCP_RTT_MS
+      tcp_rtt_update(pcb, TCP_NOW() - pcb->rttest);
+#else /* LWIP_TCP_RTT_MS */
       /* diff between this shouldn't exceed 32K since this are tcp timer ticks
          and a round-trip shouldn't be that long... */
       m = (s16_t)(tcp_ticks - pcb->rttest);
@@ -1225,9 +1561,13 @@ tcp_receive(struct tcp_pcb *pcb)
 
       LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
                                   pcb->rto, pcb->rto * TCP_SLOW_INTERVAL));
+#endif /* LWIP_TCP_RTT_MS */
 
       pcb->rttest = 0;
     }
+#if LWIP_TCP_RACK
+    tcp_rack_input(pcb);
+#endif /* LWIP_TCP_RACK */
   }
 
   /* If the incoming segment contains data, we must process it
@@ -1368,11 +1708,7 @@ tcp_receive(struct tcp_pcb *pcb)
             /* Received in-order FIN means anything that was received
              * out of order must now have been received in-order, so
              * bin the ooseq queue */
-            while (pcb->ooseq != NULL) {
-              struct tcp_seg *old_ooseq = pcb->ooseq;
-              pcb->ooseq = pcb->ooseq->next;
-              tcp_seg_free(old_ooseq);
-            }
+            tcp_ooseq_free(pcb);
           } else {
             next = pcb->ooseq;
             /* Remove all segments on ooseq that are covered by inseg already.
@@ -1386,9 +1722,9 @@ tcp_receive(struct tcp_pcb *pcb)
                 TCPH_SET_FLAG(inseg.tcphdr, TCP_FIN);
                 tcplen = TCP_TCPLEN(&inseg);
               }
-              prev = next;
-              next = next->next;
-              tcp_seg_free(prev);
+              tcp_ooseq_unlink(pcb, NULL, next);
+              tcp_seg_free(next);
+              next = pcb->ooseq;
             }
             /* Now trim right side of inseg if it overlaps with the first
              * segment on ooseq */
@@ -1405,7 +1741,6 @@ tcp_receive(struct tcp_pcb *pcb)
               LWIP_ASSERT("tcp_receive: segment not trimmed correctly to ooseq queue\n",
                           (seqno + tcplen) == next->tcphdr->seqno);
             }
-            pcb->ooseq = next;
           }
         }
 #endif /* TCP_QUEUE_OOSEQ */
@@ -1447,6 +1782,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
           cseg = pcb->ooseq;
           seqno = pcb->ooseq->tcphdr->seqno;
+          tcp_ooseq_unlink(pcb, NULL, cseg);
 
           pcb->rcv_nxt += TCP_TCPLEN(cseg);
           LWIP_ASSERT("tcp_receive: ooseq tcplen > rcv_wnd\n",
@@ -1476,13 +1812,24 @@ tcp_receive(struct tcp_pcb *pcb)
             } 
           }
 
-          pcb->ooseq = cseg->next;
           tcp_seg_free(cseg);
         }
 #endif /* TCP_QUEUE_OOSEQ */
 
 
         /* Acknowledge the segment(s). */
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+        if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+          /* a hole was (partly) filled: update the remote host's scoreboard */
+          tcp_ack_now(pcb);
+        } else
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+#if IP_GRO
+        if (tcplen >= 2 * pcb->mss) {
+          /* segments merged by GRO: ACK (at least) every second one */
+          tcp_ack_now(pcb);
+        } else
+#endif /* IP_GRO */
         tcp_ack(pcb);
 
 #if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
@@ -1494,154 +1841,100 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
-        tcp_send_empty_ack(pcb);
 #if TCP_QUEUE_OOSEQ
-        /* We queue the segment on the ->ooseq queue. */
-        if (pcb->ooseq == NULL) {
-          pcb->ooseq = tcp_seg_copy(&inseg);
-        } else {
-          /* If the queue is not empty, we walk through the queue and
-             try to find a place where the sequence number of the
-             incoming segment is between the sequence numbers of the
-             previous and the next segment on the ->ooseq queue. That is
-             the place where we put the incoming segment. If needed, we
-             trim the second edges of the previous and the incoming
-             segment so that it will fit into the sequence.
-
-             If the incoming segment has the same sequence number as a
-             segment on the ->ooseq queue, we discard the segment that
-             contains less data. */
-
-          prev = NULL;
-          for(next = pcb->ooseq; next != NULL; next = next->next) {
-            if (seqno == next->tcphdr->seqno) {
-              /* The sequence number of the incoming segment is the
-                 same as the sequence number of the segment on
-                 ->ooseq. We check the lengths to see which one to
-                 discard. */
-              if (inseg.len > next->len) {
-                /* The incoming segment is larger than the old
-                   segment. We replace some segments with the new
-                   one. */
-                cseg = tcp_seg_copy(&inseg);
-                if (cseg != NULL) {
-                  if (prev != NULL) {
-                    prev->next = cseg;
-                  } else {
-                    pcb->ooseq = cseg;
-                  }
-                  tcp_oos_insert_segment(cseg, next);
-                }
-                break;
-              } else {
-                /* Either the lengths are the same or the incoming
-                   segment was smaller than the old one; in either
-                   case, we ditch the incoming segment. */
-                break;
-              }
-            } else {
-              if (prev == NULL) {
-                if (TCP_SEQ_LT(seqno, next->tcphdr->seqno)) {
-                  /* The sequence number of the incoming segment is lower
-                     than the sequence number of the first segment on the
-                     queue. We put the incoming segment first on the
-                     queue. */
-                  cseg = tcp_seg_copy(&inseg);
-                  if (cseg != NULL) {
-                    pcb->ooseq = cseg;
-                    tcp_oos_insert_segment(cseg, next);
-                  }
-                  break;
-                }
-              } else {
-                /*if (TCP_SEQ_LT(prev->tcphdr->seqno, seqno) &&
-                  TCP_SEQ_LT(seqno, next->tcphdr->seqno)) {*/
-                if (TCP_SEQ_BETWEEN(seqno, prev->tcphdr->seqno+1, next->tcphdr->seqno-1)) {
-                  /* The sequence number of the incoming segment is in
-                     between the sequence numbers of the previous and
-                     the next segment on ->ooseq. We trim trim the previous
-                     segment, delete next segments that included in received segment
-                     and trim received, if needed. */
-                  cseg = tcp_seg_copy(&inseg);
-                  if (cseg != NULL) {
-                    if (TCP_SEQ_GT(prev->tcphdr->seqno + prev->len, seqno)) {
-                      /* We need to trim the prev segment. */
-                      prev->len = (u16_t)(seqno - prev->tcphdr->seqno);
-                      pbuf_realloc(prev->p, prev->len);
-                    }
-                    prev->next = cseg;
-                    tcp_oos_insert_segment(cseg, next);
-                  }
-                  break;
-                }
+#if LWIP_TCP_SACK
+        pcb->rcv_sack_recent = seqno;
+#endif /* LWIP_TCP_SACK */
+        /* We queue the segment on the ->ooseq queue. The ooseq tree
+           gives us the segments before (prev) and at or after (next)
+           the sequence number of the incoming segment; that is the
+           place where we put the incoming segment. If needed, we trim
+           the second edges of the previous and the incoming segment so
+           that it will fit into the sequence.
+
+           If the incoming segment has the same sequence number as a
+           segment on the ->ooseq queue, we discard the segment that
+           contains less data. */
+        next = tcp_ooseq_lookup(pcb, seqno, &prev);
+        if (next != NULL && seqno == next->tcphdr->seqno) {
+          /* The sequence number of the incoming segment is the
+             same as the sequence number of the segment on
+             ->ooseq. We check the lengths to see which one to
+             discard. */
+          if (inseg.len > next->len) {
+            /* The incoming segment is larger than the old
+               segment. We replace some segments with the new
+               one. */
+            cseg = tcp_seg_copy(&inseg);
+            if (cseg != NULL) {
+              tcp_oos_insert_segment(pcb, prev, cseg, next);
+            }
+          }
+          /* Otherwise either the lengths are the same or the incoming
+             segment was smaller than the old one; in either
+             case, we ditch the incoming segment. */
+        } else if (next == NULL && prev != NULL) {
+          /* The incoming segment starts after the last segment on the
+             ooseq queue, we add it to the end of the list. */
+          if ((TCPH_FLAGS(prev->tcphdr) & TCP_FIN) == 0) {
+            /* (otherwise segment "prev" already contains all data) */
+            cseg = tcp_seg_copy(&inseg);
+            if (cseg != NULL) {
+              if (TCP_SEQ_GT(prev->tcphdr->seqno + prev->len, seqno)) {
+                /* We need to trim the last segment. */
+                tcp_ooseq_trim(pcb, prev, (u16_t)(seqno - prev->tcphdr->seqno));
               }
-              /* If the "next" segment is the last segment on the
-                 ooseq queue, we add the incoming segment to the end
-                 of the list. */
-              if (next->next == NULL &&
-                  TCP_SEQ_GT(seqno, next->tcphdr->seqno)) {
-                if (TCPH_FLAGS(next->tcphdr) & TCP_FIN) {
-                  /* segment "next" already contains all data */
-                  break;
-                }
-                next->next = tcp_seg_copy(&inseg);
-                if (next->next != NULL) {
-                  if (TCP_SEQ_GT(next->tcphdr->seqno + next->len, seqno)) {
-                    /* We need to trim the last segment. */
-                    next->len = (u16_t)(seqno - next->tcphdr->seqno);
-                    pbuf_realloc(next->p, next->len);
-                  }
-                  /* check if the remote side overruns our receive window */
-                  if (TCP_SEQ_GT((u32_t)tcplen + seqno, pcb->rcv_nxt + (u32_t)pcb->rcv_wnd)) {
-                    LWIP_DEBUGF(TCP_INPUT_DEBUG, 
-                                ("tcp_receive: other end overran receive window"
-                                 "seqno %"U32_F" len %"U16_F" right edge %"U32_F"\n",
-                                 seqno, tcplen, pcb->rcv_nxt + pcb->rcv_wnd));
-                    if (TCPH_FLAGS(next->next->tcphdr) & TCP_FIN) {
-                      /* Must remove the FIN from the header as we're trimming 
-                       * that byte of sequence-space from the packet */
-                      TCPH_FLAGS_SET(next->next->tcphdr, TCPH_FLAGS(next->next->tcphdr) & ~TCP_FIN);
-                    }
-                    /* Adjust length of segment to fit in the window. */
-                    next->next->len = (u16_t)(pcb->rcv_nxt + pcb->rcv_wnd - seqno);
-                    pbuf_realloc(next->next->p, next->next->len);
-                    tcplen = TCP_TCPLEN(next->next);
-                    LWIP_ASSERT("tcp_receive: segment not trimmed correctly to rcv_wnd\n",
-                                (seqno + tcplen) == (pcb->rcv_nxt + pcb->rcv_wnd));
-                  }
+              /* check if the remote side overruns our receive window */
+              if (TCP_SEQ_GT((u32_t)tcplen + seqno, pcb->rcv_nxt + (u32_t)pcb->rcv_wnd)) {
+                LWIP_DEBUGF(TCP_INPUT_DEBUG, 
+                            ("tcp_receive: other end overran receive window"
+                             "seqno %"U32_F" len %"U16_F" right edge %"U32_F"\n",
+                             seqno, tcplen, pcb->rcv_nxt + pcb->rcv_wnd));
+                if (TCPH_FLAGS(cseg->tcphdr) & TCP_FIN) {
+                  /* Must remove the FIN from the header as we're trimming 
+                   * that byte of sequence-space from the packet */
+                  TCPH_FLAGS_SET(cseg->tcphdr, TCPH_FLAGS(cseg->tcphdr) & ~TCP_FIN);
                 }
-                break;
+                /* Adjust length of segment to fit in the window. */
+                cseg->len = (u16_t)(pcb->rcv_nxt + pcb->rcv_wnd - seqno);
+                pbuf_realloc(cseg->p, cseg->len);
+                tcplen = TCP_TCPLEN(cseg);
+                LWIP_ASSERT("tcp_receive: segment not trimmed correctly to rcv_wnd\n",
+                            (seqno + tcplen) == (pcb->rcv_nxt + pcb->rcv_wnd));
               }
+              tcp_ooseq_link(pcb, prev, cseg);
+            }
+          }
+        } else {
+          /* The incoming segment goes first on the queue or in between
+             the previous and the next segment on ->ooseq. We trim the
+             previous segment, delete next segments that are included in
+             the received segment and trim received, if needed. */
+          cseg = tcp_seg_copy(&inseg);
+          if (cseg != NULL) {
+            if (prev != NULL &&
+                TCP_SEQ_GT(prev->tcphdr->seqno + prev->len, seqno)) {
+              /* We need to trim the prev segment. */
+              tcp_ooseq_trim(pcb, prev, (u16_t)(seqno - prev->tcphdr->seqno));
             }
-            prev = next;
+            tcp_oos_insert_segment(pcb, prev, cseg, next);
           }
         }
 #if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
         /* Check that the data on ooseq doesn't exceed one of the limits
-           and throw away everything above that limit. */
-        ooseq_blen = 0;
-        ooseq_qlen = 0;
-        prev = NULL;
-        for(next = pcb->ooseq; next != NULL; prev = next, next = next->next) {
-          struct pbuf *p = next->p;
-          ooseq_blen += p->tot_len;
-          ooseq_qlen += pbuf_clen(p);
-          if ((ooseq_blen > TCP_OOSEQ_MAX_BYTES) ||
-              (ooseq_qlen > TCP_OOSEQ_MAX_PBUFS)) {
-             /* too much ooseq data, dump this and everything after it */
-             tcp_segs_free(next);
-             if (prev == NULL) {
-               /* first ooseq segment is too much, dump the whole queue */
-               pcb->ooseq = NULL;
-             } else {
-               /* just dump 'next' and everything after it */
-               prev->next = NULL;
-             }
-             break;
-          }
+           and throw away the segments with the highest sequence numbers
+           until it doesn't. */
+        while ((pcb->ooseq_blen > TCP_OOSEQ_MAX_BYTES) ||
+               (pcb->ooseq_qlen > TCP_OOSEQ_MAX_PBUFS)) {
+          for (cseg = pcb->ooseq_root; cseg->ooseq_right != NULL; cseg = cseg->ooseq_right);
+          tcp_ooseq_lookup(pcb, cseg->tcphdr->seqno, &prev);
+          tcp_ooseq_unlink(pcb, prev, cseg);
+          tcp_seg_free(cseg);
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
 #endif /* TCP_QUEUE_OOSEQ */
+        /* ACK after queueing the segment, so that SACK blocks include it */
+        tcp_send_empty_ack(pcb);
       }
     } else {
       /* The incoming segment is not within the window. */
@@ -1656,6 +1949,47 @@ tcp_receive(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Mark the segments on pcb->unacked covered by the SACK blocks of the
+ * segment being processed (the scoreboard used by tcp_rexmit_sack() and
+ * tcp_rexmit_rto()).
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ */
+static void
+tcp_sack_mark(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t left, right, seg_seqno;
+  u8_t i;
+
+  for (i = 0; i < sack_num; i++) {
+    left = sack_blocks[2 * i];
+    right = sack_blocks[2 * i + 1];
+    /* ignore invalid blocks and blocks not covering unacknowledged data */
+    if (!TCP_SEQ_LT(left, right) || !TCP_SEQ_LT(pcb->lastack, left) ||
+        TCP_SEQ_GT(right, pcb->snd_nxt)) {
+      continue;
+    }
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      seg_seqno = ntohl(seg->tcphdr->seqno);
+      if (TCP_SEQ_GEQ(seg_seqno, right)) {
+        break;
+      }
+      if (TCP_SEQ_GEQ(seg_seqno, left) &&
+          TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right) &&
+          !(seg->flags & TF_SEG_SACKED)) {
+        seg->flags |= TF_SEG_SACKED;
+#if LWIP_TCP_RACK
+        tcp_rack_delivered(pcb, seg);
+#endif /* LWIP_TCP_RACK */
+      }
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 static u8_t tcp_getoptbyte(void)
 {
   if ((tcphdr_opt2 == NULL) || (tcp_optidx < tcphdr_opt1len)) {
@@ -1667,6 +2001,18 @@ static u8_t tcp_getoptbyte(void)
   }
 }
 
+#if LWIP_TCP_SACK || (LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS)
+/** Read a 32 bit option field (network byte order) */
+static u32_t tcp_getoptu32(void)
+{
+  u32_t val = (u32_t)tcp_getoptbyte() << 24;
+  val |= (u32_t)tcp_getoptbyte() << 16;
+  val |= (u32_t)tcp_getoptbyte() << 8;
+  val |= tcp_getoptbyte();
+  return val;
+}
+#endif /* LWIP_TCP_SACK || (LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS) */
+
 /**
  * Parses the options contained in the incoming segment.
  *
@@ -1683,6 +2029,14 @@ tcp_parseopt(struct tcp_pcb *pcb)
 #if LWIP_TCP_TIMESTAMPS
   u32_t tsval;
 #endif
+#if LWIP_TCP_SACK
+  u32_t left, right;
+
+  sack_num = 0;
+#endif
+#if LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS
+  ts_ecr = 0;
+#endif /* LWIP_TCP_RTT_MS && LWIP_TCP_TIMESTAMPS */
 
   /* Parse the TCP MSS option, if present. */
   if (TCPH_HDRLEN(tcphdr) > 0x5) {
@@ -1758,10 +2112,46 @@ tcp_parseopt(struct tcp_pcb *pcb)
         } else if (TCP_SEQ_BETWEEN(pcb->ts_lastacksent, seqno, seqno+tcplen)) {
           pcb->ts_recent = ntohl(tsval);
         }
+#if LWIP_TCP_RTT_MS
+        ts_ecr = tcp_getoptu32();
+#else /* LWIP_TCP_RTT_MS */
         /* Advance to next option (6 bytes already read) */
         tcp_optidx += LWIP_TCP_OPT_LEN_TS - 6;
+#endif /* LWIP_TCP_RTT_MS */
         break;
 #endif
+#if LWIP_TCP_SACK
+      case LWIP_TCP_OPT_SACK_PERM:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (tcp_getoptbyte() != LWIP_TCP_OPT_LEN_SACK_PERM || (tcp_optidx - 2 + LWIP_TCP_OPT_LEN_SACK_PERM) > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          /* the remote host accepts SACK blocks */
+          pcb->flags |= TF_SACK;
+        }
+        break;
+      case LWIP_TCP_OPT_SACK:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        data = tcp_getoptbyte();
+        if ((data < 10) || (((data - 2) & 7) != 0) || (tcp_optidx - 2 + data) > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        for (data = (u8_t)((data - 2) / 8); data > 0; data--) {
+          left = tcp_getoptu32();
+          right = tcp_getoptu32();
+          if ((pcb->flags & TF_SACK) && (sack_num < LWIP_TCP_MAX_SACK_BLOCKS)) {
+            sack_blocks[2 * sack_num] = left;
+            sack_blocks[2 * sack_num + 1] = right;
+            sack_num++;
+          }
+        }
+        break;
+#endif /* LWIP_TCP_SACK */
       default:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
         data = tcp_getoptbyte();
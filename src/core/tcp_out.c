@@ -54,7 +54,7 @@
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/inet_chksum.h"
-#if LWIP_TCP_TIMESTAMPS
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_RTT_MS
 #include "lwip/sys.h"
 #endif
 
@@ -93,8 +93,18 @@
 #endif
 #endif
 
+/** Checksum and segmentation offload are only done for IPv4 */
+#define TCP_NETIF_OFFLOAD (LWIP_NETIF_OFFLOAD && LWIP_IPV4)
+
+/** Offset of the checksum field in the TCP header */
+#define TCP_CHKSUM_OFFSET 16
+
 /* Forward declarations.*/
-static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb);
+static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb,
+                                struct pbuf *gso);
+#if LWIP_TCP_RACK
+static void tcp_rack_arm(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_RACK */
 
 /** Allocate a pbuf and create a tcphdr at p->payload, used for output
  * functions other than the default tcp_output -> tcp_output_segment
@@ -274,7 +284,13 @@ tcp_pbuf_prealloc(pbuf_layer layer, u16_t length, u16_t max_length,
     return NULL;
   }
   LWIP_ASSERT("need unchained pbuf", p->next == NULL);
+#if PBUF_RAM_ARENAS
+  /* the size class may have room for more than we asked for: use it (up to
+     max_length), that memory would be wasted otherwise */
+  *oversize = (u16_t)(LWIP_MIN(pbuf_ram_capacity(p), max_length) - length);
+#else /* PBUF_RAM_ARENAS */
   *oversize = p->len - length;
+#endif /* PBUF_RAM_ARENAS */
   /* trim p->len to the currently used size */
   p->len = p->tot_len = length;
   return p;
@@ -720,10 +736,12 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     TCPH_SET_FLAG(seg->tcphdr, TCP_PSH);
   }
 
+  tcp_timers_touch(pcb);
   return ERR_OK;
 memerr:
   pcb->flags |= TF_NAGLEMEMERR;
   TCP_STATS_INC(tcp.memerr);
+  tcp_timers_touch(pcb);
 
   if (concat_p != NULL) {
     pbuf_free(concat_p);
@@ -781,6 +799,13 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_WND_SCALE;
     }
 #endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      /* Like window scaling, SACK is only permitted in a <SYN,ACK> if the
+         remote host permitted it in its SYN. */
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -870,7 +895,7 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 {
   /* Pad with two NOP options to make everything nicely aligned */
   opts[0] = PP_HTONL(0x0101080A);
-  opts[1] = htonl(sys_now());
+  opts[1] = htonl(TCP_NOW());
   opts[2] = htonl(pcb->ts_recent);
 }
 #endif
@@ -888,6 +913,64 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+/** Get the next block of contiguous data on pcb->ooseq.
+ *
+ * @param seg first segment of the block
+ * @param left returns the sequence number of the first byte of the block
+ * @param right returns the sequence number after the block
+ * @return the first segment after the block
+ */
+static struct tcp_seg *
+tcp_sack_next_block(struct tcp_seg *seg, u32_t *left, u32_t *right)
+{
+  *left = seg->tcphdr->seqno;
+  *right = *left + TCP_TCPLEN(seg);
+  for (seg = seg->next; (seg != NULL) && TCP_SEQ_LEQ(seg->tcphdr->seqno, *right); seg = seg->next) {
+    if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), *right)) {
+      *right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+    }
+  }
+  return seg;
+}
+
+/** Build the SACK blocks describing the data on pcb->ooseq (RFC 2018):
+ * the first block contains the segment received last, the others follow
+ * in sequence order.
+ *
+ * @param pcb tcp_pcb
+ * @param blocks returns the left and right edge of each block (host order)
+ * @param max maximum number of blocks
+ * @return number of blocks
+ */
+static u8_t
+tcp_build_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t left, right;
+  u8_t num = 0;
+
+  for (seg = pcb->ooseq; seg != NULL; ) {
+    seg = tcp_sack_next_block(seg, &left, &right);
+    if (TCP_SEQ_BETWEEN(pcb->rcv_sack_recent, left, right - 1)) {
+      blocks[0] = left;
+      blocks[1] = right;
+      num = 1;
+      break;
+    }
+  }
+  for (seg = pcb->ooseq; (seg != NULL) && (num < max); ) {
+    seg = tcp_sack_next_block(seg, &left, &right);
+    if ((num == 0) || (left != blocks[0])) {
+      blocks[2 * num] = left;
+      blocks[2 * num + 1] = right;
+      num++;
+    }
+  }
+  return num;
+}
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -899,15 +982,27 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   u8_t optlen = 0;
   struct netif *netif;
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK
   struct tcp_hdr *tcphdr;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK */
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  u32_t sack_blocks[2 * LWIP_TCP_MAX_SACK_BLOCKS];
+  u8_t sack_num = 0, i;
+  u32_t *opts;
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    sack_num = tcp_build_sack_blocks(pcb, sack_blocks,
+      (u8_t)(optlen ? LWIP_TCP_MAX_SACK_BLOCKS - 1 : LWIP_TCP_MAX_SACK_BLOCKS));
+    optlen = (u8_t)(optlen + LWIP_TCP_OPT_LEN_SACK_OUT(sack_num));
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -916,9 +1011,9 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK
   tcphdr = (struct tcp_hdr *)p->payload;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK */
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG, 
               ("tcp_output: sending ACK for %"U32_F"\n", pcb->rcv_nxt));
 
@@ -930,6 +1025,17 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if (sack_num > 0) {
+    /* the SACK option follows the timestamp option (if any) */
+    opts = (u32_t *)(void *)((u8_t *)(tcphdr + 1) + optlen - LWIP_TCP_OPT_LEN_SACK_OUT(sack_num));
+    /* Pad with two NOP options to make everything nicely aligned */
+    opts[0] = htonl(0x01010000 | (LWIP_TCP_OPT_SACK << 8) | (LWIP_TCP_OPT_LEN_SACK_OUT(sack_num) - 2));
+    for (i = 0; i < 2 * sack_num; i++) {
+      opts[1 + i] = htonl(sack_blocks[i]);
+    }
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
 
   netif = ip_route(PCB_ISIPV6(pcb), &pcb->remote_ip, &pcb->local_ip);
   if (netif == NULL) {
@@ -959,6 +1065,110 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   return err;
 }
 
+#if TCP_NETIF_OFFLOAD
+/**
+ * Find the segments that tcp_output() can send together with 'seg' as one
+ * GSO packet (see struct pbuf): contiguous segments with the same options
+ * and the same length (except for the last one), all fitting into the
+ * window and into netif->gso_max_size.
+ *
+ * @return the last segment to send in the GSO packet or NULL if 'seg' is
+ *         to be sent on its own
+ */
+static struct tcp_seg *
+tcp_output_gso_last(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t wnd,
+                    struct netif *netif)
+{
+  struct tcp_seg *last = seg, *next;
+  u32_t size;
+
+  if ((netif == NULL) || (netif->gso_max_size == 0) || (seg->len == 0) ||
+      (TCPH_FLAGS(seg->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST))) {
+    return NULL;
+  }
+  size = IP_HLEN + TCPH_HDRLEN(seg->tcphdr) * 4 + seg->len;
+  for (next = seg->next; next != NULL; last = next, next = next->next) {
+    if ((last->len != seg->len) || (next->len == 0) || (next->len > seg->len) ||
+        (TCPH_FLAGS(next->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) ||
+        (TCPH_HDRLEN(next->tcphdr) != TCPH_HDRLEN(seg->tcphdr)) ||
+        (ntohl(next->tcphdr->seqno) != ntohl(last->tcphdr->seqno) + last->len) ||
+        (ntohl(next->tcphdr->seqno) - pcb->lastack + next->len > wnd) ||
+        (size + next->len > netif->gso_max_size)) {
+      break;
+    }
+    /* nagle: a last short segment would not be sent yet */
+    if ((next->len < pcb->mss) && (next->next == NULL) &&
+        ((pcb->flags & (TF_NODELAY | TF_INFR | TF_NAGLEMEMERR | TF_FIN)) == 0)) {
+      break;
+    }
+    size += next->len;
+  }
+  return (last != seg) ? last : NULL;
+}
+
+/**
+ * Allocate a GSO packet for the data of the segments 'seg' to 'last': room
+ * for the TCP header of 'seg' followed by references to the data of all
+ * the segments (see pbuf_alloc_offload_ref(): the packet stays valid when
+ * the segments are acked and freed while a netif still holds it).
+ *
+ * @return the GSO packet or NULL on memory error
+ */
+static struct pbuf *
+tcp_output_gso_alloc(struct tcp_seg *seg, struct tcp_seg *last)
+{
+  struct pbuf *p, *q, *r;
+  struct tcp_seg *s;
+  u16_t offset;
+
+  p = pbuf_alloc(PBUF_IP, (u16_t)(TCPH_HDRLEN(seg->tcphdr) * 4), PBUF_RAM);
+  if (p == NULL) {
+    return NULL;
+  }
+  for (s = seg; s != last->next; s = s->next) {
+    /* the data follows the TCP header (s->p->payload may still point to the
+       IP header of a previous transmission) */
+    offset = (u16_t)((u8_t *)s->tcphdr - (u8_t *)s->p->payload + TCPH_HDRLEN(s->tcphdr) * 4);
+    for (q = s->p; q != NULL; q = q->next) {
+      if (offset >= q->len) {
+        offset = (u16_t)(offset - q->len);
+        continue;
+      }
+      r = pbuf_alloc_offload_ref(q, offset, (u16_t)(q->len - offset));
+      if (r == NULL) {
+        pbuf_free(p);
+        return NULL;
+      }
+      pbuf_cat(p, r);
+      offset = 0;
+    }
+  }
+  p->gso_size = seg->len;
+  if (TCPH_FLAGS(last->tcphdr) & TCP_PSH) {
+    p->flags |= PBUF_FLAG_PUSH;
+  }
+  return p;
+}
+
+/**
+ * Let the netif compute the TCP checksum of p (p->payload points to the
+ * TCP header): store the pseudo header sum for it (see struct pbuf).
+ *
+ * @param proto_len length for the pseudo header (0 for GSO packets)
+ */
+static void
+tcp_output_offload_chksum(struct tcp_pcb *pcb, struct pbuf *p, u16_t proto_len)
+{
+  struct tcp_hdr *tcphdr = (struct tcp_hdr *)p->payload;
+
+  tcphdr->chksum = (u16_t)~ip_chksum_pseudo_partial(p, IP_PROTO_TCP, proto_len, 0,
+    &pcb->local_ip, &pcb->remote_ip);
+  p->flags |= PBUF_FLAG_CSUM_PARTIAL;
+  p->csum_start = 0;
+  p->csum_offset = TCP_CHKSUM_OFFSET;
+}
+#endif /* TCP_NETIF_OFFLOAD */
+
 /**
  * Find out what we can send and send it
  *
@@ -972,6 +1182,14 @@ tcp_output(struct tcp_pcb *pcb)
   struct tcp_seg *seg, *useg;
   u32_t wnd, snd_nxt;
   err_t err;
+#if LWIP_TCP_RACK
+  u32_t snd_nxt_start;
+#endif /* LWIP_TCP_RACK */
+#if TCP_NETIF_OFFLOAD
+  struct netif *gso_netif = NULL;
+  struct tcp_seg *gso_last = NULL;
+  struct pbuf *gso;
+#endif /* TCP_NETIF_OFFLOAD */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
@@ -980,6 +1198,9 @@ tcp_output(struct tcp_pcb *pcb)
   LWIP_ASSERT("don't call tcp_output for listen-pcbs",
     pcb->state != LISTEN);
 
+  /* whatever we do (or did before calling us), timers may have changed */
+  tcp_timers_touch(pcb);
+
   /* First, check if we are invoked by the TCP input processing
      code. If so, we do not output anything. Instead, we rely on the
      input processing code to call us when input processing is done
@@ -988,9 +1209,20 @@ tcp_output(struct tcp_pcb *pcb)
     return ERR_OK;
   }
 
-  wnd = LWIP_MIN(pcb->snd_wnd, pcb->cwnd);
-
   seg = pcb->unsent;
+#if LWIP_TCP_RACK
+  snd_nxt_start = pcb->snd_nxt;
+#endif /* LWIP_TCP_RACK */
+
+  /* Restarting after all data was ACKed and nothing was received for an
+     RTO: the ACK clock is gone (pcb->tmr is updated by every segment
+     received) */
+  if ((seg != NULL) && (pcb->unacked == NULL) && (pcb->state >= ESTABLISHED) &&
+      ((u32_t)(tcp_ticks - pcb->tmr) > (u32_t)pcb->rto)) {
+    pcb->cc_ops->idle(pcb);
+  }
+
+  wnd = LWIP_MIN(pcb->snd_wnd, pcb->cwnd);
 
   /* If the TF_ACK_NOW flag is set and no data will be sent (either
    * because the ->unsent queue is empty or because the window does
@@ -998,6 +1230,13 @@ tcp_output(struct tcp_pcb *pcb)
    *
    * If data is to be sent, we will just piggyback the ACK (see below).
    */
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if (((pcb->flags & (TF_ACK_NOW | TF_SACK)) == (TF_ACK_NOW | TF_SACK)) &&
+      (pcb->ooseq != NULL) && (seg != NULL)) {
+    /* SACK blocks are only sent in empty ACKs: don't piggyback this one */
+    tcp_send_empty_ack(pcb);
+  }
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
   if (pcb->flags & TF_ACK_NOW &&
      (seg == NULL ||
       ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len > wnd)) {
@@ -1010,6 +1249,12 @@ tcp_output(struct tcp_pcb *pcb)
     for (; useg->next != NULL; useg = useg->next);
   }
 
+#if TCP_NETIF_OFFLOAD
+  if ((seg != NULL) && !PCB_ISIPV6(pcb)) {
+    gso_netif = ip_route(0, &pcb->local_ip, &pcb->remote_ip);
+  }
+#endif /* TCP_NETIF_OFFLOAD */
+
 #if TCP_OUTPUT_DEBUG
   if (seg == NULL) {
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: nothing to send (%p)\n",
@@ -1044,7 +1289,12 @@ tcp_output(struct tcp_pcb *pcb)
      *   RST is no sent using tcp_write/tcp_output.
      */
     if((tcp_do_output_nagle(pcb) == 0) &&
-      ((pcb->flags & (TF_NAGLEMEMERR | TF_FIN)) == 0)){
+      ((pcb->flags & (TF_NAGLEMEMERR | TF_FIN)) == 0)
+#if TCP_NETIF_OFFLOAD
+      /* already sent as part of a GSO packet */
+      && (gso_last == NULL)
+#endif /* TCP_NETIF_OFFLOAD */
+      ){
       break;
     }
 #if TCP_CWND_DEBUG
@@ -1063,12 +1313,43 @@ tcp_output(struct tcp_pcb *pcb)
 #if TCP_OVERSIZE_DBGCHECK
     seg->oversize_left = 0;
 #endif /* TCP_OVERSIZE_DBGCHECK */
-    err = tcp_output_segment(seg, pcb);
+#if TCP_NETIF_OFFLOAD
+    if (gso_last == NULL) {
+      /* send seg and as many following segments as possible in one packet */
+      gso = NULL;
+      gso_last = tcp_output_gso_last(pcb, seg, wnd, gso_netif);
+      if (gso_last != NULL) {
+        gso = tcp_output_gso_alloc(seg, gso_last);
+        if (gso == NULL) {
+          gso_last = NULL;
+        }
+      }
+      err = tcp_output_segment(seg, pcb, gso);
+      if (gso != NULL) {
+        pbuf_free(gso);
+      }
+    } else {
+      /* the rest of the GSO packet: only update the state */
+      snmp_inc_tcpoutsegs();
+      err = ERR_OK;
+    }
+    if (gso_last == seg) {
+      gso_last = NULL;
+    }
+#else /* TCP_NETIF_OFFLOAD */
+    err = tcp_output_segment(seg, pcb, NULL);
+#endif /* TCP_NETIF_OFFLOAD */
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
       pcb->flags |= TF_NAGLEMEMERR;
       return err;
     }
+#if LWIP_TCP_RACK
+    if (TCP_SEQ_LT(ntohl(seg->tcphdr->seqno), pcb->snd_nxt)) {
+      seg->flags |= TF_SEG_REXMIT;
+    }
+    seg->xmit_ts = TCP_NOW();
+#endif /* LWIP_TCP_RACK */
     pcb->unsent = seg->next;
     if (pcb->state != SYN_SENT) {
       pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
@@ -1116,6 +1397,12 @@ tcp_output(struct tcp_pcb *pcb)
     pcb->unsent_oversize = 0;
   }
 #endif /* TCP_OVERSIZE */
+#if LWIP_TCP_RACK
+  if (pcb->snd_nxt != snd_nxt_start) {
+    /* new data sent: (re-)schedule the tail loss probe */
+    tcp_rack_arm(pcb);
+  }
+#endif /* LWIP_TCP_RACK */
 
   pcb->flags &= ~TF_NAGLEMEMERR;
   return ERR_OK;
@@ -1126,9 +1413,11 @@ tcp_output(struct tcp_pcb *pcb)
  *
  * @param seg the tcp_seg to send
  * @param pcb the tcp_pcb for the TCP connection used to send the segment
+ * @param gso if != NULL, a GSO packet from tcp_output_gso_alloc() carrying the
+ *        data of seg and the following segments: it is sent instead of seg->p
  */
 static err_t
-tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
+tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct pbuf *gso)
 {
   err_t err;
   u16_t len;
@@ -1183,11 +1472,18 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 1;
   }
 #endif
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Pad with two NOP options to make everything nicely aligned */
+    *opts = PP_HTONL(0x01010000 | (LWIP_TCP_OPT_SACK_PERM << 8) | LWIP_TCP_OPT_LEN_SACK_PERM);
+    opts += 1;
+  }
+#endif
   
   /* Set retransmission timer running if it is not currently enabled 
      This must be set before checking the route. */
   if (pcb->rtime == -1) {
-    pcb->rtime = 0;
+    TCP_RTO_RESTART(pcb);
   }
 
   netif = ip_route(PCB_ISIPV6(pcb), &pcb->local_ip, &pcb->remote_ip);
@@ -1207,8 +1503,14 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
 #endif /* !LWIP_IPV4 || !LWIP_IPV6 */
   }
 
+#if LWIP_TCP_RTT_MS
+  /* Karn's algorithm: only time segments sent for the first time */
+  if ((pcb->rttest == 0) && TCP_SEQ_GEQ(ntohl(seg->tcphdr->seqno), pcb->snd_nxt)) {
+    pcb->rttest = TCP_NOW();
+#else /* LWIP_TCP_RTT_MS */
   if (pcb->rttest == 0) {
     pcb->rttest = tcp_ticks;
+#endif /* LWIP_TCP_RTT_MS */
     pcb->rtseq = ntohl(seg->tcphdr->seqno);
 
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_output_segment: rtseq %"U32_F"\n", pcb->rtseq));
@@ -1224,8 +1526,36 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
 
   seg->p->payload = seg->tcphdr;
 
+#if TCP_NETIF_OFFLOAD
+  if (gso != NULL) {
+    struct tcp_hdr *tcphdr = (struct tcp_hdr *)gso->payload;
+    MEMCPY(tcphdr, seg->tcphdr, TCPH_HDRLEN(seg->tcphdr) * 4);
+    if (gso->flags & PBUF_FLAG_PUSH) {
+      TCPH_SET_FLAG(tcphdr, TCP_PSH);
+    }
+    gso->flags = 0;
+    tcp_output_offload_chksum(pcb, gso, 0);
+    TCP_STATS_INC(tcp.xmit);
+
+    NETIF_SET_HWADDRHINT(netif, &(pcb->addr_hint));
+    err = ip_output_if(0, gso, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
+      pcb->tos, IP_PROTO_TCP, netif);
+    NETIF_SET_HWADDRHINT(netif, NULL);
+    return err;
+  }
+  seg->p->flags = (u8_t)(seg->p->flags & ~PBUF_FLAG_CSUM_PARTIAL);
+#else /* TCP_NETIF_OFFLOAD */
+  LWIP_UNUSED_ARG(gso);
+#endif /* TCP_NETIF_OFFLOAD */
+
   seg->tcphdr->chksum = 0;
 #if CHECKSUM_GEN_TCP
+#if TCP_NETIF_OFFLOAD
+  if (!PCB_ISIPV6(pcb) && (netif->offload_flags & NETIF_OFFLOAD_CSUM_TCP)) {
+    /* the netif computes the checksum */
+    tcp_output_offload_chksum(pcb, seg->p, seg->p->tot_len);
+  } else
+#endif /* TCP_NETIF_OFFLOAD */
   IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
 #if TCP_CHECKSUM_ON_COPY
     u32_t acc;
@@ -1355,20 +1685,62 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
     return;
   }
 
-  /* Move all unacked segments to the head of the unsent queue */
-  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
-  /* concatenate unsent queue after unacked queue */
-  seg->next = pcb->unsent;
+#if LWIP_TCP_SACK
+  if (pcb->flags & TF_SACK) {
+    struct tcp_seg **pseg, *holes = NULL, *last_hole = NULL;
+
+    /* a timeout ends fast recovery */
+    pcb->flags &= ~TF_INFR;
+    if (pcb->unacked->flags & TF_SEG_SACKED) {
+      /* The remote host dropped data it selectively acknowledged before
+         (otherwise, this would have been acknowledged): forget all SACKs. */
+      for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+        seg->flags &= ~TF_SEG_SACKED;
+      }
+    }
+    /* Move only the segments not SACKed to the head of the unsent queue */
+    pseg = &pcb->unacked;
+    while (*pseg != NULL) {
+      seg = *pseg;
+      if (seg->flags & TF_SEG_SACKED) {
+        pseg = &seg->next;
+      } else {
+        *pseg = seg->next;
+        if (last_hole == NULL) {
+          holes = seg;
+        } else {
+          last_hole->next = seg;
+        }
+        last_hole = seg;
+      }
+    }
+    LWIP_ASSERT("no segment to retransmit", last_hole != NULL);
+    last_hole->next = pcb->unsent;
 #if TCP_OVERSIZE && TCP_OVERSIZE_DBGCHECK
-  /* if last unsent changed, we need to update unsent_oversize */
-  if (pcb->unsent == NULL) {
-    pcb->unsent_oversize = seg->oversize_left;
-  }
+    /* if last unsent changed, we need to update unsent_oversize */
+    if (pcb->unsent == NULL) {
+      pcb->unsent_oversize = last_hole->oversize_left;
+    }
 #endif /* TCP_OVERSIZE && TCP_OVERSIZE_DBGCHECK*/
-  /* unsent queue is the concatenated queue (of unacked, unsent) */
-  pcb->unsent = pcb->unacked;
-  /* unacked queue is now empty */
-  pcb->unacked = NULL;
+    pcb->unsent = holes;
+  } else
+#endif /* LWIP_TCP_SACK */
+  {
+    /* Move all unacked segments to the head of the unsent queue */
+    for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
+    /* concatenate unsent queue after unacked queue */
+    seg->next = pcb->unsent;
+#if TCP_OVERSIZE && TCP_OVERSIZE_DBGCHECK
+    /* if last unsent changed, we need to update unsent_oversize */
+    if (pcb->unsent == NULL) {
+      pcb->unsent_oversize = seg->oversize_left;
+    }
+#endif /* TCP_OVERSIZE && TCP_OVERSIZE_DBGCHECK*/
+    /* unsent queue is the concatenated queue (of unacked, unsent) */
+    pcb->unsent = pcb->unacked;
+    /* unacked queue is now empty */
+    pcb->unacked = NULL;
+  }
 
   /* increment number of retransmissions */
   ++pcb->nrtx;
@@ -1381,26 +1753,21 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Move an unacked segment to the unsent queue for retransmission
  *
- * Called by tcp_receive() for fast retramsmit.
- *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param pseg pointer to the segment (on pcb->unacked)
  */
-void
-tcp_rexmit(struct tcp_pcb *pcb)
+static void
+tcp_rexmit_requeue(struct tcp_pcb *pcb, struct tcp_seg **pseg)
 {
   struct tcp_seg *seg;
   struct tcp_seg **cur_seg;
 
-  if (pcb->unacked == NULL) {
-    return;
-  }
-
-  /* Move the first unacked segment to the unsent queue */
+  /* Move the unacked segment to the unsent queue */
   /* Keep the unsent queue sorted. */
-  seg = pcb->unacked;
-  pcb->unacked = seg->next;
+  seg = *pseg;
+  *pseg = seg->next;
 
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
@@ -1416,8 +1783,6 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 #endif /* TCP_OVERSIZE */
 
-  ++pcb->nrtx;
-
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
 
@@ -1427,6 +1792,64 @@ tcp_rexmit(struct tcp_pcb *pcb)
      and thus tcp_output directly returns. */
 }
 
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retramsmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+void
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  if (pcb->unacked == NULL) {
+    return;
+  }
+
+  tcp_rexmit_requeue(pcb, &pcb->unacked);
+  ++pcb->nrtx;
+}
+
+#if LWIP_TCP_SACK
+/**
+ * Requeue the next segment missing at the remote host for retransmission
+ * during fast recovery with SACK: the first unacked segment that was not
+ * SACKed and not yet retransmitted in this recovery, if data after it was
+ * SACKed (so it is considered lost) or if it is the first unacked segment
+ * (after a partial ACK).
+ *
+ * Called by tcp_receive().
+ *
+ * @param pcb the tcp_pcb for which to retransmit a segment
+ * @return 1 if a segment was requeued, 0 if there was none to retransmit
+ */
+u8_t
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg **pseg, **phole = NULL;
+
+  for (pseg = &pcb->unacked; *pseg != NULL; pseg = &(*pseg)->next) {
+    if ((*pseg)->flags & TF_SEG_SACKED) {
+      if (phole != NULL) {
+        /* data after the hole arrived */
+        break;
+      }
+    } else if ((phole == NULL) &&
+               TCP_SEQ_GEQ(ntohl((*pseg)->tcphdr->seqno), pcb->sack_rexmit)) {
+      phole = pseg;
+    }
+  }
+  if ((phole == NULL) || ((*pseg == NULL) && (phole != &pcb->unacked))) {
+    return 0;
+  }
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: retransmitting %"U32_F"\n",
+                             ntohl((*phole)->tcphdr->seqno)));
+  pcb->sack_rexmit = ntohl((*phole)->tcphdr->seqno) + TCP_TCPLEN(*phole);
+  tcp_rexmit_requeue(pcb, phole);
+  return 1;
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1443,29 +1866,314 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    pcb->sack_recover = pcb->snd_nxt;
+    pcb->sack_rexmit = ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked);
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
 
-    /* Set ssthresh to half of the minimum of the current
-     * cwnd and the advertised window */
-    if (pcb->cwnd > pcb->snd_wnd) {
-      pcb->ssthresh = pcb->snd_wnd / 2;
+    /* Reduce ssthresh and cwnd for fast recovery */
+    pcb->cc_ops->loss(pcb);
+    pcb->flags |= TF_INFR;
+  } 
+}
+
+#if LWIP_TCP_RACK
+/**
+ * RACK: was segment 1 (sent at t1, ending at end1, a retransmission if
+ * rexmit1 != 0) sent after segment 2? TCP_NOW() only has a resolution of
+ * 1 ms: within the same millisecond, retransmissions count as sent after
+ * original transmissions.
+ */
+static u8_t
+tcp_rack_sent_after(u32_t t1, u32_t end1, u8_t rexmit1, u32_t t2, u32_t end2, u8_t rexmit2)
+{
+  if (t1 != t2) {
+    return (s32_t)(t1 - t2) > 0;
+  }
+  if (rexmit1 != rexmit2) {
+    return rexmit1;
+  }
+  return TCP_SEQ_GT(end1, end2);
+}
+
+/** Start the retransmission timer of a pcb for a probe or reordering time-out */
+static void
+tcp_rack_timer_start(struct tcp_pcb *pcb, u8_t kind, u32_t ms)
+{
+  pcb->rack_timer = kind;
+  tcp_rto_arm(pcb, ms);
+}
+
+/**
+ * RACK: a segment was delivered (cumulatively acknowledged or SACKed for the
+ * first time). Remembers the most recently sent segment delivered and its
+ * RTT, and whether the remote host received data out of order.
+ *
+ * Called by tcp_receive().
+ *
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the segment delivered
+ */
+void
+tcp_rack_delivered(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  u32_t rtt = TCP_NOW() - seg->xmit_ts;
+  u32_t end = ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
+  u8_t valid = pcb->rack_flags & TCP_RACK_F_VALID;
+  u8_t rexmit = (seg->flags & TF_SEG_REXMIT) ? 1 : 0;
+
+  if (valid && rexmit && (rtt < pcb->rack_min_rtt)) {
+    /* too early for the retransmission: the original was delivered */
+    return;
+  }
+  if (!valid || (rtt < pcb->rack_min_rtt)) {
+    pcb->rack_min_rtt = rtt;
+  }
+  if (!valid ||
+      tcp_rack_sent_after(seg->xmit_ts, end, rexmit, pcb->rack_xmit_ts, pcb->rack_end_seq,
+                          (pcb->rack_flags & TCP_RACK_F_REXMIT) ? 1 : 0)) {
+    pcb->rack_rtt = rtt;
+    pcb->rack_xmit_ts = seg->xmit_ts;
+    pcb->rack_end_seq = end;
+    if (rexmit) {
+      pcb->rack_flags |= TCP_RACK_F_REXMIT;
     } else {
-      pcb->ssthresh = pcb->cwnd / 2;
+      pcb->rack_flags &= ~TCP_RACK_F_REXMIT;
     }
-    
-    /* The minimum value for ssthresh should be 2 MSS */
-    if (pcb->ssthresh < (2U * pcb->mss)) {
-      LWIP_DEBUGF(TCP_FR_DEBUG, 
-                  ("tcp_receive: The minimum value for ssthresh %"U16_F
-                   " should be min 2 mss %"U16_F"...\n",
-                   pcb->ssthresh, 2*pcb->mss));
-      pcb->ssthresh = 2*pcb->mss;
+  }
+  if (!valid || TCP_SEQ_GT(end, pcb->rack_fack)) {
+    pcb->rack_fack = end;
+  } else if (!rexmit) {
+    /* delivered after data sent later: the network reorders */
+    pcb->rack_flags |= TCP_RACK_F_REORD;
+  }
+  pcb->rack_flags |= TCP_RACK_F_VALID;
+}
+
+/**
+ * RACK: the time a segment may arrive after a segment sent later before it
+ * is considered lost. Zero in fast recovery or once three segments were
+ * SACKed, unless reordering was seen; at least the 1 ms granularity of
+ * TCP_NOW() otherwise.
+ */
+static u32_t
+tcp_rack_reo_wnd(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u8_t sacked = 0;
+
+  if (!(pcb->rack_flags & TCP_RACK_F_REORD)) {
+    if (pcb->flags & TF_INFR) {
+      return 0;
     }
-    
-    pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
-    pcb->flags |= TF_INFR;
-  } 
+    for (seg = pcb->unacked; (seg != NULL) && (sacked < 3); seg = seg->next) {
+      if (seg->flags & TF_SEG_SACKED) {
+        sacked++;
+      }
+    }
+    if (sacked >= 3) {
+      return 0;
+    }
+  }
+  return LWIP_MAX(LWIP_MIN(pcb->rack_min_rtt >> 2, pcb->srtt >> 3), 1);
+}
+
+/**
+ * RACK: requeue the unacked segments sent more than an RTT plus the
+ * reordering window before the most recently sent segment delivered was sent
+ * (they are lost) and enter fast recovery. If other segments sent before it
+ * have not been delivered yet, the timer is set to the end of their
+ * reordering window.
+ *
+ * @param pcb the tcp_pcb to detect losses on
+ */
+static void
+tcp_rack_detect_loss(struct tcp_pcb *pcb)
+{
+  struct tcp_seg **pseg, *seg;
+  u32_t now, reo_wnd;
+  s32_t remaining, timeout = 0;
+
+  if (!(pcb->rack_flags & TCP_RACK_F_VALID)) {
+    return;
+  }
+  now = TCP_NOW();
+  reo_wnd = tcp_rack_reo_wnd(pcb);
+  pseg = &pcb->unacked;
+  while (*pseg != NULL) {
+    seg = *pseg;
+    if ((seg->flags & TF_SEG_SACKED) ||
+        !tcp_rack_sent_after(pcb->rack_xmit_ts, pcb->rack_end_seq,
+                             (pcb->rack_flags & TCP_RACK_F_REXMIT) ? 1 : 0, seg->xmit_ts,
+                             ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg),
+                             (seg->flags & TF_SEG_REXMIT) ? 1 : 0)) {
+      pseg = &seg->next;
+      continue;
+    }
+    remaining = (s32_t)(seg->xmit_ts + pcb->rack_rtt + reo_wnd - now);
+    if (remaining > 0) {
+      timeout = LWIP_MAX(timeout, remaining);
+      pseg = &seg->next;
+      continue;
+    }
+    LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack_detect_loss: %"U32_F" lost\n",
+                               ntohl(seg->tcphdr->seqno)));
+    if (!(pcb->flags & TF_INFR)) {
+      pcb->sack_recover = pcb->snd_nxt;
+      pcb->cc_ops->loss(pcb);
+      pcb->flags |= TF_INFR;
+      /* the recovery covers the loss a probe may have repaired */
+      pcb->rack_flags &= ~TCP_RACK_F_TLP_REXMIT;
+    }
+    /* this unlinks seg: *pseg is the next segment now */
+    tcp_rexmit_requeue(pcb, pseg);
+  }
+  if ((timeout > 0) && ((pcb->rack_timer != TCP_RACK_TMR_RTO) ||
+                        ((s32_t)(pcb->rto_node.due - (now + (u32_t)timeout)) > 0))) {
+    tcp_rack_timer_start(pcb, TCP_RACK_TMR_REO, (u32_t)timeout);
+  }
+}
+
+/**
+ * Schedule a tail loss probe about two RTTs after the last segment was sent
+ * (but not after the retransmission time-out), unless a probe is outstanding,
+ * the pcb is in fast recovery or waits for the reordering window of a
+ * segment.
+ *
+ * Called when new data was sent and by tcp_rack_input().
+ *
+ * @param pcb the tcp_pcb to schedule the probe for
+ */
+static void
+tcp_rack_arm(struct tcp_pcb *pcb)
+{
+  u32_t pto;
+  s32_t rto_left;
+
+  if (!TCP_RACK_ACTIVE(pcb) || (pcb->state < ESTABLISHED) ||
+      (pcb->unacked == NULL) || (pcb->rtime < 0) || (pcb->persist_backoff > 0) ||
+      (pcb->flags & TF_INFR) || (pcb->rack_flags & TCP_RACK_F_TLP) ||
+      (pcb->rack_timer == TCP_RACK_TMR_REO)) {
+    return;
+  }
+  if (pcb->srtt == 0) {
+    pto = TCP_RTO_INITIAL_MS;
+  } else {
+    /* srtt is scaled by 8 */
+    pto = pcb->srtt >> 2;
+    if (pcb->unacked->next == NULL) {
+      /* the ACK for a single segment may be delayed */
+      pto += TCP_TLP_WCDELACK_MS;
+    }
+  }
+  pto = LWIP_MAX(pto, TCP_TLP_MIN_PTO_MS);
+  if (pcb->rack_timer == TCP_RACK_TMR_RTO) {
+    rto_left = (s32_t)(pcb->rto_node.due - TCP_NOW());
+    if (rto_left <= 0) {
+      return;
+    }
+    pto = LWIP_MIN(pto, (u32_t)rto_left);
+  }
+  tcp_rack_timer_start(pcb, TCP_RACK_TMR_PTO, pto);
+}
+
+/**
+ * Send a tail loss probe: the next new segment if the send window allows it,
+ * otherwise a retransmission of the last segment not SACKed. The probe is
+ * sent regardless of cwnd and the Nagle algorithm. Its ACK (or the SACK
+ * blocks in it) lets RACK or fast recovery repair a lost tail.
+ *
+ * @param pcb the tcp_pcb to send the probe on
+ */
+static void
+tcp_tlp_send(struct tcp_pcb *pcb)
+{
+  struct tcp_seg **pseg, **plast = NULL;
+  tcpwnd_size_t cwnd = pcb->cwnd;
+  tcpflags_t nodelay = (tcpflags_t)(pcb->flags & TF_NODELAY);
+  u32_t wnd;
+
+  pcb->rack_flags |= TCP_RACK_F_TLP;
+  if ((pcb->unsent == NULL) ||
+      (ntohl(pcb->unsent->tcphdr->seqno) - pcb->lastack + pcb->unsent->len > pcb->snd_wnd)) {
+    for (pseg = &pcb->unacked; *pseg != NULL; pseg = &(*pseg)->next) {
+      if (!((*pseg)->flags & TF_SEG_SACKED)) {
+        plast = pseg;
+      }
+    }
+    if (plast == NULL) {
+      tcp_rto_start(pcb);
+      return;
+    }
+    tcp_rexmit_requeue(pcb, plast);
+    pcb->rack_flags |= TCP_RACK_F_TLP_REXMIT;
+  }
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_tlp_send: probe %"U32_F"\n",
+                              ntohl(pcb->unsent->tcphdr->seqno)));
+
+  wnd = ntohl(pcb->unsent->tcphdr->seqno) - pcb->lastack + pcb->unsent->len;
+  if (pcb->cwnd < wnd) {
+    pcb->cwnd = (tcpwnd_size_t)wnd;
+  }
+  pcb->flags |= TF_NODELAY;
+  tcp_output(pcb);
+  pcb->cwnd = cwnd;
+  pcb->flags = (tcpflags_t)((pcb->flags & ~TF_NODELAY) | nodelay);
+
+  pcb->tlp_end_seq = pcb->snd_nxt;
+  tcp_rto_start(pcb);
+}
+
+/**
+ * The retransmission timer of a pcb expired while running for a tail loss
+ * probe or the reordering window of a segment (pcb->rack_timer).
+ *
+ * Called by tcp_rto_tmr().
+ *
+ * @param pcb the tcp_pcb the timer expired for
+ */
+void
+tcp_rack_timeout(struct tcp_pcb *pcb)
+{
+  if (pcb->rack_timer == TCP_RACK_TMR_PTO) {
+    tcp_tlp_send(pcb);
+  } else {
+    tcp_rto_start(pcb);
+    tcp_rack_detect_loss(pcb);
+    tcp_output(pcb);
+  }
+}
+
+/**
+ * RACK: process an ACK after the SACK scoreboard and the RTT estimate were
+ * updated: end the tail loss probe episode, detect lost segments and
+ * schedule the next probe.
+ *
+ * Called by tcp_receive().
+ *
+ * @param pcb the tcp_pcb an ACK arrived for
+ */
+void
+tcp_rack_input(struct tcp_pcb *pcb)
+{
+  if (!TCP_RACK_ACTIVE(pcb) || (pcb->state < ESTABLISHED)) {
+    return;
+  }
+  if ((pcb->rack_flags & TCP_RACK_F_TLP) && TCP_SEQ_GEQ(pcb->lastack, pcb->tlp_end_seq)) {
+    if (pcb->rack_flags & TCP_RACK_F_TLP_REXMIT) {
+      /* Without DSACK, we cannot tell whether the original segment or the
+         probe was delivered: assume the probe repaired a loss and reduce
+         cwnd like a fast recovery would have done (RFC 8985, 7.4). */
+      pcb->cc_ops->loss(pcb);
+      pcb->cc_ops->recovered(pcb);
+    }
+    pcb->rack_flags &= ~(TCP_RACK_F_TLP | TCP_RACK_F_TLP_REXMIT);
+  }
+  tcp_rack_detect_loss(pcb);
+  tcp_rack_arm(pcb);
 }
+#endif /* LWIP_TCP_RACK */
 
 
 /**
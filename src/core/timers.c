@@ -62,11 +62,22 @@
 #include "lwip/sys.h"
 #include "lwip/pbuf.h"
 
+#if LWIP_TIMERS_WHEEL
+/** Timeouts are kept in a timing wheel of 4 levels of 1 ms ticks (a span of
+ * 2^24 ms), the ones of the tick being processed on timeouts_wheel.expired */
+WHEEL_DECLARE(timeouts_wheel, 4);
+/** handler/arg lookup for sys_untimeout() */
+static struct sys_timeo *timeouts_hash[SYS_TIMEOUT_HASH_SIZE];
+/** sys_now() - timeouts_offset is the current wheel tick
+ * (changed by sys_restart_timeouts()) */
+static u32_t timeouts_offset;
+#else /* LWIP_TIMERS_WHEEL */
 /** The one and only timeout list */
 static struct sys_timeo *next_timeout;
 #if NO_SYS
 static u32_t timeouts_last_time;
 #endif /* NO_SYS */
+#endif /* LWIP_TIMERS_WHEEL */
 
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
@@ -109,6 +120,52 @@ tcp_timer_needed(void)
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   }
 }
+
+#if LWIP_TCP_RTT_MS
+/** global variables that show if and for when the tcp retransmission timer
+ * is scheduled */
+static int tcpip_tcp_rto_timer_active;
+static u32_t tcpip_tcp_rto_due;
+
+/**
+ * Timer callback function that calls tcp_rto_tmr(). tcp_rto_tmr()
+ * reschedules the timer for the next deadline.
+ *
+ * @param arg unused argument
+ */
+static void
+tcpip_tcp_rto_timer(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  tcpip_tcp_rto_timer_active = 0;
+  tcp_rto_tmr();
+}
+
+/**
+ * Called when a retransmission timer is started: make sure tcp_rto_tmr()
+ * runs at TCP_NOW() 'due' (or earlier).
+ *
+ * @param due TCP_NOW() at which the retransmission timer expires
+ */
+void
+tcp_rto_timer_needed(u32_t due)
+{
+  s32_t diff;
+
+  if (tcpip_tcp_rto_timer_active) {
+    if ((s32_t)(due - tcpip_tcp_rto_due) >= 0) {
+      /* the timer runs early enough */
+      return;
+    }
+    sys_untimeout(tcpip_tcp_rto_timer, NULL);
+  }
+  tcpip_tcp_rto_timer_active = 1;
+  tcpip_tcp_rto_due = due;
+  diff = (s32_t)(due - TCP_NOW());
+  sys_timeout((diff > 0) ? (u32_t)diff : 0, tcpip_tcp_rto_timer, NULL);
+}
+#endif /* LWIP_TCP_RTT_MS */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV4
@@ -305,12 +362,249 @@ void sys_timeouts_init(void)
 #endif /* LWIP_IPV6_MLD */
 #endif /* LWIP_IPV6 */
 
-#if NO_SYS
+#if NO_SYS && !LWIP_TIMERS_WHEEL
   /* Initialise timestamp for sys_check_timeouts */
   timeouts_last_time = sys_now();
 #endif
 }
 
+#if LWIP_TIMERS_WHEEL
+/** Calculate the sys_untimeout() bucket for a handler/arg pair */
+static struct sys_timeo **
+sys_timeouts_hash_bucket(sys_timeout_handler handler, void *arg)
+{
+  u32_t h = (u32_t)((mem_ptr_t)handler ^ (mem_ptr_t)arg) * 0x9E3779B1UL;
+  h ^= h >> 16;
+  return &timeouts_hash[h & (SYS_TIMEOUT_HASH_SIZE - 1)];
+}
+
+/** Remove a timeout from the wheel (or expired list) and the hash */
+static void
+sys_timeouts_wheel_remove(struct sys_timeo *timeout)
+{
+  wheel_remove(&timeouts_wheel, &timeout->node);
+  *timeout->hash_pprev = timeout->hash_next;
+  if (timeout->hash_next != NULL) {
+    timeout->hash_next->hash_pprev = timeout->hash_pprev;
+  }
+}
+
+/**
+ * Create a one-shot timer (aka timeout). Timeouts are processed in the
+ * following cases:
+ * - while waiting for a message using sys_timeouts_mbox_fetch()
+ * - by calling sys_check_timeouts() (NO_SYS==1 only)
+ *
+ * @param msecs time in milliseconds after that the timer should expire
+ * @param handler callback function to call when msecs have elapsed
+ * @param arg argument to pass to the callback function
+ */
+#if LWIP_DEBUG_TIMERNAMES
+void
+sys_timeout_debug(u32_t msecs, sys_timeout_handler handler, void *arg, const char* handler_name)
+#else /* LWIP_DEBUG_TIMERNAMES */
+void
+sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
+#endif /* LWIP_DEBUG_TIMERNAMES */
+{
+  struct sys_timeo *timeout, **bucket;
+  u32_t now;
+
+  timeout = (struct sys_timeo *)memp_malloc(MEMP_SYS_TIMEOUT);
+  if (timeout == NULL) {
+    LWIP_ASSERT("sys_timeout: timeout != NULL, pool MEMP_SYS_TIMEOUT is empty", timeout != NULL);
+    return;
+  }
+
+  now = sys_now() - timeouts_offset;
+  /* nothing to process in between: let the wheel jump to now */
+  wheel_sync(&timeouts_wheel, now);
+
+  timeout->h = handler;
+  timeout->arg = arg;
+  timeout->node.due = now + msecs;
+  if (WHEEL_TIME_LESS(timeout->node.due, timeouts_wheel.time)) {
+    /* the tick would already be processed: expire with the next one */
+    timeout->node.due = timeouts_wheel.time;
+  }
+  timeout->node.pprev = NULL;
+#if LWIP_DEBUG_TIMERNAMES
+  timeout->handler_name = handler_name;
+  LWIP_DEBUGF(TIMERS_DEBUG, ("sys_timeout: %p msecs=%"U32_F" handler=%s arg=%p\n",
+    (void *)timeout, msecs, handler_name, (void *)arg));
+#endif /* LWIP_DEBUG_TIMERNAMES */
+
+  bucket = sys_timeouts_hash_bucket(handler, arg);
+  timeout->hash_pprev = bucket;
+  timeout->hash_next = *bucket;
+  if (*bucket != NULL) {
+    (*bucket)->hash_pprev = &timeout->hash_next;
+  }
+  *bucket = timeout;
+
+  wheel_insert(&timeouts_wheel, &timeout->node);
+}
+
+/**
+ * Remove the first matching entry (the one expiring first), even though the
+ * timeout has not triggered yet. Only the handler/arg hash bucket is searched.
+ *
+ * @param handler callback function that would be called by the timeout
+ * @param arg callback argument that would be passed to handler
+*/
+void
+sys_untimeout(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timeo *t, *match = NULL;
+
+  for (t = *sys_timeouts_hash_bucket(handler, arg); t != NULL; t = t->hash_next) {
+    if ((t->h == handler) && (t->arg == arg)) {
+      if ((match == NULL) || WHEEL_TIME_LESS(t->node.due, match->node.due)) {
+        match = t;
+      }
+    }
+  }
+  if (match != NULL) {
+    sys_timeouts_wheel_remove(match);
+    memp_free(MEMP_SYS_TIMEOUT, match);
+  }
+}
+
+/**
+ * Advance the wheel up to the current time and call the handlers of all
+ * expired timeouts (in order of their expiry tick).
+ */
+static void
+sys_timeouts_wheel_process(void)
+{
+  u32_t now = sys_now() - timeouts_offset;
+
+  /* the timeouts of a tick are moved to the expired list so that handlers
+     can safely add or remove timeouts while we call them */
+  while (wheel_advance(&timeouts_wheel, now)) {
+    while (timeouts_wheel.expired != NULL) {
+      struct sys_timeo *t = WHEEL_ENTRY(timeouts_wheel.expired, struct sys_timeo, node);
+      sys_timeout_handler handler;
+      void *arg;
+
+#if NO_SYS && PBUF_POOL_FREE_OOSEQ
+      PBUF_CHECK_FREE_OOSEQ();
+#endif /* NO_SYS && PBUF_POOL_FREE_OOSEQ */
+      sys_timeouts_wheel_remove(t);
+      handler = t->h;
+      arg = t->arg;
+#if LWIP_DEBUG_TIMERNAMES
+      if (handler != NULL) {
+        LWIP_DEBUGF(TIMERS_DEBUG, ("sct calling h=%s arg=%p\n",
+          t->handler_name, arg));
+      }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+      memp_free(MEMP_SYS_TIMEOUT, t);
+      if (handler != NULL) {
+#if !NO_SYS
+        /* For LWIP_TCPIP_CORE_LOCKING, lock the core before calling the
+           timeout handler function. */
+        LOCK_TCPIP_CORE();
+#endif /* !NO_SYS */
+        handler(arg);
+#if !NO_SYS
+        UNLOCK_TCPIP_CORE();
+#endif /* !NO_SYS */
+      }
+    }
+  }
+}
+
+/** Return the time left before the next timeout is due (or the next cascade
+ * that may bring one down to level 0). If no timeouts are enqueued, returns
+ * 0xffffffff
+ */
+static u32_t
+sys_timeouts_wheel_sleeptime(void)
+{
+  u32_t next, now;
+
+  if (timeouts_wheel.pending == 0) {
+    return 0xffffffff;
+  }
+  if (timeouts_wheel.expired != NULL) {
+    return 0;
+  }
+  next = wheel_next(&timeouts_wheel);
+  now = sys_now() - timeouts_offset;
+  if (!WHEEL_TIME_LESS(now, next)) {
+    return 0;
+  }
+  return next - now;
+}
+
+#if NO_SYS
+
+/** Handle timeouts for NO_SYS==1 (i.e. without using
+ * tcpip_thread/sys_timeouts_mbox_fetch(). Uses sys_now() to advance the
+ * timing wheel and call timeout handler functions when timeouts expire.
+ *
+ * Must be called periodically from your main loop.
+ */
+void
+sys_check_timeouts(void)
+{
+  sys_timeouts_wheel_process();
+}
+
+/** Set back the timestamp of the last call to sys_check_timeouts()
+ * This is necessary if sys_check_timeouts() hasn't been called for a long
+ * time (e.g. while saving energy) to prevent all timer functions of that
+ * period being called.
+ */
+void
+sys_restart_timeouts(void)
+{
+  timeouts_offset = sys_now() - (timeouts_wheel.time - 1);
+}
+
+/** Return the time left before the next timeout is due. If no timeouts are
+ * enqueued, returns 0xffffffff
+ */
+u32_t
+sys_timeouts_sleeptime(void)
+{
+  return sys_timeouts_wheel_sleeptime();
+}
+
+#else /* NO_SYS */
+
+/**
+ * Wait (forever) for a message to arrive in an mbox.
+ * While waiting, timeouts are processed.
+ *
+ * @param mbox the mbox to fetch the message from
+ * @param msg the place to store the message
+ */
+void
+sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
+{
+  u32_t sleeptime;
+
+again:
+  sleeptime = sys_timeouts_wheel_sleeptime();
+  if (sleeptime == 0xffffffff) {
+    sys_arch_mbox_fetch(mbox, msg, 0);
+    return;
+  }
+  if ((sleeptime == 0) || (sys_arch_mbox_fetch(mbox, msg, sleeptime) == SYS_ARCH_TIMEOUT)) {
+    /* If a timeout occurred before a message could be fetched, call the
+       handlers of all expired timeouts and try again. */
+    sys_timeouts_wheel_process();
+    LWIP_TCPIP_THREAD_ALIVE();
+    goto again;
+  }
+}
+
+#endif /* NO_SYS */
+
+#else /* LWIP_TIMERS_WHEEL */
+
 /**
  * Create a one-shot timer (aka timeout). Timeouts are processed in the
  * following cases:
@@ -369,8 +663,8 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
     return;
   }
 
-  if (next_timeout->time > msecs) {
-    next_timeout->time -= msecs;
+  if (next_timeout->time > timeout->time) {
+    next_timeout->time -= timeout->time;
     timeout->next = next_timeout;
     next_timeout = timeout;
   } else {
@@ -574,6 +868,7 @@ sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
 }
 
 #endif /* NO_SYS */
+#endif /* LWIP_TIMERS_WHEEL */
 
 #else /* LWIP_TIMERS */
 /* Satisfy the TCP code which calls this function */
@@ -581,4 +876,13 @@ void
 tcp_timer_needed(void)
 {
 }
+
+#if LWIP_TCP_RTT_MS
+/* tcp_tmr() calls tcp_rto_tmr() instead */
+void
+tcp_rto_timer_needed(u32_t due)
+{
+  LWIP_UNUSED_ARG(due);
+}
+#endif /* LWIP_TCP_RTT_MS */
 #endif /* LWIP_TIMERS */
@@ -82,6 +82,44 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if LWIP_UDP_PCB_HASH
+/** udp_pcbs again, hashed by local port (chained via hash_next) */
+static struct udp_pcb *udp_pcb_hash[UDP_PCB_HASH_SIZE];
+#define UDP_PCB_HASH(port)    ((port) & (UDP_PCB_HASH_SIZE - 1))
+/* Iterate (at least) all pcbs that may be bound to a local port */
+#define UDP_PCBS_FIRST(port)  udp_pcb_hash[UDP_PCB_HASH(port)]
+#define UDP_PCBS_NEXT(pcb)    ((pcb)->hash_next)
+
+/** Insert a pcb into udp_pcb_hash (pcb->local_port must be set) */
+static void
+udp_pcb_hash_add(struct udp_pcb *pcb)
+{
+  struct udp_pcb **bucket = &udp_pcb_hash[UDP_PCB_HASH(pcb->local_port)];
+  pcb->hash_next = *bucket;
+  *bucket = pcb;
+}
+
+/** Remove a pcb from udp_pcb_hash (does nothing if it is not hashed) */
+static void
+udp_pcb_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **bucket;
+  for (bucket = &udp_pcb_hash[UDP_PCB_HASH(pcb->local_port)]; *bucket != NULL;
+       bucket = &(*bucket)->hash_next) {
+    if (*bucket == pcb) {
+      *bucket = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+#else /* LWIP_UDP_PCB_HASH */
+#define UDP_PCBS_FIRST(port)  udp_pcbs
+#define UDP_PCBS_NEXT(pcb)    ((pcb)->next)
+#define udp_pcb_hash_add(pcb)
+#define udp_pcb_hash_remove(pcb)
+#endif /* LWIP_UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -109,7 +147,7 @@ again:
     udp_port = UDP_LOCAL_PORT_RANGE_START;
   }
   /* Check all PCBs. */
-  for(pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  for(pcb = UDP_PCBS_FIRST(udp_port); pcb != NULL; pcb = UDP_PCBS_NEXT(pcb)) {
     if (pcb->local_port == udp_port) {
       if (++n > (UDP_LOCAL_PORT_RANGE_END - UDP_LOCAL_PORT_RANGE_START)) {
         return 0;
@@ -138,6 +176,114 @@ again:
 #endif
 }
 
+/**
+ * Common code to see if the current input packet matches the local address
+ * of a pcb (the current input packet is accessed via ip(4/6)_current_*).
+ * The local port must be checked by the caller.
+ *
+ * @param pcb pcb to check
+ * @param inp network interface on which the datagram was received (only used for IPv4)
+ * @param broadcast 1 if this is an IPv4 broadcast (global or subnet-only), 0 otherwise
+ * @return 1 on match, 0 otherwise
+ */
+static u8_t
+udp_input_local_match(struct udp_pcb *pcb, struct netif *inp, u8_t broadcast)
+{
+  LWIP_UNUSED_ARG(inp);       /* in IPv6 only case */
+  LWIP_UNUSED_ARG(broadcast); /* in IPv6 only case */
+
+  if (
+#if LWIP_IPV6
+    (PCB_ISIPV6(pcb) && (ip_current_is_v6()) &&
+      (ip6_addr_isany(ip_2_ip6(&pcb->local_ip)) ||
+#if LWIP_IPV6_MLD
+      ip6_addr_ismulticast(ip6_current_dest_addr()) ||
+#endif /* LWIP_IPV6_MLD */
+      ip6_addr_cmp(ip_2_ip6(&pcb->local_ip), ip6_current_dest_addr())))
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4 && LWIP_IPV6
+     || (!PCB_ISIPV6(pcb) &&
+      (ip4_current_header() != NULL) &&
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+#if LWIP_IPV4
+#if !LWIP_IPV6
+      (
+#endif /* !LWIP_IPV6 */
+      ((!broadcast && ip_addr_isany(&pcb->local_ip)) ||
+      ip_addr_cmp(&pcb->local_ip, ip_current_dest_addr()) ||
+#if LWIP_IGMP
+      (ip_addr_isany(&pcb->local_ip) && ip_addr_ismulticast(ip_current_dest_addr())) ||
+#endif /* LWIP_IGMP */
+#if IP_SOF_BROADCAST_RECV
+      (broadcast && ip_get_option(pcb, SOF_BROADCAST) &&
+       (ip_addr_isany(&pcb->local_ip) ||
+        ip_addr_netcmp(&pcb->local_ip, ip_current_dest_addr(), netif_ip4_netmask(inp))))))
+#else /* IP_SOF_BROADCAST_RECV */
+      (broadcast &&
+       (ip_addr_isany(&pcb->local_ip) ||
+        ip_addr_netcmp(&pcb->local_ip, ip_current_dest_addr(), netif_ip4_netmask(inp))))))
+#endif /* IP_SOF_BROADCAST_RECV */
+#endif /* LWIP_IPV4 */
+        ) {
+    return 1;
+  }
+  return 0;
+}
+
+#if LWIP_UDP_REUSEPORT
+/**
+ * Select one of several unconnected pcbs with UDP_FLAGS_REUSEPORT that are
+ * bound to the destination of the current input packet. The choice is based
+ * on a hash of the remote address and port, so all datagrams of one flow are
+ * passed to the same pcb.
+ *
+ * @param dest destination port of the datagram
+ * @param src source port of the datagram
+ * @param inp network interface on which the datagram was received
+ * @param broadcast 1 if this is an IPv4 broadcast, 0 otherwise
+ * @param num_pcbs number of matching pcbs with UDP_FLAGS_REUSEPORT set
+ * @return the selected pcb
+ */
+static struct udp_pcb *
+udp_input_reuseport_select(u16_t dest, u16_t src, struct netif *inp, u8_t broadcast,
+                           u16_t num_pcbs)
+{
+  struct udp_pcb *pcb;
+  u32_t h = src;
+
+#if LWIP_IPV6
+  if (ip_current_is_v6()) {
+    const u32_t *a = ip6_current_src_addr()->addr;
+    h ^= a[0] ^ a[1] ^ a[2] ^ a[3];
+  }
+#if LWIP_IPV4
+  else
+#endif /* LWIP_IPV4 */
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  {
+    h ^= ip4_addr_get_u32(ip4_current_src_addr());
+  }
+#endif /* LWIP_IPV4 */
+  h ^= h >> 16;
+  h ^= h >> 8;
+  h %= num_pcbs;
+
+  for (pcb = UDP_PCBS_FIRST(dest); pcb != NULL; pcb = UDP_PCBS_NEXT(pcb)) {
+    if ((pcb->local_port == dest) &&
+        ((pcb->flags & (UDP_FLAGS_CONNECTED | UDP_FLAGS_REUSEPORT)) == UDP_FLAGS_REUSEPORT) &&
+        udp_input_local_match(pcb, inp, broadcast)) {
+      if (h == 0) {
+        break;
+      }
+      h--;
+    }
+  }
+  LWIP_ASSERT("reuseport pcb not found", pcb != NULL);
+  return pcb;
+}
+#endif /* LWIP_UDP_REUSEPORT */
+
 /**
  * Process an incoming UDP datagram.
  *
@@ -160,6 +306,9 @@ udp_input(struct pbuf *p, struct netif *inp)
   u8_t local_match;
   u8_t broadcast;
   u8_t for_us;
+#if LWIP_UDP_REUSEPORT
+  u16_t reuse_cnt = 0;
+#endif /* LWIP_UDP_REUSEPORT */
 
   LWIP_UNUSED_ARG(inp);
 
@@ -227,7 +376,7 @@ udp_input(struct pbuf *p, struct netif *inp)
      * 'Perfect match' pcbs (connected to the remote port & ip address) are
      * preferred. If no perfect match is found, the first unconnected pcb that
      * matches the local port and ip address gets the datagram. */
-    for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+    for (pcb = UDP_PCBS_FIRST(dest); pcb != NULL; pcb = UDP_PCBS_NEXT(pcb)) {
       local_match = 0;
       /* print the PCB local and remote address */
       LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
@@ -237,46 +386,19 @@ udp_input(struct pbuf *p, struct netif *inp)
       LWIP_DEBUGF(UDP_DEBUG, (", %"U16_F")\n", pcb->remote_port));
 
       /* compare PCB local addr+port to UDP destination addr+port */
-      if (pcb->local_port == dest) {
-        if (
-#if LWIP_IPV6
-          (PCB_ISIPV6(pcb) && (ip_current_is_v6()) &&
-            (ip6_addr_isany(ip_2_ip6(&pcb->local_ip)) ||
-#if LWIP_IPV6_MLD
-            ip6_addr_ismulticast(ip6_current_dest_addr()) ||
-#endif /* LWIP_IPV6_MLD */
-            ip6_addr_cmp(ip_2_ip6(&pcb->local_ip), ip6_current_dest_addr())))
-#endif /* LWIP_IPV6 */
-#if LWIP_IPV4 && LWIP_IPV6
-           || (!PCB_ISIPV6(pcb) &&
-            (ip4_current_header() != NULL) &&
-#endif /* LWIP_IPV4 && LWIP_IPV6 */
-#if LWIP_IPV4
-#if !LWIP_IPV6
-            (
-#endif /* !LWIP_IPV6 */
-            ((!broadcast && ip_addr_isany(&pcb->local_ip)) ||
-            ip_addr_cmp(&pcb->local_ip, ip_current_dest_addr()) ||
-#if LWIP_IGMP
-            (ip_addr_isany(&pcb->local_ip) && ip_addr_ismulticast(ip_current_dest_addr())) ||
-#endif /* LWIP_IGMP */
-#if IP_SOF_BROADCAST_RECV
-            (broadcast && ip_get_option(pcb, SOF_BROADCAST) &&
-             (ip_addr_isany(&pcb->local_ip) ||
-              ip_addr_netcmp(&pcb->local_ip, ip_current_dest_addr(), netif_ip4_netmask(inp))))))
-#else /* IP_SOF_BROADCAST_RECV */
-            (broadcast &&
-             (ip_addr_isany(&pcb->local_ip) ||
-              ip_addr_netcmp(&pcb->local_ip, ip_current_dest_addr(), netif_ip4_netmask(inp))))))
-#endif /* IP_SOF_BROADCAST_RECV */
-#endif /* LWIP_IPV4 */
-              ) {
-          local_match = 1;
-          if ((uncon_pcb == NULL) && 
-              ((pcb->flags & UDP_FLAGS_CONNECTED) == 0)) {
+      if ((pcb->local_port == dest) &&
+          udp_input_local_match(pcb, inp, broadcast)) {
+        local_match = 1;
+        if ((pcb->flags & UDP_FLAGS_CONNECTED) == 0) {
+          if (uncon_pcb == NULL) {
             /* the first unconnected matching PCB */
             uncon_pcb = pcb;
           }
+#if LWIP_UDP_REUSEPORT
+          if (pcb->flags & UDP_FLAGS_REUSEPORT) {
+            reuse_cnt++;
+          }
+#endif /* LWIP_UDP_REUSEPORT */
         }
       }
       /* compare PCB remote addr+port to UDP source addr+port */
@@ -286,11 +408,13 @@ udp_input(struct pbuf *p, struct netif *inp)
               ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()))) {
         /* the first fully matching PCB */
         if (prev != NULL) {
+#if !LWIP_UDP_PCB_HASH
           /* move the pcb to the front of udp_pcbs so that is
              found faster next time */
           prev->next = pcb->next;
           pcb->next = udp_pcbs;
           udp_pcbs = pcb;
+#endif /* !LWIP_UDP_PCB_HASH */
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -300,6 +424,12 @@ udp_input(struct pbuf *p, struct netif *inp)
     }
     /* no fully matching pcb found? then look for an unconnected pcb */
     if (pcb == NULL) {
+#if LWIP_UDP_REUSEPORT
+      if ((reuse_cnt > 1) && (uncon_pcb->flags & UDP_FLAGS_REUSEPORT)) {
+        /* spread the flows across all pcbs sharing this port */
+        uncon_pcb = udp_input_reuseport_select(dest, src, inp, broadcast, reuse_cnt);
+      }
+#endif /* LWIP_UDP_REUSEPORT */
       pcb = uncon_pcb;
     }
   }
@@ -350,6 +480,17 @@ udp_input(struct pbuf *p, struct netif *inp)
 #endif /* LWIP_UDPLITE */
       {
         if (udphdr->chksum != 0) {
+#if LWIP_CHECKSUM_ON_COPY_RX
+          if ((pcb != NULL) && (pcb->flags & UDP_FLAGS_CHKSUM_RX) && !broadcast &&
+              !ip_addr_ismulticast(ip_current_dest_addr())) {
+            /* defer the check to the copy to the application buffer:
+               only sum pseudo and UDP header now and keep that in the
+               header for recv_udp() */
+            udphdr->chksum = ip_chksum_pseudo_partial(p, IP_PROTO_UDP, p->tot_len,
+                               UDP_HLEN, ip_current_src_addr(), ip_current_dest_addr());
+            p->flags |= PBUF_FLAG_CHKSUM_RX;
+          } else
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
           if (ip_chksum_pseudo(p, IP_PROTO_UDP, p->tot_len,
                                ip_current_src_addr(),
                                ip_current_dest_addr()) != 0) {
@@ -381,7 +522,7 @@ udp_input(struct pbuf *p, struct netif *inp)
         struct udp_pcb *mpcb;
         u8_t p_header_changed = 0;
         s16_t hdrs_len = (s16_t)(ip_current_header_tot_len() + UDP_HLEN);
-        for (mpcb = udp_pcbs; mpcb != NULL; mpcb = mpcb->next) {
+        for (mpcb = UDP_PCBS_FIRST(dest); mpcb != NULL; mpcb = UDP_PCBS_NEXT(mpcb)) {
           if (mpcb != pcb) {
             /* compare PCB local addr+port to UDP destination addr+port */
             if ((mpcb->local_port == dest) &&
@@ -950,6 +1091,10 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     else {
 #endif /* SO_REUSE */
       if ((ipcb->local_port == port) && IP_PCB_IPVER_EQ(pcb, ipcb) &&
+#if LWIP_UDP_REUSEPORT
+          /* both pcbs agreed to share the port? */
+          ((pcb->flags & ipcb->flags & UDP_FLAGS_REUSEPORT) == 0) &&
+#endif /* LWIP_UDP_REUSEPORT */
           /* IP address matches, or one is IP_ADDR_ANY? */
             (ip_addr_isany(&ipcb->local_ip) ||
              ip_addr_isany(ipaddr) ||
@@ -973,6 +1118,10 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
       return ERR_USE;
     }
   }
+  if (rebind) {
+    /* the local port might change: rehash below */
+    udp_pcb_hash_remove(pcb);
+  }
   pcb->local_port = port;
   snmp_insert_udpidx_tree(pcb);
   /* pcb not active yet? */
@@ -981,6 +1130,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
   }
+  udp_pcb_hash_add(pcb);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("udp_bind: bound to "));
   ip_addr_debug_print(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, &pcb->local_ip);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, (", port %"U16_F")\n", pcb->local_port));
@@ -1062,6 +1212,7 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+  udp_pcb_hash_add(pcb);
   return ERR_OK;
 }
 
@@ -1111,6 +1262,7 @@ udp_remove(struct udp_pcb *pcb)
   struct udp_pcb *pcb2;
 
   snmp_delete_udpidx_tree(pcb);
+  udp_pcb_hash_remove(pcb);
   /* pcb to be removed is first in list? */
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
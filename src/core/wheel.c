@@ -0,0 +1,243 @@
+/**
+ * @file
+ * Hierarchical timing wheel: deadlines are linked into the slot of their
+ * tick, so that processing a tick only visits the nodes due in it.
+ *
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission. 
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT 
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT 
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY 
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#include "lwip/wheel.h"
+
+#if LWIP_WHEEL /* don't build if not used */
+
+#include "lwip/debug.h"
+
+/**
+ * Let an empty wheel jump to 'now' instead of stepping through the ticks
+ * that passed while nothing was pending.
+ *
+ * @param w the wheel
+ * @param now the current tick
+ */
+void
+wheel_sync(struct wheel *w, u32_t now)
+{
+  if ((w->pending == 0) && (w->time != now + 1)) {
+    w->time = now;
+  }
+}
+
+/** Link a node into the slot for node->due relative to w->time */
+static void
+wheel_link(struct wheel *w, struct wheel_node *node)
+{
+  struct wheel_node **slot;
+  u32_t delta = node->due - w->time;
+  u32_t when = node->due;
+  u8_t level;
+
+  if (WHEEL_TIME_LESS(node->due, w->time)) {
+    /* the tick was processed already: expire with the next one */
+    when = w->time;
+    delta = 0;
+  } else if (delta >= ((u32_t)1 << (WHEEL_BITS * w->levels))) {
+    /* park in the top level, the node is re-inserted when cascaded */
+    delta = ((u32_t)1 << (WHEEL_BITS * w->levels)) - 1;
+    when = w->time + delta;
+  }
+  for (level = 0; level < w->levels - 1; level++) {
+    if (delta < ((u32_t)1 << ((level + 1) * WHEEL_BITS))) {
+      break;
+    }
+  }
+  slot = &w->slots[level][(when >> (level * WHEEL_BITS)) & WHEEL_MASK];
+  node->level = level;
+  node->pprev = slot;
+  node->next = *slot;
+  if (*slot != NULL) {
+    (*slot)->pprev = &node->next;
+  }
+  *slot = node;
+  w->level_cnt[level]++;
+}
+
+/**
+ * Link a node into the wheel: it is moved to the expired list by the
+ * wheel_advance() that processes tick node->due (or the next tick to
+ * process if that one has been processed already).
+ *
+ * @param w the wheel
+ * @param node the node to insert (must not be linked)
+ */
+void
+wheel_insert(struct wheel *w, struct wheel_node *node)
+{
+  LWIP_ASSERT("wheel_insert: node not linked", !wheel_node_linked(node));
+  wheel_link(w, node);
+  w->pending++;
+}
+
+/**
+ * Unlink a node from its slot or from the expired list.
+ *
+ * @param w the wheel
+ * @param node the node to remove (must be linked)
+ */
+void
+wheel_remove(struct wheel *w, struct wheel_node *node)
+{
+  LWIP_ASSERT("wheel_remove: node linked", wheel_node_linked(node));
+  *node->pprev = node->next;
+  if (node->next != NULL) {
+    node->next->pprev = node->pprev;
+  }
+  if (node->level < w->levels) {
+    w->level_cnt[node->level]--;
+  }
+  node->pprev = NULL;
+  w->pending--;
+}
+
+/** Re-insert the nodes of one slot relative to the current wheel time */
+static void
+wheel_cascade(struct wheel *w, u8_t level, u32_t idx)
+{
+  struct wheel_node *node = w->slots[level][idx];
+
+  w->slots[level][idx] = NULL;
+  while (node != NULL) {
+    struct wheel_node *next = node->next;
+    w->level_cnt[level]--;
+    wheel_link(w, node);
+    node = next;
+  }
+}
+
+/**
+ * Advance the wheel up to tick 'now' (inclusive), stopping at the first tick
+ * that has nodes due. Those are moved to w->expired, from where the caller
+ * takes them with wheel_remove() before handling them, so that nodes can
+ * safely be inserted or removed meanwhile. Call again once w->expired is
+ * empty until 0 is returned.
+ *
+ * @param w the wheel
+ * @param now the current tick
+ * @return 1 if w->expired holds the nodes of a tick, 0 if the wheel is
+ *         up to date
+ */
+u8_t
+wheel_advance(struct wheel *w, u32_t now)
+{
+  LWIP_ASSERT("wheel_advance: expired list processed", w->expired == NULL);
+
+  while (!WHEEL_TIME_LESS(now, w->time)) {
+    u32_t tick = w->time;
+    u32_t idx = tick & WHEEL_MASK;
+    struct wheel_node *node;
+
+    if (w->pending == 0) {
+      w->time = now + 1;
+      break;
+    }
+    if (idx == 0) {
+      /* crossing a level-0 round: pull the next slot(s) of higher levels down */
+      u8_t level;
+      for (level = 1; level < w->levels; level++) {
+        u32_t lidx = (tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+        wheel_cascade(w, level, lidx);
+        if (lidx != 0) {
+          break;
+        }
+      }
+    } else if (w->level_cnt[0] == 0) {
+      /* nothing can expire before the next cascade: skip to it */
+      w->time = (tick | WHEEL_MASK) + 1;
+      if (WHEEL_TIME_LESS(now, w->time)) {
+        w->time = now + 1;
+      }
+      continue;
+    }
+
+    w->time = tick + 1;
+    if (w->slots[0][idx] != NULL) {
+      w->expired = w->slots[0][idx];
+      w->slots[0][idx] = NULL;
+      w->expired->pprev = &w->expired;
+      for (node = w->expired; node != NULL; node = node->next) {
+        w->level_cnt[0]--;
+        node->level = w->levels;
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Return the tick wheel_advance() has to run at next: the first deadline
+ * in level 0 or the next cascade that may bring one down to it. Nodes on
+ * the expired list are not considered.
+ * Only valid if w->pending != 0.
+ *
+ * @param w the wheel
+ * @return the next tick with work to do
+ */
+u32_t
+wheel_next(const struct wheel *w)
+{
+  u32_t next = w->time;
+  u8_t level, found = 0;
+
+  for (level = 0; level < w->levels; level++) {
+    u32_t shift = level * WHEEL_BITS;
+    u32_t step = (u32_t)1 << shift;
+    u32_t tick = (w->time + step - 1) & ~(step - 1);
+    u16_t k;
+    if (w->level_cnt[level] == 0) {
+      continue;
+    }
+    /* first slot of this level that is processed (or cascaded) next */
+    for (k = 0; k < WHEEL_SLOTS; k++, tick += step) {
+      if (w->slots[level][(tick >> shift) & WHEEL_MASK] != NULL) {
+        if (!found || WHEEL_TIME_LESS(tick, next)) {
+          next = tick;
+          found = 1;
+        }
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+#endif /* LWIP_WHEEL */
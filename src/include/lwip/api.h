@@ -64,6 +64,11 @@ extern "C" {
 #define NETCONN_COPY      0x01
 #define NETCONN_MORE      0x02
 #define NETCONN_DONTBLOCK 0x04
+#if LWIP_SO_ZEROCOPY
+/** Reference the data instead of copying it; completion is reported to
+    the callback set with netconn_set_zerocopy_callback() */
+#define NETCONN_ZEROCOPY  0x08
+#endif /* LWIP_SO_ZEROCOPY */
 
 /* Flags for struct netconn.flags (u8_t) */
 /** Should this netconn avoid blocking? */
@@ -169,6 +174,24 @@ struct api_msg_msg;
 /** A callback prototype to inform about events for a netconn */
 typedef void (* netconn_callback)(struct netconn *, enum netconn_evt, u16_t len);
 
+#if LWIP_SO_ZEROCOPY
+/** Zero-copy completion callback: the data of the NETCONN_ZEROCOPY writes
+ * numbered 'lo' to 'hi' (inclusive, counted from 0 per netconn) is no longer
+ * referenced. 'err' is ERR_OK if it was ACKed by the remote host or the
+ * error that caused the connection to be dropped otherwise.
+ * Called from tcpip_thread!
+ */
+typedef void (* netconn_zerocopy_fn)(struct netconn *conn, u32_t lo, u32_t hi, err_t err, void *arg);
+#endif /* LWIP_SO_ZEROCOPY */
+
+/** Data for netconn_write_vectors_partly() (same layout as struct iovec) */
+struct netvector {
+  /** pointer to the application buffer that contains the data to send */
+  const void *ptr;
+  /** size of the application data to send */
+  size_t len;
+};
+
 /** A netconn descriptor */
 struct netconn {
   /** type of the netconn (TCP, UDP or RAW) */
@@ -233,6 +256,23 @@ struct netconn {
       this temporarily stores the message.
       Also used during connect and close. */
   struct api_msg_msg *current_msg;
+#if LWIP_SO_ZEROCOPY
+  /** TCP: number of the next NETCONN_ZEROCOPY write */
+  u32_t zc_next;
+  /** TCP: number of the oldest zero-copy write not yet reported as completed */
+  u32_t zc_done;
+  /** TCP: zero-copy writes waiting to be ACKed (a ring of zc_count entries
+      starting at zc_first), each with the sequence number following its data */
+  struct {
+    u32_t seqno;
+    u32_t id;
+  } zc_pending[LWIP_SO_ZEROCOPY_PENDING];
+  u8_t zc_first;
+  u8_t zc_count;
+  /** TCP: called when zero-copy writes have completed */
+  netconn_zerocopy_fn zc_callback;
+  void *zc_arg;
+#endif /* LWIP_SO_ZEROCOPY */
 #endif /* LWIP_TCP */
   /** A callback function that is informed about events for this netconn */
   netconn_callback callback;
@@ -280,10 +320,14 @@ LWIP_NETCONN_SCOPE void    netconn_recved(struct netconn *conn, u32_t length);
 LWIP_NETCONN_SCOPE err_t   netconn_sendto(struct netconn *conn, struct netbuf *buf,
                              const ip_addr_t *addr, u16_t port);
 LWIP_NETCONN_SCOPE err_t   netconn_send(struct netconn *conn, struct netbuf *buf);
+LWIP_NETCONN_SCOPE err_t   netconn_send_batch(struct netconn *conn, struct netbuf *bufs, u16_t count,
+                             u16_t *sent);
 LWIP_NETCONN_SCOPE err_t   netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
                              u8_t apiflags, size_t *bytes_written);
 #define netconn_write(conn, dataptr, size, apiflags) \
           netconn_write_partly(conn, dataptr, size, apiflags, NULL)
+LWIP_NETCONN_SCOPE err_t   netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors,
+                             u16_t vectorcnt, u8_t apiflags, size_t *bytes_written);
 LWIP_NETCONN_SCOPE err_t   netconn_close(struct netconn *conn);
 LWIP_NETCONN_SCOPE err_t   netconn_shutdown(struct netconn *conn, u8_t shut_rx, u8_t shut_tx);
 
@@ -339,6 +383,13 @@ err_t   netconn_gethostbyname(const char *name, ip_addr_t *addr);
 #define netconn_get_recvbufsize(conn)               ((conn)->recv_bufsize)
 #endif /* LWIP_SO_RCVBUF*/
 
+#if LWIP_SO_ZEROCOPY
+/** Set the zero-copy completion callback of a TCP netconn (must be called
+    before the first NETCONN_ZEROCOPY write; writes without callback copy) */
+#define netconn_set_zerocopy_callback(conn, fn, arg) do { \
+  (conn)->zc_callback = (fn); (conn)->zc_arg = (arg); } while(0)
+#endif /* LWIP_SO_ZEROCOPY */
+
 #if LWIP_NETCONN_SEM_PER_THREAD
 void netconn_thread_init(void);
 void netconn_thread_cleanup(void);
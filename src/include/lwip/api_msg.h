@@ -84,6 +84,12 @@ struct api_msg_msg {
   union {
     /** used for lwip_netconn_do_send */
     struct netbuf *b;
+    /** used for lwip_netconn_do_send_batch */
+    struct {
+      struct netbuf *bufs;
+      u16_t count;
+      u16_t sent;
+    } bb;
     /** used for lwip_netconn_do_newconn */
     struct {
       u8_t proto;
@@ -101,7 +107,13 @@ struct api_msg_msg {
     } ad;
     /** used for lwip_netconn_do_write */
     struct {
-      const void *dataptr;
+      /** current vector to write */
+      const struct netvector *vector;
+      /** number of unwritten vectors */
+      u16_t vector_cnt;
+      /** offset into current vector */
+      size_t vector_off;
+      /** total length across vectors */
       size_t len;
       u8_t apiflags;
 #if LWIP_SO_SNDTIMEO
@@ -160,8 +172,8 @@ struct api_msg {
 #if LWIP_DNS
 /** As lwip_netconn_do_gethostbyname requires more arguments but doesn't require a netconn,
     it has its own struct (to avoid struct api_msg getting bigger than necessary).
-    lwip_netconn_do_gethostbyname must be called using tcpip_callback instead of tcpip_apimsg
-    (see netconn_gethostbyname). */
+    lwip_netconn_do_gethostbyname must be called using tcpip_callback (or with the core
+    locked) instead of tcpip_apimsg (see netconn_gethostbyname). */
 struct dns_api_msg {
   /** Hostname to query or dotted IP address string */
 #if LWIP_MPU_COMPATIBLE
@@ -190,6 +202,7 @@ LWIP_NETCONN_SCOPE void lwip_netconn_do_connect         ( struct api_msg_msg *ms
 LWIP_NETCONN_SCOPE void lwip_netconn_do_disconnect      ( struct api_msg_msg *msg);
 LWIP_NETCONN_SCOPE void lwip_netconn_do_listen          ( struct api_msg_msg *msg);
 LWIP_NETCONN_SCOPE void lwip_netconn_do_send            ( struct api_msg_msg *msg);
+LWIP_NETCONN_SCOPE void lwip_netconn_do_send_batch      ( struct api_msg_msg *msg);
 LWIP_NETCONN_SCOPE void lwip_netconn_do_recv            ( struct api_msg_msg *msg);
 LWIP_NETCONN_SCOPE void lwip_netconn_do_write           ( struct api_msg_msg *msg);
 LWIP_NETCONN_SCOPE void lwip_netconn_do_getaddr         ( struct api_msg_msg *msg);
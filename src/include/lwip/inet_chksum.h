@@ -58,8 +58,9 @@
     as u16_t */
 #ifndef LWIP_CHKSUM_COPY
 #define LWIP_CHKSUM_COPY(dst, src, len) lwip_chksum_copy(dst, src, len)
+/* 1: MEMCPY, then LWIP_CHKSUM; 2: single pass (see inet_chksum.c) */
 #ifndef LWIP_CHKSUM_COPY_ALGORITHM
-#define LWIP_CHKSUM_COPY_ALGORITHM 1
+#define LWIP_CHKSUM_COPY_ALGORITHM 2
 #endif /* LWIP_CHKSUM_COPY_ALGORITHM */
 #endif /* LWIP_CHKSUM_COPY */
 #else /* LWIP_CHECKSUM_ON_COPY */
@@ -76,6 +77,15 @@ u16_t inet_chksum_pbuf(struct pbuf *p);
 u16_t lwip_chksum_copy(void *dst, const void *src, u16_t len);
 #endif /* LWIP_CHKSUM_COPY_ALGORITHM */
 
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+/** Kernels for lwip_chksum_set_impl() */
+#define LWIP_CHKSUM_IMPL_AUTO    0
+#define LWIP_CHKSUM_IMPL_SCALAR  1
+#define LWIP_CHKSUM_IMPL_SSE2    2
+#define LWIP_CHKSUM_IMPL_AVX2    3
+u8_t lwip_chksum_set_impl(u8_t impl);
+#endif /* LWIP_CHKSUM_ALGORITHM == 4 */
+
 #if LWIP_IPV4
 u16_t inet_chksum_pseudo(struct pbuf *p, u8_t proto, u16_t proto_len,
        const ip4_addr_t *src, const ip4_addr_t *dest);
@@ -104,6 +104,34 @@ struct memp_malloc_helper
 };
 #endif /* MEM_USE_POOLS */
 
+#if MEMP_MAGAZINES
+/** The per-thread caches of free pool elements (see MEMP_MAGAZINES) */
+struct memp_magazines {
+  struct {
+    /** the cached elements */
+    void *first;
+    /** number of cached elements */
+    u16_t count;
+    /** count already accounted for in the memp stats */
+    u16_t synced;
+  } pool[MEMP_MAX];
+#if MEMP_STATS
+  /** name shown by stats_display() */
+  const char *name;
+  /** next in memp_magazines_list */
+  struct memp_magazines *next;
+#endif /* MEMP_STATS */
+};
+
+void  memp_magazines_flush(struct memp_magazines *mags);
+#if MEMP_STATS
+/** The magazines registered by memp_magazines_register() */
+extern struct memp_magazines *memp_magazines_list;
+void  memp_magazines_register(struct memp_magazines *mags, const char *name);
+void  memp_magazines_unregister(struct memp_magazines *mags);
+#endif /* MEMP_STATS */
+#endif /* MEMP_MAGAZINES */
+
 void  memp_init(void);
 
 #if MEMP_OVERFLOW_CHECK
@@ -47,9 +47,9 @@ LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),
 #if LWIP_IPV4 && IP_REASSEMBLY
 LWIP_MEMPOOL(REASSDATA,      MEMP_NUM_REASSDATA,       sizeof(struct ip_reassdata),   "REASSDATA")
 #endif /* LWIP_IPV4 && IP_REASSEMBLY */
-#if (IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG)
+#if (IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG) || LWIP_NETIF_OFFLOAD
 LWIP_MEMPOOL(FRAG_PBUF,      MEMP_NUM_FRAG_PBUF,       sizeof(struct pbuf_custom_ref),"FRAG_PBUF")
-#endif /* IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF */
+#endif /* IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF || LWIP_IPV6_FRAG || LWIP_NETIF_OFFLOAD */
 
 #if LWIP_NETCONN || LWIP_SOCKET
 LWIP_MEMPOOL(NETBUF,         MEMP_NUM_NETBUF,          sizeof(struct netbuf),         "NETBUF")
@@ -137,6 +137,21 @@ LWIP_MEMPOOL(MLD6_GROUP,     MEMP_NUM_MLD6_GROUP,      sizeof(struct mld_group),
 LWIP_PBUF_MEMPOOL(PBUF,      MEMP_NUM_PBUF,            0,                             "PBUF_REF/ROM")
 LWIP_PBUF_MEMPOOL(PBUF_POOL, PBUF_POOL_SIZE,           PBUF_POOL_BUFSIZE,             "PBUF_POOL")
 
+/*
+ * The size classes for PBUF_RAM (element size includes struct pbuf).
+ * These have to stay in this order (see PBUF_RAM_ARENA_POOL in pbuf.c).
+ */
+#if PBUF_RAM_ARENAS
+LWIP_MEMPOOL(PBUF_RAM_128,   PBUF_RAM_ARENA_NUM_128,   128,                           "PBUF_RAM_128")
+LWIP_MEMPOOL(PBUF_RAM_256,   PBUF_RAM_ARENA_NUM_256,   256,                           "PBUF_RAM_256")
+LWIP_MEMPOOL(PBUF_RAM_512,   PBUF_RAM_ARENA_NUM_512,   512,                           "PBUF_RAM_512")
+LWIP_MEMPOOL(PBUF_RAM_1024,  PBUF_RAM_ARENA_NUM_1024,  1024,                          "PBUF_RAM_1024")
+LWIP_MEMPOOL(PBUF_RAM_2048,  PBUF_RAM_ARENA_NUM_2048,  2048,                          "PBUF_RAM_2048")
+#if PBUF_RAM_ARENA_NUM_JUMBO
+LWIP_MEMPOOL(PBUF_RAM_JUMBO, PBUF_RAM_ARENA_NUM_JUMBO, PBUF_RAM_ARENA_JUMBO_SIZE,     "PBUF_RAM_JUMBO")
+#endif /* PBUF_RAM_ARENA_NUM_JUMBO */
+#endif /* PBUF_RAM_ARENAS */
+
 
 /*
  * Allow for user-defined pools; this must be explicitly set in lwipopts.h
@@ -54,6 +54,8 @@ extern "C" {
 #define NETBUF_FLAG_DESTADDR    0x01
 /** This netbuf includes a checksum */
 #define NETBUF_FLAG_CHKSUM      0x02
+/** The checksum of this received netbuf has not been checked yet */
+#define NETBUF_FLAG_CHKSUM_RX   0x04
 
 struct netbuf {
   struct pbuf *p, *ptr;
@@ -67,6 +69,10 @@ struct netbuf {
 #if LWIP_NETBUF_RECVINFO
   ip_addr_t toaddr;
 #endif /* LWIP_NETBUF_RECVINFO */
+#if LWIP_CHECKSUM_ON_COPY_RX
+  /** partial checksum (pseudo and UDP header) for NETBUF_FLAG_CHKSUM_RX */
+  u16_t rx_chksum;
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
 #endif /* LWIP_NETBUF_RECVINFO || LWIP_CHECKSUM_ON_COPY */
 };
 
@@ -84,6 +90,12 @@ LWIP_NETCONN_SCOPE err_t             netbuf_data     (struct netbuf *buf,
                                    void **dataptr, u16_t *len);
 LWIP_NETCONN_SCOPE s8_t              netbuf_next     (struct netbuf *buf);
 LWIP_NETCONN_SCOPE void              netbuf_first    (struct netbuf *buf);
+#if LWIP_CHECKSUM_ON_COPY_RX
+LWIP_NETCONN_SCOPE err_t             netbuf_copy_chksum(struct netbuf *buf,
+                                   void *dataptr, u16_t len);
+/** Check a deferred checksum of a received netbuf without copying any data */
+#define netbuf_check_chksum(buf) netbuf_copy_chksum((buf), NULL, 0)
+#endif /* LWIP_CHECKSUM_ON_COPY_RX */
 
 
 #define netbuf_copy_partial(buf, dataptr, len, offset) \
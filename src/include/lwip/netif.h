@@ -113,6 +113,15 @@ extern "C" {
 #define NETIF_CHECKSUM_DISABLE_ALL  0x0000
 #endif /* LWIP_CHECKSUM_CTRL_PER_NETIF */
 
+#if LWIP_NETIF_OFFLOAD
+/** The netif computes the checksums of IPv4 TCP packets marked with
+    PBUF_FLAG_CSUM_PARTIAL (see struct pbuf) */
+#define NETIF_OFFLOAD_CSUM_TCP      0x01U
+/** The netif segments IPv4 TCP packets with gso_size != 0 itself (TSO),
+    including the checksums of the segments */
+#define NETIF_OFFLOAD_TSO           0x02U
+#endif /* LWIP_NETIF_OFFLOAD */
+
 struct netif;
 
 /** Function prototype for netif init functions. Set up flags and output/linkoutput
@@ -258,6 +267,13 @@ struct netif {
 #if LWIP_CHECKSUM_CTRL_PER_NETIF
   u16_t chksum_flags;
 #endif /* LWIP_CHECKSUM_CTRL_PER_NETIF*/
+#if LWIP_NETIF_OFFLOAD
+  /** offloads supported by the driver (see NETIF_OFFLOAD_ above) */
+  u8_t offload_flags;
+  /** maximum size (IP header included) of TCP packets passed for
+      segmentation, 0 to send every segment on its own */
+  u16_t gso_max_size;
+#endif /* LWIP_NETIF_OFFLOAD */
   /** maximum transfer unit (in bytes) */
   u16_t mtu;
   /** number of bytes used in hwaddr */
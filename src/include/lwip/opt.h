@@ -76,6 +76,26 @@
 #define NO_SYS_NO_TIMERS                0
 #endif
 
+/**
+ * LWIP_TIMERS_WHEEL==1: Keep sys_timeout() timeouts in a hierarchical timing
+ * wheel (1 ms ticks) instead of the sorted delta list: sys_timeout() and
+ * sys_untimeout() become O(1) regardless of the number of pending timeouts,
+ * at the cost of a few hundred bytes of slot and hash tables and 4 pointers
+ * per struct sys_timeo. sys_check_timeouts() advances the wheel tick by tick.
+ */
+#ifndef LWIP_TIMERS_WHEEL
+#define LWIP_TIMERS_WHEEL               0
+#endif
+
+/**
+ * SYS_TIMEOUT_HASH_SIZE: number of handler/arg buckets sys_untimeout() uses
+ * to find a timeout with LWIP_TIMERS_WHEEL==1 (must be a power of 2). Should
+ * be in the order of MEMP_NUM_SYS_TIMEOUT to keep cancelling O(1).
+ */
+#ifndef SYS_TIMEOUT_HASH_SIZE
+#define SYS_TIMEOUT_HASH_SIZE           16
+#endif
+
 /**
  * MEMCPY: override this if you have a faster implementation at hand than the
  * one included in your C library
@@ -172,6 +192,44 @@
 #define MEMP_SANITY_CHECK               0
 #endif
 
+/**
+ * MEMP_LOCKFREE==1: Use lock-free freelists for the memp pools, so that
+ * memp_malloc() and memp_free() can be called from interrupts and driver
+ * threads without SYS_ARCH_PROTECT. The freelist heads are 32 bit words
+ * (16 bit element index, 16 bit ABA tag) updated by SYS_ARCH_CAS_U32.
+ * MEMP_STATS are not updated atomically in this mode, so they may be
+ * inaccurate while pools are used concurrently.
+ * Not compatible with MEMP_SANITY_CHECK or MEMP_OVERFLOW_CHECK >= 2.
+ */
+#ifndef MEMP_LOCKFREE
+#define MEMP_LOCKFREE                   0
+#endif
+
+/**
+ * MEMP_MAGAZINES==1: Put a per-thread cache ("magazine") of free elements in
+ * front of every pool with at least 4 * MEMP_MAGAZINE_SIZE elements:
+ * memp_malloc() and memp_free() only take SYS_ARCH_PROTECT to refill or
+ * flush half a magazine at a time.
+ * The port has to define MEMP_MAGAZINES_GET() to return the
+ * struct memp_magazines of the calling thread (e.g. from thread local
+ * storage) or NULL where the shared pools have to be used (e.g. in
+ * interrupts). A thread returns its cached elements by calling
+ * memp_magazines_flush() before it exits.
+ * With MEMP_STATS, 'used' and 'cached' (the elements in all magazines) are
+ * updated when a magazine is refilled or flushed; stats_display() shows the
+ * elements cached by each thread that called memp_magazines_register().
+ */
+#ifndef MEMP_MAGAZINES
+#define MEMP_MAGAZINES                  0
+#endif
+
+/**
+ * MEMP_MAGAZINE_SIZE: Maximum number of elements a magazine caches per pool.
+ */
+#ifndef MEMP_MAGAZINE_SIZE
+#define MEMP_MAGAZINE_SIZE              16
+#endif
+
 /**
  * MEM_USE_POOLS==1: Use an alternative to malloc() by allocating from a set
  * of memory pools of various sizes. When mem_malloc is called, an element of
@@ -190,6 +248,17 @@
 #define MEM_USE_POOLS_TRY_BIGGER_POOL   0
 #endif
 
+/**
+ * MEM_USE_TLSF==1: Use a two-level segregated fit (TLSF) heap for
+ * mem_malloc() instead of the first-fit heap: free blocks are kept in
+ * size-class lists found via bitmaps, so mem_malloc() and mem_free() take
+ * constant time instead of scanning the heap. Same memory layout and
+ * MEM_SIZE as the first-fit heap.
+ */
+#ifndef MEM_USE_TLSF
+#define MEM_USE_TLSF                    0
+#endif
+
 /**
  * MEMP_USE_CUSTOM_POOLS==1: whether to include a user file lwippools.h
  * that defines additional pools beyond the "standard" ones required
@@ -291,6 +360,9 @@
  * This is only used with IP_FRAG_USES_STATIC_BUF==0 and
  * LWIP_NETIF_TX_SINGLE_PBUF==0 and only has to be > 1 with DMA-enabled MACs
  * where the packet is not yet sent when netif->output returns.
+ * With LWIP_NETIF_OFFLOAD, GSO packets take one per data pbuf they carry
+ * until the netif frees them (software GSO: one or two per segment, while
+ * tcp_output() builds the packet: one per TCP segment in it).
  */
 #ifndef MEMP_NUM_FRAG_PBUF
 #define MEMP_NUM_FRAG_PBUF              15
@@ -322,7 +394,7 @@
  * The formula expects settings to be either '0' or '1'.
  */
 #ifndef MEMP_NUM_SYS_TIMEOUT
-#define MEMP_NUM_SYS_TIMEOUT            (LWIP_TCP + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + (PPP_SUPPORT*6*MEMP_NUM_PPP_PCB) + (LWIP_IPV6 ? (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD) : 0))
+#define MEMP_NUM_SYS_TIMEOUT            (LWIP_TCP + (LWIP_TCP && LWIP_TCP_RTT_MS) + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + (PPP_SUPPORT*6*MEMP_NUM_PPP_PCB) + (LWIP_IPV6 ? (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD) : 0))
 #endif
 
 /**
@@ -612,6 +684,39 @@
 #define IP_FRAG                         1
 #endif
 
+/**
+ * IP_GRO==1: Merge in-order TCP segments of a flow received in one batch
+ * (generic receive offload) before they are processed by ip4_input(), so
+ * that tcp_input() and the recv callback run once for all of them. Packets
+ * are only held between ip4_gro_start() and ip4_gro_flush(): tcpip_thread
+ * does this for the packets queued in its mbox, NO_SYS users can do it
+ * around the input of every batch of received packets.
+ * The TCP checksum of every segment is verified before it is merged (with
+ * CHECKSUM_CHECK_TCP and NETIF_CHECKSUM_CHECK_TCP), so checking the merged
+ * packet in tcp_input() sums its data a second time. A netif that disables
+ * NETIF_CHECKSUM_CHECK_TCP because it checks in hardware must drop bad
+ * segments itself: the merged checksum alone does not catch errors that
+ * cancel out between segments.
+ */
+#ifndef IP_GRO
+#define IP_GRO                          0
+#endif
+
+/**
+ * IP_GRO_MAX_FLOWS: Number of flows GRO can hold a packet for at a time.
+ */
+#ifndef IP_GRO_MAX_FLOWS
+#define IP_GRO_MAX_FLOWS                4
+#endif
+
+/**
+ * IP_GRO_MAX_BATCH: Maximum number of messages tcpip_thread processes while
+ * GRO holds packets before it flushes them (and runs its timers).
+ */
+#ifndef IP_GRO_MAX_BATCH
+#define IP_GRO_MAX_BATCH                64
+#endif
+
 #if !LWIP_IPV4
 /* disable IPv4 extensions when IPv4 is disabled */
 #undef IP_FORWARD
@@ -620,6 +725,8 @@
 #define IP_REASSEMBLY                   0
 #undef IP_FRAG
 #define IP_FRAG                         0
+#undef IP_GRO
+#define IP_GRO                          0
 #endif /* !LWIP_IPV4 */
 
 /**
@@ -1074,6 +1181,34 @@
 #define LWIP_NETBUF_RECVINFO            0
 #endif
 
+/**
+ * LWIP_UDP_PCB_HASH==1: Keep udp_pcbs in a hash table keyed on the local
+ * port so that udp_input() only checks the pcbs bound to the destination
+ * port instead of walking the whole udp_pcbs list.
+ */
+#ifndef LWIP_UDP_PCB_HASH
+#define LWIP_UDP_PCB_HASH               0
+#endif
+
+/**
+ * UDP_PCB_HASH_SIZE: number of buckets in the UDP pcb hash table.
+ * Must be a power of 2.
+ */
+#ifndef UDP_PCB_HASH_SIZE
+#define UDP_PCB_HASH_SIZE               32
+#endif
+
+/**
+ * LWIP_UDP_REUSEPORT==1: Allow multiple pcbs with UDP_FLAGS_REUSEPORT set
+ * (SO_REUSEPORT for sockets) to bind to the same local address and port.
+ * Datagrams not matching a connected pcb are spread across these pcbs by a
+ * hash over the remote address and port, so that one flow always ends up
+ * on the same pcb.
+ */
+#ifndef LWIP_UDP_REUSEPORT
+#define LWIP_UDP_REUSEPORT              0
+#endif
+
 /*
    ---------------------------------
    ---------- TCP options ----------
@@ -1241,6 +1376,119 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_TCP_SACK==1: support TCP selective acknowledgments (RFC 2018).
+ * The SACK-permitted option is sent in every SYN. If the remote host sends
+ * it, too, empty ACKs report the blocks received out of sequence (see
+ * TCP_QUEUE_OOSEQ) and SACK blocks received mark the segments on the
+ * unacked queue, so that fast recovery and retransmission timeouts only
+ * resend the segments missing at the remote host.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
+/**
+ * LWIP_TCP_CC_CUBIC==1: compile the CUBIC congestion control module
+ * (RFC 8312, "cubic"). Congestion control is selected per pcb with
+ * tcp_set_congestion() or the TCP_CONGESTION socket option; NewReno
+ * ("newreno") is always available.
+ */
+#ifndef LWIP_TCP_CC_CUBIC
+#define LWIP_TCP_CC_CUBIC               0
+#endif
+
+/**
+ * LWIP_TCP_CC_BBR==1: compile a simplified model-based congestion control
+ * module ("bbr") that sets cwnd from the measured bottleneck bandwidth and
+ * minimum round-trip time instead of reacting to loss. lwIP does not pace,
+ * so only the cwnd part of BBR is implemented.
+ */
+#ifndef LWIP_TCP_CC_BBR
+#define LWIP_TCP_CC_BBR                 0
+#endif
+
+/**
+ * TCP_CC_DEFAULT: congestion control module used by new pcbs (a pointer to
+ * a struct tcp_cc_ops, e.g. &tcp_cc_cubic).
+ */
+#ifndef TCP_CC_DEFAULT
+#define TCP_CC_DEFAULT                  (&tcp_cc_newreno)
+#endif
+
+/**
+ * TCP_CC_PRIV_WORDS: per-pcb private state of the congestion control module
+ * in u32_t words. Must be big enough for every module compiled in (and any
+ * module set with tcp_set_cc_ops()).
+ */
+#ifndef TCP_CC_PRIV_WORDS
+#if LWIP_TCP_CC_BBR
+#define TCP_CC_PRIV_WORDS               12
+#elif LWIP_TCP_CC_CUBIC
+#define TCP_CC_PRIV_WORDS               5
+#else
+#define TCP_CC_PRIV_WORDS               0
+#endif
+#endif
+
+/**
+ * LWIP_TCP_RTT_MS==1: measure round-trip times and compute the
+ * retransmission time-out in milliseconds (RFC 6298) instead of in
+ * TCP_SLOW_INTERVAL ticks. With LWIP_TCP_TIMESTAMPS, every ACK for new data
+ * echoing a timestamp is an RTT sample. The retransmission timer is a
+ * one-shot sys_timeout() running at the earliest deadline of all pcbs, not
+ * a counter incremented by tcp_slowtmr().
+ */
+#ifndef LWIP_TCP_RTT_MS
+#define LWIP_TCP_RTT_MS                 0
+#endif
+
+/**
+ * TCP_RTO_INITIAL_MS: retransmission time-out in milliseconds before the
+ * first RTT sample (LWIP_TCP_RTT_MS only).
+ */
+#ifndef TCP_RTO_INITIAL_MS
+#define TCP_RTO_INITIAL_MS              1000
+#endif
+
+/**
+ * TCP_RTO_MIN_MS: lower bound of the retransmission time-out in
+ * milliseconds (LWIP_TCP_RTT_MS only). RFC 6298 recommends 1000, lower it
+ * for networks with sub-millisecond round-trip times.
+ */
+#ifndef TCP_RTO_MIN_MS
+#define TCP_RTO_MIN_MS                  200
+#endif
+
+/**
+ * TCP_RTO_MAX_MS: upper bound of the retransmission time-out (including
+ * exponential backoff) in milliseconds (LWIP_TCP_RTT_MS only).
+ */
+#ifndef TCP_RTO_MAX_MS
+#define TCP_RTO_MAX_MS                  60000
+#endif
+
+/**
+ * LWIP_TCP_RACK==1: detect lost segments from their send times (RACK,
+ * RFC 8985) instead of counting duplicate ACKs, and send a tail loss probe
+ * about two round-trip times after the last segment of a flight so that a
+ * lost tail is recovered without waiting for the retransmission time-out.
+ * Only used on connections that negotiated SACK.
+ * Requires LWIP_TCP_SACK and LWIP_TCP_RTT_MS.
+ */
+#ifndef LWIP_TCP_RACK
+#define LWIP_TCP_RACK                   0
+#endif
+
+/**
+ * TCP_NOW(): millisecond clock used by the congestion control modules, the
+ * timestamp option and LWIP_TCP_RTT_MS.
+ * Override this to drive TCP from a simulated clock.
+ */
+#ifndef TCP_NOW
+#define TCP_NOW()                       sys_now()
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -1274,6 +1522,45 @@
 #define TCP_RCV_SCALE                   0
 #endif
 
+/**
+ * LWIP_TCP_PCB_HASH==1: Demultiplex incoming segments using hash tables
+ * instead of walking the active, TIME-WAIT and listen pcb lists linearly.
+ * Active and TIME-WAIT pcbs are hashed on their 4-tuple, listen pcbs on
+ * their local port. Costs one pointer per pcb plus the bucket arrays.
+ */
+#ifndef LWIP_TCP_PCB_HASH
+#define LWIP_TCP_PCB_HASH               0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: number of buckets in the active and TIME-WAIT pcb
+ * hash tables (each). Must be a power of 2. For constant lookup time, this
+ * should be in the order of MEMP_NUM_TCP_PCB.
+ */
+#ifndef TCP_PCB_HASH_SIZE
+#define TCP_PCB_HASH_SIZE               64
+#endif
+
+/**
+ * TCP_PCB_LISTEN_HASH_SIZE: number of buckets in the listen pcb hash table.
+ * Must be a power of 2.
+ */
+#ifndef TCP_PCB_LISTEN_HASH_SIZE
+#define TCP_PCB_LISTEN_HASH_SIZE        16
+#endif
+
+/**
+ * LWIP_TCP_PCB_TIMERS==1: Event-driven TCP timers. Instead of walking all
+ * active and TIME-WAIT pcbs, tcp_fasttmr() only handles pcbs that were
+ * touched (input, output, tcp_write, option changes) since its last run and
+ * tcp_slowtmr() only handles pcbs that have a deadline (retransmission,
+ * persist, keepalive, poll, state timeouts) in the current tick. Deadlines
+ * are kept in a timing wheel, so idle connections cost nothing per tick.
+ */
+#ifndef LWIP_TCP_PCB_TIMERS
+#define LWIP_TCP_PCB_TIMERS             0
+#endif
+
 
 /*
    ----------------------------------
@@ -1310,6 +1597,53 @@
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_ENCAPSULATION_HLEN+PBUF_LINK_HLEN)
 #endif
 
+/**
+ * PBUF_RAM_ARENAS==1: Allocate PBUF_RAM pbufs from memp pools of fixed size
+ * classes (128, 256, 512, 1024, 2048 bytes and a jumbo class, struct pbuf
+ * and headers included) instead of the heap, so allocating a TX buffer is a
+ * freelist pop. Requests that are too big for every class or whose class is
+ * empty fall back to mem_malloc(). With MEMP_STATS, hits and misses per class
+ * are counted in lwip_stats.pbuf_arena.
+ */
+#ifndef PBUF_RAM_ARENAS
+#define PBUF_RAM_ARENAS                 0
+#endif
+
+/**
+ * PBUF_RAM_ARENA_NUM_128 .. PBUF_RAM_ARENA_NUM_2048: the number of elements
+ * of each PBUF_RAM size class.
+ */
+#ifndef PBUF_RAM_ARENA_NUM_128
+#define PBUF_RAM_ARENA_NUM_128          16
+#endif
+#ifndef PBUF_RAM_ARENA_NUM_256
+#define PBUF_RAM_ARENA_NUM_256          8
+#endif
+#ifndef PBUF_RAM_ARENA_NUM_512
+#define PBUF_RAM_ARENA_NUM_512          8
+#endif
+#ifndef PBUF_RAM_ARENA_NUM_1024
+#define PBUF_RAM_ARENA_NUM_1024         4
+#endif
+#ifndef PBUF_RAM_ARENA_NUM_2048
+#define PBUF_RAM_ARENA_NUM_2048         8
+#endif
+
+/**
+ * PBUF_RAM_ARENA_NUM_JUMBO: the number of elements of the jumbo size class
+ * (0: no jumbo class, PBUF_RAM pbufs bigger than 2048 bytes use the heap).
+ */
+#ifndef PBUF_RAM_ARENA_NUM_JUMBO
+#define PBUF_RAM_ARENA_NUM_JUMBO        0
+#endif
+
+/**
+ * PBUF_RAM_ARENA_JUMBO_SIZE: the element size of the jumbo size class.
+ */
+#ifndef PBUF_RAM_ARENA_JUMBO_SIZE
+#define PBUF_RAM_ARENA_JUMBO_SIZE       9216
+#endif
+
 /*
    ------------------------------------------------
    ---------- Network Interfaces options ----------
@@ -1575,13 +1909,26 @@
    ----------------------------------------------
 */
 /**
- * LWIP_TCPIP_CORE_LOCKING: (EXPERIMENTAL!)
- * Don't use it if you're not an active lwIP project member
+ * LWIP_TCPIP_CORE_LOCKING==1: netconn and socket API calls lock the stack
+ * and run the api_msg.c functions in the calling thread instead of posting
+ * them to tcpip_thread and waiting for the result. Calls that have to wait
+ * (blocking connect, write and close) release the lock while waiting.
+ * The lock is fair: it is handed to waiting threads in FIFO order. With
+ * SYS_STATS, lwip_stats.sys.core_lock counts how often it was contended.
  */
 #ifndef LWIP_TCPIP_CORE_LOCKING
 #define LWIP_TCPIP_CORE_LOCKING         0
 #endif
 
+/**
+ * LWIP_TCPIP_CORE_LOCK_SLOTS: Number of threads that can wait for the core
+ * lock with a semaphore that is created once and then kept (at least 1).
+ * More threads waiting at the same time create and free a semaphore each.
+ */
+#ifndef LWIP_TCPIP_CORE_LOCK_SLOTS
+#define LWIP_TCPIP_CORE_LOCK_SLOTS      4
+#endif
+
 /**
  * LWIP_TCPIP_CORE_LOCKING_INPUT: (EXPERIMENTAL!)
  * Don't use it if you're not an active lwIP project member
@@ -1726,6 +2073,25 @@
 #define LWIP_SO_LINGER                  0
 #endif
 
+/**
+ * LWIP_SO_ZEROCOPY==1: Enable SO_ZEROCOPY/MSG_ZEROCOPY processing for TCP
+ * sockets and NETCONN_ZEROCOPY for netconn_write(): data is referenced
+ * instead of copied and a callback reports when it has been ACKed (i.e.
+ * when the application may reuse the buffer).
+ */
+#ifndef LWIP_SO_ZEROCOPY
+#define LWIP_SO_ZEROCOPY                0
+#endif
+
+/**
+ * LWIP_SO_ZEROCOPY_PENDING: number of zero-copy writes per netconn that
+ * are tracked separately while waiting for their ACK. Further writes are
+ * merged into the newest entry, which only delays their notification.
+ */
+#ifndef LWIP_SO_ZEROCOPY_PENDING
+#define LWIP_SO_ZEROCOPY_PENDING        4
+#endif
+
 /**
  * If LWIP_SO_RCVBUF is used, this is the default value for recv_bufsize.
  */
@@ -1768,6 +2134,55 @@
 #define LWIP_FIONREAD_LINUXMODE         0
 #endif
 
+/**
+ * LWIP_SOCKET_POLL==1: Enable lwip_poll(). It uses the same socket events
+ * as lwip_select() but is not limited by FD_SETSIZE.
+ */
+#ifndef LWIP_SOCKET_POLL
+#define LWIP_SOCKET_POLL                0
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL==1: Enable lwip_epoll_create(), lwip_epoll_ctl() and
+ * lwip_epoll_wait(). Each epoll instance keeps a list of ready sockets that
+ * is updated from the socket event callback, so waiting costs O(ready
+ * sockets) instead of O(sockets) as with lwip_select(). Any number of tasks
+ * may wait on one instance, an event wakes all of them. EPOLLERR and
+ * EPOLLHUP (connection reset or closed) are always reported.
+ */
+#ifndef LWIP_SOCKET_EPOLL
+#define LWIP_SOCKET_EPOLL               0
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL_INSTANCES: the number of epoll instances that can be
+ * open at the same time. Every socket can be registered with each of them,
+ * so this costs LWIP_SOCKET_EPOLL_INSTANCES * MEMP_NUM_NETCONN registration
+ * entries of static memory.
+ */
+#ifndef LWIP_SOCKET_EPOLL_INSTANCES
+#define LWIP_SOCKET_EPOLL_INSTANCES     1
+#endif
+
+/**
+ * LWIP_SOCKET_RECV_ZEROCOPY==1: Enable lwip_recv_lend() and
+ * lwip_recv_release(): received pbufs are lent to the application as an
+ * iovec array pointing to their payloads instead of being copied. The TCP
+ * receive window is only opened when the application releases the data.
+ */
+#ifndef LWIP_SOCKET_RECV_ZEROCOPY
+#define LWIP_SOCKET_RECV_ZEROCOPY       0
+#endif
+
+/**
+ * LWIP_SOCKET_MMSG_BATCH: the number of datagrams lwip_sendmmsg() passes to
+ * tcpip_thread per message. The netbufs for one batch are allocated on the
+ * caller's stack.
+ */
+#ifndef LWIP_SOCKET_MMSG_BATCH
+#define LWIP_SOCKET_MMSG_BATCH          8
+#endif
+
 /*
    ----------------------------------------
    ---------- Statistics options ----------
@@ -2454,6 +2869,18 @@
 #define LWIP_CHECKSUM_CTRL_PER_NETIF    0
 #endif
 
+/**
+ * LWIP_NETIF_OFFLOAD==1: Support checksum and segmentation offload for IPv4
+ * TCP: pbufs carry an offload descriptor (see struct pbuf) and netifs
+ * announce what they support in netif->offload_flags. With
+ * netif->gso_max_size != 0, tcp_output() passes several segments as one
+ * packet; if the netif does not segment it (NETIF_OFFLOAD_TSO),
+ * ip4_output_if() does (GSO).
+ */
+#ifndef LWIP_NETIF_OFFLOAD
+#define LWIP_NETIF_OFFLOAD              0
+#endif
+
 /**
  * CHECKSUM_GEN_IP==1: Generate checksums in software for outgoing IP packets.
  */
@@ -2532,6 +2959,19 @@
 #define LWIP_CHECKSUM_ON_COPY           0
 #endif
 
+/**
+ * LWIP_CHECKSUM_ON_COPY_RX==1: Defer the checksum check of UDP datagrams
+ * received on sockets from udp_input() to lwip_recvfrom(), where it is done
+ * while copying the data to the application buffer (LWIP_CHKSUM_COPY), so
+ * the data is read only once. Datagrams failing the check are dropped by
+ * lwip_recvfrom(). Needs LWIP_CHECKSUM_ON_COPY.
+ * TCP checksums are always checked in tcp_input(): ACKs and the receive
+ * window depend on the segment being valid.
+ */
+#ifndef LWIP_CHECKSUM_ON_COPY_RX
+#define LWIP_CHECKSUM_ON_COPY_RX        0
+#endif
+
 /*
    ---------------------------------------
    ---------- IPv6 options ---------------
@@ -47,7 +47,7 @@ extern "C" {
  * Currently, the pbuf_custom code is only needed for one specific configuration
  * of IP_FRAG, unless required by external driver/application code. */
 #ifndef LWIP_SUPPORT_CUSTOM_PBUF
-#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG))
+#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG) || LWIP_NETIF_OFFLOAD)
 #endif
 
 /* @todo: We need a mechanism to prevent wasting memory in every pbuf
@@ -104,6 +104,18 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+/** indicates this pbuf is a UDP datagram whose checksum has not been checked
+    yet: the partial checksum is stored in the UDP header (see
+    LWIP_CHECKSUM_ON_COPY_RX) */
+#define PBUF_FLAG_CHKSUM_RX 0x40U
+/** indicates the checksum of this packet is left to the netif: see
+    csum_start/csum_offset (LWIP_NETIF_OFFLOAD) */
+#define PBUF_FLAG_CSUM_PARTIAL 0x80U
+
+#if PBUF_RAM_ARENAS
+/** Number of PBUF_RAM size classes (128..2048 bytes and the optional jumbo class) */
+#define PBUF_RAM_ARENA_CLASSES  (PBUF_RAM_ARENA_NUM_JUMBO ? 6 : 5)
+#endif /* PBUF_RAM_ARENAS */
 
 struct pbuf {
   /** next pbuf in singly linked pbuf chain */
@@ -136,6 +148,26 @@ struct pbuf {
    * the stack itself, or pbuf->next pointers from a chain.
    */
   u16_t ref;
+
+#if PBUF_RAM_ARENAS
+  /** PBUF_RAM only: size class + 1 this pbuf was allocated from, 0: heap */
+  u8_t arena;
+#endif /* PBUF_RAM_ARENAS */
+
+#if LWIP_NETIF_OFFLOAD
+  /** Offload descriptor, only valid in the first pbuf of a packet.
+   * With PBUF_FLAG_CSUM_PARTIAL, the checksum field at csum_start +
+   * csum_offset holds the pseudo header sum (not inverted); the netif sums
+   * from csum_start (offset from payload, kept up to date by pbuf_header)
+   * to the end of the packet and stores the inverted sum there. */
+  u16_t csum_start;
+  u16_t csum_offset;
+  /** != 0: IPv4 TCP packet to be cut into segments of gso_size data bytes.
+   * The IP header and the TCP header (PSH/FIN only on the last segment)
+   * are repeated with adjusted length, id, seqno and checksums; the pseudo
+   * header sum in the TCP checksum field does not include the length. */
+  u16_t gso_size;
+#endif /* LWIP_NETIF_OFFLOAD */
 };
 
 
@@ -164,6 +196,20 @@ struct pbuf_custom {
 };
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
 
+#if LWIP_NETIF_OFFLOAD
+/** A custom pbuf that holds a reference to another pbuf, which is freed
+ * when this custom pbuf is freed (see pbuf_alloc_offload_ref()). */
+#ifndef LWIP_PBUF_CUSTOM_REF_DEFINED
+#define LWIP_PBUF_CUSTOM_REF_DEFINED
+struct pbuf_custom_ref {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** pointer to the original pbuf that is referenced */
+  struct pbuf *original;
+};
+#endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+#endif /* LWIP_NETIF_OFFLOAD */
+
 #if LWIP_TCP && TCP_QUEUE_OOSEQ
 /** Define this to 0 to prevent freeing ooseq pbufs when the PBUF_POOL is empty */
 #ifndef PBUF_POOL_FREE_OOSEQ
@@ -192,6 +238,9 @@ struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type,
                                  u16_t payload_mem_len);
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
 void pbuf_realloc(struct pbuf *p, u16_t size);
+#if PBUF_RAM_ARENAS
+u16_t pbuf_ram_capacity(const struct pbuf *p);
+#endif /* PBUF_RAM_ARENAS */
 u8_t pbuf_header(struct pbuf *p, s16_t header_size);
 u8_t pbuf_header_force(struct pbuf *p, s16_t header_size);
 void pbuf_ref(struct pbuf *p);
@@ -209,6 +258,10 @@ struct pbuf *pbuf_coalesce(struct pbuf *p, pbuf_layer layer);
 err_t pbuf_fill_chksum(struct pbuf *p, u16_t start_offset, const void *dataptr,
                        u16_t len, u16_t *chksum);
 #endif /* LWIP_CHECKSUM_ON_COPY */
+#if LWIP_NETIF_OFFLOAD
+void pbuf_offload_chksum(struct pbuf *p);
+struct pbuf *pbuf_alloc_offload_ref(struct pbuf *p, u16_t offset, u16_t length);
+#endif /* LWIP_NETIF_OFFLOAD */
 #if LWIP_TCP && TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
 void pbuf_split_64k(struct pbuf *p, struct pbuf **rest);
 #endif /* LWIP_TCP && TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
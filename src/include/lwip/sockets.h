@@ -96,12 +96,52 @@ struct sockaddr_storage {
 #endif /* LWIP_IPV6 */
 };
 
+/* If your port already defines struct iovec, define IOVEC_DEFINED
+   to prevent this code from redefining it. */
+#if !defined(iovec) && !defined(IOVEC_DEFINED)
+struct iovec {
+  void  *iov_base;
+  size_t iov_len;
+};
+#endif
+
+#if LWIP_SOCKET_RECV_ZEROCOPY
+/** Data lent to the application by lwip_recv_lend(), to be passed back to
+ * lwip_recv_release() once the application is done with it, in the order it
+ * was lent. The members are internal. */
+struct lwip_recv_loan {
+  void  *p;
+  u32_t len;
+  u32_t seq;
+};
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
+
 /* If your port already typedef's socklen_t, define SOCKLEN_T_DEFINED
    to prevent this code from redefining it. */
 #if !defined(socklen_t) && !defined(SOCKLEN_T_DEFINED)
 typedef u32_t socklen_t;
 #endif
 
+struct msghdr {
+  void         *msg_name;
+  socklen_t     msg_namelen;
+  struct iovec *msg_iov;
+  int           msg_iovlen;
+  void         *msg_control;
+  socklen_t     msg_controllen;
+  int           msg_flags;
+};
+
+/* maximum number of iovecs per lwip_sendmsg/lwip_writev call */
+#ifndef IOV_MAX
+#define IOV_MAX 0xFFFF
+#endif
+
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+};
+
 struct lwip_sock;
 
 #if !LWIP_TCPIP_CORE_LOCKING
@@ -170,6 +210,7 @@ struct lwip_setgetsockopt_data {
 #define SO_TYPE        0x1008 /* get socket type */
 #define SO_CONTIMEO    0x1009 /* Unimplemented: connect timeout */
 #define SO_NO_CHECK    0x100a /* don't create UDP checksum */
+#define SO_ZEROCOPY    0x100b /* set-only: enable MSG_ZEROCOPY, optval is a struct lwip_zerocopy */
 
 
 /*
@@ -180,6 +221,26 @@ struct linger {
        int l_linger;               /* linger time in seconds */
 };
 
+#if LWIP_SO_ZEROCOPY
+/** Zero-copy completion callback: the MSG_ZEROCOPY sends numbered 'lo' to
+ * 'hi' (inclusive, counted from 0 per socket for every send that queued data)
+ * on socket 's' are no longer referenced by the stack and their buffers may
+ * be reused. 'err' is 0 if the data was ACKed, or the errno of the error that
+ * dropped the connection. Called from tcpip_thread!
+ * Closing the socket drops pending notifications while the stack may still
+ * reference the data until it is ACKed, so wait for them before closing.
+ */
+typedef void (*lwip_zerocopy_fn)(int s, u32_t lo, u32_t hi, int err, void *arg);
+
+/*
+ * Structure used for the SO_ZEROCOPY option.
+ */
+struct lwip_zerocopy {
+  lwip_zerocopy_fn callback; /* NULL disables MSG_ZEROCOPY again */
+  void *arg;
+};
+#endif /* LWIP_SO_ZEROCOPY */
+
 /*
  * Level number for (get/set)sockopt() to apply to socket itself.
  */
@@ -214,6 +275,8 @@ struct linger {
 #define MSG_OOB        0x04    /* Unimplemented: Requests out-of-band data. The significance and semantics of out-of-band data are protocol-specific */
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
+#define MSG_ZEROCOPY   0x20    /* TCP: don't copy the data, see SO_ZEROCOPY (ignored if not enabled) */
+#define MSG_TRUNC      0x40    /* recvmsg msg_flags: datagram was larger than the buffers */
 
 
 /*
@@ -231,6 +294,7 @@ struct linger {
 #define TCP_KEEPIDLE   0x03    /* set pcb->keep_idle  - Same as TCP_KEEPALIVE, but use seconds for get/setsockopt */
 #define TCP_KEEPINTVL  0x04    /* set pcb->keep_intvl - Use seconds for get/setsockopt */
 #define TCP_KEEPCNT    0x05    /* set pcb->keep_cnt   - Use number of probes sent for get/setsockopt */
+#define TCP_CONGESTION 0x06    /* congestion control module by name (char[]), see tcp_set_congestion() */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV6
@@ -423,6 +487,60 @@ struct timeval {
 };
 #endif /* LWIP_TIMEVAL_PRIVATE */
 
+#if LWIP_SOCKET_POLL
+/* poll-related defines and types */
+#if !defined(POLLIN) && !defined(POLLOUT)
+#define POLLIN     0x1
+#define POLLOUT    0x2
+#define POLLERR    0x4
+#define POLLNVAL   0x8
+/* Below values are unimplemented */
+#define POLLRDNORM 0x10
+#define POLLRDBAND 0x20
+#define POLLPRI    0x40
+#define POLLWRNORM 0x80
+#define POLLWRBAND 0x100
+#define POLLHUP    0x200
+typedef unsigned int nfds_t;
+struct pollfd
+{
+  int fd;
+  short events;
+  short revents;
+};
+#endif /* !defined(POLLIN) && !defined(POLLOUT) */
+#endif /* LWIP_SOCKET_POLL */
+
+#if LWIP_SOCKET_EPOLL
+/* Flags for lwip_epoll_ctl() and lwip_epoll_wait(), values as in linux */
+#ifndef EPOLLIN
+#define EPOLLIN       0x001U
+#define EPOLLOUT      0x004U
+#define EPOLLERR      0x008U
+#define EPOLLHUP      0x010U
+#define EPOLLONESHOT  (1U << 30)
+#define EPOLLET       (1U << 31)
+#endif /* EPOLLIN */
+
+/* Operations for lwip_epoll_ctl() */
+#ifndef EPOLL_CTL_ADD
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+#endif /* EPOLL_CTL_ADD */
+
+typedef union lwip_epoll_data {
+  void *ptr;
+  int fd;
+  u32_t u32;
+} lwip_epoll_data_t;
+
+struct lwip_epoll_event {
+  u32_t events;            /* EPOLL* flags */
+  lwip_epoll_data_t data;  /* returned unchanged by lwip_epoll_wait() */
+};
+#endif /* LWIP_SOCKET_EPOLL */
+
 #define lwip_socket_init() /* Compatibility define, no init needed. */
 void lwip_socket_thread_init(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: initialize thread-local semaphore */
 void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destroy thread-local semaphore */
@@ -441,15 +559,24 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #define lwip_listen       listen
 #define lwip_recv         recv
 #define lwip_recvfrom     recvfrom
+#define lwip_recvmsg      recvmsg
+#define lwip_recvmmsg     recvmmsg
 #define lwip_send         send
+#define lwip_sendmsg      sendmsg
+#define lwip_sendmmsg     sendmmsg
 #define lwip_sendto       sendto
 #define lwip_socket       socket
 #define lwip_select       select
+#if LWIP_SOCKET_POLL
+#define lwip_poll         poll
+#endif /* LWIP_SOCKET_POLL */
 #define lwip_ioctlsocket  ioctl
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define lwip_read         read
+#define lwip_readv        readv
 #define lwip_write        write
+#define lwip_writev       writev
 #undef lwip_close
 #define lwip_close        close
 #define closesocket(s)    close(s)
@@ -470,17 +597,35 @@ int lwip_connect(int s, const struct sockaddr *name, socklen_t namelen);
 int lwip_listen(int s, int backlog);
 int lwip_recv(int s, void *mem, size_t len, int flags);
 int lwip_read(int s, void *mem, size_t len);
+int lwip_readv(int s, const struct iovec *iov, int iovcnt);
 int lwip_recvfrom(int s, void *mem, size_t len, int flags,
       struct sockaddr *from, socklen_t *fromlen);
+int lwip_recvmsg(int s, struct msghdr *message, int flags);
+int lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
 int lwip_send(int s, const void *dataptr, size_t size, int flags);
+int lwip_sendmsg(int s, const struct msghdr *message, int flags);
+int lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
 int lwip_sendto(int s, const void *dataptr, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 int lwip_socket(int domain, int type, int protocol);
 int lwip_write(int s, const void *dataptr, size_t size);
+int lwip_writev(int s, const struct iovec *iov, int iovcnt);
 int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
                 struct timeval *timeout);
+#if LWIP_SOCKET_POLL
+int lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+#endif /* LWIP_SOCKET_POLL */
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
+#if LWIP_SOCKET_RECV_ZEROCOPY
+int lwip_recv_lend(int s, struct iovec *iov, int *iovcnt, int flags, struct lwip_recv_loan *loan);
+int lwip_recv_release(int s, struct lwip_recv_loan *loan);
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
+#if LWIP_SOCKET_EPOLL
+int lwip_epoll_create(int size);
+int lwip_epoll_ctl(int epfd, int op, int s, struct lwip_epoll_event *event);
+int lwip_epoll_wait(int epfd, struct lwip_epoll_event *events, int maxevents, int timeout);
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_COMPAT_SOCKETS
 #if LWIP_COMPAT_SOCKETS != 2
@@ -496,15 +641,24 @@ int lwip_fcntl(int s, int cmd, int val);
 #define listen(s,backlog)                         lwip_listen(s,backlog)
 #define recv(s,mem,len,flags)                     lwip_recv(s,mem,len,flags)
 #define recvfrom(s,mem,len,flags,from,fromlen)    lwip_recvfrom(s,mem,len,flags,from,fromlen)
+#define recvmsg(s,message,flags)                  lwip_recvmsg(s,message,flags)
+#define recvmmsg(s,msgvec,vlen,flags)             lwip_recvmmsg(s,msgvec,vlen,flags)
 #define send(s,dataptr,size,flags)                lwip_send(s,dataptr,size,flags)
+#define sendmsg(s,message,flags)                  lwip_sendmsg(s,message,flags)
+#define sendmmsg(s,msgvec,vlen,flags)             lwip_sendmmsg(s,msgvec,vlen,flags)
 #define sendto(s,dataptr,size,flags,to,tolen)     lwip_sendto(s,dataptr,size,flags,to,tolen)
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
+#if LWIP_SOCKET_POLL
+#define poll(fds,nfds,timeout)                    lwip_poll(fds,nfds,timeout)
+#endif /* LWIP_SOCKET_POLL */
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define read(s,mem,len)                           lwip_read(s,mem,len)
+#define readv(s,iov,iovcnt)                       lwip_readv(s,iov,iovcnt)
 #define write(s,dataptr,len)                      lwip_write(s,dataptr,len)
+#define writev(s,iov,iovcnt)                      lwip_writev(s,iov,iovcnt)
 #define close(s)                                  lwip_close(s)
 #define fcntl(s,cmd,val)                          lwip_fcntl(s,cmd,val)
 #define ioctl(s,cmd,argp)                         lwip_ioctl(s,cmd,argp)
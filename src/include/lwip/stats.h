@@ -36,6 +36,7 @@
 
 #include "lwip/mem.h"
 #include "lwip/memp.h"
+#include "lwip/pbuf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -96,18 +97,47 @@ struct stats_mem {
   mem_size_t used;
   mem_size_t max;
   STAT_COUNTER illegal;
+#if MEMP_MAGAZINES
+  /** elements in all magazines (per thread: see memp_magazines_register) */
+  mem_size_t cached;
+#endif /* MEMP_MAGAZINES */
 };
 
+#if PBUF_RAM_ARENAS
+struct stats_pbuf_arena {
+  /** allocations served by the size class */
+  STAT_COUNTER hit;
+  /** allocations that found the size class empty and used the heap */
+  STAT_COUNTER miss;
+};
+#endif /* PBUF_RAM_ARENAS */
+
 struct stats_syselem {
   STAT_COUNTER used;
   STAT_COUNTER max;
   STAT_COUNTER err;
 };
 
+#if LWIP_TCPIP_CORE_LOCKING
+struct stats_corelock {
+  /** number of times the core lock was taken */
+  STAT_COUNTER acquired;
+  /** number of times a thread had to wait for it */
+  STAT_COUNTER contended;
+  /** threads currently waiting */
+  STAT_COUNTER waiting;
+  /** maximum number of threads waiting at the same time */
+  STAT_COUNTER max_waiting;
+};
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
 struct stats_sys {
   struct stats_syselem sem;
   struct stats_syselem mutex;
   struct stats_syselem mbox;
+#if LWIP_TCPIP_CORE_LOCKING
+  struct stats_corelock core_lock;
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 };
 
 struct stats_ {
@@ -141,6 +171,9 @@ struct stats_ {
 #if MEMP_STATS
   struct stats_mem memp[MEMP_MAX];
 #endif
+#if MEMP_STATS && PBUF_RAM_ARENAS
+  struct stats_pbuf_arena pbuf_arena[PBUF_RAM_ARENA_CLASSES];
+#endif
 #if SYS_STATS
   struct stats_sys sys;
 #endif
@@ -257,6 +290,14 @@ void stats_init(void);
 #define MEM_STATS_DISPLAY()
 #endif
 
+#if MEMP_STATS && PBUF_RAM_ARENAS
+#define PBUF_ARENA_STATS_INC(x, i) STATS_INC(pbuf_arena[i].x)
+#define PBUF_ARENA_STATS_DISPLAY(i) stats_display_pbuf_arena(&lwip_stats.pbuf_arena[i], i)
+#else
+#define PBUF_ARENA_STATS_INC(x, i)
+#define PBUF_ARENA_STATS_DISPLAY(i)
+#endif
+
 #if MEMP_STATS
 #define MEMP_STATS_AVAIL(x, i, y) lwip_stats.memp[i].x = y
 #define MEMP_STATS_INC(x, i) STATS_INC(memp[i].x)
@@ -330,6 +371,12 @@ void stats_display_proto(struct stats_proto *proto, const char *name);
 void stats_display_igmp(struct stats_igmp *igmp, const char *name);
 void stats_display_mem(struct stats_mem *mem, const char *name);
 void stats_display_memp(struct stats_mem *mem, int index);
+#if MEMP_MAGAZINES
+void stats_display_memp_magazines(struct memp_magazines *mags);
+#endif /* MEMP_MAGAZINES */
+#if PBUF_RAM_ARENAS
+void stats_display_pbuf_arena(struct stats_pbuf_arena *arena, int index);
+#endif /* PBUF_RAM_ARENAS */
 void stats_display_sys(struct stats_sys *sys);
 #else /* LWIP_STATS_DISPLAY */
 #define stats_display()
@@ -337,6 +384,8 @@ void stats_display_sys(struct stats_sys *sys);
 #define stats_display_igmp(igmp, name)
 #define stats_display_mem(mem, name)
 #define stats_display_memp(mem, index)
+#define stats_display_memp_magazines(mags)
+#define stats_display_pbuf_arena(arena, index)
 #define stats_display_sys(sys)
 #endif /* LWIP_STATS_DISPLAY */
 
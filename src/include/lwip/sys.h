@@ -350,6 +350,15 @@ void sys_arch_unprotect(sys_prot_t pval);
                               } while(0)
 #endif /* SYS_ARCH_SET */
 
+/** SYS_ARCH_CAS_U32
+ * Atomically replace the u32_t at 'ptr' by 'newval' if it still equals
+ * 'oldval' (full memory barrier). Evaluates to nonzero on success.
+ * Only needed for MEMP_LOCKFREE. Defaults to the GCC builtin, other
+ * compilers have to define it in sys_arch.h.
+ */
+#if !defined(SYS_ARCH_CAS_U32) && defined(__GNUC__)
+#define SYS_ARCH_CAS_U32(ptr, oldval, newval) __sync_bool_compare_and_swap(ptr, oldval, newval)
+#endif /* SYS_ARCH_CAS_U32 */
 
 #ifdef __cplusplus
 }
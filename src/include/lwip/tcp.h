@@ -41,6 +41,7 @@
 #include "lwip/ip.h"
 #include "lwip/icmp.h"
 #include "lwip/err.h"
+#include "lwip/wheel.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 
@@ -49,6 +50,7 @@ extern "C" {
 #endif
 
 struct tcp_pcb;
+struct tcp_cc_ops;
 
 /** Function prototype for tcp accept callback functions. Called when a new
  * connection can be accepted on a listening pcb.
@@ -131,13 +133,17 @@ typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
 #define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xFFFF))
 #define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND : TCPWND16(TCP_WND)))
 typedef u32_t tcpwnd_size_t;
-typedef u16_t tcpflags_t;
 #else
 #define RCV_WND_SCALE(pcb, wnd) (wnd)
 #define SND_WND_SCALE(pcb, wnd) (wnd)
 #define TCPWND16(x)             (x)
 #define TCP_WND_MAX(pcb)        TCP_WND
 typedef u16_t tcpwnd_size_t;
+#endif
+
+#if LWIP_WND_SCALE || LWIP_TCP_SACK
+typedef u16_t tcpflags_t;
+#else
 typedef u8_t tcpflags_t;
 #endif
 
@@ -168,11 +174,19 @@ enum tcp_state {
 #define DEF_ACCEPT_CALLBACK
 #endif /* LWIP_CALLBACK_API */
 
+#if LWIP_TCP_PCB_HASH
+  /* Chains pcbs sharing a hash bucket (see tcp_pcb_hash_reg()) */
+#define DEF_HASH_NEXT(type)  type *hash_next;
+#else /* LWIP_TCP_PCB_HASH */
+#define DEF_HASH_NEXT(type)
+#endif /* LWIP_TCP_PCB_HASH */
+
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  DEF_HASH_NEXT(type) \
   void *callback_arg; \
   /* the accept callback for listen- and normal pcbs, if LWIP_CALLBACK_API */ \
   DEF_ACCEPT_CALLBACK \
@@ -203,6 +217,9 @@ struct tcp_pcb {
 #define TF_NAGLEMEMERR 0x80U   /* nagle enabled, memerr, try to output to prevent delayed ACK to happen */
 #if LWIP_WND_SCALE
 #define TF_WND_SCALE   0x0100U /* Window Scale option enabled */
+#endif
+#if LWIP_TCP_SACK
+#define TF_SACK        0x0200U /* Selective acknowledgments enabled */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -212,6 +229,16 @@ struct tcp_pcb {
   u8_t polltmr, pollinterval;
   u8_t last_timer;
   u32_t tmr;
+#if LWIP_TCP_PCB_TIMERS
+  /* Timer wheel linkage, tmr_node.due is the next deadline (in tcp_ticks) */
+  struct wheel_node tmr_node;
+  /* Linkage for pcbs to re-evaluate (see tcp_timers_touch()) */
+  struct tcp_pcb *tmr_dirty_next;
+  struct tcp_pcb **tmr_dirty_pprev;
+  /* tcp_ticks when tcp_slowtmr() last handled this pcb */
+  u32_t tmr_last;
+  u8_t tmr_flags;
+#endif /* LWIP_TCP_PCB_TIMERS */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
@@ -225,20 +252,52 @@ struct tcp_pcb {
   u16_t mss;   /* maximum segment size */
 
   /* RTT (round trip time) estimation variables */
-  u32_t rttest; /* RTT estimate in 500ms ticks */
+  u32_t rttest; /* start of the RTT measurement (tcp_ticks, TCP_NOW() with LWIP_TCP_RTT_MS) */
   u32_t rtseq;  /* sequence number being timed */
   s16_t sa, sv; /* @todo document this */
 
   s16_t rto;    /* retransmission time-out */
   u8_t nrtx;    /* number of retransmissions */
+#if LWIP_TCP_RTT_MS
+  u32_t srtt;    /* smoothed RTT in ms, scaled by 8 (0: no sample yet) */
+  u32_t rttvar;  /* RTT variation in ms, scaled by 4 */
+  u32_t rto_ms;  /* retransmission time-out in ms (including backoff) */
+  /* Linkage into the wheel of retransmission deadlines (see tcp_rto_tmr()),
+     rto_node.due is the TCP_NOW() at which the timer expires */
+  struct wheel_node rto_node;
+#endif /* LWIP_TCP_RTT_MS */
+#if LWIP_TCP_RACK
+  /* RACK loss detection and tail loss probes (RFC 8985) */
+  u32_t rack_xmit_ts;  /* send time of the most recently sent segment delivered */
+  u32_t rack_end_seq;  /* end of that segment */
+  u32_t rack_rtt;      /* RTT of that segment in ms */
+  u32_t rack_min_rtt;  /* minimum RTT of all segments delivered in ms */
+  u32_t rack_fack;     /* highest sequence number delivered (cumulatively or SACKed) */
+  u32_t tlp_end_seq;   /* snd_nxt when the tail loss probe was sent */
+  u8_t rack_timer;     /* what rto_node.due is for: TCP_RACK_TMR_* */
+  u8_t rack_flags;
+#define TCP_RACK_F_VALID      0x01U /* rack_* describe a delivered segment */
+#define TCP_RACK_F_REORD      0x02U /* reordering was seen */
+#define TCP_RACK_F_TLP        0x04U /* a tail loss probe is outstanding */
+#define TCP_RACK_F_TLP_REXMIT 0x08U /* ... and it was a retransmission */
+#define TCP_RACK_F_REXMIT     0x10U /* the segment rack_* describe was retransmitted */
+#endif /* LWIP_TCP_RACK */
 
   /* fast retransmit/recovery */
   u8_t dupacks;
   u32_t lastack; /* Highest acknowledged seqno. */
+#if LWIP_TCP_SACK
+  u32_t sack_recover; /* snd_nxt when fast recovery was entered */
+  u32_t sack_rexmit;  /* end of the last segment retransmitted in recovery */
+#endif /* LWIP_TCP_SACK */
 
   /* congestion avoidance/control variables */
   tcpwnd_size_t cwnd;
   tcpwnd_size_t ssthresh;
+  const struct tcp_cc_ops *cc_ops;
+#if TCP_CC_PRIV_WORDS
+  u32_t cc_priv[TCP_CC_PRIV_WORDS]; /* private state of cc_ops */
+#endif /* TCP_CC_PRIV_WORDS */
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
@@ -264,6 +323,14 @@ struct tcp_pcb {
   struct tcp_seg *unacked;  /* Sent but unacknowledged segments. */
 #if TCP_QUEUE_OOSEQ  
   struct tcp_seg *ooseq;    /* Received out of sequence segments. */
+  struct tcp_seg *ooseq_root; /* AVL tree over the segments on ooseq */
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  u32_t ooseq_blen;         /* bytes queued on ooseq */
+  u16_t ooseq_qlen;         /* pbufs queued on ooseq */
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+#if LWIP_TCP_SACK
+  u32_t rcv_sack_recent;    /* seqno of the last segment put on ooseq */
+#endif /* LWIP_TCP_SACK */
 #endif /* TCP_QUEUE_OOSEQ */
 
   struct pbuf *refused_data; /* Data previously received but not yet taken by upper layer */
@@ -320,8 +387,42 @@ struct tcp_pcb_listen {
 #if LWIP_IPV4 && LWIP_IPV6
   u8_t accept_any_ip_version;
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
+  /* congestion control passed on to accepted pcbs */
+  const struct tcp_cc_ops *cc_ops;
 };
 
+/**
+ * A congestion control module. All hooks are called from the tcpip thread
+ * and adjust pcb->cwnd and pcb->ssthresh; state of their own goes to
+ * pcb->cc_priv. All hooks must be set.
+ */
+struct tcp_cc_ops {
+  /** name used by tcp_set_congestion() and TCP_CONGESTION */
+  const char *name;
+  /** pcb allocated or module changed: initialize pcb->cc_priv */
+  void (*init)(struct tcp_pcb *pcb);
+  /** 'acked' bytes of new data were acknowledged (also called in fast
+      recovery, TF_INFR is set then) */
+  void (*ack)(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+  /** fast retransmit: loss detected by duplicate ACKs, set ssthresh and
+      cwnd for fast recovery */
+  void (*loss)(struct tcp_pcb *pcb);
+  /** fast recovery ended (all data outstanding at the loss was ACKed) */
+  void (*recovered)(struct tcp_pcb *pcb);
+  /** retransmission timeout */
+  void (*rto)(struct tcp_pcb *pcb);
+  /** sending is resumed after the connection was idle for an RTO */
+  void (*idle)(struct tcp_pcb *pcb);
+};
+
+extern const struct tcp_cc_ops tcp_cc_newreno;
+#if LWIP_TCP_CC_CUBIC
+extern const struct tcp_cc_ops tcp_cc_cubic;
+#endif /* LWIP_TCP_CC_CUBIC */
+#if LWIP_TCP_CC_BBR
+extern const struct tcp_cc_ops tcp_cc_bbr;
+#endif /* LWIP_TCP_CC_BBR */
+
 #if LWIP_EVENT_API
 
 enum lwip_event {
@@ -395,6 +496,18 @@ void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
 
 err_t            tcp_output  (struct tcp_pcb *pcb);
 
+/** Maximum length of a congestion control module name (including the NUL) */
+#define TCP_CC_NAME_MAX 16
+err_t            tcp_set_congestion(struct tcp_pcb *pcb, const char *name);
+void             tcp_set_cc_ops(struct tcp_pcb *pcb, const struct tcp_cc_ops *ops);
+const char *     tcp_get_congestion(struct tcp_pcb *pcb);
+
+#if LWIP_TCP_PCB_TIMERS
+void             tcp_timers_touch(struct tcp_pcb *pcb);
+#else /* LWIP_TCP_PCB_TIMERS */
+#define          tcp_timers_touch(pcb)
+#endif /* LWIP_TCP_PCB_TIMERS */
+
 
 const char* tcp_debug_state_str(enum tcp_state s);
 
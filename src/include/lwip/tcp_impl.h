@@ -60,6 +60,11 @@ void             tcp_tmr     (void);  /* Must be called every
    intervals (instead of calling tcp_tmr()). */
 void             tcp_slowtmr (void);
 void             tcp_fasttmr (void);
+#if LWIP_TCP_RTT_MS
+/* Retransmission timer: called when the earliest deadline passed in
+   tcp_rto_timer_needed() is reached (and from tcp_tmr() without LWIP_TIMERS) */
+void             tcp_rto_tmr (void);
+#endif /* LWIP_TCP_RTT_MS */
 
 /* Call this from a netif driver (watch out for threading issues!) that has
    returned a memory error on transmit and now has free buffers to send more.
@@ -76,9 +81,51 @@ err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 void             tcp_rexmit  (struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+u8_t             tcp_rexmit_sack (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
+/** Initial CWND calculation as defined RFC 2581 */
+#define LWIP_TCP_CALC_INITIAL_CWND(mss) LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U))
+
+/** Private congestion control state of a pcb, cast to the module's struct */
+#define TCP_CC_PRIV(pcb, type) ((type *)(void *)(pcb)->cc_priv)
+
+#if LWIP_TCP_RTT_MS
+void             tcp_rtt_update(struct tcp_pcb *pcb, u32_t rtt);
+void             tcp_rto_calc(struct tcp_pcb *pcb);
+void             tcp_rto_start(struct tcp_pcb *pcb);
+void             tcp_rto_arm(struct tcp_pcb *pcb, u32_t ms);
+/** (Re-)start the retransmission timer of a pcb */
+#define TCP_RTO_RESTART(pcb) tcp_rto_start(pcb)
+/** Reset the retransmission time-out from the RTT estimate (no backoff) */
+#define TCP_RTO_RESET(pcb)   tcp_rto_calc(pcb)
+#else /* LWIP_TCP_RTT_MS */
+#define TCP_RTO_RESTART(pcb) do { (pcb)->rtime = 0; } while(0)
+#define TCP_RTO_RESET(pcb)   do { (pcb)->rto = ((pcb)->sa >> 3) + (pcb)->sv; } while(0)
+#endif /* LWIP_TCP_RTT_MS */
+
+#if LWIP_TCP_RACK
+/* What the retransmission timer (pcb->rto_node.due) of a pcb is running for */
+#define TCP_RACK_TMR_RTO     0 /* retransmission time-out */
+#define TCP_RACK_TMR_PTO     1 /* tail loss probe */
+#define TCP_RACK_TMR_REO     2 /* end of the reordering window of a segment */
+/** Worst case delayed ACK time added to the probe time-out of a single
+    segment (RFC 8985) */
+#define TCP_TLP_WCDELACK_MS  200
+/** Lower bound of the probe time-out */
+#define TCP_TLP_MIN_PTO_MS   10
+/** RACK and tail loss probes are used on connections that negotiated SACK */
+#define TCP_RACK_ACTIVE(pcb) (((pcb)->flags & TF_SACK) != 0)
+void             tcp_rack_delivered(struct tcp_pcb *pcb, struct tcp_seg *seg);
+void             tcp_rack_input(struct tcp_pcb *pcb);
+void             tcp_rack_timeout(struct tcp_pcb *pcb);
+#else /* LWIP_TCP_RACK */
+#define TCP_RACK_ACTIVE(pcb) 0
+#endif /* LWIP_TCP_RACK */
+
 /**
  * This is the Nagle algorithm: try to combine user data to send as few TCP
  * segments as possible. Only send if
@@ -300,6 +347,18 @@ struct tcp_seg {
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Segment (on unacked) was selectively
+                                               acknowledged by the remote host */
+#define TF_SEG_REXMIT           (u8_t)0x40U /* Segment was retransmitted */
+#if LWIP_TCP_RACK
+  u32_t xmit_ts;           /* TCP_NOW() when the segment was last sent */
+#endif /* LWIP_TCP_RACK */
+#if TCP_QUEUE_OOSEQ
+  struct tcp_seg *ooseq_left;  /* children in the pcb->ooseq_root tree, */
+  struct tcp_seg *ooseq_right; /* which is keyed by sequence number */
+  u8_t  ooseq_height;      /* height of the subtree rooted here */
+#endif /* TCP_QUEUE_OOSEQ */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -307,6 +366,8 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_NOP        1
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
+#define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
 
 #define LWIP_TCP_OPT_LEN_MSS    4
@@ -322,11 +383,22 @@ struct tcp_seg {
 #else
 #define LWIP_TCP_OPT_LEN_WS_OUT 0
 #endif
+#if LWIP_TCP_SACK
+#define LWIP_TCP_OPT_LEN_SACK_PERM     2
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 4 /* aligned for output (includes NOP padding) */
+/* SACK option with n blocks, aligned for output (includes NOP padding) */
+#define LWIP_TCP_OPT_LEN_SACK_OUT(n)   (4 + 8 * (n))
+/** Maximum number of SACK blocks in a segment (3 with the timestamp option) */
+#define LWIP_TCP_MAX_SACK_BLOCKS       4
+#else
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 0
+#endif
 
 #define LWIP_TCP_OPT_LENGTH(flags) \
   (flags & TF_SEG_OPTS_MSS       ? LWIP_TCP_OPT_LEN_MSS    : 0) + \
   (flags & TF_SEG_OPTS_TS        ? LWIP_TCP_OPT_LEN_TS_OUT : 0) + \
-  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0)
+  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0) + \
+  (flags & TF_SEG_OPTS_SACK_PERM ? LWIP_TCP_OPT_LEN_SACK_PERM_OUT : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -362,6 +434,49 @@ extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. *
 
 extern struct tcp_pcb *tcp_tmp_pcb;      /* Only used for temporary storage. */
 
+#if LWIP_TCP_PCB_HASH
+/* Hash tables mirroring tcp_active_pcbs, tcp_tw_pcbs and tcp_listen_pcbs.
+   They are maintained by TCP_REG/TCP_RMV and only used to speed up
+   tcp_input(); the lists above stay authoritative. */
+extern struct tcp_pcb *tcp_active_hash[TCP_PCB_HASH_SIZE];
+extern struct tcp_pcb *tcp_tw_hash[TCP_PCB_HASH_SIZE];
+extern union tcp_listen_pcbs_t tcp_listen_hash[TCP_PCB_LISTEN_HASH_SIZE];
+
+u16_t tcp_pcb_hash(const ip_addr_t *local_ip, u16_t local_port,
+                   const ip_addr_t *remote_ip, u16_t remote_port);
+#define TCP_PCB_LISTEN_HASH(port) ((port) & (TCP_PCB_LISTEN_HASH_SIZE - 1))
+void tcp_pcb_hash_reg(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+void tcp_pcb_hash_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+#define TCP_HASH_REG(pcbs, npcb) tcp_pcb_hash_reg(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb) tcp_pcb_hash_rmv(pcbs, npcb)
+#else /* LWIP_TCP_PCB_HASH */
+#define TCP_HASH_REG(pcbs, npcb)
+#define TCP_HASH_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_PCB_TIMERS
+/* Bits of pcb->tmr_flags */
+#define TCP_TIMERS_F_REG      0x01U /* in tcp_active_pcbs or tcp_tw_pcbs */
+#define TCP_TIMERS_F_DIRTY    0x04U /* tmr_dirty_next links into tcp_timers_dirty or tcp_timers_touched */
+
+/* Active and TIME-WAIT pcbs take part in the event-driven timers */
+void tcp_timers_reg(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+void tcp_timers_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+#define TCP_TIMERS_REG(pcbs, npcb) tcp_timers_reg(pcbs, npcb)
+#define TCP_TIMERS_RMV(pcbs, npcb) tcp_timers_rmv(pcbs, npcb)
+#else /* LWIP_TCP_PCB_TIMERS */
+#define TCP_TIMERS_REG(pcbs, npcb)
+#define TCP_TIMERS_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_PCB_TIMERS */
+
+#if LWIP_TCP_RTT_MS
+/* Active pcbs leave the wheel of retransmission deadlines when removed */
+void tcp_rto_rmv(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
+#define TCP_RTO_RMV(pcbs, npcb) tcp_rto_rmv(pcbs, npcb)
+#else /* LWIP_TCP_RTT_MS */
+#define TCP_RTO_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_RTT_MS */
+
 /* Axioms about the above lists:   
    1) Every TCP PCB that is not CLOSED is in one of the lists.
    2) A PCB is only in one of the lists.
@@ -385,6 +500,8 @@ extern struct tcp_pcb *tcp_tmp_pcb;      /* Only used for temporary storage. */
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_HASH_REG(pcbs, npcb); \
+                            TCP_TIMERS_REG(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -400,6 +517,9 @@ extern struct tcp_pcb *tcp_tmp_pcb;      /* Only used for temporary storage. */
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_HASH_RMV(pcbs, npcb); \
+                            TCP_TIMERS_RMV(pcbs, npcb); \
+                            TCP_RTO_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (npcb), *(pcbs))); \
                             } while(0)
@@ -410,6 +530,8 @@ extern struct tcp_pcb *tcp_tmp_pcb;      /* Only used for temporary storage. */
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_HASH_REG(pcbs, npcb);                      \
+    TCP_TIMERS_REG(pcbs, npcb);                    \
     tcp_timer_needed();                            \
   } while (0)
 
@@ -429,6 +551,9 @@ extern struct tcp_pcb *tcp_tmp_pcb;      /* Only used for temporary storage. */
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_HASH_RMV(pcbs, npcb);                      \
+    TCP_TIMERS_RMV(pcbs, npcb);                    \
+    TCP_RTO_RMV(pcbs, npcb);                       \
   } while(0)
 
 #endif /* LWIP_DEBUG */
@@ -460,6 +585,9 @@ void tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
 void tcp_segs_free(struct tcp_seg *seg);
 void tcp_seg_free(struct tcp_seg *seg);
 struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
+#if TCP_QUEUE_OOSEQ
+void tcp_ooseq_free(struct tcp_pcb *pcb);
+#endif /* TCP_QUEUE_OOSEQ */
 
 #define tcp_ack(pcb)                               \
   do {                                             \
@@ -532,6 +660,12 @@ s16_t tcp_pcbs_sane(void);
  * that a timer is needed (i.e. active- or time-wait-pcb found). */
 void tcp_timer_needed(void);
 
+#if LWIP_TCP_RTT_MS
+/** External function (implemented in timers.c), called when a retransmission
+ * timer is started: tcp_rto_tmr() has to run at TCP_NOW() 'due' or earlier. */
+void tcp_rto_timer_needed(u32_t due);
+#endif /* LWIP_TCP_RTT_MS */
+
 #if LWIP_IPV4
 void tcp_netif_ipv4_addr_changed(const ip4_addr_t* old_addr, const ip4_addr_t* new_addr);
 #endif /* LWIP_IPV4 */
@@ -56,10 +56,9 @@ extern "C" {
 #endif
 
 #if LWIP_TCPIP_CORE_LOCKING
-/** The global semaphore to lock the stack. */
-extern sys_mutex_t lock_tcpip_core;
-#define LOCK_TCPIP_CORE()     sys_mutex_lock(&lock_tcpip_core)
-#define UNLOCK_TCPIP_CORE()   sys_mutex_unlock(&lock_tcpip_core)
+/** The global lock of the stack, see tcpip_core_lock() */
+#define LOCK_TCPIP_CORE()     tcpip_core_lock()
+#define UNLOCK_TCPIP_CORE()   tcpip_core_unlock()
 #ifdef LWIP_DEBUG
 #define TCIP_APIMSG_SET_ERR(m, e) (m)->msg.err = e  /* catch functions that don't set err */
 #else
@@ -141,6 +140,11 @@ void tcpip_init(tcpip_init_done_fn tcpip_init_done, void *arg);
 err_t tcpip_apimsg(struct api_msg *apimsg);
 #endif /* LWIP_NETCONN || LWIP_SOCKET */
 
+#if LWIP_TCPIP_CORE_LOCKING
+void tcpip_core_lock(void);
+void tcpip_core_unlock(void);
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
 err_t tcpip_input(struct pbuf *p, struct netif *inp);
 
 #if PPPOS_SUPPORT && !PPP_INPROC_IRQ_SAFE
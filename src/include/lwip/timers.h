@@ -41,6 +41,9 @@
 #if LWIP_TIMERS
 
 #include "lwip/err.h"
+#if LWIP_TIMERS_WHEEL
+#include "lwip/wheel.h"
+#endif /* LWIP_TIMERS_WHEEL */
 #if !NO_SYS
 #include "lwip/sys.h"
 #endif
@@ -65,8 +68,17 @@ extern "C" {
 typedef void (* sys_timeout_handler)(void *arg);
 
 struct sys_timeo {
+#if LWIP_TIMERS_WHEEL
+  /** wheel linkage, node.due is the expiry time in wheel ticks */
+  struct wheel_node node;
+  /** chains timeouts hashing to the same handler/arg bucket */
+  struct sys_timeo *hash_next;
+  struct sys_timeo **hash_pprev;
+#else /* LWIP_TIMERS_WHEEL */
   struct sys_timeo *next;
+  /** delta to the previous timeout */
   u32_t time;
+#endif /* LWIP_TIMERS_WHEEL */
   sys_timeout_handler h;
   void *arg;
 #if LWIP_DEBUG_TIMERNAMES
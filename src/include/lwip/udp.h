@@ -68,6 +68,8 @@ PACK_STRUCT_END
 #define UDP_FLAGS_UDPLITE        0x02U
 #define UDP_FLAGS_CONNECTED      0x04U
 #define UDP_FLAGS_MULTICAST_LOOP 0x08U
+#define UDP_FLAGS_REUSEPORT      0x10U
+#define UDP_FLAGS_CHKSUM_RX      0x20U
 
 struct udp_pcb;
 
@@ -95,6 +97,10 @@ struct udp_pcb {
 /* Protocol specific PCB members */
 
   struct udp_pcb *next;
+#if LWIP_UDP_PCB_HASH
+  /** chains pcbs with the same local port hash */
+  struct udp_pcb *hash_next;
+#endif /* LWIP_UDP_PCB_HASH */
 
   u8_t flags;
   /** ports are in host byte order */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_HDR_WHEEL_H
+#define LWIP_HDR_WHEEL_H
+
+#include "lwip/opt.h"
+
+/* The timing wheel is used by the sys_timeout() wheel, the event-driven TCP
+   timers and the TCP retransmission timers */
+#define LWIP_WHEEL (LWIP_TIMERS_WHEEL || (LWIP_TCP && (LWIP_TCP_PCB_TIMERS || LWIP_TCP_RTT_MS)))
+
+#if LWIP_WHEEL
+
+#include "lwip/def.h"
+
+#include <stddef.h> /* for offsetof */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Each wheel level has 2^WHEEL_BITS slots, level 0 slots are 1 tick wide,
+ * level n slots cover 2^(n*WHEEL_BITS) ticks. Deadlines beyond the span of
+ * the top level are parked in it and re-cascaded. */
+#define WHEEL_BITS            6
+#define WHEEL_SLOTS           (1 << WHEEL_BITS)
+#define WHEEL_MASK            (WHEEL_SLOTS - 1)
+
+/** Tick a is before tick b (wrap-around safe) */
+#define WHEEL_TIME_LESS(a, b) ((s32_t)((u32_t)(a) - (u32_t)(b)) < 0)
+
+/** Get the struct of type 'type' a wheel_node is embedded in as 'member' */
+#define WHEEL_ENTRY(node, type, member) \
+  ((type *)(void *)((u8_t *)(node) - offsetof(type, member)))
+
+/** Linkage of a deadline into a wheel, embedded in the struct it is for */
+struct wheel_node {
+  struct wheel_node *next;
+  /** points to the 'next' pointer referencing this node (O(1) unlink),
+   *  NULL while the node is not linked */
+  struct wheel_node **pprev;
+  /** deadline in wheel ticks */
+  u32_t due;
+  /** wheel level this node is linked into (levels: on the expired list) */
+  u8_t level;
+};
+
+struct wheel {
+  /** 'levels' arrays of WHEEL_SLOTS slots */
+  struct wheel_node *(*slots)[WHEEL_SLOTS];
+  /** Number of nodes linked into each level */
+  u32_t *level_cnt;
+  /** Nodes due in the tick processed last (see wheel_advance()) */
+  struct wheel_node *expired;
+  /** Number of nodes linked into the wheel or the expired list */
+  u32_t pending;
+  /** The next tick to process: all ticks before this one have been handled */
+  u32_t time;
+  u8_t levels;
+};
+
+/** Define a static wheel 'name' of 'levels' levels and its slots */
+#define WHEEL_DECLARE(name, levels) \
+  static struct wheel_node *name##_slots[levels][WHEEL_SLOTS]; \
+  static u32_t name##_level_cnt[levels]; \
+  static struct wheel name = { name##_slots, name##_level_cnt, NULL, 0, 0, levels }
+
+/** The node is linked into the wheel or its expired list */
+#define wheel_node_linked(node) ((node)->pprev != NULL)
+
+void wheel_sync(struct wheel *w, u32_t now);
+void wheel_insert(struct wheel *w, struct wheel_node *node);
+void wheel_remove(struct wheel *w, struct wheel_node *node);
+u8_t wheel_advance(struct wheel *w, u32_t now);
+u32_t wheel_next(const struct wheel *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_WHEEL */
+
+#endif /* LWIP_HDR_WHEEL_H */
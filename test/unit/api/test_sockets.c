@@ -0,0 +1,1575 @@
+#include "test_sockets.h"
+
+#include "lwip/sockets.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/stats.h"
+#include "lwip/tcp_impl.h"
+
+#include <time.h>
+
+#if LWIP_SOCKET
+
+/* the tests run against the loopback netif, with the stack in the tcpip thread */
+#if !LWIP_HAVE_LOOPIF || !LWIP_STATS || !UDP_STATS
+#error "This tests needs the loopback netif and UDP statistics"
+#endif
+
+#define SOCKETS_TEST_PORT   7000
+#define SOCKETS_HELD_MAX    32
+#define SOCKETS_MMSG_COUNT  (LWIP_SOCKET_MMSG_BATCH + 4)
+#define SOCKETS_BENCH_CALLS 20000
+
+/* test_sockets_tcp_lend_release sends 2000 bytes */
+static u8_t sockets_data[2000];
+
+/* Helper functions */
+
+static void
+sockets_init_done(void *arg)
+{
+  sys_sem_signal((sys_sem_t*)arg);
+}
+
+/** Wait until the tcpip thread has processed everything posted before */
+static void
+sockets_sync(void)
+{
+  sys_sem_t sem;
+  err_t err;
+  EXPECT_RET(sys_sem_new(&sem, 0) == ERR_OK);
+  err = tcpip_callback(sockets_init_done, &sem);
+  EXPECT(err == ERR_OK);
+  if (err == ERR_OK) {
+    sys_arch_sem_wait(&sem, 0);
+  }
+  sys_sem_free(&sem);
+}
+
+static struct sockaddr_in
+sockets_addr(u16_t port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = lwip_htons(port);
+  addr.sin_addr.s_addr = lwip_htonl(INADDR_LOOPBACK);
+  return addr;
+}
+
+static int
+sockets_udp_bound(u16_t port)
+{
+  struct sockaddr_in addr = sockets_addr(port);
+  int s = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  EXPECT_RETX(s >= 0, -1);
+  EXPECT(lwip_bind(s, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  return s;
+}
+
+/** Pass an IPv4/UDP datagram 127.0.0.1:9 -> 127.0.0.1:dport carrying 'len'
+    bytes of sockets_data (from 'offset') to tcpip_input, chained in pbufs of
+    at most 'split' bytes. 'corrupt' flips a payload bit after the checksum
+    has been calculated. */
+static void
+sockets_inject_udp(u16_t dport, u16_t offset, u16_t len, u16_t split, int corrupt)
+{
+  struct pbuf *p, *q;
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  ip4_addr_t addr;
+  u16_t off, n;
+
+  IP4_ADDR(&addr, 127, 0, 0, 1);
+  n = LWIP_MIN(len, split);
+  p = pbuf_alloc(PBUF_RAW, IP_HLEN + UDP_HLEN + n, PBUF_RAM);
+  EXPECT_RET(p != NULL);
+  memcpy((u8_t*)p->payload + IP_HLEN + UDP_HLEN, sockets_data + offset, n);
+  for (off = n; off < len; off = (u16_t)(off + n)) {
+    n = LWIP_MIN((u16_t)(len - off), split);
+    q = pbuf_alloc(PBUF_RAW, n, PBUF_RAM);
+    EXPECT_RET(q != NULL);
+    memcpy(q->payload, sockets_data + offset + off, n);
+    pbuf_cat(p, q);
+  }
+
+  pbuf_header(p, -IP_HLEN);
+  udphdr = (struct udp_hdr*)p->payload;
+  udphdr->src = lwip_htons(9);
+  udphdr->dest = lwip_htons(dport);
+  udphdr->len = lwip_htons(p->tot_len);
+  udphdr->chksum = 0;
+  udphdr->chksum = inet_chksum_pseudo(p, IP_PROTO_UDP, p->tot_len, &addr, &addr);
+  if (corrupt) {
+    ((u8_t*)p->payload)[UDP_HLEN + 1] ^= 0x10;
+  }
+
+  pbuf_header(p, IP_HLEN);
+  iphdr = (struct ip_hdr*)p->payload;
+  memset(iphdr, 0, IP_HLEN);
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_LEN_SET(iphdr, lwip_htons(p->tot_len));
+  IPH_TTL_SET(iphdr, 64);
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  ip4_addr_copy(iphdr->src, addr);
+  ip4_addr_copy(iphdr->dest, addr);
+  IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+
+  EXPECT(tcpip_input(p, netif_list) == ERR_OK);
+}
+
+static double
+sockets_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+#if LWIP_TCPIP_CORE_LOCKING
+static void
+sockets_bench_count(void *arg)
+{
+  (*(int*)arg)++;
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
+/** Connect a TCP socket pair over the loopback netif, the accepted socket
+    has local port 'port' */
+static int
+sockets_tcp_pair(u16_t port, int *client, int *server)
+{
+  struct sockaddr_in addr = sockets_addr(port);
+  int l = lwip_socket(AF_INET, SOCK_STREAM, 0);
+  int ret;
+  EXPECT_RETX(l >= 0, -1);
+  EXPECT(lwip_bind(l, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  EXPECT(lwip_listen(l, 1) == 0);
+  *client = lwip_socket(AF_INET, SOCK_STREAM, 0);
+  EXPECT_RETX(*client >= 0, -1);
+  ret = lwip_connect(*client, (struct sockaddr*)&addr, sizeof(addr));
+  EXPECT_RETX(ret == 0, -1);
+  *server = lwip_accept(l, NULL, NULL);
+  EXPECT_RETX(*server >= 0, -1);
+  EXPECT(lwip_close(l) == 0);
+  return 0;
+}
+
+/* Holding back the TCP segments sent from one port: LWIP_HOOK_IP4_INPUT
+   keeps them from the tcpip thread until they are released */
+static u16_t sockets_hold_port;
+static struct pbuf *sockets_held[SOCKETS_HELD_MAX];
+static int sockets_held_count;
+
+int
+test_sockets_ip4_input(struct pbuf *p, struct netif *inp)
+{
+  struct ip_hdr *iphdr = (struct ip_hdr*)p->payload;
+  LWIP_UNUSED_ARG(inp);
+  if ((sockets_hold_port != 0) && (IPH_PROTO(iphdr) == IP_PROTO_TCP) &&
+      (sockets_held_count < SOCKETS_HELD_MAX)) {
+    struct tcp_hdr *tcphdr = (struct tcp_hdr*)((u8_t*)p->payload + IPH_HL(iphdr) * 4);
+    if (tcphdr->src == lwip_htons(sockets_hold_port)) {
+      sockets_held[sockets_held_count++] = p;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+sockets_hold_start(void *arg)
+{
+  sockets_hold_port = (u16_t)(size_t)arg;
+}
+
+/** Stop holding segments: 'arg' != NULL passes the held segments on in
+    order, otherwise they are dropped */
+static void
+sockets_hold_stop(void *arg)
+{
+  int i;
+  sockets_hold_port = 0;
+  for (i = 0; i < sockets_held_count; i++) {
+    if ((arg == NULL) || (ip_input(sockets_held[i], netif_list) != ERR_OK)) {
+      pbuf_free(sockets_held[i]);
+    }
+  }
+  sockets_held_count = 0;
+}
+
+static void
+sockets_held_wnd_get(void *arg)
+{
+  struct pbuf *p = sockets_held[sockets_held_count - 1];
+  struct ip_hdr *iphdr = (struct ip_hdr*)p->payload;
+  struct tcp_hdr *tcphdr = (struct tcp_hdr*)((u8_t*)p->payload + IPH_HL(iphdr) * 4);
+  *(u16_t*)arg = lwip_ntohs(tcphdr->wnd);
+}
+
+/** The window advertised by the last segment held back, 0 if none */
+static u16_t
+sockets_held_wnd(void)
+{
+  u16_t wnd = 0;
+  sockets_sync();
+  if (sockets_held_count > 0) {
+    EXPECT(tcpip_callback(sockets_held_wnd_get, &wnd) == ERR_OK);
+    sockets_sync();
+  }
+  return wnd;
+}
+
+/* The data segments among the segments held back */
+struct sockets_held_segs {
+  int num;    /* number of segments with data */
+  int bytes;  /* data bytes in them */
+  u32_t psh;  /* bit i is set if segment i has the PSH flag */
+};
+
+static void
+sockets_held_segs_get(void *arg)
+{
+  struct sockets_held_segs *h = (struct sockets_held_segs*)arg;
+  int i, len;
+  memset(h, 0, sizeof(*h));
+  for (i = 0; i < sockets_held_count; i++) {
+    struct ip_hdr *iphdr = (struct ip_hdr*)sockets_held[i]->payload;
+    struct tcp_hdr *tcphdr = (struct tcp_hdr*)((u8_t*)iphdr + IPH_HL(iphdr) * 4);
+    len = lwip_ntohs(IPH_LEN(iphdr)) - IPH_HL(iphdr) * 4 - TCPH_HDRLEN(tcphdr) * 4;
+    if (len > 0) {
+      if (TCPH_FLAGS(tcphdr) & TCP_PSH) {
+        h->psh |= 1UL << h->num;
+      }
+      h->num++;
+      h->bytes += len;
+    }
+  }
+}
+
+static void
+sockets_held_segs(struct sockets_held_segs *h)
+{
+  sockets_sync();
+  EXPECT(tcpip_callback(sockets_held_segs_get, h) == ERR_OK);
+  sockets_sync();
+}
+
+/** Hold back the segments sent from 'port' until sockets_release() */
+static void
+sockets_hold(u16_t port)
+{
+  EXPECT(tcpip_callback(sockets_hold_start, (void*)(size_t)port) == ERR_OK);
+  sockets_sync();
+}
+
+static void
+sockets_release(int pass)
+{
+  EXPECT(tcpip_callback(sockets_hold_stop, pass ? (void*)1 : NULL) == ERR_OK);
+  sockets_sync();
+}
+
+/** Read 'len' bytes from a TCP socket with lwip_readv() (into 10 bytes, an
+    empty vector and the rest) and compare them to 'expected' */
+static void
+sockets_tcp_readv_expect(int s, const u8_t *expected, int len)
+{
+  static u8_t buf[4 * sizeof(sockets_data) + 100];
+  struct iovec iov[3];
+  int i, ret, got = 0;
+  EXPECT_RET(len <= (int)sizeof(buf));
+  for (i = 0; (i < 100) && (got < len); i++) {
+    iov[0].iov_base = buf + got;
+    iov[0].iov_len = LWIP_MIN(10, len - got);
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = buf + got + iov[0].iov_len;
+    iov[2].iov_len = len - got - iov[0].iov_len;
+    ret = lwip_readv(s, iov, 3);
+    EXPECT_RET(ret > 0);
+    got += ret;
+  }
+  EXPECT(got == len);
+  EXPECT(memcmp(buf, expected, len) == 0);
+}
+
+/* The timers of the active pcbs connecting ports [port, port + num) */
+struct sockets_tcp_timers {
+  u16_t port, num;
+  int pcbs;       /* pcbs found */
+  int polled;     /* ... with a poll callback */
+  int scheduled;  /* ... with a deadline on the LWIP_TCP_PCB_TIMERS wheel */
+};
+
+static void
+sockets_tcp_timers_get(void *arg)
+{
+  struct sockets_tcp_timers *t = (struct sockets_tcp_timers*)arg;
+  struct tcp_pcb *pcb;
+  t->pcbs = t->polled = t->scheduled = 0;
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if (((u16_t)(pcb->local_port - t->port) < t->num) ||
+        ((u16_t)(pcb->remote_port - t->port) < t->num)) {
+      t->pcbs++;
+      if (pcb->poll != NULL) {
+        t->polled++;
+      }
+#if LWIP_TCP_PCB_TIMERS
+      if (wheel_node_linked(&pcb->tmr_node)) {
+        t->scheduled++;
+      }
+#endif /* LWIP_TCP_PCB_TIMERS */
+    }
+  }
+}
+
+static void
+sockets_tcp_timers(struct sockets_tcp_timers *t)
+{
+  EXPECT(tcpip_callback(sockets_tcp_timers_get, t) == ERR_OK);
+  sockets_sync();
+}
+
+#if LWIP_SO_ZEROCOPY
+struct sockets_zc_done {
+  volatile int calls;
+  volatile u32_t next;
+  volatile int err;
+};
+
+/** Counts the completed sends in 'next', they must complete in order */
+static void
+sockets_zerocopy_done(int s, u32_t lo, u32_t hi, int err, void *arg)
+{
+  struct sockets_zc_done *done = (struct sockets_zc_done*)arg;
+  LWIP_UNUSED_ARG(s);
+  EXPECT(lo == done->next);
+  EXPECT(hi >= lo);
+  done->next = hi + 1;
+  done->err = err;
+  done->calls++;
+}
+
+/** Wait up to a second until the first 'count' sends have completed */
+static void
+sockets_zerocopy_wait(struct sockets_zc_done *done, u32_t count)
+{
+  int i;
+  for (i = 0; (i < 100) && (done->next < count); i++) {
+    sys_msleep(10);
+  }
+}
+#endif /* LWIP_SO_ZEROCOPY */
+
+/* A task blocking in lwip_select() or lwip_poll() for reading one socket */
+struct sockets_select_waiter {
+  int s;
+  int use_poll;
+  int ret;
+  int readable;
+  sys_sem_t done;
+};
+
+static void
+sockets_select_waiter(void *arg)
+{
+  struct sockets_select_waiter *w = (struct sockets_select_waiter*)arg;
+#if LWIP_SOCKET_POLL
+  if (w->use_poll) {
+    struct pollfd pfd;
+    pfd.fd = w->s;
+    pfd.events = POLLIN;
+    w->ret = lwip_poll(&pfd, 1, 5000);
+    w->readable = (pfd.revents == POLLIN);
+  } else
+#endif /* LWIP_SOCKET_POLL */
+  {
+    fd_set readset;
+    struct timeval tv;
+    FD_ZERO(&readset);
+    FD_SET(w->s, &readset);
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+    w->ret = lwip_select(w->s + 1, &readset, NULL, NULL, &tv);
+    w->readable = FD_ISSET(w->s, &readset) ? 1 : 0;
+  }
+  sys_sem_signal(&w->done);
+}
+
+#if LWIP_TCPIP_CORE_LOCKING
+#define SOCKETS_LOCK_THREADS 3
+
+/* Threads contending for the core lock record the order they get it in */
+struct sockets_lock_thread {
+  int id;
+  sys_sem_t done;
+};
+static int sockets_lock_order[SOCKETS_LOCK_THREADS];
+static int sockets_lock_cnt;
+
+static void
+sockets_lock_thread(void *arg)
+{
+  struct sockets_lock_thread *t = (struct sockets_lock_thread*)arg;
+  LOCK_TCPIP_CORE();
+  sockets_lock_order[sockets_lock_cnt++] = t->id;
+  UNLOCK_TCPIP_CORE();
+  sys_sem_signal(&t->done);
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
+#if LWIP_SOCKET_EPOLL
+/* A task blocking in lwip_epoll_wait() */
+struct sockets_epoll_waiter {
+  int epfd;
+  int ret;
+  struct lwip_epoll_event ev;
+  sys_sem_t done;
+};
+
+static void
+sockets_epoll_waiter(void *arg)
+{
+  struct sockets_epoll_waiter *w = (struct sockets_epoll_waiter*)arg;
+  w->ret = lwip_epoll_wait(w->epfd, &w->ev, 1, 5000);
+  sys_sem_signal(&w->done);
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
+#endif /* LWIP_SOCKET */
+
+/* Setups/teardown functions */
+
+static void
+sockets_setup(void)
+{
+#if LWIP_SOCKET
+  static int initialized;
+  size_t i;
+  if (!initialized) {
+    sys_sem_t sem;
+    initialized = 1;
+    EXPECT_RET(sys_sem_new(&sem, 0) == ERR_OK);
+    tcpip_init(sockets_init_done, &sem);
+    sys_arch_sem_wait(&sem, 0);
+    sys_sem_free(&sem);
+  }
+  for (i = 0; i < sizeof(sockets_data); i++) {
+    sockets_data[i] = (u8_t)(i * 7 + (i >> 8));
+  }
+#endif /* LWIP_SOCKET */
+}
+
+static void
+sockets_teardown(void)
+{
+}
+
+
+/* Test functions */
+
+/** A UDP datagram with a wrong checksum is dropped by every receive function
+    when the check is deferred to the copy (LWIP_CHECKSUM_ON_COPY_RX), and the
+    next (valid) datagram is received in its place */
+START_TEST(test_sockets_udp_deferred_chksum)
+{
+#if LWIP_SOCKET && LWIP_CHECKSUM_ON_COPY_RX
+  u8_t buf[1500];
+  u16_t chkerr;
+  int s, i, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  s = sockets_udp_bound(SOCKETS_TEST_PORT);
+  EXPECT_RET(s >= 0);
+
+  for (i = 0; i < 3; i++) {
+    /* a bad datagram in front of a good one, both chained */
+    chkerr = lwip_stats.udp.chkerr;
+    sockets_inject_udp(SOCKETS_TEST_PORT, 0, 1018, 100, 1);
+    sockets_inject_udp(SOCKETS_TEST_PORT, 10, 1018, 100, 0);
+    memset(buf, 0, sizeof(buf));
+    if (i == 0) {
+      ret = lwip_recvfrom(s, buf, sizeof(buf), 0, NULL, NULL);
+      EXPECT(ret == 1018);
+      EXPECT(memcmp(buf, sockets_data + 10, 1018) == 0);
+    } else if (i == 1) {
+      struct iovec iov[2];
+      struct msghdr msg;
+      iov[0].iov_base = buf;
+      iov[0].iov_len = 3;
+      iov[1].iov_base = buf + 3;
+      iov[1].iov_len = sizeof(buf) - 3;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = 2;
+      ret = lwip_recvmsg(s, &msg, 0);
+      EXPECT(ret == 1018);
+      EXPECT(msg.msg_flags == 0);
+      EXPECT(memcmp(buf, sockets_data + 10, 1018) == 0);
+    } else {
+#if LWIP_SOCKET_RECV_ZEROCOPY
+      struct iovec iov[16];
+      struct lwip_recv_loan loan;
+      int iovcnt = 16, j, off = 0;
+      ret = lwip_recv_lend(s, iov, &iovcnt, 0, &loan);
+      EXPECT(ret == 1018);
+      for (j = 0; j < iovcnt; j++) {
+        EXPECT(memcmp(iov[j].iov_base, sockets_data + 10 + off, iov[j].iov_len) == 0);
+        off += (int)iov[j].iov_len;
+      }
+      EXPECT(off == 1018);
+      EXPECT(lwip_recv_release(s, &loan) == 0);
+#endif /* LWIP_SOCKET_RECV_ZEROCOPY */
+    }
+    EXPECT(lwip_stats.udp.chkerr == chkerr + 1);
+  }
+
+  /* a bad datagram alone: dropped, nothing to read */
+  chkerr = lwip_stats.udp.chkerr;
+  sockets_inject_udp(SOCKETS_TEST_PORT, 0, 500, 500, 1);
+  sockets_sync();
+  ret = lwip_recv(s, buf, sizeof(buf), MSG_DONTWAIT);
+  EXPECT(ret == -1);
+  EXPECT(errno == EWOULDBLOCK);
+  EXPECT(lwip_stats.udp.chkerr == chkerr + 1);
+
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_CHECKSUM_ON_COPY_RX */
+}
+END_TEST
+
+/** recvmsg scatters a datagram larger than its buffers as far as they go,
+    sets MSG_TRUNC and drops the rest */
+START_TEST(test_sockets_udp_recvmsg_trunc)
+{
+#if LWIP_SOCKET
+  u8_t buf[3][400];
+  struct iovec iov[3];
+  struct msghdr msg;
+  struct sockaddr_in from;
+  int s, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  s = sockets_udp_bound(SOCKETS_TEST_PORT + 4);
+  EXPECT_RET(s >= 0);
+
+  /* 1000 bytes into 100 + 0 + 300 bytes */
+  sockets_inject_udp(SOCKETS_TEST_PORT + 4, 0, 1000, 128, 0);
+  sockets_inject_udp(SOCKETS_TEST_PORT + 4, 20, 400, 128, 0);
+  memset(buf, 0xee, sizeof(buf));
+  iov[0].iov_base = buf[0];
+  iov[0].iov_len = 100;
+  iov[1].iov_base = buf[1];
+  iov[1].iov_len = 0;
+  iov[2].iov_base = buf[2];
+  iov[2].iov_len = 300;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &from;
+  msg.msg_namelen = sizeof(from);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 3;
+  ret = lwip_recvmsg(s, &msg, MSG_PEEK);
+  EXPECT(ret == 400);
+  EXPECT(msg.msg_flags == MSG_TRUNC);
+  ret = lwip_recvmsg(s, &msg, 0);
+  EXPECT(ret == 400);
+  EXPECT(msg.msg_flags == MSG_TRUNC);
+  EXPECT(msg.msg_namelen == sizeof(from));
+  EXPECT(from.sin_port == lwip_htons(9));
+  EXPECT(memcmp(buf[0], sockets_data, 100) == 0);
+  EXPECT(buf[0][100] == 0xee);
+  EXPECT(buf[1][0] == 0xee);
+  EXPECT(memcmp(buf[2], sockets_data + 100, 300) == 0);
+  EXPECT(buf[2][300] == 0xee);
+
+  /* the rest is gone, the next datagram fits exactly */
+  memset(buf, 0xee, sizeof(buf));
+  ret = lwip_recvmsg(s, &msg, 0);
+  EXPECT(ret == 400);
+  EXPECT(msg.msg_flags == 0);
+  EXPECT(memcmp(buf[0], sockets_data + 20, 100) == 0);
+  EXPECT(memcmp(buf[2], sockets_data + 120, 300) == 0);
+  EXPECT(lwip_recv(s, buf[0], sizeof(buf[0]), MSG_DONTWAIT) == -1);
+  EXPECT(errno == EWOULDBLOCK);
+
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** lwip_sendmmsg returns the number of datagrams sent before an invalid one
+    (also in a later batch), lwip_recvmmsg returns the datagrams queued */
+START_TEST(test_sockets_udp_mmsg_partial)
+{
+#if LWIP_SOCKET
+  struct mmsghdr msgs[SOCKETS_MMSG_COUNT];
+  struct iovec iov[SOCKETS_MMSG_COUNT][2];
+  u8_t buf[4][64];
+  struct sockaddr_in to = sockets_addr(SOCKETS_TEST_PORT + 5);
+  int s, r, ret;
+  unsigned int i, bad = LWIP_SOCKET_MMSG_BATCH + 1;
+  LWIP_UNUSED_ARG(_i);
+
+  r = sockets_udp_bound(SOCKETS_TEST_PORT + 5);
+  EXPECT_RET(r >= 0);
+  s = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  EXPECT_RET(s >= 0);
+
+  /* datagram i has 10 + i bytes, one past the first batch is too long */
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < SOCKETS_MMSG_COUNT; i++) {
+    iov[i][0].iov_base = sockets_data + i;
+    iov[i][0].iov_len = 10 + i;
+    iov[i][1].iov_base = sockets_data;
+    iov[i][1].iov_len = (i == bad) ? 0xffff : 0;
+    msgs[i].msg_hdr.msg_name = &to;
+    msgs[i].msg_hdr.msg_namelen = sizeof(to);
+    msgs[i].msg_hdr.msg_iov = iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 2;
+    msgs[i].msg_len = 0xdead;
+  }
+  ret = lwip_sendmmsg(s, msgs, SOCKETS_MMSG_COUNT, 0);
+  EXPECT(ret == (int)bad);
+  for (i = 0; i < bad; i++) {
+    EXPECT(msgs[i].msg_len == 10 + i);
+  }
+  EXPECT(msgs[bad].msg_len == 0xdead);
+  /* starting at the invalid one: nothing sent */
+  ret = lwip_sendmmsg(s, &msgs[bad], SOCKETS_MMSG_COUNT - bad, 0);
+  EXPECT(ret == -1);
+  EXPECT(errno == EMSGSIZE);
+
+  /* receive them 4 at a time: the last call gets what is left */
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < 4; i++) {
+    iov[i][0].iov_base = buf[i];
+    iov[i][0].iov_len = sizeof(buf[i]);
+    msgs[i].msg_hdr.msg_iov = iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  sockets_sync();
+  for (i = 0; i < bad; i += (unsigned int)ret) {
+    unsigned int j;
+    ret = lwip_recvmmsg(r, msgs, 4, 0);
+    EXPECT_RET(ret == (int)LWIP_MIN(4, bad - i));
+    for (j = 0; j < (unsigned int)ret; j++) {
+      EXPECT(msgs[j].msg_len == 10 + i + j);
+      EXPECT(memcmp(buf[j], sockets_data + i + j, 10 + i + j) == 0);
+    }
+  }
+  ret = lwip_recvmmsg(r, msgs, 4, MSG_DONTWAIT);
+  EXPECT(ret == -1);
+  EXPECT(errno == EWOULDBLOCK);
+
+  EXPECT(lwip_close(s) == 0);
+  EXPECT(lwip_close(r) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** Data lent by lwip_recv_lend() keeps the TCP window closed until it is
+    released, and loans are only taken back once and in order */
+START_TEST(test_sockets_tcp_lend_release)
+{
+#if LWIP_SOCKET && LWIP_SOCKET_RECV_ZEROCOPY
+  struct lwip_recv_loan loans[8], copy;
+  struct iovec iov;
+  int c, s, i, n, len, ret, one = 1;
+  LWIP_UNUSED_ARG(_i);
+
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 3, &c, &s);
+  EXPECT_RET(ret == 0);
+  EXPECT(lwip_setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == 0);
+
+  /* lend 2000 bytes in pbufs of at most one segment */
+  sockets_hold(SOCKETS_TEST_PORT + 3);
+  EXPECT(lwip_send(c, sockets_data, 1000, 0) == 1000);
+  EXPECT(lwip_send(c, sockets_data + 1000, 1000, 0) == 1000);
+  for (n = 0, len = 0; (len < 2000) && (n < 8); n++) {
+    i = 1;
+    ret = lwip_recv_lend(s, &iov, &i, 0, &loans[n]);
+    EXPECT_RET(ret > 0);
+    EXPECT(memcmp(iov.iov_base, sockets_data + len, ret) == 0);
+    len += ret;
+  }
+  EXPECT_RET((len == 2000) && (n >= 2));
+
+  /* after the delayed ACK, the window is still reduced by the lent data */
+  sys_msleep(2 * TCP_TMR_INTERVAL);
+  EXPECT(sockets_held_wnd() == TCP_WND - 2000);
+
+  /* out of order: rejected, the window stays closed */
+  EXPECT(lwip_recv_release(s, &loans[1]) == -1);
+  EXPECT(errno == EINVAL);
+  EXPECT(loans[1].p != NULL);
+  EXPECT(sockets_held_wnd() == TCP_WND - 2000);
+
+  /* in order: the window is re-advertised (the last update may leave out
+     less than TCP_WND_UPDATE_THRESHOLD) */
+  copy = loans[0];
+  for (i = 0; i < n; i++) {
+    EXPECT(lwip_recv_release(s, &loans[i]) == 0);
+    EXPECT(loans[i].p == NULL);
+  }
+  EXPECT(sockets_held_wnd() > TCP_WND - TCP_WND_UPDATE_THRESHOLD);
+
+  /* twice: rejected, also through a copy of the loan */
+  EXPECT(lwip_recv_release(s, &loans[0]) == -1);
+  EXPECT(errno == EINVAL);
+  EXPECT(lwip_recv_release(s, &copy) == -1);
+  EXPECT(errno == EINVAL);
+
+  sockets_release(1);
+  EXPECT(lwip_close(s) == 0);
+  EXPECT(lwip_close(c) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SOCKET_RECV_ZEROCOPY */
+}
+END_TEST
+
+/** Benchmark: the round trip of a call into the stack, posted to the tcpip
+    thread's mailbox (as netconn calls are without LWIP_TCPIP_CORE_LOCKING)
+    or run under the core lock, and of lwip_getsockname() (one netconn call)
+    as configured. Prints ns per call. */
+START_TEST(test_sockets_dispatch_latency)
+{
+#if LWIP_SOCKET
+  struct sockaddr_in addr;
+  socklen_t addrlen;
+  sys_sem_t sem;
+  double start, mbox_ns, call_ns;
+#if LWIP_TCPIP_CORE_LOCKING
+  double lock_ns;
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+  int s, i;
+#if LWIP_TCPIP_CORE_LOCKING && SYS_STATS
+  STAT_COUNTER acquired = lwip_stats.sys.core_lock.acquired;
+#endif /* LWIP_TCPIP_CORE_LOCKING && SYS_STATS */
+  LWIP_UNUSED_ARG(_i);
+
+  EXPECT_RET(sys_sem_new(&sem, 0) == ERR_OK);
+  start = sockets_ns();
+  for (i = 0; i < SOCKETS_BENCH_CALLS; i++) {
+    EXPECT(tcpip_callback(sockets_init_done, &sem) == ERR_OK);
+    sys_arch_sem_wait(&sem, 0);
+  }
+  mbox_ns = sockets_ns() - start;
+  sys_sem_free(&sem);
+#if LWIP_TCPIP_CORE_LOCKING
+  start = sockets_ns();
+  for (i = 0; i < SOCKETS_BENCH_CALLS; ) {
+    LOCK_TCPIP_CORE();
+    sockets_bench_count(&i);
+    UNLOCK_TCPIP_CORE();
+  }
+  lock_ns = sockets_ns() - start;
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
+  s = sockets_udp_bound(SOCKETS_TEST_PORT + 6);
+  EXPECT_RET(s >= 0);
+  start = sockets_ns();
+  for (i = 0; i < SOCKETS_BENCH_CALLS; i++) {
+    addrlen = sizeof(addr);
+    EXPECT(lwip_getsockname(s, (struct sockaddr*)&addr, &addrlen) == 0);
+  }
+  call_ns = sockets_ns() - start;
+  EXPECT(addr.sin_port == lwip_htons(SOCKETS_TEST_PORT + 6));
+  EXPECT(lwip_close(s) == 0);
+#if LWIP_TCPIP_CORE_LOCKING && SYS_STATS
+  /* every locked call and netconn call took the lock */
+  EXPECT((STAT_COUNTER)(lwip_stats.sys.core_lock.acquired - acquired) >= 2 * SOCKETS_BENCH_CALLS);
+#endif /* LWIP_TCPIP_CORE_LOCKING && SYS_STATS */
+
+  printf("dispatch round trip: mailbox %.0f ns", mbox_ns / SOCKETS_BENCH_CALLS);
+#if LWIP_TCPIP_CORE_LOCKING
+  printf(", core lock %.0f ns", lock_ns / SOCKETS_BENCH_CALLS);
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+  printf(", getsockname (%s) %.0f ns\n", LWIP_TCPIP_CORE_LOCKING ? "core lock" : "mailbox",
+    call_ns / SOCKETS_BENCH_CALLS);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** MSG_ZEROCOPY sends complete when the peer has ACKed them, not when the
+    data has been sent or received */
+START_TEST(test_sockets_tcp_zerocopy_acked)
+{
+#if LWIP_SOCKET && LWIP_SO_ZEROCOPY
+  struct sockets_zc_done done;
+  struct lwip_zerocopy zc;
+  u8_t buf[1500];
+  int c, s, i, len, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 1, &c, &s);
+  EXPECT_RET(ret == 0);
+  memset(&done, 0, sizeof(done));
+  zc.callback = sockets_zerocopy_done;
+  zc.arg = &done;
+  EXPECT(lwip_setsockopt(c, SOL_SOCKET, SO_ZEROCOPY, &zc, sizeof(zc)) == 0);
+
+  /* the server receives everything, but its ACKs are held back */
+  sockets_hold(SOCKETS_TEST_PORT + 1);
+  for (i = 0; i < 3; i++) {
+    EXPECT(lwip_send(c, sockets_data + i * 100, 100, MSG_ZEROCOPY) == 100);
+  }
+  for (len = 0; len < 300; ) {
+    ret = lwip_recv(s, buf + len, sizeof(buf) - len, 0);
+    EXPECT_RET(ret > 0);
+    len += ret;
+  }
+  EXPECT(memcmp(buf, sockets_data, 300) == 0);
+  sockets_sync();
+  EXPECT(done.calls == 0);
+
+  /* the ACKs complete all three sends */
+  sockets_release(1);
+  sockets_zerocopy_wait(&done, 3);
+  EXPECT(done.next == 3);
+  EXPECT(done.err == 0);
+
+  EXPECT(lwip_close(s) == 0);
+  EXPECT(lwip_close(c) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SO_ZEROCOPY */
+}
+END_TEST
+
+/** MSG_ZEROCOPY sends that are still queued (unsent or unACKed) when the
+    connection is reset complete with the error */
+START_TEST(test_sockets_tcp_zerocopy_abort)
+{
+#if LWIP_SOCKET && LWIP_SO_ZEROCOPY
+  struct sockets_zc_done done;
+  struct lwip_zerocopy zc;
+  int c, s, i, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 2, &c, &s);
+  EXPECT_RET(ret == 0);
+  memset(&done, 0, sizeof(done));
+  zc.callback = sockets_zerocopy_done;
+  zc.arg = &done;
+  EXPECT(lwip_setsockopt(c, SOL_SOCKET, SO_ZEROCOPY, &zc, sizeof(zc)) == 0);
+
+  /* without ACKs, the initial cwnd keeps most of this data queued */
+  sockets_hold(SOCKETS_TEST_PORT + 2);
+  for (i = 0; i < 4; i++) {
+    EXPECT(lwip_send(c, sockets_data, 1000, MSG_ZEROCOPY) == 1000);
+  }
+  sockets_sync();
+  EXPECT(done.calls == 0);
+
+  /* drop the ACKs and close the server with unread data: it ACKs what it
+     has received, then resets the connection, which completes the sends
+     still queued with the error */
+  sockets_release(0);
+  EXPECT(lwip_close(s) == 0);
+  sockets_zerocopy_wait(&done, 4);
+  EXPECT(done.next == 4);
+  EXPECT(done.err == ECONNRESET);
+
+  EXPECT(lwip_close(c) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SO_ZEROCOPY */
+}
+END_TEST
+
+/** Idle socket connections have no poll callback and (with
+    LWIP_TCP_PCB_TIMERS) no deadline, however many there are. poll_tcp is
+    only registered while a write waits for send buffer space. */
+START_TEST(test_sockets_tcp_idle_timers)
+{
+#if LWIP_SOCKET
+  int c[16], s[16];
+  u8_t buf[1500];
+  struct sockets_tcp_timers t;
+  int i, ret, sent = 0, received = 0, flags;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&t, 0, sizeof(t));
+  t.port = SOCKETS_TEST_PORT + 100;
+  t.num = 16;
+  for (i = 0; i < 16; i++) {
+    ret = sockets_tcp_pair((u16_t)(t.port + i), &c[i], &s[i]);
+    EXPECT_RET(ret == 0);
+  }
+  /* let delayed ACKs of the handshakes go out */
+  sys_msleep(3 * TCP_TMR_INTERVAL);
+  sockets_tcp_timers(&t);
+  EXPECT(t.pcbs == 32);
+  EXPECT(t.polled == 0);
+  EXPECT(t.scheduled == 0);
+
+  /* a nonblocking write that does not fit waits for send buffer space */
+  do {
+    ret = lwip_send(c[0], sockets_data, sizeof(sockets_data), MSG_DONTWAIT);
+    if (ret > 0) {
+      sent += ret;
+    }
+  } while (ret > 0);
+  EXPECT(errno == EWOULDBLOCK);
+  sockets_tcp_timers(&t);
+  EXPECT(t.polled == 1);
+
+  /* read everything: once all is ACKed, the poll callback goes away */
+  flags = lwip_fcntl(s[0], F_GETFL, 0);
+  EXPECT(lwip_fcntl(s[0], F_SETFL, flags | O_NONBLOCK) == 0);
+  for (i = 0; (i < 300) && (received < sent); i++) {
+    ret = lwip_recv(s[0], buf, sizeof(buf), 0);
+    if (ret > 0) {
+      received += ret;
+    } else {
+      sys_msleep(10);
+    }
+  }
+  EXPECT(received == sent);
+  for (i = 0; i < 300; i++) {
+    sockets_tcp_timers(&t);
+    if ((t.polled == 0) && (t.scheduled == 0)) {
+      break;
+    }
+    sys_msleep(10);
+  }
+  EXPECT(t.pcbs == 32);
+  EXPECT(t.polled == 0);
+  EXPECT(t.scheduled == 0);
+
+  for (i = 0; i < 16; i++) {
+    EXPECT(lwip_close(c[i]) == 0);
+    EXPECT(lwip_close(s[i]) == 0);
+  }
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** Threads contending for the core lock get it in the order they asked for
+    it, and the waits are counted. Waiting takes no new semaphore once the
+    waiter slots have one. */
+START_TEST(test_sockets_core_lock_fifo)
+{
+#if LWIP_SOCKET && LWIP_TCPIP_CORE_LOCKING
+  struct sockets_lock_thread t[SOCKETS_LOCK_THREADS];
+  int round, i;
+#if SYS_STATS
+  STAT_COUNTER contended = 0, sems = 0;
+#endif /* SYS_STATS */
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < SOCKETS_LOCK_THREADS; i++) {
+    t[i].id = i;
+    EXPECT_RET(sys_sem_new(&t[i].done, 0) == ERR_OK);
+  }
+  /* the first round creates the semaphores of the waiter slots */
+  for (round = 0; round < 2; round++) {
+    LOCK_TCPIP_CORE();
+    sockets_lock_cnt = 0;
+#if SYS_STATS
+    contended = lwip_stats.sys.core_lock.contended;
+    lwip_stats.sys.core_lock.max_waiting = 0;
+    sems = lwip_stats.sys.sem.used;
+#endif /* SYS_STATS */
+    for (i = 0; i < SOCKETS_LOCK_THREADS; i++) {
+      sys_thread_new("core_lock", sockets_lock_thread, &t[i], 0, 0);
+      /* let it queue before the next one starts */
+      sys_msleep(20);
+    }
+#if SYS_STATS
+    EXPECT(lwip_stats.sys.core_lock.waiting >= SOCKETS_LOCK_THREADS);
+    if (round > 0) {
+      EXPECT(lwip_stats.sys.sem.used == sems);
+    }
+#endif /* SYS_STATS */
+    UNLOCK_TCPIP_CORE();
+
+    for (i = 0; i < SOCKETS_LOCK_THREADS; i++) {
+      EXPECT(sys_arch_sem_wait(&t[i].done, 1000) != SYS_ARCH_TIMEOUT);
+    }
+    EXPECT(sockets_lock_cnt == SOCKETS_LOCK_THREADS);
+    for (i = 0; i < SOCKETS_LOCK_THREADS; i++) {
+      EXPECT(sockets_lock_order[i] == i);
+    }
+#if SYS_STATS
+    EXPECT((STAT_COUNTER)(lwip_stats.sys.core_lock.contended - contended) >= SOCKETS_LOCK_THREADS);
+    EXPECT(lwip_stats.sys.core_lock.max_waiting >= SOCKETS_LOCK_THREADS);
+    EXPECT(lwip_stats.sys.core_lock.waiting == 0);
+#endif /* SYS_STATS */
+  }
+  for (i = 0; i < SOCKETS_LOCK_THREADS; i++) {
+    sys_sem_free(&t[i].done);
+  }
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_TCPIP_CORE_LOCKING */
+}
+END_TEST
+
+/** lwip_writev() on TCP is one write: the vectors (one of them empty) fill
+    full-sized segments and only the last segment has the PSH flag */
+START_TEST(test_sockets_tcp_writev)
+{
+#if LWIP_SOCKET
+  static const int lens[6] = {100, 0, 150, 50, 200, 100};
+  struct sockets_held_segs h;
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  struct iovec iov[6];
+  int c, s, i, ret, one = 1, total = 0;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < 6; i++) {
+    iov[i].iov_base = sockets_data + total;
+    iov[i].iov_len = lens[i];
+    total += lens[i];
+  }
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 40, &c, &s);
+  EXPECT_RET(ret == 0);
+  EXPECT(lwip_setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == 0);
+  EXPECT(lwip_getsockname(c, (struct sockaddr*)&addr, &addrlen) == 0);
+
+  sockets_hold(lwip_ntohs(addr.sin_port));
+  ret = lwip_writev(c, iov, 6);
+  EXPECT(ret == total);
+  sockets_held_segs(&h);
+  EXPECT(h.num == (total + TCP_MSS - 1) / TCP_MSS);
+  EXPECT(h.bytes == total);
+  EXPECT(h.psh == 1UL << (h.num - 1));
+  sockets_release(1);
+  sockets_tcp_readv_expect(s, sockets_data, total);
+
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** A nonblocking lwip_sendmsg() on TCP that does not fit into the send
+    buffer returns the part written (ending in the middle of a vector), the
+    rest can be sent starting at that offset */
+START_TEST(test_sockets_tcp_sendmsg_partial)
+{
+#if LWIP_SOCKET
+  static u8_t expected[4 * sizeof(sockets_data) + 100];
+  struct iovec iov[6], rest[6];
+  struct msghdr msg;
+  int c, s, i, ret, sent, off, total = 0;
+  size_t rest_off;
+  LWIP_UNUSED_ARG(_i);
+
+  iov[0].iov_base = sockets_data + 1000;
+  iov[0].iov_len = 100;
+  iov[1].iov_base = sockets_data;
+  iov[1].iov_len = 0;
+  for (i = 2; i < 6; i++) {
+    iov[i].iov_base = sockets_data;
+    iov[i].iov_len = sizeof(sockets_data);
+  }
+  for (i = 0; i < 6; i++) {
+    memcpy(expected + total, iov[i].iov_base, iov[i].iov_len);
+    total += (int)iov[i].iov_len;
+  }
+  EXPECT_RET(total > TCP_SND_BUF);
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 41, &c, &s);
+  EXPECT_RET(ret == 0);
+
+  /* without ACKs, the send buffer fills up */
+  sockets_hold(SOCKETS_TEST_PORT + 41);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 6;
+  sent = lwip_sendmsg(c, &msg, MSG_DONTWAIT);
+  EXPECT_RET((sent > 100) && (sent <= TCP_SND_BUF));
+
+  /* the rest, starting in the middle of a vector */
+  for (i = 0, off = sent; off >= (int)iov[i].iov_len; i++) {
+    off -= (int)iov[i].iov_len;
+  }
+  EXPECT_RET(off > 0);
+  rest_off = (size_t)off;
+  msg.msg_iov = rest;
+  msg.msg_iovlen = 6 - i;
+  memcpy(rest, &iov[i], (6 - i) * sizeof(struct iovec));
+  rest[0].iov_base = (u8_t*)rest[0].iov_base + rest_off;
+  rest[0].iov_len -= rest_off;
+  EXPECT(lwip_sendmsg(c, &msg, MSG_DONTWAIT) == -1);
+  EXPECT(errno == EWOULDBLOCK);
+
+  sockets_release(1);
+  sockets_tcp_readv_expect(s, expected, sent);
+  EXPECT(lwip_sendmsg(c, &msg, 0) == total - sent);
+  sockets_tcp_readv_expect(s, expected + sent, total - sent);
+
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** lwip_sendmsg() on UDP sends one datagram made of all vectors */
+START_TEST(test_sockets_udp_sendmsg)
+{
+#if LWIP_SOCKET
+  struct sockaddr_in to = sockets_addr(SOCKETS_TEST_PORT + 42);
+  struct iovec iov[4];
+  struct msghdr msg;
+  u8_t buf[100];
+  int r, s, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  r = sockets_udp_bound(SOCKETS_TEST_PORT + 42);
+  EXPECT_RET(r >= 0);
+  s = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  EXPECT_RET(s >= 0);
+
+  iov[0].iov_base = sockets_data;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = sockets_data + 10;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sockets_data + 100;
+  iov[2].iov_len = 20;
+  iov[3].iov_base = sockets_data + 500;
+  iov[3].iov_len = 30;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &to;
+  msg.msg_namelen = sizeof(to);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 4;
+  ret = lwip_sendmsg(s, &msg, 0);
+  EXPECT(ret == 60);
+
+  ret = lwip_recv(r, buf, sizeof(buf), 0);
+  EXPECT(ret == 60);
+  EXPECT(memcmp(buf, sockets_data, 10) == 0);
+  EXPECT(memcmp(buf + 10, sockets_data + 100, 20) == 0);
+  EXPECT(memcmp(buf + 30, sockets_data + 500, 30) == 0);
+  EXPECT(lwip_recv(r, buf, sizeof(buf), MSG_DONTWAIT) == -1);
+  EXPECT(errno == EWOULDBLOCK);
+
+  EXPECT(lwip_close(r) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** lwip_poll(): POLLIN/POLLOUT readiness, POLLNVAL, negative fds and the
+    timeout */
+START_TEST(test_sockets_poll)
+{
+#if LWIP_SOCKET && LWIP_SOCKET_POLL
+  struct pollfd fds[4];
+  int a, b, c, s, d, ret;
+  u32_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  a = sockets_udp_bound(SOCKETS_TEST_PORT + 30);
+  b = sockets_udp_bound(SOCKETS_TEST_PORT + 31);
+  EXPECT_RET((a >= 0) && (b >= 0));
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 32, &c, &s);
+  EXPECT_RET(ret == 0);
+
+  fds[0].fd = a;
+  fds[0].events = POLLIN;
+  fds[1].fd = b;
+  fds[1].events = POLLIN;
+  fds[2].fd = -1;
+  fds[2].events = POLLIN;
+  fds[3].fd = c;
+  fds[3].events = POLLIN | POLLOUT;
+  ret = lwip_poll(fds, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT((fds[0].revents == 0) && (fds[1].revents == 0));
+  EXPECT(fds[2].revents == 0);
+  EXPECT(fds[3].revents == POLLOUT);
+
+  sockets_inject_udp(SOCKETS_TEST_PORT + 30, 0, 10, 10, 0);
+  EXPECT(lwip_send(s, sockets_data, 10, 0) == 10);
+  sockets_sync();
+  ret = lwip_poll(fds, 4, 1000);
+  EXPECT(ret == 2);
+  EXPECT((fds[0].revents == POLLIN) && (fds[1].revents == 0));
+  EXPECT(fds[2].revents == 0);
+  EXPECT(fds[3].revents == (POLLIN | POLLOUT));
+
+  /* nothing pending on b: the timeout expires */
+  start = sys_now();
+  ret = lwip_poll(&fds[1], 2, 100);
+  EXPECT(ret == 0);
+  EXPECT((u32_t)(sys_now() - start) >= 99);
+
+  /* a descriptor that is not an open socket is reported as POLLNVAL */
+  d = sockets_udp_bound(SOCKETS_TEST_PORT + 33);
+  EXPECT_RET(d >= 0);
+  EXPECT(lwip_close(d) == 0);
+  fds[2].fd = d;
+  ret = lwip_poll(&fds[1], 2, 1000);
+  EXPECT(ret == 1);
+  EXPECT(fds[2].revents == POLLNVAL);
+
+  EXPECT(lwip_close(a) == 0);
+  EXPECT(lwip_close(b) == 0);
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SOCKET_POLL */
+}
+END_TEST
+
+/** lwip_select(): read and write sets and the timeout */
+START_TEST(test_sockets_select)
+{
+#if LWIP_SOCKET
+  fd_set readset, writeset;
+  struct timeval tv;
+  int a, b, c, s, ret, maxfdp1;
+  u32_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  a = sockets_udp_bound(SOCKETS_TEST_PORT + 34);
+  b = sockets_udp_bound(SOCKETS_TEST_PORT + 35);
+  EXPECT_RET((a >= 0) && (b >= 0));
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 36, &c, &s);
+  EXPECT_RET(ret == 0);
+  maxfdp1 = LWIP_MAX(LWIP_MAX(a, b), LWIP_MAX(c, s)) + 1;
+
+  FD_ZERO(&readset);
+  FD_SET(a, &readset);
+  FD_SET(b, &readset);
+  FD_ZERO(&writeset);
+  FD_SET(c, &writeset);
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  ret = lwip_select(maxfdp1, &readset, &writeset, NULL, &tv);
+  EXPECT(ret == 1);
+  EXPECT(!FD_ISSET(a, &readset) && !FD_ISSET(b, &readset));
+  EXPECT(FD_ISSET(c, &writeset));
+
+  /* nothing to read: the timeout expires */
+  FD_ZERO(&readset);
+  FD_SET(a, &readset);
+  FD_SET(b, &readset);
+  tv.tv_usec = 100000;
+  start = sys_now();
+  ret = lwip_select(maxfdp1, &readset, NULL, NULL, &tv);
+  EXPECT(ret == 0);
+  EXPECT((u32_t)(sys_now() - start) >= 99);
+
+  sockets_inject_udp(SOCKETS_TEST_PORT + 35, 0, 10, 10, 0);
+  sockets_sync();
+  FD_ZERO(&readset);
+  FD_SET(a, &readset);
+  FD_SET(b, &readset);
+  ret = lwip_select(maxfdp1, &readset, NULL, NULL, &tv);
+  EXPECT(ret == 1);
+  EXPECT(!FD_ISSET(a, &readset) && FD_ISSET(b, &readset));
+
+  EXPECT(lwip_close(a) == 0);
+  EXPECT(lwip_close(b) == 0);
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** A task blocking in lwip_select() or lwip_poll() is only woken by the
+    events it waits for: not by other sockets, not by other events */
+START_TEST(test_sockets_select_wakeup)
+{
+#if LWIP_SOCKET
+  struct sockets_select_waiter w;
+  u8_t buf[10];
+  int b, c, s, ret, use_poll;
+  LWIP_UNUSED_ARG(_i);
+
+  b = sockets_udp_bound(SOCKETS_TEST_PORT + 37);
+  EXPECT_RET(b >= 0);
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 38, &c, &s);
+  EXPECT_RET(ret == 0);
+  EXPECT_RET(sys_sem_new(&w.done, 0) == ERR_OK);
+  for (use_poll = 0; use_poll <= LWIP_SOCKET_POLL; use_poll++) {
+    w.s = c;
+    w.use_poll = use_poll;
+    w.ret = -2;
+    w.readable = 0;
+    sys_thread_new("select_waiter", sockets_select_waiter, &w, 0, 0);
+    sys_msleep(50);
+
+    /* neither a datagram for another socket nor send buffer space (the
+       ACK of data sent) wakes a task waiting to read */
+    sockets_inject_udp(SOCKETS_TEST_PORT + 37, 0, 10, 10, 0);
+    EXPECT(lwip_send(c, sockets_data, 10, 0) == 10);
+    EXPECT(sys_arch_sem_wait(&w.done, 200) == SYS_ARCH_TIMEOUT);
+    EXPECT(w.ret == -2);
+
+    EXPECT(lwip_send(s, sockets_data, 10, 0) == 10);
+    EXPECT(sys_arch_sem_wait(&w.done, 1000) != SYS_ARCH_TIMEOUT);
+    EXPECT(w.ret == 1);
+    EXPECT(w.readable);
+    EXPECT(lwip_recv(c, buf, sizeof(buf), 0) == 10);
+    EXPECT(lwip_recv(s, buf, sizeof(buf), 0) == 10);
+    EXPECT(lwip_recv(b, buf, sizeof(buf), 0) == 10);
+  }
+  sys_sem_free(&w.done);
+
+  EXPECT(lwip_close(b) == 0);
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(s) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET */
+}
+END_TEST
+
+/** Level-triggered, EPOLLET and EPOLLONESHOT registrations, EPOLL_CTL_MOD/
+    DEL, closing a registered socket and the timeout of lwip_epoll_wait() */
+START_TEST(test_sockets_epoll_level_edge)
+{
+#if LWIP_SOCKET && LWIP_SOCKET_EPOLL
+  struct lwip_epoll_event ev, events[4];
+  u8_t buf[100];
+  int ep, ep2, a, b, ret;
+  u32_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  ep = lwip_epoll_create(1);
+  EXPECT_RET(ep >= 0);
+  a = sockets_udp_bound(SOCKETS_TEST_PORT + 20);
+  b = sockets_udp_bound(SOCKETS_TEST_PORT + 21);
+  EXPECT_RET((a >= 0) && (b >= 0));
+  ev.events = EPOLLIN;
+  ev.data.fd = a;
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == 0);
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == -1);
+  EXPECT(errno == EEXIST);
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = b;
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, b, &ev) == 0);
+
+  /* nothing pending: the timeout expires */
+  start = sys_now();
+  ret = lwip_epoll_wait(ep, events, 4, 100);
+  EXPECT(ret == 0);
+  EXPECT((u32_t)(sys_now() - start) >= 99);
+
+  sockets_inject_udp(SOCKETS_TEST_PORT + 20, 0, 10, 10, 0);
+  sockets_inject_udp(SOCKETS_TEST_PORT + 21, 0, 10, 10, 0);
+  sockets_sync();
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 2);
+  EXPECT((events[0].data.fd == a) && (events[0].events == EPOLLIN));
+  EXPECT((events[1].data.fd == b) && (events[1].events == EPOLLIN));
+  /* the level-triggered socket is reported until it is read, the
+     edge-triggered one only again when the next datagram arrives */
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT(events[0].data.fd == a);
+  sockets_inject_udp(SOCKETS_TEST_PORT + 21, 0, 10, 10, 0);
+  sockets_sync();
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 2);
+  EXPECT((events[0].data.fd == a) && (events[1].data.fd == b));
+  EXPECT(lwip_recv(a, buf, sizeof(buf), 0) == 10);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 0);
+
+  /* EPOLLONESHOT: reported once, then disabled until EPOLL_CTL_MOD */
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = a;
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, a, &ev) == 0);
+  sockets_inject_udp(SOCKETS_TEST_PORT + 20, 0, 10, 10, 0);
+  sockets_sync();
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT(events[0].data.fd == a);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 0);
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, a, &ev) == 0);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT(events[0].data.fd == a);
+
+  /* a deleted socket is not reported, although data is pending */
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, a, NULL) == 0);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 0);
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_DEL, a, NULL) == -1);
+  EXPECT(errno == ENOENT);
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_MOD, a, &ev) == -1);
+  EXPECT(errno == ENOENT);
+
+  /* registrations are per instance */
+  ep2 = lwip_epoll_create(1);
+  EXPECT_RET(ep2 >= 0);
+  ev.events = EPOLLIN;
+  ev.data.fd = a;
+  EXPECT(lwip_epoll_ctl(ep2, EPOLL_CTL_ADD, a, &ev) == 0);
+  ret = lwip_epoll_wait(ep2, events, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT(events[0].data.fd == a);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 0);
+
+  /* closing a registered socket unregisters it: a new socket that gets the
+     same descriptor is not registered */
+  EXPECT(lwip_close(a) == 0);
+  ret = lwip_epoll_wait(ep2, events, 4, 0);
+  EXPECT(ret == 0);
+  EXPECT(lwip_epoll_ctl(ep2, EPOLL_CTL_DEL, a, NULL) == -1);
+  EXPECT(errno == EBADF);
+  a = sockets_udp_bound(SOCKETS_TEST_PORT + 20);
+  EXPECT_RET(a >= 0);
+  sockets_inject_udp(SOCKETS_TEST_PORT + 20, 0, 10, 10, 0);
+  sockets_sync();
+  ret = lwip_epoll_wait(ep2, events, 4, 0);
+  EXPECT(ret == 0);
+
+  EXPECT(lwip_close(ep2) == 0);
+  EXPECT(lwip_epoll_wait(ep2, events, 4, 0) == -1);
+  EXPECT(errno == EBADF);
+  EXPECT(lwip_close(a) == 0);
+  EXPECT(lwip_close(b) == 0);
+  EXPECT(lwip_close(ep) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SOCKET_EPOLL */
+}
+END_TEST
+
+/** One event wakes every task waiting on an epoll instance, and the
+    instance cannot be closed while they wait */
+START_TEST(test_sockets_epoll_waiters)
+{
+#if LWIP_SOCKET && LWIP_SOCKET_EPOLL
+  struct sockets_epoll_waiter w[2];
+  struct lwip_epoll_event ev;
+  int ep, a, i;
+  u32_t waitres;
+  LWIP_UNUSED_ARG(_i);
+
+  ep = lwip_epoll_create(1);
+  EXPECT_RET(ep >= 0);
+  a = sockets_udp_bound(SOCKETS_TEST_PORT + 22);
+  EXPECT_RET(a >= 0);
+  ev.events = EPOLLIN;
+  ev.data.fd = a;
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, a, &ev) == 0);
+  for (i = 0; i < 2; i++) {
+    w[i].epfd = ep;
+    w[i].ret = -2;
+    EXPECT_RET(sys_sem_new(&w[i].done, 0) == ERR_OK);
+    sys_thread_new("epoll_waiter", sockets_epoll_waiter, &w[i], 0, 0);
+  }
+  sys_msleep(100);
+  EXPECT(lwip_close(ep) == -1);
+  EXPECT(errno == EBUSY);
+
+  sockets_inject_udp(SOCKETS_TEST_PORT + 22, 0, 10, 10, 0);
+  for (i = 0; i < 2; i++) {
+    waitres = sys_arch_sem_wait(&w[i].done, 1000);
+    EXPECT(waitres != SYS_ARCH_TIMEOUT);
+    if (waitres == SYS_ARCH_TIMEOUT) {
+      sys_arch_sem_wait(&w[i].done, 0);
+    }
+    EXPECT(w[i].ret == 1);
+    EXPECT(w[i].ev.data.fd == a);
+    sys_sem_free(&w[i].done);
+  }
+
+  EXPECT(lwip_close(ep) == 0);
+  EXPECT(lwip_close(a) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SOCKET_EPOLL */
+}
+END_TEST
+
+/** A reset connection reports EPOLLHUP and EPOLLERR without asking */
+START_TEST(test_sockets_epoll_hup)
+{
+#if LWIP_SOCKET && LWIP_SOCKET_EPOLL
+  struct lwip_epoll_event ev, events[4];
+  int ep, c, s, i, ret;
+  LWIP_UNUSED_ARG(_i);
+
+  ret = sockets_tcp_pair(SOCKETS_TEST_PORT + 23, &c, &s);
+  EXPECT_RET(ret == 0);
+  ep = lwip_epoll_create(1);
+  EXPECT_RET(ep >= 0);
+  ev.events = EPOLLOUT | EPOLLET;
+  ev.data.fd = c;
+  EXPECT(lwip_epoll_ctl(ep, EPOLL_CTL_ADD, c, &ev) == 0);
+  ret = lwip_epoll_wait(ep, events, 4, 0);
+  EXPECT(ret == 1);
+  EXPECT(events[0].events == EPOLLOUT);
+
+  /* data sent to the closed server resets the connection */
+  EXPECT(lwip_close(s) == 0);
+  sockets_sync();
+  EXPECT(lwip_send(c, sockets_data, 100, 0) == 100);
+  for (i = 0; i < 10; i++) {
+    ret = lwip_epoll_wait(ep, events, 4, 100);
+    if ((ret == 1) && (events[0].events & EPOLLHUP)) {
+      break;
+    }
+  }
+  EXPECT(i < 10);
+  EXPECT(events[0].events & EPOLLERR);
+
+  EXPECT(lwip_close(c) == 0);
+  EXPECT(lwip_close(ep) == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SOCKET && LWIP_SOCKET_EPOLL */
+}
+END_TEST
+
+
+/** Create the suite including all tests for this module */
+Suite *
+sockets_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_sockets_udp_deferred_chksum),
+    TESTFUNC(test_sockets_udp_recvmsg_trunc),
+    TESTFUNC(test_sockets_udp_mmsg_partial),
+    TESTFUNC(test_sockets_tcp_lend_release),
+    TESTFUNC(test_sockets_tcp_zerocopy_acked),
+    TESTFUNC(test_sockets_tcp_zerocopy_abort),
+    TESTFUNC(test_sockets_dispatch_latency),
+    TESTFUNC(test_sockets_core_lock_fifo),
+    TESTFUNC(test_sockets_tcp_idle_timers),
+    TESTFUNC(test_sockets_tcp_writev),
+    TESTFUNC(test_sockets_tcp_sendmsg_partial),
+    TESTFUNC(test_sockets_udp_sendmsg),
+    TESTFUNC(test_sockets_poll),
+    TESTFUNC(test_sockets_select),
+    TESTFUNC(test_sockets_select_wakeup),
+    TESTFUNC(test_sockets_epoll_level_edge),
+    TESTFUNC(test_sockets_epoll_waiters),
+    TESTFUNC(test_sockets_epoll_hup),
+  };
+  return create_suite("SOCKETS", tests, sizeof(tests)/sizeof(testfunc), sockets_setup, sockets_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_SOCKETS_H__
+#define LWIP_HDR_TEST_SOCKETS_H__
+
+#include "../lwip_check.h"
+
+Suite *sockets_suite(void);
+
+#endif
@@ -0,0 +1,377 @@
+#include "lwip/sys.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include <time.h>
+
+#if NO_SYS
+/* The core tests run on a simulated clock: the tests advance it, TCP_NOW()
+   and the lwIP timeouts follow it (see lwipopts.h) */
+unsigned int test_tcp_now;
+
+u32_t
+sys_now(void)
+{
+  return test_tcp_now;
+}
+#else /* NO_SYS */
+u32_t
+sys_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif /* NO_SYS */
+
+#if !NO_SYS
+
+#include <pthread.h>
+#include <errno.h>
+
+#define SYS_MBOX_SIZE 128
+
+struct sys_sem {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int count;
+};
+
+struct sys_mutex {
+  pthread_mutex_t mutex;
+};
+
+struct sys_mbox {
+  struct sys_sem not_empty;
+  struct sys_sem not_full;
+  pthread_mutex_t mutex;
+  void *msgs[SYS_MBOX_SIZE];
+  int first, count;
+};
+
+static pthread_mutex_t sys_prot_mutex;
+static pthread_once_t sys_prot_once = PTHREAD_ONCE_INIT;
+
+#if MEMP_MAGAZINES
+static __thread struct memp_magazines sys_magazines;
+
+/** MEMP_MAGAZINES_GET(): every thread has its own magazines */
+struct memp_magazines *
+sys_arch_magazines(void)
+{
+  return &sys_magazines;
+}
+#endif /* MEMP_MAGAZINES */
+
+static void
+sys_prot_init(void)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&sys_prot_mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void
+sys_init(void)
+{
+  pthread_once(&sys_prot_once, sys_prot_init);
+}
+
+sys_prot_t
+sys_arch_protect(void)
+{
+  pthread_once(&sys_prot_once, sys_prot_init);
+  pthread_mutex_lock(&sys_prot_mutex);
+  return 0;
+}
+
+void
+sys_arch_unprotect(sys_prot_t pval)
+{
+  LWIP_UNUSED_ARG(pval);
+  pthread_mutex_unlock(&sys_prot_mutex);
+}
+
+static void
+sys_sem_init(struct sys_sem *sem, int count)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sem->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&sem->mutex, NULL);
+  sem->count = count;
+}
+
+static void
+sys_sem_deinit(struct sys_sem *sem)
+{
+  pthread_cond_destroy(&sem->cond);
+  pthread_mutex_destroy(&sem->mutex);
+}
+
+static void
+sys_sem_up(struct sys_sem *sem)
+{
+  pthread_mutex_lock(&sem->mutex);
+  sem->count++;
+  pthread_cond_signal(&sem->cond);
+  pthread_mutex_unlock(&sem->mutex);
+}
+
+/** Wait for the semaphore, 0 = forever. Returns SYS_ARCH_TIMEOUT or the
+    milliseconds waited */
+static u32_t
+sys_sem_down(struct sys_sem *sem, u32_t timeout)
+{
+  u32_t start = sys_now();
+  struct timespec ts;
+
+  if (timeout != 0) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+  }
+  pthread_mutex_lock(&sem->mutex);
+  while (sem->count <= 0) {
+    if (timeout == 0) {
+      pthread_cond_wait(&sem->cond, &sem->mutex);
+    } else if ((pthread_cond_timedwait(&sem->cond, &sem->mutex, &ts) == ETIMEDOUT) &&
+               (sem->count <= 0)) {
+      pthread_mutex_unlock(&sem->mutex);
+      return SYS_ARCH_TIMEOUT;
+    }
+  }
+  sem->count--;
+  pthread_mutex_unlock(&sem->mutex);
+  return sys_now() - start;
+}
+
+err_t
+sys_sem_new(sys_sem_t *sem, u8_t count)
+{
+  struct sys_sem *s = (struct sys_sem *)malloc(sizeof(struct sys_sem));
+  SYS_ARCH_DECL_PROTECT(lev);
+  if (s == NULL) {
+    return ERR_MEM;
+  }
+  sys_sem_init(s, count);
+  *sem = s;
+  SYS_ARCH_PROTECT(lev);
+  SYS_STATS_INC_USED(sem);
+  SYS_ARCH_UNPROTECT(lev);
+  return ERR_OK;
+}
+
+void
+sys_sem_signal(sys_sem_t *sem)
+{
+  sys_sem_up(*sem);
+}
+
+u32_t
+sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
+{
+  return sys_sem_down(*sem, timeout);
+}
+
+void
+sys_sem_free(sys_sem_t *sem)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  sys_sem_deinit(*sem);
+  free(*sem);
+  *sem = NULL;
+  SYS_ARCH_PROTECT(lev);
+  SYS_STATS_DEC(sem.used);
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+err_t
+sys_mutex_new(sys_mutex_t *mutex)
+{
+  struct sys_mutex *m = (struct sys_mutex *)malloc(sizeof(struct sys_mutex));
+  if (m == NULL) {
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&m->mutex, NULL);
+  *mutex = m;
+  return ERR_OK;
+}
+
+void
+sys_mutex_lock(sys_mutex_t *mutex)
+{
+  pthread_mutex_lock(&(*mutex)->mutex);
+}
+
+void
+sys_mutex_unlock(sys_mutex_t *mutex)
+{
+  pthread_mutex_unlock(&(*mutex)->mutex);
+}
+
+void
+sys_mutex_free(sys_mutex_t *mutex)
+{
+  pthread_mutex_destroy(&(*mutex)->mutex);
+  free(*mutex);
+  *mutex = NULL;
+}
+
+err_t
+sys_mbox_new(sys_mbox_t *mbox, int size)
+{
+  struct sys_mbox *b = (struct sys_mbox *)malloc(sizeof(struct sys_mbox));
+  LWIP_UNUSED_ARG(size);
+  if (b == NULL) {
+    return ERR_MEM;
+  }
+  sys_sem_init(&b->not_empty, 0);
+  sys_sem_init(&b->not_full, SYS_MBOX_SIZE);
+  pthread_mutex_init(&b->mutex, NULL);
+  b->first = b->count = 0;
+  *mbox = b;
+  return ERR_OK;
+}
+
+void
+sys_mbox_free(sys_mbox_t *mbox)
+{
+  struct sys_mbox *b = *mbox;
+  sys_sem_deinit(&b->not_empty);
+  sys_sem_deinit(&b->not_full);
+  pthread_mutex_destroy(&b->mutex);
+  free(b);
+  *mbox = NULL;
+}
+
+static void
+sys_mbox_put(struct sys_mbox *b, void *msg)
+{
+  pthread_mutex_lock(&b->mutex);
+  b->msgs[(b->first + b->count) % SYS_MBOX_SIZE] = msg;
+  b->count++;
+  pthread_mutex_unlock(&b->mutex);
+  sys_sem_up(&b->not_empty);
+}
+
+static void *
+sys_mbox_get(struct sys_mbox *b)
+{
+  void *msg;
+  pthread_mutex_lock(&b->mutex);
+  msg = b->msgs[b->first];
+  b->first = (b->first + 1) % SYS_MBOX_SIZE;
+  b->count--;
+  pthread_mutex_unlock(&b->mutex);
+  sys_sem_up(&b->not_full);
+  return msg;
+}
+
+void
+sys_mbox_post(sys_mbox_t *mbox, void *msg)
+{
+  sys_sem_down(&(*mbox)->not_full, 0);
+  sys_mbox_put(*mbox, msg);
+}
+
+err_t
+sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
+{
+  struct sys_sem *not_full = &(*mbox)->not_full;
+  pthread_mutex_lock(&not_full->mutex);
+  if (not_full->count <= 0) {
+    pthread_mutex_unlock(&not_full->mutex);
+    return ERR_MEM;
+  }
+  not_full->count--;
+  pthread_mutex_unlock(&not_full->mutex);
+  sys_mbox_put(*mbox, msg);
+  return ERR_OK;
+}
+
+u32_t
+sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
+{
+  void *m;
+  u32_t waited = sys_sem_down(&(*mbox)->not_empty, timeout);
+  if (waited == SYS_ARCH_TIMEOUT) {
+    return SYS_ARCH_TIMEOUT;
+  }
+  m = sys_mbox_get(*mbox);
+  if (msg != NULL) {
+    *msg = m;
+  }
+  return waited;
+}
+
+u32_t
+sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
+{
+  struct sys_sem *not_empty = &(*mbox)->not_empty;
+  void *m;
+  pthread_mutex_lock(&not_empty->mutex);
+  if (not_empty->count <= 0) {
+    pthread_mutex_unlock(&not_empty->mutex);
+    return SYS_MBOX_EMPTY;
+  }
+  not_empty->count--;
+  pthread_mutex_unlock(&not_empty->mutex);
+  m = sys_mbox_get(*mbox);
+  if (msg != NULL) {
+    *msg = m;
+  }
+  return 0;
+}
+
+struct sys_thread_start {
+  const char *name;
+  lwip_thread_fn function;
+  void *arg;
+};
+
+static void *
+sys_thread_main(void *arg)
+{
+  struct sys_thread_start start = *(struct sys_thread_start *)arg;
+  free(arg);
+#if MEMP_MAGAZINES && MEMP_STATS
+  memp_magazines_register(&sys_magazines, start.name);
+#endif /* MEMP_MAGAZINES && MEMP_STATS */
+  start.function(start.arg);
+#if MEMP_MAGAZINES
+  memp_magazines_flush(&sys_magazines);
+#if MEMP_STATS
+  memp_magazines_unregister(&sys_magazines);
+#endif /* MEMP_STATS */
+#endif /* MEMP_MAGAZINES */
+  return NULL;
+}
+
+sys_thread_t
+sys_thread_new(const char *name, lwip_thread_fn function, void *arg, int stacksize, int prio)
+{
+  pthread_t thread;
+  struct sys_thread_start *start = (struct sys_thread_start *)malloc(sizeof(struct sys_thread_start));
+  LWIP_UNUSED_ARG(stacksize);
+  LWIP_UNUSED_ARG(prio);
+  LWIP_ASSERT("out of memory", start != NULL);
+  start->name = name;
+  start->function = function;
+  start->arg = arg;
+  if (pthread_create(&thread, NULL, sys_thread_main, start) != 0) {
+    LWIP_ASSERT("pthread_create failed", 0);
+  }
+  pthread_detach(thread);
+  return (sys_thread_t)thread;
+}
+
+#endif /* !NO_SYS */
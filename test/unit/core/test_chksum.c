@@ -0,0 +1,308 @@
+#include "test_chksum.h"
+
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/ip.h"
+
+#include <time.h>
+
+#define CHKSUM_BUF_SIZE  (65535 + 8)
+
+static u8_t chksum_buf[CHKSUM_BUF_SIZE];
+
+/* Setups/teardown functions */
+
+static void
+chksum_setup(void)
+{
+  size_t i;
+  u32_t x = 0x12345678;
+  for (i = 0; i < sizeof(chksum_buf); i++) {
+    /* xorshift: some data that is not easily summed */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chksum_buf[i] = (u8_t)x;
+  }
+}
+
+static void
+chksum_teardown(void)
+{
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AUTO);
+#endif
+}
+
+/** Reference implementation (RFC 1071, byte by byte, in network order) */
+static u16_t
+chksum_ref(const u8_t *data, int len)
+{
+  u32_t acc = 0;
+  int i;
+  for (i = 0; i + 1 < len; i += 2) {
+    acc += ((u32_t)data[i] << 8) | data[i + 1];
+  }
+  if (len & 1) {
+    acc += (u32_t)data[len - 1] << 8;
+  }
+  while (acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return (u16_t)~acc;
+}
+
+/** inet_chksum() returns the checksum as stored in the header (network order) */
+static void
+chksum_check_all(const char *impl)
+{
+  int len, offset;
+  for (offset = 0; offset < 8; offset++) {
+    for (len = 0; len < 300; len++) {
+      u16_t sum = inet_chksum(&chksum_buf[offset], (u16_t)len);
+      if (lwip_ntohs(sum) != chksum_ref(&chksum_buf[offset], len)) {
+        fail("%s: offset %d len %d: 0x%04x != 0x%04x", impl, offset, len,
+          lwip_ntohs(sum), chksum_ref(&chksum_buf[offset], len));
+        return;
+      }
+    }
+    for (len = 1400; len < CHKSUM_BUF_SIZE - 8; len += 997) {
+      u16_t sum = inet_chksum(&chksum_buf[offset], (u16_t)len);
+      fail_unless(lwip_ntohs(sum) == chksum_ref(&chksum_buf[offset], len));
+    }
+    fail_unless(lwip_ntohs(inet_chksum(&chksum_buf[offset], 65535)) == chksum_ref(&chksum_buf[offset], 65535));
+  }
+  /* worst case for carries: all ones */
+  memset(chksum_buf, 0xff, sizeof(chksum_buf));
+  fail_unless(lwip_ntohs(inet_chksum(chksum_buf, 65535)) == chksum_ref(chksum_buf, 65535));
+  fail_unless(lwip_ntohs(inet_chksum(&chksum_buf[1], 65534)) == chksum_ref(&chksum_buf[1], 65534));
+  chksum_setup();
+}
+
+#if LWIP_CHKSUM_COPY_ALGORITHM
+static u8_t chksum_dst[CHKSUM_BUF_SIZE];
+
+/** lwip_chksum_copy() returns the lwip checksum (host order, not inverted) */
+static void
+chksum_copy_check_all(const char *impl)
+{
+  int len, soff, doff;
+  for (soff = 0; soff < 4; soff++) {
+    for (doff = 0; doff < 4; doff++) {
+      for (len = 0; len < 300; len++) {
+        u16_t sum = lwip_chksum_copy(&chksum_dst[doff], &chksum_buf[soff], (u16_t)len);
+        if ((lwip_ntohs((u16_t)~sum) != chksum_ref(&chksum_buf[soff], len)) ||
+            (memcmp(&chksum_dst[doff], &chksum_buf[soff], len) != 0)) {
+          fail("%s: src %d dst %d len %d", impl, soff, doff, len);
+          return;
+        }
+      }
+    }
+  }
+  for (len = 1400; len < CHKSUM_BUF_SIZE - 8; len += 3989) {
+    u16_t sum = lwip_chksum_copy(&chksum_dst[3], &chksum_buf[1], (u16_t)len);
+    fail_unless(lwip_ntohs((u16_t)~sum) == chksum_ref(&chksum_buf[1], len));
+    fail_unless(memcmp(&chksum_dst[3], &chksum_buf[1], len) == 0);
+  }
+  memset(chksum_buf, 0xff, sizeof(chksum_buf));
+  fail_unless(lwip_ntohs((u16_t)~lwip_chksum_copy(chksum_dst, chksum_buf, 65535)) ==
+    chksum_ref(chksum_buf, 65535));
+  chksum_setup();
+}
+
+static double
+chksum_copy_bench_one(int len, int fused)
+{
+  volatile u16_t sink = 0;
+  long iterations = (64L * 1024 * 1024) / len;
+  long i;
+  clock_t start = clock();
+  for (i = 0; i < iterations; i++) {
+    if (fused) {
+      sink = (u16_t)(sink + lwip_chksum_copy(chksum_dst, &chksum_buf[1], (u16_t)len));
+    } else {
+      MEMCPY(chksum_dst, &chksum_buf[1], len);
+      sink = (u16_t)(sink + inet_chksum(chksum_dst, (u16_t)len));
+    }
+  }
+  return (double)iterations * len / ((double)(clock() - start) * 1e9 / CLOCKS_PER_SEC);
+}
+
+static void
+chksum_copy_bench(const char *impl, int fused)
+{
+  static const int lens[] = {64, 1500, 65535};
+  size_t l;
+  printf("copy   %-8s", impl);
+  for (l = 0; l < sizeof(lens)/sizeof(lens[0]); l++) {
+    printf(" %5d:%6.2f", lens[l], chksum_copy_bench_one(lens[l], fused));
+  }
+  printf(" (GB/s)\n");
+}
+#endif /* LWIP_CHKSUM_COPY_ALGORITHM */
+
+static double
+chksum_bench_one(const u8_t *data, int len, int ref)
+{
+  volatile u16_t sink = 0;
+  long iterations = (64L * 1024 * 1024) / len;
+  long i;
+  clock_t start = clock();
+  for (i = 0; i < iterations; i++) {
+    sink = (u16_t)(sink + (ref ? chksum_ref(data, len) : inet_chksum(data, (u16_t)len)));
+  }
+  /* returns bytes per ns */
+  return (double)iterations * len / ((double)(clock() - start) * 1e9 / CLOCKS_PER_SEC);
+}
+
+static void
+chksum_bench(const char *impl, int ref)
+{
+  static const int lens[] = {64, 1500, 65535};
+  static const int offsets[] = {0, 1, 2, 4};
+  size_t l, o;
+  printf("chksum %-8s", impl);
+  for (l = 0; l < sizeof(lens)/sizeof(lens[0]); l++) {
+    for (o = 0; o < sizeof(offsets)/sizeof(offsets[0]); o++) {
+      printf(" %5d@%d:%6.2f", lens[l], offsets[o], chksum_bench_one(&chksum_buf[offsets[o]], lens[l], ref));
+    }
+  }
+  printf(" (GB/s)\n");
+}
+
+/* Test functions */
+
+/** All lengths and alignments must give the same result as the reference
+ * implementation (with every kernel for LWIP_CHKSUM_ALGORITHM 4) */
+START_TEST(test_chksum_variants)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  chksum_check_all("default");
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+  fail_unless(lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SCALAR) == LWIP_CHKSUM_IMPL_SCALAR);
+  chksum_check_all("scalar");
+  fail_unless(lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SSE2) == LWIP_CHKSUM_IMPL_SSE2);
+  chksum_check_all("sse2");
+  if (lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AVX2) == LWIP_CHKSUM_IMPL_AVX2) {
+    chksum_check_all("avx2");
+  }
+#endif
+}
+END_TEST
+
+/** Checksums over pbuf chains with odd lengths (byte swapping) and the
+ * pseudo header checksum must match the reference implementation */
+START_TEST(test_chksum_pbuf)
+{
+  static const u16_t lens[] = {1, 3, 64, 1, 1499, 2, 333};
+  struct pbuf *p = NULL, *q;
+  size_t i;
+  u16_t total = 0;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+    q = pbuf_alloc(PBUF_RAW, lens[i], PBUF_RAM);
+    fail_unless(q != NULL);
+    MEMCPY(q->payload, &chksum_buf[total], lens[i]);
+    total = (u16_t)(total + lens[i]);
+    if (p == NULL) {
+      p = q;
+    } else {
+      pbuf_cat(p, q);
+    }
+  }
+  fail_unless(lwip_ntohs(inet_chksum_pbuf(p)) == chksum_ref(chksum_buf, total));
+#if LWIP_IPV4
+  {
+    /* pseudo header: src, dst, zero, proto, length in front of the data */
+    u8_t pseudo[12 + 1 + 3 + 64 + 1 + 1499 + 2 + 333];
+    ip4_addr_t src, dst;
+    IP4_ADDR(&src, 192, 168, 1, 1);
+    IP4_ADDR(&dst, 10, 0, 0, 200);
+    memcpy(&pseudo[0], &src, 4);
+    memcpy(&pseudo[4], &dst, 4);
+    pseudo[8] = 0;
+    pseudo[9] = IP_PROTO_UDP;
+    pseudo[10] = (u8_t)(total >> 8);
+    pseudo[11] = (u8_t)total;
+    memcpy(&pseudo[12], chksum_buf, total);
+    fail_unless(lwip_ntohs(inet_chksum_pseudo(p, IP_PROTO_UDP, total, &src, &dst)) ==
+      chksum_ref(pseudo, 12 + total));
+  }
+#endif /* LWIP_IPV4 */
+#if LWIP_CHKSUM_COPY_ALGORITHM
+  {
+    static u8_t dst[CHKSUM_BUF_SIZE];
+    fail_unless(lwip_ntohs((u16_t)~lwip_chksum_copy(&dst[1], &chksum_buf[3], 1501)) ==
+      chksum_ref(&chksum_buf[3], 1501));
+    fail_unless(memcmp(&dst[1], &chksum_buf[3], 1501) == 0);
+  }
+#endif /* LWIP_CHKSUM_COPY_ALGORITHM */
+  pbuf_free(p);
+}
+END_TEST
+
+#if LWIP_CHKSUM_COPY_ALGORITHM
+/** The copy must be exact and the checksum must match the reference
+ * implementation for all lengths and source/destination alignments */
+START_TEST(test_chksum_copy)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  chksum_copy_check_all("default");
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SCALAR);
+  chksum_copy_check_all("scalar");
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SSE2);
+  chksum_copy_check_all("sse2");
+  if (lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AVX2) == LWIP_CHKSUM_IMPL_AVX2) {
+    chksum_copy_check_all("avx2");
+  }
+#endif
+}
+END_TEST
+#endif /* LWIP_CHKSUM_COPY_ALGORITHM */
+
+/** Micro-benchmark: 64B, 1500B and 64KB at different alignments */
+START_TEST(test_chksum_bench)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  chksum_bench("ref", 1);
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SCALAR);
+  chksum_bench("scalar", 0);
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_SSE2);
+  chksum_bench("sse2", 0);
+  if (lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AVX2) == LWIP_CHKSUM_IMPL_AVX2) {
+    chksum_bench("avx2", 0);
+  }
+#else
+  chksum_bench("default", 0);
+#endif
+#if LWIP_CHKSUM_COPY_ALGORITHM
+#if defined(LWIP_CHKSUM_ALGORITHM) && (LWIP_CHKSUM_ALGORITHM == 4)
+  lwip_chksum_set_impl(LWIP_CHKSUM_IMPL_AUTO);
+#endif
+  chksum_copy_bench("2-pass", 0);
+  chksum_copy_bench("fused", 1);
+#endif /* LWIP_CHKSUM_COPY_ALGORITHM */
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+chksum_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_chksum_variants),
+    TESTFUNC(test_chksum_pbuf),
+#if LWIP_CHKSUM_COPY_ALGORITHM
+    TESTFUNC(test_chksum_copy),
+#endif /* LWIP_CHKSUM_COPY_ALGORITHM */
+    TESTFUNC(test_chksum_bench)
+  };
+  return create_suite("CHKSUM", tests, sizeof(tests)/sizeof(testfunc), chksum_setup, chksum_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_CHKSUM_H__
+#define LWIP_HDR_TEST_CHKSUM_H__
+
+#include "../lwip_check.h"
+
+Suite *chksum_suite(void);
+
+#endif
@@ -3,6 +3,8 @@
 #include "lwip/mem.h"
 #include "lwip/stats.h"
 
+#include <time.h>
+
 #if !LWIP_STATS || !MEM_STATS
 #error "This tests needs MEM-statistics enabled"
 #endif
@@ -109,13 +111,156 @@ START_TEST(test_mem_random)
 }
 END_TEST
 
+#define MEM_TRACE_LOOPS      20
+#define MEM_TRACE_STEPS      20000
+#define MEM_TRACE_TCP_QUEUE  8
+#define MEM_TRACE_UDP_QUEUE  4
+#define MEM_TRACE_LONG_LIVED 16
+/* per allocation overhead of the heaps (struct mem), upper bound */
+#define MEM_TRACE_OVERHEAD   (2 * MEM_ALIGNMENT)
+
+struct mem_trace_result {
+  int ops;
+  /* allocations that failed... */
+  int failed;
+  /* ...because the free bytes of the heap did not add up to the request */
+  int failed_full;
+};
+
+static void *
+mem_trace_malloc(mem_size_t size, struct mem_trace_result *res)
+{
+  void *p = mem_malloc(size);
+  res->ops++;
+  if (p == NULL) {
+    res->failed++;
+    if (lwip_stats.mem.used + LWIP_MEM_ALIGN_SIZE(size) + MEM_TRACE_OVERHEAD > lwip_stats.mem.avail) {
+      res->failed_full++;
+    }
+  }
+  return p;
+}
+
+static void
+mem_trace_free(void *p, struct mem_trace_result *res)
+{
+  mem_free(p);
+  res->ops++;
+}
+
+/** Replay a synthetic allocation trace of a host sending TCP data (segments
+ * of mixed sizes held until acked), receiving ACKs and UDP datagrams (freed
+ * soon) and keeping some long-lived allocations. Not a pass/fail test for
+ * speed: the unit tests are built with MEM_USE_TLSF 0 and 1 to compare the
+ * heaps. At its peaks the trace nearly fills the heap, so some allocations
+ * fail on both heaps: 'full' counts the ones where the free bytes did not
+ * add up to the request, the rest failed because the free memory was
+ * fragmented (in practice: full-sized segments that found several KByte free,
+ * but split up by the long-lived allocations). */
+START_TEST(test_mem_trace_replay)
+{
+  void *tcp[MEM_TRACE_TCP_QUEUE];
+  void *udp[MEM_TRACE_UDP_QUEUE];
+  void *longlived[MEM_TRACE_LONG_LIVED];
+  struct mem_trace_result res;
+  int tcp_head = 0, tcp_num = 0, udp_head = 0;
+  int loop, step, i;
+  u32_t seed = 1;
+  u32_t r;
+  mem_size_t size;
+  clock_t start;
+  void *p;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(lwip_stats.mem.used == 0);
+  memset(&res, 0, sizeof(res));
+  memset(tcp, 0, sizeof(tcp));
+  memset(udp, 0, sizeof(udp));
+  memset(longlived, 0, sizeof(longlived));
+
+  start = clock();
+  for (loop = 0; loop < MEM_TRACE_LOOPS; loop++) {
+    for (step = 0; step < MEM_TRACE_STEPS; step++) {
+      seed = seed * 1103515245 + 12345;
+      r = seed >> 8;
+      switch (r % 8) {
+        case 0: case 1: case 2:
+          /* tcp_write: full-sized, 536 byte or small segment + headers */
+          if (tcp_num < MEM_TRACE_TCP_QUEUE) {
+            size = (mem_size_t)(((r >> 4) & 1) ? 1460 : (((r >> 5) & 1) ? 536 : 1 + ((r >> 6) % 200)));
+            p = mem_trace_malloc((mem_size_t)(size + 54), &res);
+            if (p != NULL) {
+              tcp[(tcp_head + tcp_num) % MEM_TRACE_TCP_QUEUE] = p;
+              tcp_num++;
+            }
+          }
+          break;
+        case 3: case 4:
+          /* ACK received: free the 1..3 oldest segments */
+          for (i = 0; (i < 1 + (int)((r >> 4) % 3)) && (tcp_num > 0); i++) {
+            mem_trace_free(tcp[tcp_head], &res);
+            tcp_head = (tcp_head + 1) % MEM_TRACE_TCP_QUEUE;
+            tcp_num--;
+          }
+          break;
+        case 5:
+          /* ACK sent: small pbuf, freed right away */
+          p = mem_trace_malloc(60, &res);
+          if (p != NULL) {
+            mem_trace_free(p, &res);
+          }
+          break;
+        case 6:
+          /* UDP datagram, freed after a few more */
+          if (udp[udp_head] != NULL) {
+            mem_trace_free(udp[udp_head], &res);
+          }
+          udp[udp_head] = mem_trace_malloc((mem_size_t)(32 + ((r >> 4) % 480)), &res);
+          udp_head = (udp_head + 1) % MEM_TRACE_UDP_QUEUE;
+          break;
+        default:
+          /* long-lived allocation replaced */
+          i = (int)((r >> 4) % MEM_TRACE_LONG_LIVED);
+          if (longlived[i] != NULL) {
+            mem_trace_free(longlived[i], &res);
+          }
+          longlived[i] = mem_trace_malloc((mem_size_t)(16 + ((r >> 8) % 240)), &res);
+          break;
+      }
+    }
+  }
+  printf("mem trace replay (%s heap): %.1f ns/op, %d of %d ops failed (%d full, %d fragmented), max used %d of %d\n",
+    MEM_USE_TLSF ? "TLSF" : "first-fit",
+    (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / res.ops, res.failed, res.ops,
+    res.failed_full, res.failed - res.failed_full,
+    (int)lwip_stats.mem.max, (int)lwip_stats.mem.avail);
+
+  for (; tcp_num > 0; tcp_num--) {
+    mem_free(tcp[tcp_head]);
+    tcp_head = (tcp_head + 1) % MEM_TRACE_TCP_QUEUE;
+  }
+  for (i = 0; i < MEM_TRACE_UDP_QUEUE; i++) {
+    mem_free(udp[i]);
+  }
+  for (i = 0; i < MEM_TRACE_LONG_LIVED; i++) {
+    mem_free(longlived[i]);
+  }
+  fail_unless(lwip_stats.mem.used == 0);
+  /* all free blocks have been merged again */
+  p = mem_malloc(MEM_SIZE / 2);
+  fail_unless(p != NULL);
+  mem_free(p);
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 mem_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_mem_one),
-    TESTFUNC(test_mem_random)
+    TESTFUNC(test_mem_random),
+    TESTFUNC(test_mem_trace_replay)
   };
   return create_suite("MEM", tests, sizeof(tests)/sizeof(testfunc), mem_setup, mem_teardown);
 }
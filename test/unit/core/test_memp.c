@@ -0,0 +1,322 @@
+#include "test_memp.h"
+
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !LWIP_STATS || !MEMP_STATS
+#error "This tests needs MEMP-statistics enabled"
+#endif
+#if !MEMP_MAGAZINES || !MEMP_LOCKFREE
+#error "This tests needs MEMP_MAGAZINES and MEMP_LOCKFREE enabled"
+#endif
+#if MEMP_NUM_UDP_PCB < 4 * MEMP_MAGAZINE_SIZE
+#error "This tests needs a udp pcb pool that is cached in magazines"
+#endif
+#if MEMP_NUM_PBUF >= 4 * MEMP_MAGAZINE_SIZE
+#error "This tests needs a pbuf pool that is too small for magazines"
+#endif
+
+/* MEMP_MAGAZINES_GET() as defined in lwipopts.h: NULL (no magazines) except
+   while a test of this suite runs */
+struct memp_magazines *test_memp_magazines;
+/* LWIP_HOOK_MEMP_AVAILABLE as defined in lwipopts.h counts here */
+unsigned int test_memp_available[MEMP_MAX];
+
+#define MEMP_STRESS_THREADS   4
+#define MEMP_STRESS_LOOPS     200000
+#define MEMP_STRESS_HOLD      16
+
+struct memp_stress_thread {
+  pthread_t thread;
+  unsigned int seed;
+  u8_t id;
+  int errors;
+  int allocs;
+};
+
+static struct memp_magazines test_mags;
+
+/* Setups/teardown functions */
+
+static void
+memp_setup(void)
+{
+  memset(&test_mags, 0, sizeof(test_mags));
+  test_memp_magazines = &test_mags;
+}
+
+static void
+memp_teardown(void)
+{
+  memp_magazines_flush(&test_mags);
+  test_memp_magazines = NULL;
+}
+
+
+/* Test functions */
+
+/** Allocate and free through a magazine, check the stats are in sync after flushing */
+START_TEST(test_memp_magazine_cache)
+{
+  void *p1, *p2;
+  mem_size_t used = lwip_stats.memp[MEMP_UDP_PCB].used;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == 0);
+
+  /* the first allocation refills half a magazine */
+  p1 = memp_malloc(MEMP_UDP_PCB);
+  fail_unless(p1 != NULL);
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == (MEMP_MAGAZINE_SIZE + 1) / 2 - 1);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == (MEMP_MAGAZINE_SIZE + 1) / 2);
+  /* the second one is served from the magazine */
+  p2 = memp_malloc(MEMP_UDP_PCB);
+  fail_unless(p2 != NULL);
+  fail_unless(p2 != p1);
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == (MEMP_MAGAZINE_SIZE + 1) / 2 - 2);
+
+  memp_free(MEMP_UDP_PCB, p1);
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == (MEMP_MAGAZINE_SIZE + 1) / 2 - 1);
+  /* LIFO: the element just freed is handed out again */
+  fail_unless(memp_malloc(MEMP_UDP_PCB) == p1);
+
+  memp_magazines_flush(&test_mags);
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == 0);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == 0);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == used + 2);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].max >= used + 2);
+
+  memp_free(MEMP_UDP_PCB, p1);
+  memp_free(MEMP_UDP_PCB, p2);
+  memp_magazines_flush(&test_mags);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == used);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == 0);
+
+  /* pools too small for magazines are used directly */
+  p1 = memp_malloc(MEMP_PBUF);
+  fail_unless(p1 != NULL);
+  fail_unless(test_mags.pool[MEMP_PBUF].count == 0);
+  fail_unless(lwip_stats.memp[MEMP_PBUF].used == 1);
+  memp_free(MEMP_PBUF, p1);
+  fail_unless(test_mags.pool[MEMP_PBUF].count == 0);
+  fail_unless(lwip_stats.memp[MEMP_PBUF].used == 0);
+}
+END_TEST
+
+/** Registered magazines report how much each of them caches */
+START_TEST(test_memp_magazine_stats)
+{
+  struct memp_magazines other;
+  void *p1, *p2;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&other, 0, sizeof(other));
+  memp_magazines_register(&test_mags, "test");
+  memp_magazines_register(&other, "other");
+  fail_unless(memp_magazines_list == &other);
+  fail_unless(other.next == &test_mags);
+  fail_unless(strcmp(test_mags.name, "test") == 0);
+
+  /* one element taken from each magazine */
+  p1 = memp_malloc(MEMP_UDP_PCB);
+  test_memp_magazines = &other;
+  p2 = memp_malloc(MEMP_UDP_PCB);
+  fail_unless((p1 != NULL) && (p2 != NULL));
+  /* p1 freed into the other thread's magazine */
+  memp_free(MEMP_UDP_PCB, p1);
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == (MEMP_MAGAZINE_SIZE + 1) / 2 - 1);
+  fail_unless(other.pool[MEMP_UDP_PCB].count == (MEMP_MAGAZINE_SIZE + 1) / 2);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == 2 * ((MEMP_MAGAZINE_SIZE + 1) / 2));
+  stats_display_memp_magazines(&test_mags);
+
+  memp_free(MEMP_UDP_PCB, p2);
+  memp_magazines_flush(&other);
+  memp_magazines_unregister(&other);
+  fail_unless(memp_magazines_list == &test_mags);
+  memp_magazines_unregister(&test_mags);
+  fail_unless(memp_magazines_list == NULL);
+  test_memp_magazines = &test_mags;
+}
+END_TEST
+
+/** Exhaust a pool through a magazine, then free everything again */
+START_TEST(test_memp_magazine_exhaust)
+{
+  void *p[MEMP_NUM_UDP_PCB];
+  int i, num;
+  STAT_COUNTER err = lwip_stats.memp[MEMP_UDP_PCB].err;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
+
+  for (num = 0; num < MEMP_NUM_UDP_PCB; num++) {
+    p[num] = memp_malloc(MEMP_UDP_PCB);
+    fail_unless(p[num] != NULL);
+  }
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count == 0);
+  fail_unless(memp_malloc(MEMP_UDP_PCB) == NULL);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].err == err + 1);
+
+  /* a full magazine is flushed to half its size */
+  for (i = 0; i < num; i++) {
+    memp_free(MEMP_UDP_PCB, p[i]);
+    fail_unless(test_mags.pool[MEMP_UDP_PCB].count <= MEMP_MAGAZINE_SIZE);
+  }
+  fail_unless(test_mags.pool[MEMP_UDP_PCB].count > 0);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].max == MEMP_NUM_UDP_PCB);
+
+  memp_magazines_flush(&test_mags);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].cached == 0);
+
+  /* all elements are back in the pool */
+  test_memp_magazines = NULL;
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    p[i] = memp_malloc(MEMP_UDP_PCB);
+    fail_unless(p[i] != NULL);
+  }
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    memp_free(MEMP_UDP_PCB, p[i]);
+  }
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
+}
+END_TEST
+
+/** LWIP_HOOK_MEMP_AVAILABLE is called when an element is returned to an
+ * empty pool, directly or through a magazine */
+START_TEST(test_memp_available_hook)
+{
+  void *p[MEMP_NUM_UDP_PCB];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  /* directly */
+  test_memp_magazines = NULL;
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    p[i] = memp_malloc(MEMP_UDP_PCB);
+    fail_unless(p[i] != NULL);
+  }
+  fail_unless(memp_malloc(MEMP_UDP_PCB) == NULL);
+  test_memp_available[MEMP_UDP_PCB] = 0;
+  memp_free(MEMP_UDP_PCB, p[0]);
+  fail_unless(test_memp_available[MEMP_UDP_PCB] == 1);
+  memp_free(MEMP_UDP_PCB, p[1]);
+  fail_unless(test_memp_available[MEMP_UDP_PCB] == 1);
+  p[0] = memp_malloc(MEMP_UDP_PCB);
+  p[1] = memp_malloc(MEMP_UDP_PCB);
+  fail_unless((p[0] != NULL) && (p[1] != NULL));
+
+  /* through a magazine: only when it is flushed */
+  test_memp_magazines = &test_mags;
+  test_memp_available[MEMP_UDP_PCB] = 0;
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    memp_free(MEMP_UDP_PCB, p[i]);
+    if (i < MEMP_MAGAZINE_SIZE) {
+      fail_unless(test_memp_available[MEMP_UDP_PCB] == 0);
+    }
+  }
+  fail_unless(test_memp_available[MEMP_UDP_PCB] == 1);
+  memp_magazines_flush(&test_mags);
+  fail_unless(test_memp_available[MEMP_UDP_PCB] == 1);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
+}
+END_TEST
+
+/** Allocate and free elements at random, fill every element with the
+ * thread's id and check nobody else wrote to it before freeing it */
+static void *
+memp_stress_thread_fn(void *arg)
+{
+  struct memp_stress_thread *t = (struct memp_stress_thread *)arg;
+  u8_t *held[MEMP_STRESS_HOLD];
+  int num = 0;
+  int i;
+  size_t k;
+
+  for (i = 0; i < MEMP_STRESS_LOOPS; i++) {
+    if ((num < MEMP_STRESS_HOLD) && ((num == 0) || (rand_r(&t->seed) & 1))) {
+      u8_t *p = (u8_t *)memp_malloc(MEMP_UDP_PCB);
+      if (p != NULL) {
+        memset(p, t->id, sizeof(struct udp_pcb));
+        held[num++] = p;
+        t->allocs++;
+      }
+    } else {
+      int j = (int)(rand_r(&t->seed) % (unsigned int)num);
+      u8_t *p = held[j];
+      for (k = 0; k < sizeof(struct udp_pcb); k++) {
+        if (p[k] != t->id) {
+          t->errors++;
+          break;
+        }
+      }
+      held[j] = held[--num];
+      memp_free(MEMP_UDP_PCB, p);
+    }
+  }
+  while (num > 0) {
+    memp_free(MEMP_UDP_PCB, held[--num]);
+  }
+  return NULL;
+}
+
+/** Hammer one pool from several threads, then check it is still intact */
+START_TEST(test_memp_lockfree_stress)
+{
+  struct memp_stress_thread threads[MEMP_STRESS_THREADS];
+  struct stats_mem stats = lwip_stats.memp[MEMP_UDP_PCB];
+  void *p[MEMP_NUM_UDP_PCB];
+  int i, j;
+  LWIP_UNUSED_ARG(_i);
+
+  /* MEMP_MAGAZINES_GET() is not per-thread in the unit tests */
+  test_memp_magazines = NULL;
+
+  memset(threads, 0, sizeof(threads));
+  for (i = 0; i < MEMP_STRESS_THREADS; i++) {
+    threads[i].id = (u8_t)(i + 1);
+    threads[i].seed = (unsigned int)(i + 1);
+    fail_unless(pthread_create(&threads[i].thread, NULL, memp_stress_thread_fn, &threads[i]) == 0);
+  }
+  for (i = 0; i < MEMP_STRESS_THREADS; i++) {
+    fail_unless(pthread_join(threads[i].thread, NULL) == 0);
+    fail_unless(threads[i].errors == 0);
+    fail_unless(threads[i].allocs > 0);
+  }
+  /* the statistics are not updated atomically: restore them */
+  lwip_stats.memp[MEMP_UDP_PCB] = stats;
+
+  /* every element is in the pool exactly once */
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    p[i] = memp_malloc(MEMP_UDP_PCB);
+    fail_unless(p[i] != NULL);
+    for (j = 0; j < i; j++) {
+      fail_unless(p[i] != p[j]);
+    }
+  }
+  fail_unless(memp_malloc(MEMP_UDP_PCB) == NULL);
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    memp_free(MEMP_UDP_PCB, p[i]);
+  }
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+memp_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_memp_magazine_cache),
+    TESTFUNC(test_memp_magazine_exhaust),
+    TESTFUNC(test_memp_magazine_stats),
+    TESTFUNC(test_memp_available_hook),
+    TESTFUNC(test_memp_lockfree_stress)
+  };
+  return create_suite("MEMP", tests, sizeof(tests)/sizeof(testfunc), memp_setup, memp_teardown);
+}
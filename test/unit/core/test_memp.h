@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_MEMP_H__
+#define LWIP_HDR_TEST_MEMP_H__
+
+#include "../lwip_check.h"
+
+Suite *memp_suite(void);
+
+#endif
@@ -224,6 +224,70 @@ START_TEST(test_pbuf_get_put_at_edge)
 }
 END_TEST
 
+#if PBUF_RAM_ARENAS
+/** PBUF_RAM pbufs come from the smallest size class they fit into and from
+ * the heap if that class is empty or none fits */
+START_TEST(test_pbuf_ram_arenas)
+{
+  struct pbuf *p[PBUF_RAM_ARENA_NUM_128 + 1];
+  struct pbuf *q;
+  struct stats_pbuf_arena small = lwip_stats.pbuf_arena[0];
+  struct stats_pbuf_arena jumbo = lwip_stats.pbuf_arena[PBUF_RAM_ARENA_CLASSES - 1];
+  mem_size_t heap_used = lwip_stats.mem.used;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(PBUF_RAM_ARENA_CLASSES == 6);
+
+  for (i = 0; i < PBUF_RAM_ARENA_NUM_128; i++) {
+    p[i] = pbuf_alloc(PBUF_RAW, 64, PBUF_RAM);
+    fail_unless(p[i] != NULL);
+    fail_unless(p[i]->arena == 1);
+    /* the rest of the 128 byte element can be used */
+    fail_unless(pbuf_ram_capacity(p[i]) > 64);
+  }
+  fail_unless(lwip_stats.pbuf_arena[0].hit == small.hit + PBUF_RAM_ARENA_NUM_128);
+  fail_unless(lwip_stats.mem.used == heap_used);
+  /* the class is empty: the heap is used */
+  p[i] = pbuf_alloc(PBUF_RAW, 64, PBUF_RAM);
+  fail_unless(p[i] != NULL);
+  fail_unless(p[i]->arena == 0);
+  fail_unless(pbuf_ram_capacity(p[i]) == 64);
+  fail_unless(lwip_stats.pbuf_arena[0].miss == small.miss + 1);
+  fail_unless(lwip_stats.mem.used > heap_used);
+
+  /* trimming leaves pool elements alone */
+  pbuf_realloc(p[0], 10);
+  fail_unless(p[0]->len == 10);
+  fail_unless(pbuf_ram_capacity(p[0]) > 64);
+
+  for (i = 0; i <= PBUF_RAM_ARENA_NUM_128; i++) {
+    pbuf_free(p[i]);
+  }
+  fail_unless(lwip_stats.mem.used == heap_used);
+  fail_unless(lwip_stats.memp[MEMP_PBUF_RAM_128].used == 0);
+
+  /* a full-sized TCP segment fits into the 2048 byte class,
+     bigger ones into the jumbo class */
+  q = pbuf_alloc(PBUF_TRANSPORT, 1460, PBUF_RAM);
+  fail_unless(q != NULL);
+  fail_unless(q->arena == 5);
+  pbuf_free(q);
+  q = pbuf_alloc(PBUF_TRANSPORT, 8000, PBUF_RAM);
+  fail_unless(q != NULL);
+  fail_unless(q->arena == 6);
+  fail_unless(lwip_stats.pbuf_arena[PBUF_RAM_ARENA_CLASSES - 1].hit == jumbo.hit + 1);
+  pbuf_free(q);
+  /* too big for every class */
+  q = pbuf_alloc(PBUF_TRANSPORT, PBUF_RAM_ARENA_JUMBO_SIZE, PBUF_RAM);
+  fail_unless(q != NULL);
+  fail_unless(q->arena == 0);
+  pbuf_free(q);
+  fail_unless(lwip_stats.mem.used == heap_used);
+}
+END_TEST
+#endif /* PBUF_RAM_ARENAS */
+
 /** Create the suite including all tests for this module */
 Suite *
 pbuf_suite(void)
@@ -233,7 +297,10 @@ pbuf_suite(void)
     TESTFUNC(test_pbuf_split_64k_on_small_pbufs),
     TESTFUNC(test_pbuf_queueing_bigger_than_64k),
     TESTFUNC(test_pbuf_take_at_edge),
-    TESTFUNC(test_pbuf_get_put_at_edge)
+    TESTFUNC(test_pbuf_get_put_at_edge),
+#if PBUF_RAM_ARENAS
+    TESTFUNC(test_pbuf_ram_arenas)
+#endif /* PBUF_RAM_ARENAS */
   };
   return create_suite("PBUF", tests, sizeof(tests)/sizeof(testfunc), pbuf_setup, pbuf_teardown);
 }
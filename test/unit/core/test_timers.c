@@ -0,0 +1,219 @@
+#include "test_timers.h"
+
+#include "lwip/timers.h"
+#include "lwip/sys.h"
+#include "lwip/wheel.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#if !LWIP_TIMERS
+#error "This tests needs timers enabled"
+#endif
+
+#define TIMERS_NUM_ORDER    20
+#define TIMERS_NUM_BENCH    10000
+#define TIMERS_NUM_WHEEL    70000
+
+static int timers_fired[TIMERS_NUM_ORDER];
+static int timers_fired_cnt;
+
+/* Setups/teardown functions */
+
+static void
+timers_setup(void)
+{
+  timers_fired_cnt = 0;
+  /* get rid of stack timers that expired while other tests were running */
+  sys_check_timeouts();
+}
+
+static void
+timers_teardown(void)
+{
+}
+
+static void
+timers_record(void *arg)
+{
+  if (timers_fired_cnt < TIMERS_NUM_ORDER) {
+    timers_fired[timers_fired_cnt] = (int)(mem_ptr_t)arg;
+  }
+  timers_fired_cnt++;
+}
+
+static void
+timers_never(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  fail();
+}
+
+/* Test functions */
+
+/** Timeouts must fire in order of expiry and cancelled ones must not fire */
+START_TEST(test_timers_order)
+{
+  int i, j;
+  u32_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  /* insert in scrambled order, 5ms apart */
+  for (i = 0; i < TIMERS_NUM_ORDER; i++) {
+    j = (i * 7) % TIMERS_NUM_ORDER;
+    sys_timeout((u32_t)(j + 1) * 5, timers_record, (void *)(mem_ptr_t)j);
+  }
+  sys_untimeout(timers_record, (void *)(mem_ptr_t)3);
+  sys_untimeout(timers_record, (void *)(mem_ptr_t)11);
+  fail_unless(sys_timeouts_sleeptime() <= 5);
+
+  /* the unit tests run on a simulated clock */
+  start = sys_now();
+  while ((timers_fired_cnt < TIMERS_NUM_ORDER - 2) && ((u32_t)(sys_now() - start) < 1000)) {
+    test_tcp_now++;
+    sys_check_timeouts();
+  }
+  fail_unless(timers_fired_cnt == TIMERS_NUM_ORDER - 2);
+  for (i = 1; i < timers_fired_cnt; i++) {
+    fail_unless(timers_fired[i - 1] < timers_fired[i]);
+    fail_unless(timers_fired[i] != 3);
+    fail_unless(timers_fired[i] != 11);
+  }
+}
+END_TEST
+
+/** Timeouts far in the future (beyond the wheel span) can be cancelled, and
+ * they fire on time after being cascaded down */
+START_TEST(test_timers_long)
+{
+  u32_t sleeptime, start, due;
+  LWIP_UNUSED_ARG(_i);
+
+  sys_timeout(10 * 60 * 60 * 1000, timers_never, NULL);
+  sys_timeout(60 * 1000, timers_never, NULL);
+  sleeptime = sys_timeouts_sleeptime();
+  fail_unless(sleeptime > 0);
+  fail_unless(sleeptime != 0xffffffff);
+  sys_check_timeouts();
+  sys_untimeout(timers_never, NULL);
+  sys_untimeout(timers_never, NULL);
+  sys_check_timeouts();
+
+  /* 5 hours (the wheel spans 2^24 ms): sleep as long as we are told, like
+     a main loop would, it must never take us past the expiry */
+  start = sys_now();
+  due = 5 * 60 * 60 * 1000;
+  sys_timeout(due, timers_record, (void *)(mem_ptr_t)1);
+  while (timers_fired_cnt == 0) {
+    sleeptime = sys_timeouts_sleeptime();
+    fail_unless(sleeptime != 0xffffffff);
+    fail_unless((u32_t)(sys_now() - start) + sleeptime <= due);
+    test_tcp_now += (sleeptime != 0) ? sleeptime : 1;
+    sys_check_timeouts();
+  }
+  fail_unless(timers_fired_cnt == 1);
+  fail_unless(timers_fired[0] == 1);
+  fail_unless((u32_t)(sys_now() - start) == due);
+}
+END_TEST
+
+/** Measure sys_timeout/sys_check_timeouts/sys_untimeout with 10k outstanding
+ * timeouts. Not a pass/fail test: run with LWIP_TIMERS_WHEEL 0 and 1 to
+ * compare the list and wheel backends. */
+START_TEST(test_timers_10k_outstanding)
+{
+  int i;
+  u32_t seed = 1;
+  clock_t start;
+  double ns_add, ns_check, ns_cancel;
+  LWIP_UNUSED_ARG(_i);
+
+  start = clock();
+  for (i = 0; i < TIMERS_NUM_BENCH; i++) {
+    seed = seed * 1103515245 + 12345;
+    /* somewhere between 10s and ~1h */
+    sys_timeout(10000 + (seed >> 10) % 3600000, timers_never, (void *)(mem_ptr_t)(i + 1));
+  }
+  ns_add = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / TIMERS_NUM_BENCH;
+
+  /* one tick per call: none of the timeouts is due in this second */
+  start = clock();
+  for (i = 0; i < 1000; i++) {
+    test_tcp_now++;
+    sys_check_timeouts();
+  }
+  ns_check = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / 1000;
+
+  start = clock();
+  for (i = 0; i < TIMERS_NUM_BENCH; i++) {
+    /* cancel in a different order than inserted */
+    sys_untimeout(timers_never, (void *)(mem_ptr_t)(((i * 7919) % TIMERS_NUM_BENCH) + 1));
+  }
+  ns_cancel = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / TIMERS_NUM_BENCH;
+
+  printf("sys_timeout %s, %d outstanding: add %.1f ns, check %.1f ns, cancel %.1f ns\n",
+    LWIP_TIMERS_WHEEL ? "wheel" : "list", TIMERS_NUM_BENCH, ns_add, ns_check, ns_cancel);
+}
+END_TEST
+
+#if LWIP_WHEEL
+WHEEL_DECLARE(timers_wheel, 3);
+#endif /* LWIP_WHEEL */
+
+/** The shared timing wheel keeps count of more nodes than fit in 16 bits and
+ * hands out each node in the tick it is due, including those parked beyond
+ * the span of the top level */
+START_TEST(test_timers_wheel)
+{
+#if LWIP_WHEEL
+  struct wheel_node *nodes, *n;
+  u32_t i, seed = 1, now, expired = 0;
+  LWIP_UNUSED_ARG(_i);
+
+  nodes = (struct wheel_node *)calloc(TIMERS_NUM_WHEEL, sizeof(struct wheel_node));
+  fail_unless(nodes != NULL);
+  now = 0xfffff000UL;
+  timers_wheel.time = now;
+  for (i = 0; i < TIMERS_NUM_WHEEL; i++) {
+    seed = seed * 1103515245 + 12345;
+    /* up to 2^20 ticks, 2^18 is the span of 3 levels */
+    nodes[i].due = now + (seed >> 12);
+    wheel_insert(&timers_wheel, &nodes[i]);
+  }
+  fail_unless(timers_wheel.pending == TIMERS_NUM_WHEEL);
+  fail_unless(!WHEEL_TIME_LESS(wheel_next(&timers_wheel), now));
+
+  while (timers_wheel.pending > 0) {
+    /* jump ahead like a sleeping main loop would */
+    now = wheel_next(&timers_wheel);
+    while (wheel_advance(&timers_wheel, now)) {
+      while ((n = timers_wheel.expired) != NULL) {
+        fail_unless(n->due == timers_wheel.time - 1);
+        wheel_remove(&timers_wheel, n);
+        expired++;
+      }
+    }
+  }
+  fail_unless(expired == TIMERS_NUM_WHEEL);
+  for (i = 0; i < 3; i++) {
+    fail_unless(timers_wheel.level_cnt[i] == 0);
+  }
+  free(nodes);
+#else /* LWIP_WHEEL */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_WHEEL */
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+timers_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_timers_order),
+    TESTFUNC(test_timers_long),
+    TESTFUNC(test_timers_wheel),
+    TESTFUNC(test_timers_10k_outstanding)
+  };
+  return create_suite("TIMERS", tests, sizeof(tests)/sizeof(testfunc), timers_setup, timers_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TIMERS_H__
+#define LWIP_HDR_TEST_TIMERS_H__
+
+#include "../lwip_check.h"
+
+Suite *timers_suite(void);
+
+#endif
@@ -1,12 +1,23 @@
 #include "lwip_check.h"
 
+#include "lwip/opt.h"
+
+#if NO_SYS
 #include "udp/test_udp.h"
 #include "tcp/test_tcp.h"
 #include "tcp/test_tcp_oos.h"
+#include "tcp/test_tcp_cc.h"
+#include "tcp/test_tcp_rack.h"
 #include "core/test_mem.h"
+#include "core/test_memp.h"
 #include "core/test_pbuf.h"
+#include "core/test_timers.h"
+#include "core/test_chksum.h"
 #include "etharp/test_etharp.h"
 #include "dhcp/test_dhcp.h"
+#else /* NO_SYS */
+#include "api/test_sockets.h"
+#endif /* NO_SYS */
 
 #include "lwip/init.h"
 
@@ -36,18 +47,30 @@ int main(void)
   SRunner *sr;
   size_t i;
   suite_getter_fn* suites[] = {
+#if NO_SYS
     udp_suite,
     tcp_suite,
     tcp_oos_suite,
+    tcp_cc_suite,
+    tcp_rack_suite,
     mem_suite,
+    memp_suite,
     pbuf_suite,
+    timers_suite,
+    chksum_suite,
     etharp_suite,
     dhcp_suite
+#else /* NO_SYS */
+    /* the socket tests start the tcpip thread (which initializes the stack) */
+    sockets_suite
+#endif /* NO_SYS */
   };
   size_t num = sizeof(suites)/sizeof(void*);
   LWIP_ASSERT("No suites defined", num > 0);
 
+#if NO_SYS
   lwip_init();
+#endif /* NO_SYS */
 
   sr = srunner_create((suites[0])());
   for(i = 1; i < num; i++) {
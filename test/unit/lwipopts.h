@@ -32,10 +32,13 @@
 #ifndef LWIP_HDR_LWIPOPTS_H__
 #define LWIP_HDR_LWIPOPTS_H__
 
-/* Prevent having to link sys_arch.c (we don't test the API layers in unit tests) */
+/* The core tests run without an OS (NO_SYS). Build with NO_SYS=0 to run the
+   socket API tests instead: they need the pthread port in arch/sys_arch.c */
+#ifndef NO_SYS
 #define NO_SYS                          1
-#define LWIP_NETCONN                    0
-#define LWIP_SOCKET                     0
+#endif
+#define LWIP_NETCONN                    !NO_SYS
+#define LWIP_SOCKET                     !NO_SYS
 
 /* Enable DHCP to test it, disable UDP checksum to easier inject packets */
 #define LWIP_DHCP                       1
@@ -43,14 +46,141 @@
 /* Minimal changes to opt.h required for tcp unit tests: */
 #define MEM_SIZE                        16000
 #define TCP_SND_QUEUELEN                40
-#define MEMP_NUM_TCP_SEG                TCP_SND_QUEUELEN
+/* test_tcp_recv_ooseq_fuzz queues a few hundred segments */
+#define MEMP_NUM_TCP_SEG                256
 #define TCP_SND_BUF                     (12 * TCP_MSS)
 #define TCP_WND                         (10 * TCP_MSS)
 #define LWIP_WND_SCALE                  1
 #define TCP_RCV_SCALE                   0
+#define LWIP_TCP_SACK                   1
+
+/* All congestion control modules, on the simulated clock of the test port
+   (arch/sys_arch.c) */
+#define LWIP_TCP_CC_CUBIC               1
+#define LWIP_TCP_CC_BBR                 1
+#if NO_SYS
+extern unsigned int test_tcp_now;
+#define TCP_NOW()                       test_tcp_now
+#endif
+
+/* Millisecond RTT estimation, sampled from timestamps */
+#define LWIP_TCP_RTT_MS                 1
+#define LWIP_TCP_TIMESTAMPS             1
+/* RACK loss detection and tail loss probes (SACK connections only) */
+#define LWIP_TCP_RACK                   1
 #define PBUF_POOL_SIZE                  400 // pbuf tests need ~200KByte
 
+/* Hashed pcb lookup, scaled up for the pcb lookup test (10000 pcbs) */
+#define LWIP_TCP_PCB_HASH               1
+#define TCP_PCB_HASH_SIZE               4096
+#define MEMP_NUM_TCP_PCB                10000
+
+/* Hashed UDP pcb lookup (small table to get collisions) and SO_REUSEPORT */
+#define LWIP_UDP_PCB_HASH               1
+#define UDP_PCB_HASH_SIZE               8
+#define LWIP_UDP_REUSEPORT              1
+#define MEMP_NUM_UDP_PCB                40
+
+/* Timing wheel timeouts, enough of them for the 10k outstanding benchmark
+   (build with LWIP_TIMERS_WHEEL=0 to compare with the sorted list) */
+#ifndef LWIP_TIMERS_WHEEL
+#define LWIP_TIMERS_WHEEL               1
+#endif
+#define LWIP_TCP_PCB_TIMERS             1
+#define MEMP_NUM_SYS_TIMEOUT            10016
+#define SYS_TIMEOUT_HASH_SIZE           8192
+
+/* x86-64 (GCC/clang): use the SSE2/AVX2 checksum kernels, so that
+   test_chksum checks every kernel against the reference implementation and
+   the benchmark lists them. Build with LWIP_CHKSUM_ALGORITHM=2 to run the
+   tests with the portable C version instead. */
+#if !defined(LWIP_CHKSUM_ALGORITHM) && defined(__x86_64__) && defined(__GNUC__)
+#define LWIP_CHKSUM_ALGORITHM           4
+#endif
+
+/* Checksum on copy (fused copy+checksum kernels) */
+#define LWIP_CHECKSUM_ON_COPY           1
+
+/* Checksum and segmentation offload (test netifs emulate the hardware) */
+#define LWIP_NETIF_OFFLOAD              1
+/* GSO data references: test_tcp_tx_offload_gso_queued holds 8 segments */
+#define MEMP_NUM_FRAG_PBUF              32
+
+/* Generic receive offload (only active between ip4_gro_start/flush) */
+#define IP_GRO                          1
+
+/* The unit tests are run with both heaps: first-fit (default) and TLSF
+   (build with MEM_USE_TLSF=1); test_mem_trace_replay prints the results */
+#ifndef MEM_USE_TLSF
+#define MEM_USE_TLSF                    0
+#endif
+
+/* PBUF_RAM size classes (small ones so the pbuf tests can exhaust them) */
+#define PBUF_RAM_ARENAS                 1
+#define PBUF_RAM_ARENA_NUM_128          4
+#define PBUF_RAM_ARENA_NUM_JUMBO        2
+
+/* Per-thread memp magazines (only used while test_memp sets a magazine) */
+#define MEMP_MAGAZINES                  1
+#define MEMP_MAGAZINE_SIZE              8
+struct memp_magazines;
+#if NO_SYS
+extern struct memp_magazines *test_memp_magazines;
+#define MEMP_MAGAZINES_GET()            test_memp_magazines
+#else
+/* thread local magazines of the test port */
+struct memp_magazines *sys_arch_magazines(void);
+#define MEMP_MAGAZINES_GET()            sys_arch_magazines()
+#endif
+
+/* Lock-free memp freelists, count LWIP_HOOK_MEMP_AVAILABLE calls per pool */
+#define MEMP_LOCKFREE                   1
+#if NO_SYS
+extern unsigned int test_memp_available[];
+#define LWIP_HOOK_MEMP_AVAILABLE(type)  test_memp_available[type]++
+#endif
+
 /* Minimal changes to opt.h required for etharp unit tests: */
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
 
+#if !NO_SYS
+/* Socket API tests: loopback netif, the tcpip thread runs the stack */
+#define SYS_LIGHTWEIGHT_PROT            1
+/* netconn calls run under the core lock, -DLWIP_TCPIP_CORE_LOCKING=0 posts
+   them to the tcpip thread's mailbox */
+#ifndef LWIP_TCPIP_CORE_LOCKING
+#define LWIP_TCPIP_CORE_LOCKING         1
+#endif
+#define LWIP_NETIF_LOOPBACK             1
+#define LWIP_HAVE_LOOPIF                1
+#define LWIP_SO_RCVTIMEO                1
+#define LWIP_SO_SNDTIMEO                1
+#define TCPIP_MBOX_SIZE                 64
+#define DEFAULT_UDP_RECVMBOX_SIZE       16
+#define DEFAULT_TCP_RECVMBOX_SIZE       16
+#define DEFAULT_ACCEPTMBOX_SIZE         4
+#define MEMP_NUM_NETBUF                 16
+/* test_sockets_tcp_idle_timers keeps 16 connections open */
+#define MEMP_NUM_NETCONN                40
+#define MEMP_NUM_TCPIP_MSG_INPKT        32
+/* the loopback netif posts a callback for every packet it queues */
+#define MEMP_NUM_TCPIP_MSG_API          32
+/* Deferred UDP receive checksum (checked while copying to the application) */
+#define LWIP_CHECKSUM_ON_COPY_RX        1
+/* Lending received pbufs to the application */
+#define LWIP_SOCKET_RECV_ZEROCOPY       1
+/* MSG_ZEROCOPY sends with completion callbacks */
+#define LWIP_SO_ZEROCOPY                1
+/* poll(), sharing the select wakeup code */
+#define LWIP_SOCKET_POLL                1
+/* epoll, test_sockets_epoll_level_edge opens two instances */
+#define LWIP_SOCKET_EPOLL               1
+#define LWIP_SOCKET_EPOLL_INSTANCES     2
+/* test_sockets.c holds back segments to control when the peer sees them */
+struct pbuf;
+struct netif;
+int test_sockets_ip4_input(struct pbuf *p, struct netif *inp);
+#define LWIP_HOOK_IP4_INPUT(p, inp)     test_sockets_ip4_input(p, inp)
+#endif /* !NO_SYS */
+
 #endif /* LWIP_HDR_LWIPOPTS_H__ */
@@ -5,6 +5,9 @@
 #include "lwip/pbuf.h"
 #include "lwip/inet_chksum.h"
 #include "lwip/ip_addr.h"
+#include "lwip/timers.h"
+
+#include <string.h>
 
 #if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
 #error "This tests needs TCP- and MEMP-statistics enabled"
@@ -39,23 +42,26 @@ tcp_remove_all(void)
 
 /** Create a TCP segment usable for passing to tcp_input */
 static struct pbuf*
-tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
+tcp_create_segment_opts(ip_addr_t* src_ip, ip_addr_t* dst_ip,
                    u16_t src_port, u16_t dst_port, void* data, size_t data_len,
-                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd)
+                   u32_t seqno, u32_t ackno, u8_t headerflags, u16_t wnd,
+                   const u8_t* opts, u8_t optlen)
 {
   struct pbuf *p, *q;
   struct ip_hdr* iphdr;
   struct tcp_hdr* tcphdr;
-  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + sizeof(struct tcp_hdr) + data_len);
+  u16_t hdr_len = (u16_t)(sizeof(struct tcp_hdr) + optlen);
+  u16_t pbuf_len = (u16_t)(sizeof(struct ip_hdr) + hdr_len + data_len);
   LWIP_ASSERT("data_len too big", data_len <= 0xFFFF);
+  LWIP_ASSERT("invalid optlen", (optlen <= 40) && ((optlen & 3) == 0));
 
   p = pbuf_alloc(PBUF_RAW, pbuf_len, PBUF_POOL);
   EXPECT_RETNULL(p != NULL);
   /* first pbuf must be big enough to hold the headers */
-  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+  EXPECT_RETNULL(p->len >= (sizeof(struct ip_hdr) + hdr_len));
   if (data_len > 0) {
     /* first pbuf must be big enough to hold at least 1 data byte, too */
-    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + sizeof(struct tcp_hdr)));
+    EXPECT_RETNULL(p->len > (sizeof(struct ip_hdr) + hdr_len));
   }
 
   for(q = p; q != NULL; q = q->next) {
@@ -79,17 +85,20 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
   tcphdr->dest  = htons(dst_port);
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
-  TCPH_HDRLEN_SET(tcphdr, sizeof(struct tcp_hdr)/4);
+  TCPH_HDRLEN_SET(tcphdr, hdr_len/4);
   TCPH_FLAGS_SET(tcphdr, headerflags);
   tcphdr->wnd   = htons(wnd);
+  if (optlen > 0) {
+    memcpy(tcphdr + 1, opts, optlen);
+  }
 
   if (data_len > 0) {
     /* let p point to TCP data */
-    pbuf_header(p, -(s16_t)sizeof(struct tcp_hdr));
+    pbuf_header(p, -(s16_t)hdr_len);
     /* copy data */
     pbuf_take(p, data, (u16_t)data_len);
     /* let p point to TCP header again */
-    pbuf_header(p, sizeof(struct tcp_hdr));
+    pbuf_header(p, hdr_len);
   }
 
   /* calculate checksum */
@@ -108,8 +117,19 @@ tcp_create_segment(ip_addr_t* src_ip, ip_addr_t* dst_ip,
                    u16_t src_port, u16_t dst_port, void* data, size_t data_len,
                    u32_t seqno, u32_t ackno, u8_t headerflags)
 {
-  return tcp_create_segment_wnd(src_ip, dst_ip, src_port, dst_port, data,
-    data_len, seqno, ackno, headerflags, TCP_WND);
+  return tcp_create_segment_opts(src_ip, dst_ip, src_port, dst_port, data,
+    data_len, seqno, ackno, headerflags, TCP_WND, NULL, 0);
+}
+
+/** Create a TCP segment with options (optlen must be a multiple of 4) */
+struct pbuf*
+tcp_create_segment_with_opts(ip_addr_t* src_ip, ip_addr_t* dst_ip,
+                   u16_t src_port, u16_t dst_port, void* data, size_t data_len,
+                   u32_t seqno, u32_t ackno, u8_t headerflags,
+                   const u8_t* opts, u8_t optlen)
+{
+  return tcp_create_segment_opts(src_ip, dst_ip, src_port, dst_port, data,
+    data_len, seqno, ackno, headerflags, TCP_WND, opts, optlen);
 }
 
 /** Create a TCP segment usable for passing to tcp_input
@@ -132,8 +152,47 @@ tcp_create_rx_segment(struct tcp_pcb* pcb, void* data, size_t data_len, u32_t se
 struct pbuf* tcp_create_rx_segment_wnd(struct tcp_pcb* pcb, void* data, size_t data_len,
                    u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags, u16_t wnd)
 {
-  return tcp_create_segment_wnd(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
-    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd);
+  return tcp_create_segment_opts(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
+    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd, NULL, 0);
+}
+
+/** Create a TCP segment usable for passing to tcp_input
+ * - IP-addresses, ports, seqno and ackno are taken from pcb
+ * - seqno and ackno can be altered with an offset
+ * - carries a SACK option with 'num' blocks: left and right edge (relative
+ *   to pcb->lastack) of each block in 'blocks'
+ */
+struct pbuf*
+tcp_create_rx_segment_sack(struct tcp_pcb* pcb, void* data, size_t data_len,
+                   u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags,
+                   const u32_t* blocks, u8_t num)
+{
+  return tcp_create_rx_segment_sack_wnd(pcb, data, data_len, seqno_offset, ackno_offset,
+    headerflags, blocks, num, TCP_WND);
+}
+
+/** Like tcp_create_rx_segment_sack(), but with a given window */
+struct pbuf*
+tcp_create_rx_segment_sack_wnd(struct tcp_pcb* pcb, void* data, size_t data_len,
+                   u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags,
+                   const u32_t* blocks, u8_t num, u16_t wnd)
+{
+  u8_t opts[40];
+  u8_t i;
+  u32_t edge;
+  LWIP_ASSERT("too many SACK blocks", num <= 4);
+
+  opts[0] = 1; /* NOP */
+  opts[1] = 1; /* NOP */
+  opts[2] = 5; /* SACK */
+  opts[3] = (u8_t)(2 + 8 * num);
+  for (i = 0; i < 2 * num; i++) {
+    edge = htonl(pcb->lastack + blocks[i]);
+    memcpy(&opts[4 + 4 * i], &edge, 4);
+  }
+  return tcp_create_segment_opts(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
+    data, data_len, pcb->rcv_nxt + seqno_offset, pcb->lastack + ackno_offset, headerflags, wnd,
+    opts, (u8_t)(4 + 8 * num));
 }
 
 /** Safely bring a tcp_pcb into the requested state */
@@ -143,23 +202,24 @@ tcp_set_state(struct tcp_pcb* pcb, enum tcp_state state, ip_addr_t* local_ip,
 {
   /* @todo: are these all states? */
   /* @todo: remove from previous list */
+  /* addresses and ports must be set before TCP_REG (pcb hash tables) */
   pcb->state = state;
   if (state == ESTABLISHED) {
-    TCP_REG(&tcp_active_pcbs, pcb);
     pcb->local_ip.addr = local_ip->addr;
     pcb->local_port = local_port;
     pcb->remote_ip.addr = remote_ip->addr;
     pcb->remote_port = remote_port;
+    TCP_REG(&tcp_active_pcbs, pcb);
   } else if(state == LISTEN) {
-    TCP_REG(&tcp_listen_pcbs.pcbs, pcb);
     pcb->local_ip.addr = local_ip->addr;
     pcb->local_port = local_port;
+    TCP_REG(&tcp_listen_pcbs.pcbs, pcb);
   } else if(state == TIME_WAIT) {
-    TCP_REG(&tcp_tw_pcbs, pcb);
     pcb->local_ip.addr = local_ip->addr;
     pcb->local_port = local_port;
     pcb->remote_ip.addr = remote_ip->addr;
     pcb->remote_port = remote_port;
+    TCP_REG(&tcp_tw_pcbs, pcb);
   } else {
     fail();
   }
@@ -303,3 +363,198 @@ void test_tcp_init_netif(struct netif *netif, struct test_tcp_txcounters *txcoun
   netif->next = NULL;
   netif_list = netif;
 }
+
+/** netif->output of a simulated link: queue data segments at the bottleneck */
+static err_t
+test_tcp_link_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct test_tcp_link *link = (struct test_tcp_link *)netif->state;
+  struct test_tcp_link_pkt *pkt;
+  struct tcp_hdr tcphdr;
+  u16_t iphlen, hdrlen;
+  u32_t seqno, idx;
+  u8_t ip_vhl, first;
+  int i, queued = 0;
+  LWIP_UNUSED_ARG(ipaddr);
+
+  pbuf_copy_partial(p, &ip_vhl, 1, 0);
+  iphlen = (u16_t)((ip_vhl & 0x0f) * 4);
+  pbuf_copy_partial(p, &tcphdr, sizeof(tcphdr), iphlen);
+  hdrlen = (u16_t)(TCPH_HDRLEN(&tcphdr) * 4);
+  if (p->tot_len == iphlen + hdrlen) {
+    /* no data: the receiver model does not need it */
+    return ERR_OK;
+  }
+  seqno = ntohl(tcphdr.seqno);
+  first = TCP_SEQ_GEQ(seqno, link->snd_max);
+  if (first) {
+    link->snd_max = seqno + p->tot_len - iphlen - hdrlen;
+  } else if (link->first_rexmit == 0) {
+    link->first_rexmit = test_tcp_now;
+  }
+  idx = (seqno - link->start) / TCP_MSS;
+  if (idx < TEST_TCP_LINK_SEGS) {
+    link->xmits[idx]++;
+    if (first && (link->drop & TEST_TCP_LINK_SEG(idx))) {
+      return ERR_OK;
+    }
+  }
+  if (link->num_pkts >= TEST_TCP_LINK_MAX_PKTS) {
+    link->dropped++;
+    return ERR_OK;
+  }
+  if (link->rate != 0) {
+    /* drop-tail: count the packets still waiting at the bottleneck */
+    for (i = 0; i < link->num_pkts; i++) {
+      if ((s32_t)(link->pkts[i].depart - test_tcp_now) > 0) {
+        queued++;
+      }
+    }
+    if (queued >= (int)link->queue) {
+      link->dropped++;
+      return ERR_OK;
+    }
+  }
+  pkt = &link->pkts[link->num_pkts++];
+  pkt->seqno = seqno;
+  pkt->len = (u16_t)(p->tot_len - iphlen - hdrlen);
+  pkt->depart = test_tcp_now;
+  if (link->rate != 0) {
+    if ((s32_t)(link->last_depart - test_tcp_now) < 0) {
+      link->last_depart = test_tcp_now;
+    }
+    link->last_depart += (p->tot_len + link->rate - 1) / link->rate;
+    pkt->depart = link->last_depart;
+  }
+  pkt->arrive = pkt->depart + link->delay;
+  if (first && (idx < TEST_TCP_LINK_SEGS) && (link->late & TEST_TCP_LINK_SEG(idx))) {
+    pkt->arrive += link->late_ms;
+  }
+  return ERR_OK;
+}
+
+/** The receiver of a simulated link got a segment: update its queue and
+ * send an ACK */
+static void
+test_tcp_link_receive(struct test_tcp_link *link, u32_t seqno, u16_t len)
+{
+  struct test_tcp_link_pkt *ack;
+  u32_t end = seqno + len;
+  int i, j;
+
+  if (TCP_SEQ_LEQ(seqno, link->rcv_nxt)) {
+    if (TCP_SEQ_GT(end, link->rcv_nxt)) {
+      link->rcv_nxt = end;
+    }
+    /* pull in the ooseq ranges now in sequence */
+    while ((link->num_ranges > 0) && TCP_SEQ_LEQ(link->ranges[0][0], link->rcv_nxt)) {
+      if (TCP_SEQ_GT(link->ranges[0][1], link->rcv_nxt)) {
+        link->rcv_nxt = link->ranges[0][1];
+      }
+      link->num_ranges--;
+      memmove(&link->ranges[0], &link->ranges[1], link->num_ranges * sizeof(link->ranges[0]));
+    }
+  } else {
+    /* out of sequence: insert and merge */
+    for (i = 0; (i < link->num_ranges) && TCP_SEQ_LT(link->ranges[i][1], seqno); i++);
+    if ((i < link->num_ranges) && TCP_SEQ_LEQ(link->ranges[i][0], end)) {
+      if (TCP_SEQ_LT(seqno, link->ranges[i][0])) {
+        link->ranges[i][0] = seqno;
+      }
+      if (TCP_SEQ_GT(end, link->ranges[i][1])) {
+        link->ranges[i][1] = end;
+      }
+      while ((i + 1 < link->num_ranges) && TCP_SEQ_LEQ(link->ranges[i + 1][0], link->ranges[i][1])) {
+        if (TCP_SEQ_GT(link->ranges[i + 1][1], link->ranges[i][1])) {
+          link->ranges[i][1] = link->ranges[i + 1][1];
+        }
+        link->num_ranges--;
+        memmove(&link->ranges[i + 1], &link->ranges[i + 2], (link->num_ranges - i - 1) * sizeof(link->ranges[0]));
+      }
+    } else if (link->num_ranges < TEST_TCP_LINK_MAX_RANGES) {
+      memmove(&link->ranges[i + 1], &link->ranges[i], (link->num_ranges - i) * sizeof(link->ranges[0]));
+      link->ranges[i][0] = seqno;
+      link->ranges[i][1] = end;
+      link->num_ranges++;
+    }
+    link->recent = seqno;
+  }
+
+  fail_unless(link->num_acks < TEST_TCP_LINK_MAX_PKTS);
+  ack = &link->acks[link->num_acks++];
+  ack->seqno = link->rcv_nxt;
+  ack->arrive = test_tcp_now + link->delay;
+  ack->num = 0;
+  if (!link->sack) {
+    return;
+  }
+  /* SACK: the block with the most recent segment first */
+  for (i = 0; i < link->num_ranges; i++) {
+    if (TCP_SEQ_BETWEEN(link->recent, link->ranges[i][0], link->ranges[i][1] - 1)) {
+      ack->blocks[0] = link->ranges[i][0];
+      ack->blocks[1] = link->ranges[i][1];
+      ack->num = 1;
+      break;
+    }
+  }
+  for (j = 0; (j < link->num_ranges) && (ack->num < 3); j++) {
+    if (j != i) {
+      ack->blocks[2 * ack->num] = link->ranges[j][0];
+      ack->blocks[2 * ack->num + 1] = link->ranges[j][1];
+      ack->num++;
+    }
+  }
+}
+
+/** Connect a pcb to a simulated link: segments it sends on 'netif' go over
+ * the link (zero 'link' and set its configuration first) */
+void
+test_tcp_link_init(struct test_tcp_link *link, struct netif *netif, struct tcp_pcb *pcb)
+{
+  link->pcb = pcb;
+  link->netif = netif;
+  link->start = link->snd_max = link->rcv_nxt = pcb->snd_nxt;
+  netif->state = link;
+  netif->output = test_tcp_link_output;
+}
+
+/** Advance a simulated link by one millisecond: deliver the segments and
+ * ACKs that arrive and run the lwIP timeouts (tcp_tmr() and the
+ * retransmission timer) */
+void
+test_tcp_link_step(struct test_tcp_link *link)
+{
+  int i;
+
+  test_tcp_now++;
+
+  /* segments arriving at the receiver (late ones are overtaken) */
+  for (i = 0; i < link->num_pkts; ) {
+    if ((s32_t)(link->pkts[i].arrive - test_tcp_now) <= 0) {
+      test_tcp_link_receive(link, link->pkts[i].seqno, link->pkts[i].len);
+      link->num_pkts--;
+      memmove(&link->pkts[i], &link->pkts[i + 1], (link->num_pkts - i) * sizeof(link->pkts[0]));
+    } else {
+      i++;
+    }
+  }
+
+  /* ACKs arriving at the sender */
+  while ((link->num_acks > 0) && ((s32_t)(link->acks[0].arrive - test_tcp_now) <= 0)) {
+    struct test_tcp_link_pkt *ack = &link->acks[0];
+    struct tcp_pcb *pcb = link->pcb;
+    u32_t rel[6];
+    struct pbuf *p;
+    for (i = 0; i < 2 * ack->num; i++) {
+      rel[i] = ack->blocks[i] - pcb->lastack;
+    }
+    p = tcp_create_rx_segment_sack_wnd(pcb, NULL, 0, 0, ack->seqno - pcb->lastack, TCP_ACK,
+      rel, ack->num, link->wnd);
+    fail_unless(p != NULL);
+    test_tcp_input(p, link->netif);
+    link->num_acks--;
+    memmove(&link->acks[0], &link->acks[1], link->num_acks * sizeof(link->acks[0]));
+  }
+
+  sys_check_timeouts();
+}
@@ -26,6 +26,59 @@ struct test_tcp_txcounters {
   struct pbuf *tx_packets;
 };
 
+#define TEST_TCP_LINK_MAX_PKTS    64
+#define TEST_TCP_LINK_MAX_RANGES  16
+/* segments (from 'start', TCP_MSS each) the loss model and xmits[] cover */
+#define TEST_TCP_LINK_SEGS        32
+#define TEST_TCP_LINK_SEG(i)      (1UL << (i))
+
+struct test_tcp_link_pkt {
+  u32_t seqno;   /* data: seqno, ACK: ackno */
+  u16_t len;
+  u32_t depart;  /* leaves the bottleneck (ms) */
+  u32_t arrive;  /* arrives at the other end (ms) */
+  u32_t blocks[6];
+  u8_t num;      /* SACK blocks of an ACK */
+};
+
+/** Simulated link for one pcb (see test_tcp_link_init()): data segments pass
+ * an optional bottleneck with a drop-tail queue, selected segments are lost
+ * or arrive late on their first transmission, and a receiver ACKs every
+ * segment after a fixed one-way delay in both directions (with SACK blocks
+ * if enabled). Everything is driven by test_tcp_now, so runs are
+ * deterministic. Zero it, set the configuration, call test_tcp_link_init()
+ * and then test_tcp_link_step() once per millisecond. */
+struct test_tcp_link {
+  /* configuration */
+  u32_t delay;     /* one-way delay, ms */
+  u32_t rate;      /* bottleneck rate, bytes per ms (0: no bottleneck) */
+  u32_t queue;     /* bottleneck queue, packets */
+  u8_t sack;       /* the receiver sends SACK blocks */
+  u16_t wnd;       /* window advertised by the receiver */
+  u32_t drop;      /* TEST_TCP_LINK_SEG()s lost on their first transmission */
+  u32_t late;      /* TEST_TCP_LINK_SEG()s arriving late_ms late on their first transmission */
+  u32_t late_ms;
+  /* state */
+  struct tcp_pcb *pcb;
+  struct netif *netif;
+  u32_t start;     /* seqno of the first segment */
+  u32_t snd_max;   /* end of the data sent so far */
+  struct test_tcp_link_pkt pkts[TEST_TCP_LINK_MAX_PKTS];
+  int num_pkts;
+  u32_t last_depart;
+  struct test_tcp_link_pkt acks[TEST_TCP_LINK_MAX_PKTS];
+  int num_acks;
+  /* receiver */
+  u32_t rcv_nxt;
+  u32_t ranges[TEST_TCP_LINK_MAX_RANGES][2];  /* out of sequence data, ordered */
+  int num_ranges;
+  u32_t recent;    /* seqno of the last ooseq segment */
+  /* results */
+  u32_t dropped;   /* segments dropped at the bottleneck */
+  u8_t xmits[TEST_TCP_LINK_SEGS];
+  u32_t first_rexmit; /* test_tcp_now of the first retransmission (0: none) */
+};
+
 /* Helper functions */
 void tcp_remove_all(void);
 
@@ -36,6 +89,16 @@ struct pbuf* tcp_create_rx_segment(struct tcp_pcb* pcb, void* data, size_t data_
                    u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags);
 struct pbuf* tcp_create_rx_segment_wnd(struct tcp_pcb* pcb, void* data, size_t data_len,
                    u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags, u16_t wnd);
+struct pbuf* tcp_create_segment_with_opts(ip_addr_t* src_ip, ip_addr_t* dst_ip,
+                   u16_t src_port, u16_t dst_port, void* data, size_t data_len,
+                   u32_t seqno, u32_t ackno, u8_t headerflags,
+                   const u8_t* opts, u8_t optlen);
+struct pbuf* tcp_create_rx_segment_sack(struct tcp_pcb* pcb, void* data, size_t data_len,
+                   u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags,
+                   const u32_t* blocks, u8_t num);
+struct pbuf* tcp_create_rx_segment_sack_wnd(struct tcp_pcb* pcb, void* data, size_t data_len,
+                   u32_t seqno_offset, u32_t ackno_offset, u8_t headerflags,
+                   const u32_t* blocks, u8_t num, u16_t wnd);
 void tcp_set_state(struct tcp_pcb* pcb, enum tcp_state state, ip_addr_t* local_ip,
                    ip_addr_t* remote_ip, u16_t local_port, u16_t remote_port);
 void test_tcp_counters_err(void* arg, err_t err);
@@ -48,5 +111,8 @@ void test_tcp_input(struct pbuf *p, struct netif *inp);
 void test_tcp_init_netif(struct netif *netif, struct test_tcp_txcounters *txcounters,
                          ip_addr_t *ip_addr, ip_addr_t *netmask);
 
+void test_tcp_link_init(struct test_tcp_link *link, struct netif *netif, struct tcp_pcb *pcb);
+void test_tcp_link_step(struct test_tcp_link *link);
+
 
 #endif
@@ -2,8 +2,13 @@
 
 #include "lwip/tcp_impl.h"
 #include "lwip/stats.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip4_gro.h"
+#include "lwip/timers.h"
 #include "tcp_helper.h"
 
+#include <time.h>
+
 #ifdef _MSC_VER
 #pragma warning(disable: 4307) /* we explicitly wrap around TCP seqnos */
 #endif
@@ -15,16 +20,14 @@
 #error "This tests needs TCP_SND_BUF to be > TCP_WND"
 #endif
 
-static u8_t test_tcp_timer;
-
-/* our own version of tcp_tmr so we can reset fast/slow timer state */
+/* advance the simulated clock by TCP_TMR_INTERVAL: tcp_tmr() runs once
+   (the first run after a pcb was registered calls tcp_slowtmr(), too) and
+   the retransmission timer runs if it is due */
 static void
 test_tcp_tmr(void)
 {
-  tcp_fasttmr();
-  if (++test_tcp_timer & 1) {
-    tcp_slowtmr();
-  }
+  test_tcp_now += TCP_TMR_INTERVAL;
+  sys_check_timeouts();
 }
 
 /* Setups/teardown functions */
@@ -38,7 +41,6 @@ tcp_setup(void)
   tcp_next_iss();
   tcp_ticks = 0;
 
-  test_tcp_timer = 0;
   tcp_remove_all();
 }
 
@@ -470,11 +472,15 @@ START_TEST(test_tcp_rto_rexmit_wraparound)
   check_seqnos(pcb->unsent, 4, &seqnos[2]);
 
   /* call the tcp timer some times */
+#if LWIP_TCP_RTT_MS
+  for (i = 0; i < TCP_RTO_INITIAL_MS / TCP_TMR_INTERVAL - 1; i++) {
+#else /* LWIP_TCP_RTT_MS */
   for (i = 0; i < 10; i++) {
+#endif /* LWIP_TCP_RTT_MS */
     test_tcp_tmr();
     EXPECT(txcounters.num_tx_calls == 0);
   }
-  /* 11th call to tcp_tmr: RTO rexmit fires */
+  /* next call to tcp_tmr: RTO rexmit fires */
   test_tcp_tmr();
   EXPECT(txcounters.num_tx_calls == 1);
   check_seqnos(pcb->unacked, 1, seqnos);
@@ -496,6 +502,215 @@ START_TEST(test_tcp_rto_rexmit_wraparound)
 }
 END_TEST
 
+#if LWIP_TCP_RTT_MS
+/** Create an ACK for 'ackno_offset' bytes echoing 'tsecr' in a timestamp option */
+static struct pbuf*
+test_tcp_create_ts_ack(struct tcp_pcb* pcb, u32_t ackno_offset, u32_t tsecr)
+{
+  u8_t opts[12];
+  u32_t val;
+
+  opts[0] = 1; /* NOP */
+  opts[1] = 1; /* NOP */
+  opts[2] = 8; /* timestamp */
+  opts[3] = 10;
+  val = htonl(pcb->ts_recent + 1);
+  memcpy(&opts[4], &val, 4);
+  val = htonl(tsecr);
+  memcpy(&opts[8], &val, 4);
+  return tcp_create_segment_with_opts(&pcb->remote_ip, &pcb->local_ip,
+    pcb->remote_port, pcb->local_port, NULL, 0, pcb->rcv_nxt,
+    pcb->lastack + ackno_offset, TCP_ACK, opts, sizeof(opts));
+}
+
+/** Round-trip times are measured in milliseconds and the retransmission
+ * timer expires after RTO milliseconds, independent of tcp_slowtmr() */
+START_TEST(test_tcp_rtt_ms_rto)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  u32_t rto;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_now += 1000;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  EXPECT(pcb->rto_ms == TCP_RTO_INITIAL_MS);
+
+  /* a 3 ms round trip is measured as such: SRTT = R, RTTVAR = R/2 */
+  err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  test_tcp_now += 3;
+  test_tcp_input(tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK), &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->srtt == (3 << 3));
+  EXPECT(pcb->rttvar == (3 << 1));
+  EXPECT(pcb->rto_ms == LWIP_MAX(3 + 6, TCP_RTO_MIN_MS));
+  rto = pcb->rto_ms;
+
+  /* lose a segment: it is retransmitted exactly one RTO later */
+  memset(&txcounters, 0, sizeof(txcounters));
+  err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_tcp_now += rto - 1;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_tcp_now++;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(pcb->nrtx == 1);
+  EXPECT(pcb->rto_ms == 2 * rto);
+
+  /* Karn's algorithm: the ACK of the retransmission is no RTT sample */
+  test_tcp_now += 50;
+  test_tcp_input(tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK), &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->srtt == (3 << 3));
+  EXPECT(pcb->nrtx == 0);
+  EXPECT(pcb->rto_ms == rto);
+
+  tcp_abort(pcb);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+
+/** With timestamps, every ACK for new data is an RTT sample */
+START_TEST(test_tcp_rtt_ms_timestamps)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  u16_t len, i;
+  err_t err;
+  /* RFC 6298 with samples of 10, 20 and 30 ms (SRTT scaled by 8, RTTVAR by 4) */
+  const u32_t srtt[] = {80, 90, 109};
+  const u32_t rttvar[] = {20, 25, 38};
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_now += 1000;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  pcb->flags |= TF_TIMESTAMP;
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_nagle_disable(pcb);
+  len = tcp_mss(pcb);
+
+  /* one flight of 3 segments */
+  for (i = 0; i < 3; i++) {
+    err = tcp_write(pcb, tx_data, len, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 3);
+
+  for (i = 0; i < 3; i++) {
+    test_tcp_now += 5;
+    test_tcp_input(test_tcp_create_ts_ack(pcb, len, test_tcp_now - 10 * (i + 1)), &netif);
+    EXPECT(pcb->srtt == srtt[i]);
+    EXPECT(pcb->rttvar == rttvar[i]);
+  }
+  EXPECT(pcb->unacked == NULL);
+
+  /* a duplicate ACK is no sample */
+  test_tcp_input(test_tcp_create_ts_ack(pcb, 0, test_tcp_now - 100), &netif);
+  EXPECT(pcb->srtt == srtt[2]);
+
+  tcp_abort(pcb);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+
+/** Retransmission timers in every level of the deadline wheel fire on the
+ * millisecond from the one-shot timeout, a pcb removed before its deadline
+ * leaves the wheel */
+START_TEST(test_tcp_rtt_ms_wheel)
+{
+  static const u32_t rto[] = {40, 300, 5000, TCP_RTO_MAX_MS};
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcbs[5];
+  ip_addr_t remote_ip, local_ip, netmask;
+  u32_t fired[4], start, left, i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_now += 1000;
+  start = test_tcp_now;
+
+  for (i = 0; i < 5; i++) {
+    pcbs[i] = test_tcp_new_counters_pcb(&counters);
+    EXPECT_RET(pcbs[i] != NULL);
+    tcp_set_state(pcbs[i], ESTABLISHED, &local_ip, &remote_ip, 0x101, (u16_t)(0x100 + i));
+    pcbs[i]->mss = TCP_MSS;
+    pcbs[i]->cwnd = pcbs[i]->snd_wnd;
+    pcbs[i]->rto_ms = rto[i % 4];
+    err = tcp_write(pcbs[i], tx_data, 100, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    err = tcp_output(pcbs[i]);
+    EXPECT_RET(err == ERR_OK);
+  }
+  tcp_abort(pcbs[4]);
+
+  memset(fired, 0, sizeof(fired));
+  left = 4;
+  while ((left > 0) && (test_tcp_now - start <= TCP_RTO_MAX_MS)) {
+    test_tcp_now++;
+    sys_check_timeouts();
+    for (i = 0; i < 4; i++) {
+      if ((pcbs[i] != NULL) && (pcbs[i]->nrtx != 0)) {
+        fired[i] = test_tcp_now - start;
+        tcp_abort(pcbs[i]);
+        pcbs[i] = NULL;
+        left--;
+      }
+    }
+  }
+  for (i = 0; i < 4; i++) {
+    EXPECT(fired[i] == rto[i]);
+  }
+  EXPECT(counters.err_calls == 5);
+  EXPECT_RET(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+END_TEST
+#endif /* LWIP_TCP_RTT_MS */
+
 /** Provoke fast retransmission by duplicate ACKs and then recover by ACKing all sent data.
  * At the end, send more data. */
 static void test_tcp_tx_full_window_lost(u8_t zero_window_probe_from_unsent)
@@ -654,6 +869,649 @@ START_TEST(test_tcp_tx_full_window_lost_from_unacked)
 }
 END_TEST
 
+/** Demultiplex segments to many established pcbs and print the cost per
+ * segment. Every segment must reach its pcb. With LWIP_TCP_PCB_HASH, the
+ * number of pcbs compared per lookup must not grow with the number of pcbs
+ * (as long as there are fewer pcbs than buckets), while walking
+ * tcp_active_pcbs grows linearly. The time per segment still rises at
+ * 10000 pcbs because they no longer fit in the CPU caches. */
+START_TEST(test_tcp_pcb_lookup_scaling)
+{
+  static const u32_t num_pcbs[] = {10, 100, 1000, 10000};
+  static struct tcp_pcb* pcbs[10000];
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[] = {1, 2, 3, 4};
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  u32_t i, j, rcv_nxt, visited;
+  clock_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  /* initialize local vars */
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  for (i = 0; (i < sizeof(num_pcbs)/sizeof(num_pcbs[0])) && (num_pcbs[i] <= MEMP_NUM_TCP_PCB); i++) {
+    for (j = 0; j < num_pcbs[i]; j++) {
+      pcbs[j] = test_tcp_new_counters_pcb(&counters);
+      EXPECT_RET(pcbs[j] != NULL);
+      tcp_set_state(pcbs[j], ESTABLISHED, &local_ip, &remote_ip, local_port, (u16_t)(remote_port + j));
+    }
+    EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == num_pcbs[i]);
+
+    visited = 0;
+    start = clock();
+    for (j = 0; j < 10000; j++) {
+      /* spread segments over the pcbs to defeat the move-to-front cache */
+      pcb = pcbs[(j * 7919) % num_pcbs[i]];
+      rcv_nxt = pcb->rcv_nxt;
+#if LWIP_TCP_PCB_HASH
+      {
+        /* the pcbs tcp_input() compares before it finds 'pcb' */
+        struct tcp_pcb *cur = tcp_active_hash[tcp_pcb_hash(&pcb->local_ip, pcb->local_port,
+          &pcb->remote_ip, pcb->remote_port)];
+        for (visited++; (cur != NULL) && (cur != pcb); cur = cur->hash_next) {
+          visited++;
+        }
+        EXPECT_RET(cur == pcb);
+      }
+#endif /* LWIP_TCP_PCB_HASH */
+      p = tcp_create_rx_segment(pcb, data, sizeof(data), 0, 0, 0);
+      EXPECT_RET(p != NULL);
+      test_tcp_input(p, &netif);
+      /* the segment must have been delivered to 'pcb' */
+      EXPECT_RET(pcb->rcv_nxt == rcv_nxt + sizeof(data));
+      if (pcb->rcv_wnd < TCP_WND / 2) {
+        tcp_recved(pcb, (u16_t)(TCP_WND / 2));
+      }
+    }
+    printf("tcp pcb lookup: %5"U32_F" pcbs: %8.1f ns/segment, %4.2f pcbs compared\n", num_pcbs[i],
+      (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / 10000, (double)visited / 10000);
+#if LWIP_TCP_PCB_HASH
+    /* a chain holds about num_pcbs / TCP_PCB_HASH_SIZE pcbs */
+    EXPECT(visited <= 10000 * (2 + num_pcbs[i] / TCP_PCB_HASH_SIZE));
+#endif /* LWIP_TCP_PCB_HASH */
+
+    tcp_remove_all();
+  }
+}
+END_TEST
+
+/** An idle pcb with keepalive enabled must still send its probe on time
+ * (with LWIP_TCP_PCB_TIMERS, it sleeps on the timer wheel until then). */
+START_TEST(test_tcp_keepalive_idle)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, 0x100);
+  pcb->keep_idle = 2 * TCP_SLOW_INTERVAL;
+  pcb->so_options |= SOF_KEEPALIVE;
+  tcp_timers_touch(pcb);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* 2 slow ticks idle: no probe yet */
+  for (i = 0; i < 4; i++) {
+    test_tcp_tmr();
+  }
+  EXPECT(txcounters.num_tx_calls == 0);
+  /* 3rd slow tick: first probe */
+  test_tcp_tmr();
+  test_tcp_tmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->keep_cnt_sent == 1);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** A pcb in TIME-WAIT is freed after 2*MSL (with LWIP_TCP_PCB_TIMERS, it
+ * sleeps on the timer wheel until then) */
+START_TEST(test_tcp_timewait_expire)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip;
+  u32_t ticks;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_arg(pcb, NULL);
+  tcp_err(pcb, NULL);
+  tcp_set_state(pcb, TIME_WAIT, &local_ip, &remote_ip, 0x101, 0x100);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+
+  /* tcp_slowtmr() runs every second tcp_tmr() */
+  for (ticks = 0; (lwip_stats.memp[MEMP_TCP_PCB].used == 1) && (ticks < 4 * TCP_MSL / TCP_SLOW_INTERVAL); ticks++) {
+    test_tcp_tmr();
+    test_tcp_tmr();
+  }
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  EXPECT(tcp_tw_pcbs == NULL);
+  /* the pcb expires when more than 2*MSL have passed */
+  EXPECT(ticks == 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+}
+END_TEST
+
+/** A single received segment is ACKed by the next tcp_fasttmr(), not at
+ * once and not later */
+START_TEST(test_tcp_delayed_ack)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[] = {1, 2, 3, 4};
+  ip_addr_t remote_ip, local_ip, netmask;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, 0x100);
+  /* let the first run settle the timers of the new pcb */
+  test_tcp_tmr();
+  test_tcp_tmr();
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  p = tcp_create_rx_segment(pcb, data, sizeof(data), 0, 0, 0);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(counters.recved_bytes == sizeof(data));
+  EXPECT(pcb->flags & TF_ACK_DELAY);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  test_tcp_tmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(!(pcb->flags & (TF_ACK_DELAY | TF_ACK_NOW)));
+  test_tcp_tmr();
+  test_tcp_tmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Measure the cost of the TCP timers with many idle connections: with
+ * LWIP_TCP_PCB_TIMERS, idle pcbs are not visited by tcp_tmr() at all, and
+ * the retransmission timer only runs for pcbs that have one running. */
+START_TEST(test_tcp_tmr_idle_scaling)
+{
+  static const u32_t num_pcbs[] = {10, 100, 1000, 10000};
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip;
+  u32_t i, j;
+  clock_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+
+  for (i = 0; (i < sizeof(num_pcbs)/sizeof(num_pcbs[0])) && (num_pcbs[i] <= MEMP_NUM_TCP_PCB); i++) {
+    memset(&counters, 0, sizeof(counters));
+    for (j = 0; j < num_pcbs[i]; j++) {
+      pcb = test_tcp_new_counters_pcb(&counters);
+      EXPECT_RET(pcb != NULL);
+      tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, (u16_t)(0x100 + j));
+    }
+    /* let the first run settle the timers of the new pcbs */
+    test_tcp_tmr();
+    test_tcp_tmr();
+
+    start = clock();
+    for (j = 0; j < 1000; j++) {
+      test_tcp_tmr();
+    }
+    printf("tcp_tmr: %5"U32_F" idle pcbs: %10.1f ns/call\n", num_pcbs[i],
+      (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / 1000);
+    EXPECT(counters.err_calls == 0);
+
+    tcp_remove_all();
+  }
+}
+END_TEST
+
+#if LWIP_NETIF_OFFLOAD
+#define TEST_TCP_OFFLOAD_LEN 4000
+
+/* what the offload test netif has seen */
+static struct {
+  u32_t tx_calls;
+  u32_t segments;
+  u32_t psh_segments;
+  u32_t seqno;
+  u32_t len;
+  u8_t data[TEST_TCP_OFFLOAD_LEN];
+  /* packets held by test_tcp_offload_output_queued() */
+  struct pbuf *queue[TEST_TCP_OFFLOAD_LEN / TCP_MSS + 1];
+  u32_t queued;
+} offload;
+
+/* check a complete IP/TCP segment as it would go on the wire */
+static void
+test_tcp_offload_check_segment(struct pbuf *p)
+{
+  struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+  struct tcp_hdr *tcphdr;
+  ip4_addr_t src, dest;
+  u16_t iphlen, hdrlen, len;
+
+  iphlen = (u16_t)(IPH_HL(iphdr) * 4);
+  EXPECT(inet_chksum(iphdr, iphlen) == 0);
+  EXPECT(ntohs(IPH_LEN(iphdr)) == p->tot_len);
+  ip4_addr_copy(src, iphdr->src);
+  ip4_addr_copy(dest, iphdr->dest);
+  tcphdr = (struct tcp_hdr *)((u8_t *)p->payload + iphlen);
+  hdrlen = (u16_t)(TCPH_HDRLEN(tcphdr) * 4);
+  EXPECT(ntohl(tcphdr->seqno) == offload.seqno);
+  if (TCPH_FLAGS(tcphdr) & TCP_PSH) {
+    offload.psh_segments++;
+  }
+
+  pbuf_header(p, (s16_t)-iphlen);
+  EXPECT(inet_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &src, &dest) == 0);
+  len = (u16_t)(p->tot_len - hdrlen);
+  EXPECT(len <= TCP_MSS);
+  EXPECT_RET(offload.len + len <= TEST_TCP_OFFLOAD_LEN);
+  pbuf_copy_partial(p, offload.data + offload.len, len, hdrlen);
+  offload.len += len;
+  offload.seqno += len;
+  offload.segments++;
+}
+
+/* emulates a netif doing checksum offload and TSO in "hardware" */
+static err_t
+test_tcp_offload_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct pbuf *flat, *seg;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  u16_t iphlen, hdrlen, off, len;
+  u32_t acc;
+  LWIP_UNUSED_ARG(ipaddr);
+
+  offload.tx_calls++;
+  EXPECT(((p->flags & PBUF_FLAG_CSUM_PARTIAL) != 0) ==
+    ((netif->offload_flags & NETIF_OFFLOAD_CSUM_TCP) != 0));
+  if (p->gso_size == 0) {
+    if (p->flags & PBUF_FLAG_CSUM_PARTIAL) {
+      EXPECT(p->csum_start == IP_HLEN);
+      EXPECT(p->csum_offset == 16);
+      pbuf_offload_chksum(p);
+    }
+    flat = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    EXPECT_RETX(flat != NULL, ERR_MEM);
+    pbuf_copy(flat, p);
+    test_tcp_offload_check_segment(flat);
+    pbuf_free(flat);
+    return ERR_OK;
+  }
+
+  /* TSO: cut the packet into segments */
+  EXPECT(netif->offload_flags & NETIF_OFFLOAD_TSO);
+  EXPECT(p->tot_len <= netif->gso_max_size);
+  EXPECT(p->gso_size == TCP_MSS);
+  flat = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+  EXPECT_RETX(flat != NULL, ERR_MEM);
+  pbuf_copy(flat, p);
+  iphlen = (u16_t)(IPH_HL((struct ip_hdr *)flat->payload) * 4);
+  hdrlen = (u16_t)(TCPH_HDRLEN((struct tcp_hdr *)((u8_t *)flat->payload + iphlen)) * 4);
+  for (off = 0; off < flat->tot_len - iphlen - hdrlen; off = (u16_t)(off + len)) {
+    len = (u16_t)LWIP_MIN(p->gso_size, flat->tot_len - iphlen - hdrlen - off);
+    seg = pbuf_alloc(PBUF_RAW, (u16_t)(iphlen + hdrlen + len), PBUF_RAM);
+    EXPECT_RETX(seg != NULL, ERR_MEM);
+    pbuf_copy_partial(flat, seg->payload, (u16_t)(iphlen + hdrlen), 0);
+    pbuf_copy_partial(flat, (u8_t *)seg->payload + iphlen + hdrlen, len,
+      (u16_t)(iphlen + hdrlen + off));
+    iphdr = (struct ip_hdr *)seg->payload;
+    IPH_LEN_SET(iphdr, htons(seg->tot_len));
+    IPH_CHKSUM_SET(iphdr, 0);
+    IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, iphlen));
+    tcphdr = (struct tcp_hdr *)((u8_t *)seg->payload + iphlen);
+    tcphdr->seqno = htonl(ntohl(tcphdr->seqno) + off);
+    if (off + len < flat->tot_len - iphlen - hdrlen) {
+      TCPH_FLAGS_SET(tcphdr, TCPH_FLAGS(tcphdr) & ~(TCP_PSH | TCP_FIN));
+    }
+    acc = (u32_t)tcphdr->chksum + htons((u16_t)(hdrlen + len));
+    acc = FOLD_U32T(acc);
+    tcphdr->chksum = (u16_t)FOLD_U32T(acc);
+    seg->flags |= PBUF_FLAG_CSUM_PARTIAL;
+    seg->csum_start = iphlen;
+    seg->csum_offset = p->csum_offset;
+    pbuf_offload_chksum(seg);
+    test_tcp_offload_check_segment(seg);
+    pbuf_free(seg);
+  }
+  pbuf_free(flat);
+  return ERR_OK;
+}
+
+/* emulates a DMA netif that sends the packets after its output call returned */
+static err_t
+test_tcp_offload_output_queued(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(ipaddr);
+  EXPECT_RETX(offload.queued < sizeof(offload.queue) / sizeof(offload.queue[0]), ERR_MEM);
+  pbuf_ref(p);
+  offload.queue[offload.queued++] = p;
+  return ERR_OK;
+}
+
+static err_t
+test_tcp_offload_output_discard(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(p);
+  LWIP_UNUSED_ARG(ipaddr);
+  return ERR_OK;
+}
+
+/* send TEST_TCP_OFFLOAD_LEN bytes through a netif with the given offloads */
+static void
+test_tcp_tx_offload(u8_t offload_flags, u16_t gso_max_size, u32_t expected_tx_calls)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u8_t data[TEST_TCP_OFFLOAD_LEN];
+  u32_t i;
+  err_t err;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (u8_t)(i * 7);
+  }
+  memset(&offload, 0, sizeof(offload));
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  netif.output = test_tcp_offload_output;
+  netif.offload_flags = offload_flags;
+  netif.gso_max_size = gso_max_size;
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, 0x100);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_nagle_disable(pcb);
+  offload.seqno = pcb->snd_nxt;
+
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(offload.tx_calls == expected_tx_calls);
+  EXPECT(offload.segments == (sizeof(data) + TCP_MSS - 1) / TCP_MSS);
+  EXPECT(offload.psh_segments == 1);
+  EXPECT(offload.len == sizeof(data));
+  EXPECT(memcmp(offload.data, data, sizeof(data)) == 0);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->snd_nxt == offload.seqno);
+
+  /* ACK everything: the segments are freed normally */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(data), TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(lwip_stats.memp[MEMP_TCP_SEG].used == 0);
+  EXPECT(lwip_stats.memp[MEMP_PBUF].used == 0);
+}
+
+/** Checksum offload only: every segment is passed on its own */
+START_TEST(test_tcp_tx_offload_csum)
+{
+  LWIP_UNUSED_ARG(_i);
+  test_tcp_tx_offload(NETIF_OFFLOAD_CSUM_TCP, 0, 8);
+}
+END_TEST
+
+/** TSO: one packet carries all segments (limited by gso_max_size) */
+START_TEST(test_tcp_tx_offload_tso)
+{
+  LWIP_UNUSED_ARG(_i);
+  test_tcp_tx_offload(NETIF_OFFLOAD_CSUM_TCP | NETIF_OFFLOAD_TSO, 0xffff, 1);
+  test_tcp_tx_offload(NETIF_OFFLOAD_CSUM_TCP | NETIF_OFFLOAD_TSO,
+    IP_HLEN + TCP_HLEN + 3 * TCP_MSS, 3);
+}
+END_TEST
+
+/** Software GSO: tcp_output passes one packet, ip4_output_if segments it */
+START_TEST(test_tcp_tx_offload_gso)
+{
+  LWIP_UNUSED_ARG(_i);
+  test_tcp_tx_offload(0, 0xffff, 8);
+  test_tcp_tx_offload(NETIF_OFFLOAD_CSUM_TCP, 0xffff, 8);
+}
+END_TEST
+
+/** Software GSO segments handed to a netif that queues them stay valid after
+    tcp has freed the data (acked) and reused the memory for new data */
+START_TEST(test_tcp_tx_offload_gso_queued)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u8_t data[TEST_TCP_OFFLOAD_LEN];
+  u32_t i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (u8_t)(i * 7);
+  }
+  memset(&offload, 0, sizeof(offload));
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  netif.output = test_tcp_offload_output_queued;
+  netif.gso_max_size = 0xffff;
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, 0x100);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_nagle_disable(pcb);
+  offload.seqno = pcb->snd_nxt;
+
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(offload.queued == (sizeof(data) + TCP_MSS - 1) / TCP_MSS);
+  EXPECT(lwip_stats.memp[MEMP_FRAG_PBUF].used >= offload.queued);
+
+  /* ACK everything, then send other data from the freed memory */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(data), TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(lwip_stats.memp[MEMP_TCP_SEG].used == 0);
+  netif.output = test_tcp_offload_output_discard;
+  memset(data, 0xaa, sizeof(data));
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+
+  /* the "hardware" sends the queued segments now */
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (u8_t)(i * 7);
+  }
+  for (i = 0; i < offload.queued; i++) {
+    test_tcp_offload_output(&netif, offload.queue[i], NULL);
+    pbuf_free(offload.queue[i]);
+  }
+  EXPECT(offload.len == sizeof(data));
+  EXPECT(memcmp(offload.data, data, sizeof(data)) == 0);
+  EXPECT(lwip_stats.memp[MEMP_FRAG_PBUF].used == 0);
+
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_SEG].used == 0);
+  EXPECT(lwip_stats.memp[MEMP_PBUF].used == 0);
+}
+END_TEST
+#endif /* LWIP_NETIF_OFFLOAD */
+
+#if IP_GRO
+#define TEST_TCP_GRO_SEGS 4
+
+/* create a received segment that passes ip4_input() */
+static struct pbuf *
+test_tcp_gro_segment(struct tcp_pcb *pcb, u8_t *data, u32_t seqno_offset, u8_t flags)
+{
+  struct pbuf *p = tcp_create_rx_segment(pcb, data, TCP_MSS, seqno_offset, 0, flags);
+  struct ip_hdr *iphdr;
+
+  EXPECT_RETNULL(p != NULL);
+  iphdr = (struct ip_hdr *)p->payload;
+  IPH_PROTO_SET(iphdr, IP_PROTO_TCP);
+  IPH_TTL_SET(iphdr, 64);
+  IPH_CHKSUM_SET(iphdr, 0);
+  IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+  return p;
+}
+
+/* receive TEST_TCP_GRO_SEGS segments in one GRO batch: the one with index
+   'psh' gets the PSH flag, the one with index 'corrupt' a bad checksum (and
+   with 'cancel' the next one, too, with an error that cancels out the first
+   one in the sum of both), the ones from index 'gap' on are sent one MSS
+   too late */
+static void
+test_tcp_gro(int psh, int corrupt, int cancel, int gap, u32_t expected_calls_before_flush,
+             u32_t expected_calls, u32_t expected_bytes, u32_t expected_tx_calls)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  ip_addr_t remote_ip, local_ip, netmask;
+  static u8_t data[TEST_TCP_GRO_SEGS * TCP_MSS];
+  u32_t i, rcv_nxt, chkerr = lwip_stats.tcp.chkerr;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (u8_t)(i * 13);
+  }
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = sizeof(data);
+  counters.expected_data = (char *)data;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, 0x101, 0x100);
+  pcb->mss = TCP_MSS;
+
+  ip4_gro_start();
+  rcv_nxt = pcb->rcv_nxt;
+  for (i = 0; i < TEST_TCP_GRO_SEGS; i++) {
+    u32_t seg = (gap >= 0) && (i >= (u32_t)gap) ? i + 1 : i;
+    p = test_tcp_gro_segment(pcb, data + i * TCP_MSS,
+      rcv_nxt + seg * TCP_MSS - pcb->rcv_nxt,
+      (u8_t)(TCP_ACK | ((int)i == psh ? TCP_PSH : 0)));
+    EXPECT_RET(p != NULL);
+    if ((int)i == corrupt) {
+      EXPECT(pbuf_get_at(p, p->tot_len - 1) != 0xff);
+      pbuf_put_at(p, p->tot_len - 1, (u8_t)(pbuf_get_at(p, p->tot_len - 1) + 1));
+    } else if (cancel && ((int)i == corrupt + 1)) {
+      EXPECT(pbuf_get_at(p, p->tot_len - 1) != 0);
+      pbuf_put_at(p, p->tot_len - 1, (u8_t)(pbuf_get_at(p, p->tot_len - 1) - 1));
+    }
+    ip_input(p, &netif);
+  }
+  EXPECT(counters.recv_calls == expected_calls_before_flush);
+  ip4_gro_flush();
+  EXPECT(!ip4_gro_pending());
+  EXPECT(counters.recv_calls == expected_calls);
+  EXPECT(counters.recved_bytes == expected_bytes);
+  EXPECT(lwip_stats.tcp.chkerr == chkerr + (corrupt >= 0 ? (cancel ? 2 : 1) : 0));
+  /* merged segments are ACKed at once */
+  EXPECT(txcounters.num_tx_calls == expected_tx_calls);
+
+  /* outside of a batch, segments are not held */
+  memset(&txcounters, 0, sizeof(txcounters));
+  p = test_tcp_gro_segment(pcb, data, 10 * TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  ip_input(p, &netif);
+  EXPECT(!ip4_gro_pending());
+  EXPECT(txcounters.num_tx_calls == 1);
+
+  tcp_abort(pcb);
+}
+
+/** In-order segments are delivered in one recv callback */
+START_TEST(test_tcp_gro_merge)
+{
+  LWIP_UNUSED_ARG(_i);
+  test_tcp_gro(-1, -1, 0, -1, 0, 1, TEST_TCP_GRO_SEGS * TCP_MSS, 1);
+  /* PSH delivers at once */
+  test_tcp_gro(1, -1, 0, -1, 1, 2, TEST_TCP_GRO_SEGS * TCP_MSS, 2);
+}
+END_TEST
+
+/** A corrupted segment is not merged but dropped by tcp_input(), even if
+    a second error cancels it out in the merged checksum; a gap stops
+    merging */
+START_TEST(test_tcp_gro_nomerge)
+{
+  LWIP_UNUSED_ARG(_i);
+  /* the segments before the corrupted one are delivered, the ones after
+     it are out of order */
+  test_tcp_gro(-1, 2, 0, -1, 1, 1, 2 * TCP_MSS, 2);
+  test_tcp_gro(-1, 1, 1, -1, 1, 1, TCP_MSS, 1);
+  /* the segments after the gap are merged, too (and queued as ooseq) */
+  test_tcp_gro(-1, -1, 0, 2, 1, 1, 2 * TCP_MSS, 2);
+}
+END_TEST
+#endif /* IP_GRO */
+
 /** Create the suite including all tests for this module */
 Suite *
 tcp_suite(void)
@@ -664,8 +1522,28 @@ tcp_suite(void)
     TESTFUNC(test_tcp_fast_retx_recover),
     TESTFUNC(test_tcp_fast_rexmit_wraparound),
     TESTFUNC(test_tcp_rto_rexmit_wraparound),
+#if LWIP_TCP_RTT_MS
+    TESTFUNC(test_tcp_rtt_ms_rto),
+    TESTFUNC(test_tcp_rtt_ms_timestamps),
+    TESTFUNC(test_tcp_rtt_ms_wheel),
+#endif /* LWIP_TCP_RTT_MS */
     TESTFUNC(test_tcp_tx_full_window_lost_from_unacked),
-    TESTFUNC(test_tcp_tx_full_window_lost_from_unsent)
+    TESTFUNC(test_tcp_tx_full_window_lost_from_unsent),
+    TESTFUNC(test_tcp_pcb_lookup_scaling),
+    TESTFUNC(test_tcp_keepalive_idle),
+    TESTFUNC(test_tcp_timewait_expire),
+    TESTFUNC(test_tcp_delayed_ack),
+    TESTFUNC(test_tcp_tmr_idle_scaling),
+#if LWIP_NETIF_OFFLOAD
+    TESTFUNC(test_tcp_tx_offload_csum),
+    TESTFUNC(test_tcp_tx_offload_tso),
+    TESTFUNC(test_tcp_tx_offload_gso),
+    TESTFUNC(test_tcp_tx_offload_gso_queued),
+#endif /* LWIP_NETIF_OFFLOAD */
+#if IP_GRO
+    TESTFUNC(test_tcp_gro_merge),
+    TESTFUNC(test_tcp_gro_nomerge),
+#endif /* IP_GRO */
   };
   return create_suite("TCP", tests, sizeof(tests)/sizeof(testfunc), tcp_setup, tcp_teardown);
 }
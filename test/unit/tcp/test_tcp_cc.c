@@ -0,0 +1,216 @@
+#include "test_tcp_cc.h"
+
+#include "lwip/tcp_impl.h"
+#include "lwip/stats.h"
+#include "lwip/timers.h"
+#include "tcp_helper.h"
+
+#include <string.h>
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+/** Bulk transfer link: one bottleneck with a drop-tail queue and SACK */
+#define SIM_DELAY        10   /* one-way delay, ms */
+#define SIM_RATE         600  /* bottleneck rate, bytes per ms */
+#define SIM_QUEUE        8    /* bottleneck queue, packets */
+
+static struct test_tcp_link sim;
+
+/** Run a bulk transfer over the simulated link for 'duration' ms
+ * @return the number of bytes received in sequence */
+static u32_t
+sim_run(const char *cc, u32_t duration)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  static char data[TCP_MSS];
+  u32_t i;
+
+  /* the clock never goes back, the lwIP timeouts run on it */
+  test_tcp_now += 1000;
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  fail_unless(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  fail_unless(tcp_set_congestion(pcb, cc) == ERR_OK);
+  fail_unless(strcmp(tcp_get_congestion(pcb), cc) == 0);
+  pcb->mss = TCP_MSS;
+  pcb->flags |= TF_SACK | TF_NODELAY;
+  pcb->cwnd = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+  /* the window is not the limit here: use the whole send queue */
+  pcb->snd_buf = (TCP_SND_QUEUELEN - 2) * TCP_MSS;
+  memset(&sim, 0, sizeof(sim));
+  sim.delay = SIM_DELAY;
+  sim.rate = SIM_RATE;
+  sim.queue = SIM_QUEUE;
+  sim.sack = 1;
+  sim.wnd = 0xFFFF;
+  test_tcp_link_init(&sim, &netif, pcb);
+
+  for (i = 0; i < duration; i++) {
+    /* the application always has data to send */
+    while ((tcp_sndbuf(pcb) >= pcb->mss) && (tcp_sndqueuelen(pcb) + 2 < TCP_SND_QUEUELEN)) {
+      if (tcp_write(pcb, data, pcb->mss, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+        break;
+      }
+    }
+    tcp_output(pcb);
+    test_tcp_link_step(&sim);
+  }
+  tcp_abort(pcb);
+  netif_list = NULL;
+  return sim.rcv_nxt - sim.start;
+}
+
+static void
+tcp_cc_setup(void)
+{
+  tcp_remove_all();
+}
+
+static void
+tcp_cc_teardown(void)
+{
+  tcp_remove_all();
+  netif_list = NULL;
+  netif_default = NULL;
+}
+
+/* Test functions */
+
+/** Select congestion control modules by name */
+START_TEST(test_tcp_cc_select)
+{
+  struct tcp_pcb *pcb, *lpcb;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = tcp_new();
+  fail_unless(pcb != NULL);
+  fail_unless(strcmp(tcp_get_congestion(pcb), "newreno") == 0);
+  fail_unless(tcp_set_congestion(pcb, "vegas") == ERR_ARG);
+  fail_unless(pcb->cc_ops == &tcp_cc_newreno);
+  fail_unless(tcp_set_congestion(pcb, "cubic") == ERR_OK);
+  fail_unless(pcb->cc_ops == &tcp_cc_cubic);
+  fail_unless(tcp_set_congestion(pcb, "bbr") == ERR_OK);
+  fail_unless(strcmp(tcp_get_congestion(pcb), "bbr") == 0);
+
+  /* listening pcbs pass their module on */
+  fail_unless(tcp_bind(pcb, IP_ADDR_ANY, 1234) == ERR_OK);
+  lpcb = tcp_listen(pcb);
+  fail_unless(lpcb != NULL);
+  fail_unless(strcmp(tcp_get_congestion(lpcb), "bbr") == 0);
+  fail_unless(tcp_set_congestion(lpcb, "cubic") == ERR_OK);
+  fail_unless(((struct tcp_pcb_listen *)lpcb)->cc_ops == &tcp_cc_cubic);
+  tcp_close(lpcb);
+}
+END_TEST
+
+/** Restarting after an idle period resets cwnd to the restart window */
+START_TEST(test_tcp_cc_idle_restart)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  char data[100];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  memset(data, 0, sizeof(data));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  fail_unless(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+
+  /* not idle: cwnd is kept */
+  fail_unless(tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  fail_unless(tcp_output(pcb) == ERR_OK);
+  fail_unless(pcb->cwnd == pcb->snd_wnd);
+  test_tcp_input(tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(data), TCP_ACK), &netif);
+  fail_unless(pcb->unacked == NULL);
+
+  /* idle for longer than an RTO */
+  for (i = 0; i <= pcb->rto; i++) {
+    tcp_slowtmr();
+  }
+  fail_unless(tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  fail_unless(tcp_output(pcb) == ERR_OK);
+  fail_unless(pcb->cwnd == LWIP_TCP_CALC_INITIAL_CWND(pcb->mss));
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** The simulated link is deterministic */
+START_TEST(test_tcp_cc_sim_deterministic)
+{
+  u32_t bytes1, bytes2, dropped1;
+  LWIP_UNUSED_ARG(_i);
+
+  bytes1 = sim_run("cubic", 3000);
+  dropped1 = sim.dropped;
+  bytes2 = sim_run("cubic", 3000);
+  fail_unless(bytes1 == bytes2);
+  fail_unless(dropped1 == sim.dropped);
+}
+END_TEST
+
+/** Bulk transfer over a lossy bottleneck: every module must fill the link */
+START_TEST(test_tcp_cc_sim_bulk)
+{
+  const char *names[] = { "newreno", "cubic", "bbr" };
+  u32_t bytes[3], dropped[3];
+  /* the link can carry about SIM_RATE bytes per ms (including headers) */
+  const u32_t duration = 20000;
+  const u32_t capacity = duration * SIM_RATE / (TCP_MSS + 40) * TCP_MSS;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < 3; i++) {
+    bytes[i] = sim_run(names[i], duration);
+    dropped[i] = sim.dropped;
+    fail_unless(bytes[i] > capacity / 10 * 6, "%s: %u of %u bytes", names[i], bytes[i], capacity);
+  }
+  /* the loss-based modules fill the bottleneck queue */
+  fail_unless(dropped[0] > 0);
+  fail_unless(dropped[1] > 0);
+  /* CUBIC backs off less than NewReno, BBR sends at the BDP and does not
+     fill the bottleneck queue */
+  fail_unless(bytes[1] >= bytes[0], "cubic %u newreno %u", bytes[1], bytes[0]);
+  fail_unless(bytes[2] > capacity / 10 * 8, "bbr: %u of %u bytes", bytes[2], capacity);
+  fail_unless(dropped[2] < dropped[0] / 4, "bbr %u newreno %u dropped", dropped[2], dropped[0]);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_cc_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_cc_select),
+    TESTFUNC(test_tcp_cc_idle_restart),
+    TESTFUNC(test_tcp_cc_sim_deterministic),
+    TESTFUNC(test_tcp_cc_sim_bulk)
+  };
+  return create_suite("TCP_CC", tests, sizeof(tests)/sizeof(testfunc), tcp_cc_setup, tcp_cc_teardown);
+}
@@ -1016,6 +1016,642 @@ FIN_TEST(test_tcp_recv_ooseq_double_FIN_13, 13)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_14, 14)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_15, 15)
 
+#if LWIP_WND_SCALE
+/** Size of the stream sent by test_tcp_recv_ooseq_fuzz (larger than an
+ * unscaled window) */
+#define TCP_OOS_FUZZ_LEN   96000
+/** Maximum distance from rcv_nxt of the segments sent per round */
+#define TCP_OOS_FUZZ_SPAN  24000
+#define TCP_OOS_FUZZ_SEGS  512
+
+static char tcp_oos_fuzz_data[TCP_OOS_FUZZ_LEN];
+static struct {
+  u32_t start;
+  u16_t len;
+} tcp_oos_fuzz_segs[TCP_OOS_FUZZ_SEGS];
+static u32_t tcp_oos_fuzz_seed;
+
+/** Simple LCG so that failures are reproducible */
+static u32_t
+tcp_oos_fuzz_rand(void)
+{
+  tcp_oos_fuzz_seed = tcp_oos_fuzz_seed * 1103515245UL + 12345UL;
+  return tcp_oos_fuzz_seed >> 8;
+}
+
+/** Check order, height and balance of an ooseq subtree and that its in-order
+ * walk matches the ooseq list (starting at *list). Returns the height. */
+static int
+tcp_oos_check_subtree(struct tcp_seg* seg, struct tcp_seg** list)
+{
+  int hl, hr;
+  if (seg == NULL) {
+    return 0;
+  }
+  hl = tcp_oos_check_subtree(seg->ooseq_left, list);
+  EXPECT(*list == seg);
+  if (*list != NULL) {
+    *list = (*list)->next;
+  }
+  hr = tcp_oos_check_subtree(seg->ooseq_right, list);
+  EXPECT((hl - hr <= 1) && (hr - hl <= 1));
+  EXPECT(seg->ooseq_height == LWIP_MAX(hl, hr) + 1);
+  return LWIP_MAX(hl, hr) + 1;
+}
+
+/** Check that ooseq is sorted, doesn't overlap, matches its tree and (if
+ * enabled) the byte/pbuf accounting of the pcb */
+static void
+tcp_oos_check_queue(struct tcp_pcb* pcb)
+{
+  struct tcp_seg* seg;
+  struct tcp_seg* list = pcb->ooseq;
+  u32_t blen = 0;
+  u16_t qlen = 0;
+
+  tcp_oos_check_subtree(pcb->ooseq_root, &list);
+  EXPECT(list == NULL);
+  for (seg = pcb->ooseq; seg != NULL; seg = seg->next) {
+    EXPECT(TCP_SEQ_GT(seg->tcphdr->seqno, pcb->rcv_nxt));
+    EXPECT(TCP_SEQ_LEQ(seg->tcphdr->seqno + TCP_TCPLEN(seg), pcb->rcv_nxt + pcb->rcv_wnd));
+    EXPECT(seg->p->tot_len == seg->len);
+    if (seg->next != NULL) {
+      EXPECT(TCP_SEQ_LEQ(seg->tcphdr->seqno + TCP_TCPLEN(seg), seg->next->tcphdr->seqno));
+      EXPECT((TCPH_FLAGS(seg->tcphdr) & TCP_FIN) == 0);
+    }
+    blen += seg->p->tot_len;
+    qlen += pbuf_clen(seg->p);
+  }
+#if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
+  EXPECT(pcb->ooseq_blen == blen);
+  EXPECT(pcb->ooseq_qlen == qlen);
+  EXPECT(blen <= TCP_OOSEQ_MAX_BYTES);
+  EXPECT(qlen <= TCP_OOSEQ_MAX_PBUFS);
+#else
+  LWIP_UNUSED_ARG(blen);
+  LWIP_UNUSED_ARG(qlen);
+#endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+}
+#endif /* LWIP_WND_SCALE */
+
+/** pass a large (scaled) window of randomly sized, overlapping and duplicated
+ * segments in random order to tcp_input until the stream is reassembled,
+ * checking the ooseq queue after every segment */
+START_TEST(test_tcp_recv_ooseq_fuzz)
+{
+#if LWIP_WND_SCALE
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  struct netif netif;
+  u32_t base = 0xFFFFC000UL; /* wraps around after 16 KByte */
+  u32_t i, j, n, off, done, end, start, len;
+  int round;
+  LWIP_UNUSED_ARG(_i);
+
+  tcp_oos_fuzz_seed = 0x1234;
+  for (i = 0; i < TCP_OOS_FUZZ_LEN; i++) {
+    tcp_oos_fuzz_data[i] = (char)tcp_oos_fuzz_rand();
+  }
+
+  /* initialize local vars */
+  memset(&netif, 0, sizeof(netif));
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  /* initialize counter struct */
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = TCP_OOS_FUZZ_LEN;
+  counters.expected_data = tcp_oos_fuzz_data;
+
+  /* create and initialize the pcb */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->rcv_nxt = base;
+  /* the whole stream (+FIN) fits into the receive window */
+  pcb->rcv_wnd = TCP_OOS_FUZZ_LEN + 1;
+  pcb->rcv_ann_wnd = TCP_OOS_FUZZ_LEN + 1;
+  pcb->rcv_ann_right_edge = base + TCP_OOS_FUZZ_LEN + 1;
+
+  for (round = 0; (round < 1000) && (counters.close_calls == 0); round++) {
+    /* cover the next TCP_OOS_FUZZ_SPAN bytes not received yet with segments
+       of 1..300 bytes, some of them overlapping the previous ones or
+       duplicating their start */
+    done = counters.recved_bytes;
+    end = LWIP_MIN(done + TCP_OOS_FUZZ_SPAN, TCP_OOS_FUZZ_LEN);
+    n = 0;
+    for (off = done; (off < end) && (n < TCP_OOS_FUZZ_SEGS - 1); ) {
+      start = off;
+      if ((off > done) && (tcp_oos_fuzz_rand() % 4 == 0)) {
+        len = tcp_oos_fuzz_rand() % 200;
+        start -= len % (off - done);
+      }
+      len = 1 + tcp_oos_fuzz_rand() % 300;
+      len = LWIP_MIN(len, end - start);
+      tcp_oos_fuzz_segs[n].start = start;
+      tcp_oos_fuzz_segs[n].len = (u16_t)len;
+      n++;
+      if (tcp_oos_fuzz_rand() % 8 == 0) {
+        j = 1 + tcp_oos_fuzz_rand() % 300;
+        tcp_oos_fuzz_segs[n].start = start;
+        tcp_oos_fuzz_segs[n].len = (u16_t)LWIP_MIN(j, end - start);
+        n++;
+      }
+      if (start + len > off) {
+        off = start + len;
+      }
+    }
+    /* shuffle */
+    for (i = n - 1; i > 0; i--) {
+      j = tcp_oos_fuzz_rand() % (i + 1);
+      start = tcp_oos_fuzz_segs[i].start;
+      len = tcp_oos_fuzz_segs[i].len;
+      tcp_oos_fuzz_segs[i] = tcp_oos_fuzz_segs[j];
+      tcp_oos_fuzz_segs[j].start = start;
+      tcp_oos_fuzz_segs[j].len = (u16_t)len;
+    }
+    for (i = 0; i < n; i++) {
+      struct pbuf *p;
+      start = tcp_oos_fuzz_segs[i].start;
+      len = tcp_oos_fuzz_segs[i].len;
+      p = tcp_create_rx_segment(pcb, &tcp_oos_fuzz_data[start], len,
+                                base + start - pcb->rcv_nxt, 0,
+                                (u8_t)(TCP_ACK | ((start + len == TCP_OOS_FUZZ_LEN) ? TCP_FIN : 0)));
+      EXPECT_RET(p != NULL);
+      test_tcp_input(p, &netif);
+      tcp_oos_check_queue(pcb);
+      EXPECT(pcb->rcv_nxt == base + counters.recved_bytes + counters.close_calls);
+    }
+  }
+  /* check if counters are as expected */
+  EXPECT(counters.recved_bytes == TCP_OOS_FUZZ_LEN);
+  EXPECT(counters.close_calls == 1);
+  EXPECT(counters.err_calls == 0);
+  EXPECT(pcb->ooseq == NULL);
+  EXPECT(pcb->ooseq_root == NULL);
+
+  /* make sure the pcb is freed */
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 1);
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#else /* LWIP_WND_SCALE */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_WND_SCALE */
+}
+END_TEST
+
+
+#if LWIP_TCP_SACK
+/** Parse one captured packet (IPv4 + TCP): returns the number of SACK blocks
+ * found in the TCP options and stores their edges (host order) in 'blocks' */
+static int
+tcp_sack_parse_packet(struct pbuf* q, u32_t* seqno, u16_t* datalen, u32_t* blocks, u8_t* sack_perm)
+{
+  struct ip_hdr* iphdr = (struct ip_hdr*)q->payload;
+  struct tcp_hdr* tcphdr;
+  u8_t* opts;
+  u16_t iphlen, hdrlen, i;
+  int num = 0;
+
+  iphlen = (u16_t)(IPH_HL(iphdr) * 4);
+  tcphdr = (struct tcp_hdr*)((u8_t*)q->payload + iphlen);
+  hdrlen = (u16_t)(TCPH_HDRLEN(tcphdr) * 4);
+  opts = (u8_t*)(tcphdr + 1);
+  *seqno = ntohl(tcphdr->seqno);
+  *datalen = (u16_t)(q->len - iphlen - hdrlen);
+  *sack_perm = 0;
+  for (i = 0; i < hdrlen - sizeof(struct tcp_hdr); ) {
+    if (opts[i] == 0) {
+      break;
+    } else if (opts[i] == 1) {
+      i++;
+    } else {
+      if (opts[i] == 4) {
+        *sack_perm = 1;
+      } else if (opts[i] == 5) {
+        u16_t k;
+        for (k = 2; k + 8 <= opts[i + 1]; k += 8, num++) {
+          u32_t edge;
+          memcpy(&edge, &opts[i + k], 4);
+          blocks[2 * num] = ntohl(edge);
+          memcpy(&edge, &opts[i + k + 4], 4);
+          blocks[2 * num + 1] = ntohl(edge);
+        }
+      }
+      i = (u16_t)(i + opts[i + 1]);
+    }
+  }
+  return num;
+}
+
+/** Check that exactly one packet was sent and return its SACK blocks */
+static int
+tcp_sack_check_sent(struct test_tcp_txcounters* txcounters, u32_t* seqno, u16_t* datalen, u32_t* blocks)
+{
+  int num = -1;
+  u8_t sack_perm;
+  EXPECT(txcounters->num_tx_calls == 1);
+  if (txcounters->tx_packets != NULL) {
+    EXPECT(txcounters->tx_packets->next == NULL);
+    num = tcp_sack_parse_packet(txcounters->tx_packets, seqno, datalen, blocks, &sack_perm);
+    pbuf_free(txcounters->tx_packets);
+    txcounters->tx_packets = NULL;
+  }
+  txcounters->num_tx_calls = 0;
+  txcounters->num_tx_bytes = 0;
+  return num;
+}
+
+/** Free all captured packets, returning the seqno of each packet (max. 'max') */
+static int
+tcp_sack_sent_seqnos(struct test_tcp_txcounters* txcounters, u32_t* seqnos, int max)
+{
+  int num = 0;
+  struct pbuf* q;
+  for (q = txcounters->tx_packets; q != NULL; q = q->next) {
+    u32_t blocks[8];
+    u16_t datalen;
+    u8_t sack_perm;
+    if (num < max) {
+      tcp_sack_parse_packet(q, &seqnos[num], &datalen, blocks, &sack_perm);
+    }
+    num++;
+  }
+  if (txcounters->tx_packets != NULL) {
+    pbuf_free(txcounters->tx_packets);
+    txcounters->tx_packets = NULL;
+  }
+  txcounters->num_tx_calls = 0;
+  txcounters->num_tx_bytes = 0;
+  return num;
+}
+#endif /* LWIP_TCP_SACK */
+
+/** Send a SYN, check it carries SACK-permitted and check a SYN/ACK with
+ * (or without) SACK-permitted enables (or doesn't enable) SACK on the pcb */
+START_TEST(test_tcp_sack_negotiate)
+{
+#if LWIP_TCP_SACK
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100;
+  const u8_t sack_perm_opt[4] = { 1, 1, 4, 2 };
+  u32_t seqno, blocks[8];
+  u16_t datalen;
+  u8_t sack_perm;
+  int with_sack;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+
+  for (with_sack = 0; with_sack < 2; with_sack++) {
+    memset(&counters, 0, sizeof(counters));
+    pcb = test_tcp_new_counters_pcb(&counters);
+    EXPECT_RET(pcb != NULL);
+
+    txcounters.num_tx_calls = 0;
+    txcounters.num_tx_bytes = 0;
+    txcounters.copy_tx_packets = 1;
+    err = tcp_connect(pcb, &remote_ip, remote_port, NULL);
+    EXPECT_RET(err == ERR_OK);
+    EXPECT_RET(txcounters.num_tx_calls == 1);
+    EXPECT_RET(txcounters.tx_packets != NULL);
+    tcp_sack_parse_packet(txcounters.tx_packets, &seqno, &datalen, blocks, &sack_perm);
+    EXPECT(sack_perm == 1);
+    EXPECT(datalen == 0);
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+    txcounters.num_tx_calls = 0;
+
+    /* SYN/ACK from the remote host */
+    p = tcp_create_segment_with_opts(&remote_ip, &local_ip, remote_port, pcb->local_port,
+      NULL, 0, 0x1000, pcb->snd_nxt, TCP_SYN | TCP_ACK,
+      sack_perm_opt, with_sack ? sizeof(sack_perm_opt) : 0);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    txcounters.copy_tx_packets = 0;
+    if (txcounters.tx_packets != NULL) {
+      pbuf_free(txcounters.tx_packets);
+      txcounters.tx_packets = NULL;
+    }
+    EXPECT(pcb->state == ESTABLISHED);
+    EXPECT(((pcb->flags & TF_SACK) != 0) == (with_sack != 0));
+
+    tcp_abort(pcb);
+    EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+  }
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK */
+}
+END_TEST
+
+/** Receive segments out of order and check the SACK blocks sent with each
+ * ACK: the block containing the most recently received segment comes first */
+START_TEST(test_tcp_sack_recv_blocks)
+{
+#if LWIP_TCP_SACK
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf *p1, *p2, *p3, *p4;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  u32_t seqno, blocks[8];
+  u16_t datalen;
+  int i, num;
+  LWIP_UNUSED_ARG(_i);
+
+  for(i = 0; i < (int)sizeof(data_full_wnd); i++) {
+    data_full_wnd[i] = (char)i;
+  }
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = TCP_WND;
+  counters.expected_data = data_full_wnd;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->rcv_nxt = 0x8000;
+  pcb->flags |= TF_SACK;
+
+  p1 = tcp_create_rx_segment(pcb, &data_full_wnd[0],   100, 0,   0, TCP_ACK);
+  p2 = tcp_create_rx_segment(pcb, &data_full_wnd[100], 100, 100, 0, TCP_ACK);
+  p3 = tcp_create_rx_segment(pcb, &data_full_wnd[200], 100, 200, 0, TCP_ACK);
+  p4 = tcp_create_rx_segment(pcb, &data_full_wnd[300], 100, 300, 0, TCP_ACK);
+  EXPECT_RET(p1 != NULL && p2 != NULL && p3 != NULL && p4 != NULL);
+  txcounters.copy_tx_packets = 1;
+
+  /* 1st gap: ACK 0x8000 with one block */
+  test_tcp_input(p2, &netif);
+  num = tcp_sack_check_sent(&txcounters, &seqno, &datalen, blocks);
+  EXPECT(num == 1);
+  EXPECT(blocks[0] == 0x8000 + 100);
+  EXPECT(blocks[1] == 0x8000 + 200);
+
+  /* 2nd gap: most recent block first */
+  test_tcp_input(p4, &netif);
+  num = tcp_sack_check_sent(&txcounters, &seqno, &datalen, blocks);
+  EXPECT(num == 2);
+  EXPECT(blocks[0] == 0x8000 + 300);
+  EXPECT(blocks[1] == 0x8000 + 400);
+  EXPECT(blocks[2] == 0x8000 + 100);
+  EXPECT(blocks[3] == 0x8000 + 200);
+
+  /* 2nd gap filled: blocks merge */
+  test_tcp_input(p3, &netif);
+  num = tcp_sack_check_sent(&txcounters, &seqno, &datalen, blocks);
+  EXPECT(num == 1);
+  EXPECT(blocks[0] == 0x8000 + 100);
+  EXPECT(blocks[1] == 0x8000 + 400);
+  EXPECT(counters.recv_calls == 0);
+
+  /* 1st gap filled: everything is passed up, no SACK option is sent */
+  test_tcp_input(p1, &netif);
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(counters.recved_bytes == 400);
+  EXPECT(pcb->rcv_nxt == 0x8000 + 400);
+  EXPECT(pcb->ooseq == NULL);
+  tcp_output(pcb);
+  if (txcounters.num_tx_calls == 0) {
+    tcp_fasttmr();
+  }
+  num = tcp_sack_check_sent(&txcounters, &seqno, &datalen, blocks);
+  EXPECT(num == 0);
+  txcounters.copy_tx_packets = 0;
+
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+#else
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK */
+}
+END_TEST
+
+#if LWIP_TCP_SACK
+static char data_sack_tx[600];
+
+/** Input an ACK acknowledging 'ackno' and SACKing 'num' blocks, all given
+ * relative to 'base' (the first byte sent) */
+static void
+test_tcp_sack_input_ack(struct tcp_pcb* pcb, struct netif* netif, u32_t base,
+                        u32_t ackno, const u32_t* blocks, u8_t num)
+{
+  u32_t rel[8];
+  u8_t i;
+  struct pbuf* p;
+  u32_t off = pcb->lastack - base;
+  for (i = 0; i < 2 * num; i++) {
+    rel[i] = blocks[i] - off;
+  }
+  p = tcp_create_rx_segment_sack(pcb, NULL, 0, 0, ackno - off, TCP_ACK, rel, num);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, netif);
+}
+
+/** Send 6 segments of 100 bytes, segments 1 and 3 (0-based) are lost,
+ * the receiver SACKs the others. 'variant' selects how the holes get
+ * retransmitted:
+ * 0: fast retransmit + further duplicate ACKs
+ * 1: fast retransmit + partial ACK
+ * 2: retransmission timeout
+ * 3: retransmission timeout after the receiver reneged on SACKed data
+ */
+static void
+test_tcp_sack_tx(int variant)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  const u32_t sack_2[2] = { 200, 300 };
+  const u32_t sack_2_4[4] = { 400, 500, 200, 300 };
+  const u32_t sack_2_45[4] = { 400, 600, 200, 300 };
+  const u32_t sack_45[2] = { 400, 600 };
+  u32_t seqnos[8];
+  u32_t base;
+  int i, num;
+  err_t err;
+
+  for(i = 0; i < (int)sizeof(data_sack_tx); i++) {
+    data_sack_tx[i] = (char)i;
+  }
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  /* disable initial congestion window (we don't send a SYN here...) */
+  pcb->cwnd = pcb->snd_wnd;
+  pcb->flags |= TF_SACK;
+  tcp_nagle_disable(pcb);
+  base = pcb->snd_nxt;
+
+  /* send 6 segments */
+  for (i = 0; i < 6; i++) {
+    err = tcp_write(pcb, &data_sack_tx[i * 100], 100, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    err = tcp_output(pcb);
+    EXPECT_RET(err == ERR_OK);
+  }
+  EXPECT_RET(txcounters.num_tx_calls == 6);
+  EXPECT_RET(pcb->snd_nxt == base + 600);
+  memset(&txcounters, 0, sizeof(txcounters));
+  txcounters.copy_tx_packets = 1;
+
+  /* segment 0 is ACKed, then 3 duplicate ACKs SACK segments 2, 4 and 5 */
+  test_tcp_sack_input_ack(pcb, &netif, base, 100, NULL, 0);
+  EXPECT(pcb->lastack == base + 100);
+  test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2, 1);
+  test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_4, 2);
+  EXPECT(pcb->dupacks == 2);
+  EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+
+  if (variant >= 2) {
+    /* one more SACK without triggering fast retransmit: the receiver
+       reports 4 and 5 but the sender times out first */
+    pcb->dupacks = 0;
+    test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_45, 2);
+    pcb->dupacks = 0;
+#if LWIP_TCP_RACK
+    /* RACK does not count duplicate ACKs: with three segments SACKed,
+       both holes are lost and resent (and the timeout resends them again) */
+    num = tcp_sack_sent_seqnos(&txcounters, seqnos, 8);
+    EXPECT(num == 2);
+    EXPECT(seqnos[0] == base + 100);
+    EXPECT(seqnos[1] == base + 300);
+#else /* LWIP_TCP_RACK */
+    EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+#endif /* LWIP_TCP_RACK */
+    if (variant == 3) {
+      /* segments 1 and 3 arrive (sent "late"), but the receiver dropped
+         segment 4 and 5 (which were SACKed) from its queue */
+      test_tcp_sack_input_ack(pcb, &netif, base, 400, NULL, 0);
+      EXPECT(pcb->lastack == base + 400);
+      EXPECT(pcb->unacked != NULL);
+      if (pcb->unacked != NULL) {
+        EXPECT(pcb->unacked->flags & TF_SEG_SACKED);
+      }
+      EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+    }
+    /* retransmission timeout */
+    tcp_rexmit_rto(pcb);
+    EXPECT(!(pcb->flags & TF_INFR));
+    num = tcp_sack_sent_seqnos(&txcounters, seqnos, 8);
+    if (variant == 2) {
+      /* only the holes are resent */
+      EXPECT(num == 2);
+      EXPECT(seqnos[0] == base + 100);
+      EXPECT(seqnos[1] == base + 300);
+    } else {
+      /* reneging: SACK information is discarded, everything is resent */
+      EXPECT(num == 2);
+      EXPECT(seqnos[0] == base + 400);
+      EXPECT(seqnos[1] == base + 500);
+    }
+  } else {
+    /* 3rd duplicate ACK: fast retransmit of segment 1 */
+    test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_45, 2);
+    EXPECT(pcb->flags & TF_INFR);
+    num = tcp_sack_sent_seqnos(&txcounters, seqnos, 8);
+#if LWIP_TCP_RACK
+    /* RACK: segment 3 was sent before the SACKed segment 5, so it is
+       known to be lost, too */
+    EXPECT(num == 2);
+    EXPECT(seqnos[0] == base + 100);
+    EXPECT(seqnos[1] == base + 300);
+    if (variant == 0) {
+      test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_45, 2);
+      EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+    } else {
+      test_tcp_sack_input_ack(pcb, &netif, base, 300, sack_45, 1);
+      EXPECT(pcb->lastack == base + 300);
+      EXPECT(pcb->flags & TF_INFR);
+      EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+    }
+#else /* LWIP_TCP_RACK */
+    EXPECT(num == 1);
+    EXPECT(seqnos[0] == base + 100);
+
+    if (variant == 0) {
+      /* next duplicate ACK: the next hole (segment 3) is resent */
+      test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_45, 2);
+      num = tcp_sack_sent_seqnos(&txcounters, seqnos, 8);
+      EXPECT(num == 1);
+      EXPECT(seqnos[0] == base + 300);
+      /* no more holes: nothing is resent */
+      test_tcp_sack_input_ack(pcb, &netif, base, 100, sack_2_45, 2);
+      EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+    } else {
+      /* partial ACK (segment 1 arrived): segment 3 is resent */
+      test_tcp_sack_input_ack(pcb, &netif, base, 300, sack_45, 1);
+      EXPECT(pcb->lastack == base + 300);
+      EXPECT(pcb->flags & TF_INFR);
+      num = tcp_sack_sent_seqnos(&txcounters, seqnos, 8);
+      EXPECT(num == 1);
+      EXPECT(seqnos[0] == base + 300);
+    }
+#endif /* LWIP_TCP_RACK */
+    /* everything is ACKed: recovery ends */
+    test_tcp_sack_input_ack(pcb, &netif, base, 600, NULL, 0);
+    EXPECT(!(pcb->flags & TF_INFR));
+    EXPECT(pcb->unacked == NULL);
+    EXPECT(pcb->unsent == NULL);
+    EXPECT(tcp_sack_sent_seqnos(&txcounters, seqnos, 8) == 0);
+  }
+  txcounters.copy_tx_packets = 0;
+
+  tcp_abort(pcb);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB].used == 0);
+}
+#endif /* LWIP_TCP_SACK */
+
+#if LWIP_TCP_SACK
+#define SACK_TX_TEST(name, num) \
+  START_TEST(name) \
+  { \
+    LWIP_UNUSED_ARG(_i); \
+    test_tcp_sack_tx(num); \
+  } \
+  END_TEST
+#else
+#define SACK_TX_TEST(name, num) \
+  START_TEST(name) \
+  { \
+    LWIP_UNUSED_ARG(_i); \
+  } \
+  END_TEST
+#endif /* LWIP_TCP_SACK */
+SACK_TX_TEST(test_tcp_sack_tx_dupacks, 0)
+SACK_TX_TEST(test_tcp_sack_tx_partial_ack, 1)
+SACK_TX_TEST(test_tcp_sack_tx_rto, 2)
+SACK_TX_TEST(test_tcp_sack_tx_rto_reneging, 3)
+
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -1043,7 +1679,14 @@ tcp_oos_suite(void)
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_12),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_13),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_14),
-    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15)
+    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15),
+    TESTFUNC(test_tcp_recv_ooseq_fuzz),
+    TESTFUNC(test_tcp_sack_negotiate),
+    TESTFUNC(test_tcp_sack_recv_blocks),
+    TESTFUNC(test_tcp_sack_tx_dupacks),
+    TESTFUNC(test_tcp_sack_tx_partial_ack),
+    TESTFUNC(test_tcp_sack_tx_rto),
+    TESTFUNC(test_tcp_sack_tx_rto_reneging)
   };
   return create_suite("TCP_OOS", tests, sizeof(tests)/sizeof(testfunc), tcp_oos_setup, tcp_oos_teardown);
 }
@@ -0,0 +1,192 @@
+#include "test_tcp_rack.h"
+
+#include "lwip/tcp_impl.h"
+#include "lwip/stats.h"
+#include "lwip/timers.h"
+#include "tcp_helper.h"
+
+#include <string.h>
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+#if LWIP_TCP_RACK
+/** Path for a short response: every segment takes LINK_DELAY ms in each
+ * direction (no bottleneck), selected segments are lost on their first
+ * transmission or arrive late. The times measured are exact.
+ */
+#define LINK_DELAY     20   /* one-way delay, ms */
+#define LINK_RTT       (2 * LINK_DELAY)
+#define LINK_SEGS      10   /* segments in the response (TCP_WND) */
+#define LINK_TIMEOUT   5000 /* ms */
+
+static struct test_tcp_link link;
+static u8_t link_rack_flags;
+
+/** Send a response of LINK_SEGS segments over the simulated path
+ * @param sack 1 to use SACK (and with it RACK and tail loss probes)
+ * @param drop segments lost on their first transmission
+ * @param late segments arriving late_ms late on their first transmission
+ * @return ms until the receiver got the whole response */
+static u32_t
+link_run(u8_t sack, u32_t drop, u32_t late, u32_t late_ms)
+{
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  static char data[LINK_SEGS * TCP_MSS];
+  u32_t t0, i, done = 0;
+
+  /* the clock never goes back, the lwIP timeouts run on it */
+  test_tcp_now += 1000;
+
+  IP_ADDR4(&local_ip,  192, 168,   1, 1);
+  IP_ADDR4(&remote_ip, 192, 168,   1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, NULL, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  fail_unless(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  pcb->mss = TCP_MSS;
+  /* the window is not the limit here */
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_nagle_disable(pcb);
+  if (sack) {
+    pcb->flags |= TF_SACK;
+  }
+  memset(&link, 0, sizeof(link));
+  link.delay = LINK_DELAY;
+  link.sack = sack;
+  link.wnd = TCP_WND;
+  link.drop = drop;
+  link.late = late;
+  link.late_ms = late_ms;
+  test_tcp_link_init(&link, &netif, pcb);
+
+  t0 = test_tcp_now;
+  fail_unless(tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY) == ERR_OK);
+  fail_unless(tcp_output(pcb) == ERR_OK);
+  fail_unless(link.xmits[LINK_SEGS - 1] == 1);
+
+  for (i = 0; (i < LINK_TIMEOUT) && ((done == 0) || (pcb->unacked != NULL)); i++) {
+    test_tcp_link_step(&link);
+    if ((done == 0) && (link.rcv_nxt - link.start == LINK_SEGS * TCP_MSS)) {
+      done = test_tcp_now;
+    }
+  }
+  fail_unless(done != 0);
+  fail_unless(pcb->unacked == NULL);
+  fail_unless(pcb->unsent == NULL);
+  fail_unless(!(pcb->flags & TF_INFR));
+  link_rack_flags = pcb->rack_flags;
+  tcp_abort(pcb);
+  netif_list = NULL;
+
+  if (link.first_rexmit != 0) {
+    link.first_rexmit -= t0;
+  }
+  return done - t0;
+}
+#endif /* LWIP_TCP_RACK */
+
+static void
+tcp_rack_setup(void)
+{
+  tcp_remove_all();
+}
+
+static void
+tcp_rack_teardown(void)
+{
+  tcp_remove_all();
+  netif_list = NULL;
+  netif_default = NULL;
+}
+
+/* Test functions */
+
+/** The last three segments of a response are lost: without SACK, only the
+ * retransmission time-out repairs them; with SACK, a tail loss probe is sent
+ * two RTTs after the last ACK and its SACK lets RACK resend the rest */
+START_TEST(test_tcp_rack_tail_loss)
+{
+#if LWIP_TCP_RACK
+  const u32_t drop = TEST_TCP_LINK_SEG(LINK_SEGS - 3) | TEST_TCP_LINK_SEG(LINK_SEGS - 2) |
+                     TEST_TCP_LINK_SEG(LINK_SEGS - 1);
+  u32_t rto, rack, probe;
+  u8_t i;
+
+  rto = link_run(0, drop, 0, 0);
+  fail_unless(link.first_rexmit >= LINK_RTT + TCP_RTO_MIN_MS, "rto after %u ms", link.first_rexmit);
+
+  rack = link_run(1, drop, 0, 0);
+  probe = link.first_rexmit;
+  fail_unless(probe <= LINK_RTT + 2 * LINK_RTT + 1, "probe after %u ms", probe);
+  fail_unless(rack <= probe + 2 * LINK_RTT, "probe after %u ms, done after %u ms", probe, rack);
+  fail_unless(rack + LINK_RTT < rto, "rack %u ms, rto %u ms", rack, rto);
+  /* the probe resent the last segment, nothing was resent twice */
+  for (i = 0; i < LINK_SEGS; i++) {
+    fail_unless(link.xmits[i] == ((drop & TEST_TCP_LINK_SEG(i)) ? 2 : 1));
+  }
+#endif /* LWIP_TCP_RACK */
+  LWIP_UNUSED_ARG(_i);
+}
+END_TEST
+
+/** A segment is lost and only one segment follows it (one duplicate ACK,
+ * no fast retransmit): RACK resends it when the SACKed segment after it was
+ * delivered and the reordering window (a quarter of the minimum RTT) passed */
+START_TEST(test_tcp_rack_few_dupacks)
+{
+#if LWIP_TCP_RACK
+  const u32_t drop = TEST_TCP_LINK_SEG(LINK_SEGS - 2);
+  u32_t rto, rack;
+  u8_t i;
+
+  rto = link_run(0, drop, 0, 0);
+  fail_unless(link.first_rexmit >= LINK_RTT + TCP_RTO_MIN_MS, "rto after %u ms", link.first_rexmit);
+
+  rack = link_run(1, drop, 0, 0);
+  fail_unless(link.first_rexmit <= LINK_RTT + LINK_RTT / 4 + 1, "rexmit after %u ms", link.first_rexmit);
+  fail_unless(rack <= link.first_rexmit + LINK_DELAY, "done after %u ms", rack);
+  fail_unless(rack + LINK_RTT < rto, "rack %u ms, rto %u ms", rack, rto);
+  for (i = 0; i < LINK_SEGS; i++) {
+    fail_unless(link.xmits[i] == ((drop & TEST_TCP_LINK_SEG(i)) ? 2 : 1));
+  }
+#endif /* LWIP_TCP_RACK */
+  LWIP_UNUSED_ARG(_i);
+}
+END_TEST
+
+/** A segment overtaken by the next one, but arriving within the reordering
+ * window, is not resent, and RACK notes the reordering */
+START_TEST(test_tcp_rack_reordering)
+{
+#if LWIP_TCP_RACK
+  u32_t rack;
+
+  rack = link_run(1, 0, TEST_TCP_LINK_SEG(LINK_SEGS - 2), LINK_RTT / 8);
+  fail_unless(link.first_rexmit == 0, "rexmit after %u ms", link.first_rexmit);
+  fail_unless(rack == LINK_DELAY + LINK_RTT / 8);
+  fail_unless(link_rack_flags & TCP_RACK_F_REORD);
+#endif /* LWIP_TCP_RACK */
+  LWIP_UNUSED_ARG(_i);
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_rack_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_rack_tail_loss),
+    TESTFUNC(test_tcp_rack_few_dupacks),
+    TESTFUNC(test_tcp_rack_reordering)
+  };
+  return create_suite("TCP_RACK", tests, sizeof(tests)/sizeof(testfunc), tcp_rack_setup, tcp_rack_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TCP_RACK_H__
+#define LWIP_HDR_TEST_TCP_RACK_H__
+
+#include "../lwip_check.h"
+
+Suite *tcp_rack_suite(void);
+
+#endif
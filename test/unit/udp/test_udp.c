@@ -2,6 +2,7 @@
 
 #include "lwip/udp.h"
 #include "lwip/stats.h"
+#include "lwip/ip.h"
 
 #if !LWIP_STATS || !UDP_STATS || !MEMP_STATS
 #error "This tests needs UDP- and MEMP-statistics enabled"
@@ -22,6 +23,66 @@ udp_remove_all(void)
   fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
 }
 
+/** recv callback counting datagrams in the u32_t pointed to by 'arg' */
+static void
+udp_recv_count(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+               const ip_addr_t *addr, u16_t port)
+{
+  u32_t *count = (u32_t*)arg;
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+  (*count)++;
+  pbuf_free(p);
+}
+
+/** Create a UDP datagram and pass it to udp_input() like ip4_input() does */
+static void
+test_udp_input(struct netif *inp, const ip4_addr_t *src_ip, u16_t src_port,
+               const ip4_addr_t *dst_ip, u16_t dst_port)
+{
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + UDP_HLEN + 4, PBUF_RAM);
+  EXPECT_RET(p != NULL);
+  memset(p->payload, 0, p->len);
+
+  iphdr = (struct ip_hdr*)p->payload;
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_LEN_SET(iphdr, htons(p->tot_len));
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  ip4_addr_copy(iphdr->src, *src_ip);
+  ip4_addr_copy(iphdr->dest, *dst_ip);
+  udphdr = (struct udp_hdr*)((u8_t*)p->payload + IP_HLEN);
+  udphdr->src = htons(src_port);
+  udphdr->dest = htons(dst_port);
+  udphdr->len = htons(UDP_HLEN + 4);
+  /* udphdr->chksum == 0: no checksum */
+
+  /* these lines are a hack, don't use them as an example :-) */
+  ip_addr_copy_from_ip4(*ip_current_dest_addr(), *dst_ip);
+  ip_addr_copy_from_ip4(*ip_current_src_addr(), *src_ip);
+  ip_current_netif() = inp;
+  ip4_current_header() = iphdr;
+  pbuf_header(p, -IP_HLEN);
+
+  udp_input(p, inp);
+
+  ip_addr_set_zero(ip_current_dest_addr());
+  ip_addr_set_zero(ip_current_src_addr());
+  ip_current_netif() = NULL;
+  ip4_current_header() = NULL;
+}
+
+static void
+test_udp_init_netif(struct netif *netif, ip4_addr_t *ip_addr)
+{
+  memset(netif, 0, sizeof(struct netif));
+  netif->flags = NETIF_FLAG_UP | NETIF_FLAG_LINK_UP;
+  ip4_addr_copy(netif->ip_addr, *ip_addr);
+  IP4_ADDR(&netif->netmask, 255, 255, 255, 0);
+}
+
 /* Setups/teardown functions */
 
 static void
@@ -57,12 +118,124 @@ START_TEST(test_udp_new_remove)
 END_TEST
 
 
+/** Bind more pcbs than hash buckets, rebind and remove some and check that
+ * datagrams are always passed to the pcb bound to the destination port */
+START_TEST(test_udp_demux_many_ports)
+{
+  struct udp_pcb *pcbs[MEMP_NUM_UDP_PCB];
+  u32_t counts[MEMP_NUM_UDP_PCB];
+  struct netif netif;
+  ip4_addr_t local_ip, remote_ip;
+  u16_t i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  IP4_ADDR(&local_ip, 192, 168, 1, 1);
+  IP4_ADDR(&remote_ip, 192, 168, 1, 2);
+  test_udp_init_netif(&netif, &local_ip);
+  memset(counts, 0, sizeof(counts));
+
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    pcbs[i] = udp_new();
+    EXPECT_RET(pcbs[i] != NULL);
+    err = udp_bind(pcbs[i], IP_ADDR_ANY, (u16_t)(1000 + i));
+    EXPECT_RET(err == ERR_OK);
+    udp_recv(pcbs[i], udp_recv_count, &counts[i]);
+  }
+  /* a port can only be bound once */
+  err = udp_bind(pcbs[0], IP_ADDR_ANY, 1001);
+  EXPECT(err == ERR_USE);
+
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    test_udp_input(&netif, &remote_ip, 5000, &local_ip, (u16_t)(1000 + i));
+  }
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    EXPECT(counts[i] == 1);
+  }
+
+  /* rebind pcb 3 to a port in another bucket (1003 and 2004 differ in the
+     low bits), datagrams must follow and the old port must be free */
+  EXPECT(((1003 ^ 2004) & (UDP_PCB_HASH_SIZE - 1)) != 0);
+  err = udp_bind(pcbs[3], IP_ADDR_ANY, 2004);
+  EXPECT_RET(err == ERR_OK);
+  test_udp_input(&netif, &remote_ip, 5000, &local_ip, 2004);
+  EXPECT(counts[3] == 2);
+  test_udp_input(&netif, &remote_ip, 5000, &local_ip, 1003);
+  EXPECT(counts[3] == 2);
+
+  /* remove pcb 4, the others must still be found */
+  udp_remove(pcbs[4]);
+  pcbs[4] = NULL;
+  test_udp_input(&netif, &remote_ip, 5000, &local_ip, 1012);
+  EXPECT(counts[12] == 2);
+  EXPECT(counts[4] == 1);
+}
+END_TEST
+
+/** Check that several pcbs with UDP_FLAGS_REUSEPORT can share a port and
+ * that flows are spread across them consistently */
+START_TEST(test_udp_reuseport)
+{
+  struct udp_pcb *pcbs[4];
+  struct udp_pcb *pcb;
+  u32_t counts[4];
+  u32_t before[4];
+  struct netif netif;
+  ip4_addr_t local_ip, remote_ip;
+  u16_t i, j, port;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  IP4_ADDR(&local_ip, 192, 168, 1, 1);
+  IP4_ADDR(&remote_ip, 192, 168, 1, 2);
+  test_udp_init_netif(&netif, &local_ip);
+  memset(counts, 0, sizeof(counts));
+
+  for (i = 0; i < 4; i++) {
+    pcbs[i] = udp_new();
+    EXPECT_RET(pcbs[i] != NULL);
+    udp_setflags(pcbs[i], udp_flags(pcbs[i]) | UDP_FLAGS_REUSEPORT);
+    err = udp_bind(pcbs[i], IP_ADDR_ANY, 514);
+    EXPECT_RET(err == ERR_OK);
+    udp_recv(pcbs[i], udp_recv_count, &counts[i]);
+  }
+  /* a pcb without UDP_FLAGS_REUSEPORT cannot join */
+  pcb = udp_new();
+  EXPECT_RET(pcb != NULL);
+  err = udp_bind(pcb, IP_ADDR_ANY, 514);
+  EXPECT(err == ERR_USE);
+  udp_remove(pcb);
+
+  /* 64 flows, each pcb should get some of them */
+  for (port = 40000; port < 40064; port++) {
+    test_udp_input(&netif, &remote_ip, port, &local_ip, 514);
+  }
+  for (i = 0; i < 4; i++) {
+    EXPECT(counts[i] > 0);
+  }
+  EXPECT(counts[0] + counts[1] + counts[2] + counts[3] == 64);
+
+  /* all datagrams of a flow go to the same pcb */
+  for (port = 40000; port < 40008; port++) {
+    memcpy(before, counts, sizeof(counts));
+    for (j = 0; j < 5; j++) {
+      test_udp_input(&netif, &remote_ip, port, &local_ip, 514);
+    }
+    for (i = 0; i < 4; i++) {
+      EXPECT((counts[i] == before[i]) || (counts[i] == before[i] + 5));
+    }
+  }
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 udp_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_udp_new_remove),
+    TESTFUNC(test_udp_demux_many_ports),
+    TESTFUNC(test_udp_reuseport),
   };
   return create_suite("UDP", tests, sizeof(tests)/sizeof(testfunc), udp_setup, udp_teardown);
 }